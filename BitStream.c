@@ -9,10 +9,13 @@
  * 	     BitStreamCreateHex
  * 	     BitStreamCreateAscii
  *           BitStreamDelete
+ *           BitStreamDetach
  *           BitStreamRealloc
  *           BitStreamShow
  *           BitStreamPutByte
  *           BitStreamGetByte
+ *           BitStreamPutByteLsb
+ *           BitStreamGetByteLsb
  *           BitStreamPutBits
  *           BitStreamGetBits
  *	     BitStreamCopy
@@ -25,6 +28,8 @@
  * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
  */
 
+#include <sys/mman.h>
+
 #include "BitStream.h"
 
 /**
@@ -46,7 +51,7 @@ static inline unsigned char xtoi(char c) {
              ll = c - '0';
       else if (c >= 'a' && c <= 'f')
             ll = c - 'a' + 10;
-      else if (c >= 'A' && c <- 'F')
+      else if (c >= 'A' && c <= 'F')
             ll = c - 'A' + 10;
       else 
             assert(0);
@@ -54,7 +59,7 @@ static inline unsigned char xtoi(char c) {
 }
 
 /**
- * @fn int32_t strtox(const char* in, uint8_t *out, uint16_t size)
+ * @fn int64_t strtox(const char* in, uint8_t *out, size_t size)
  *
  * @brief Convert HEX ascii string into byte array of integers, modeled on 
  * 	strtoi or strtol
@@ -72,9 +77,9 @@ static inline unsigned char xtoi(char c) {
  *
  * @returns number of bytes converted (1 converted byte = 2 HEX ascii chars)
  */
-static inline int32_t strtox(const char* in, uint8_t *out, uint16_t size) {
-    short len = strlen(in);
-    short i = 0, j   = 0;
+static inline int64_t strtox(const char* in, uint8_t *out, size_t size) {
+    size_t len = strlen(in);
+    size_t i = 0, j   = 0;
 
     if (len % 2) {
        i = 1;
@@ -94,14 +99,14 @@ static inline int32_t strtox(const char* in, uint8_t *out, uint16_t size) {
 
 /**
  * @ingroup Bitstream
- * @fn uint16_t BitStreamGetSizeBits(BitStream* bs)
+ * @fn uint64_t BitStreamGetSizeBits(BitStream* bs)
  * @brief Get size in bits of the BitStream object 
  *
  * @param [in] *bs\n
  * 	Pointer to bitstream object whose size is to be retrieved
  * @returns length in BITs of the bit stream
  */
-inline uint16_t BitStreamGetSizeBits(BitStream *bs) {
+inline uint64_t BitStreamGetSizeBits(BitStream *bs) {
    return bs ? bs->nbits : 0;
 }   
 
@@ -120,7 +125,7 @@ inline uint8_t* BitStreamGetArray(BitStream *bs) {
  
 /**
  * @ingroup Bitstream
- * @fn BitStream* BitStreamCreate(uint16_t nbits)
+ * @fn BitStream* BitStreamCreate(uint64_t nbits)
  * @brief Creates a object of type BitStream and allocates space to hold nbits
  *
  * @param [in] nbits\n
@@ -128,7 +133,7 @@ inline uint8_t* BitStreamGetArray(BitStream *bs) {
  * 	object is created and new buffer can be added with BitStreamBuffer()
  * @returns pointer to newly created bit stream object, NULL on failure
  */
-BitStream* BitStreamCreate(uint16_t nbits) {
+BitStream* BitStreamCreate(uint64_t nbits) {
    
    BitStream *bs = (BitStream *)malloc(sizeof(BitStream));
    if (bs != NULL) { 
@@ -139,13 +144,17 @@ BitStream* BitStreamCreate(uint16_t nbits) {
           free(bs);
           bs = NULL;
         } else {
-	  memset(bs->array, (nbits + BITS_PER_BYTE - 1)/BITS_PER_BYTE, '\0');
+	  memset(bs->array, '\0', (nbits + BITS_PER_BYTE - 1)/BITS_PER_BYTE);
         }
       } else {
 	 bs->array = NULL;
       }
    }
-   bs->nbits = nbits;
+   if (bs != NULL) {
+      bs->nbits = nbits;
+      bs->mapping = NULL;
+      bs->mappingSize = 0;
+   }
 
    return bs;
 }
@@ -195,10 +204,30 @@ BitStream* BitStreamCreateAscii(const char* s) {
    }
    return bs;
 }
+/**
+ * @fn void BitStreamFreeArray(BitStream* bs)
+ *
+ * @brief releases the memory holding the bits, unmapping it if it belongs to
+ * 	a file mapping
+ *
+ * @param [in] bs\n
+ * 	bit stream whose array is released, array is left dangling
+ * @returns none
+ */
+static void BitStreamFreeArray(BitStream* bs) {
+   if (bs->mapping) {
+      munmap(bs->mapping, bs->mappingSize);
+      bs->mapping = NULL;
+      bs->mappingSize = 0;
+   } else {
+      free(bs->array);
+   }
+}
+
 /**
  * @ingroup Bitstream
  *
- * @fn BitStreamRealloc(BitStream* bs, uint8_t buffer, uint16_t nbits) 
+ * @fn BitStreamRealloc(BitStream* bs, uint8_t buffer, uint64_t nbits) 
  *
  * @brief Reinitialize the BitStream buffer to a new one
  * 	Routine will create a new one with number of bits if not provided
@@ -214,17 +243,20 @@ BitStream* BitStreamCreateAscii(const char* s) {
  * 	size in bits of the new buffer
  * @returns none
  */
-void BitStreamRealloc(BitStream* bs, uint8_t *buffer, uint16_t nbits) {
+void BitStreamRealloc(BitStream* bs, uint8_t *buffer, uint64_t nbits) {
    if (bs) { 
       if (bs->array) {
          if (buffer) {
-	    free (bs->array);
+	    BitStreamFreeArray(bs);
 	    bs->array = buffer;
 	 } else {
             if (nbits) {
+               if (bs->mapping && BitStreamDetach(bs) < 0)
+                  return;
                bs->array = (uint8_t *)realloc(bs->array, 
 			       (nbits + BITS_PER_BYTE - 1)/ BITS_PER_BYTE);
 	    } else {
+	       BitStreamFreeArray(bs);
 	       bs->array = NULL;
 	    }
 	 }
@@ -249,13 +281,45 @@ void BitStreamRealloc(BitStream* bs, uint8_t *buffer, uint16_t nbits) {
  */
 void BitStreamDelete(BitStream* bs) {
    if (bs != NULL) {
-      if (bs->array != NULL) {
-         free(bs->array);
+      if (bs->array != NULL || bs->mapping != NULL) {
+         BitStreamFreeArray(bs);
       }
       free(bs);
    }
 }
 
+/**
+ * @ingroup BitStream
+ * @fn int BitStreamDetach(BitStream* bs)
+ *
+ * @brief moves the bits of a stream mapped from a file into memory of its
+ * 	own, so the stream can be resized and freed like any other
+ *
+ * Streams that are not mapped are left alone. Writes to a mapped stream are
+ * allowed without detaching, they stay private to the process.
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to detach
+ * @returns 0 on success, -1 on allocation failure (the stream stays mapped)
+ */
+int BitStreamDetach(BitStream* bs) {
+   uint64_t size;
+   uint8_t  *array;
+
+   if (bs == NULL || bs->mapping == NULL)
+      return 0;
+
+   size = (bs->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+   array = (uint8_t *)malloc(size ? size : 1);
+   if (array == NULL)
+      return (-1);
+
+   memcpy(array, bs->array, size);
+   BitStreamFreeArray(bs);
+   bs->array = array;
+   return 0;
+}
+
 /**
  * @ingroup BitStream
  * @fn void BitSreamShow(BitStream* bs, const char* fmt)
@@ -267,18 +331,18 @@ void BitStreamDelete(BitStream* bs) {
  * @returns void
  */
 void BitStreamShow(BitStream* bs) {
-   uint16_t i = 0;
+   uint64_t i = 0;
 
    char repr[32] = {'\0'};
 
    if (bs != NULL && bs->array != NULL) {
-      printf("%03d\t", i);
+      printf("%03llu\t", (unsigned long long)i);
       for (i = 0; i < (bs->nbits + BITS_PER_BYTE - 1)/BITS_PER_BYTE; i++) {
 
          if ((i != 0) && (i % 8 == 0))
 		 printf("  ");
          if ((i != 0) && (i % 16 == 0)) 
-		 printf("%s\n%03d\t", repr, i);
+		 printf("%s\n%03llu\t", repr, (unsigned long long)i);
 
          sprintf(repr + (i % 16),"%c", isprint(bs->array[i]) ? bs->array[i] : 
 			 '.');
@@ -302,7 +366,7 @@ void BitStreamShow(BitStream* bs) {
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset,\n 
+ * @fn uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint64_t offset,\n 
  * 	uint16_t nbits) 
  *
  * @brief inserts maximum 1 byte of data in bit stream at offset (in bits) nbits
@@ -325,7 +389,7 @@ void BitStreamShow(BitStream* bs) {
  * @returns Number of bits inserted. Insertion fails while inserting bits 
  * 	beyond the size of bit stream
  */
-uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset, 
+uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint64_t offset, 
 	uint16_t nbits) {
 
    uint16_t curBits;
@@ -335,7 +399,7 @@ uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset,
    DECL_BYTE_OFFSET(i);
    DECL_BITS_OFFSET(j);
 
-   if (offset > bs->nbits)
+   if (offset >= bs->nbits)
 	   return 0;
 
    nbits = MIN(nbits, (bs->nbits - offset));
@@ -366,7 +430,7 @@ uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset,
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamGetByte(BitStream* bs, uint8_t *byte, uint16_t offset,\n 
+ * @fn uint16_t BitStreamGetByte(BitStream* bs, uint8_t *byte, uint64_t offset,\n 
  * 	uint16_t nbits) 
  *
  * @brief fetches maximum 1 byte of data in bit stream at offset (in bits) nbits
@@ -388,7 +452,7 @@ uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset,
  * @returns Number of bits fetched. Retrieval fails while fetching bits 
  * 	beyond the size of bit stream
  */
-uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint16_t offset, 
+uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint64_t offset, 
 		uint16_t nbits) {
 
    uint16_t curBits;
@@ -398,7 +462,7 @@ uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint16_t offset,
    DECL_BYTE_OFFSET(i);
    DECL_BITS_OFFSET(j);
 
-   if (offset > bs->nbits)
+   if (offset >= bs->nbits)
 	   return (0);
 
    nbits = MIN(nbits, (bs->nbits - offset));
@@ -428,7 +492,106 @@ uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint16_t offset,
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamCopy(BitStream* bs, uint8_t* inp, uint16_t nbits) 
+ * @fn uint16_t BitStreamPutByteLsb(BitStream* bs, uint8_t byte,
+ * 	uint64_t offset, uint16_t nbits)
+ *
+ * @brief inserts maximum 1 byte of data in a least significant bit first
+ * 	stream, the counterpart of BitStreamPutByte() for formats such as
+ * 	DEFLATE
+ *
+ * Bit offset k of an LSB first stream is bit (k % 8) of byte (k / 8), and
+ * bit n of the value goes to offset + n, i.e, inserting 3 bits (101b) at
+ * offset 0 gives
+ * 	- xxxxx101b
+ *
+ * @param [in] bs\n
+ * 	Bit stream in which the bits are to be inserted
+ * @param [in] byte\n
+ * 	Bits to be inserted in bit stream (maximum 8), right aligned
+ * @param [in] offset\n
+ * 	offset in bits at which the above byte is to be inserted
+ * @param [in] nbits\n
+ * 	number of bits to insert
+ * @returns Number of bits inserted. Insertion fails while inserting bits
+ * 	beyond the size of bit stream
+ */
+uint16_t BitStreamPutByteLsb(BitStream* bs, uint8_t byte, uint64_t offset,
+	uint16_t nbits) {
+
+   uint16_t mask;
+   uint16_t window;
+
+   DECL_BYTE_OFFSET(i);
+   DECL_BITS_OFFSET(j);
+
+   if (offset >= bs->nbits)
+	   return 0;
+
+   nbits = MIN(MIN(nbits, BITS_PER_BYTE), (bs->nbits - offset));
+
+   /* the bits span at most two bytes, the second one is the high byte */
+   mask = ((1u << nbits) - 1) << j;
+   window = bs->array[i];
+   if (j + nbits > BITS_PER_BYTE)
+      window |= bs->array[i + 1] << BITS_PER_BYTE;
+
+   window = (window & ~mask) | ((byte << j) & mask);
+
+   bs->array[i] = (uint8_t)window;
+   if (j + nbits > BITS_PER_BYTE)
+      bs->array[i + 1] = (uint8_t)(window >> BITS_PER_BYTE);
+
+   return nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint16_t BitStreamGetByteLsb(BitStream *bs, uint8_t *byte,
+ * 	uint64_t offset, uint16_t nbits)
+ *
+ * @brief fetches maximum 1 byte of data from a least significant bit first
+ * 	stream, the counterpart of BitStreamGetByte()
+ *
+ * Bit offset + n of the stream becomes bit n of the value, i.e, requesting
+ * 3 bits gives 00000xxx with the bit at offset in the least significant
+ * position
+ *
+ * @param [in] bs\n
+ * 	Bit stream to fetch from
+ * @param [out] *byte\n
+ * 	Bits fetched from the stream (maxium 8), right aligned
+ * @param [in] offset\n
+ * 	offset in bits from which the above byte is to be fetched
+ * @param [in] nbits\n
+ * 	number of bits to fetch
+ * @returns Number of bits fetched. Retrieval fails while fetching bits
+ * 	beyond the size of bit stream
+ */
+uint16_t BitStreamGetByteLsb(BitStream *bs, uint8_t *byte, uint64_t offset,
+	uint16_t nbits) {
+
+   uint16_t window;
+
+   DECL_BYTE_OFFSET(i);
+   DECL_BITS_OFFSET(j);
+
+   if (offset >= bs->nbits)
+	   return (0);
+
+   nbits = MIN(MIN(nbits, BITS_PER_BYTE), (bs->nbits - offset));
+
+   window = bs->array[i];
+   if (j + nbits > BITS_PER_BYTE)
+      window |= bs->array[i + 1] << BITS_PER_BYTE;
+
+   *byte = (uint8_t)((window >> j) & ((1u << nbits) - 1));
+
+   return nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopy(BitStream* bs, const uint8_t* inp, uint64_t nbits) 
  *
  * @brief Copies the bytes from input buffer into bit stream
  *
@@ -440,8 +603,8 @@ uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint16_t offset,
  * 	size of input data in bits
  * @returns number of bits copied into bit stream
  */
-uint16_t BitStreamCopy(BitStream* bs, uint8_t* inp, uint16_t nbits) {
-   uint16_t bitsCopied = 0;
+uint64_t BitStreamCopy(BitStream* bs, const uint8_t* inp, uint64_t nbits) {
+   uint64_t bitsCopied = 0;
    
    while (bitsCopied < bs->nbits) {
       bitsCopied += BitStreamPutByte(bs, *inp++, bitsCopied, BITS_PER_BYTE);
@@ -452,7 +615,7 @@ uint16_t BitStreamCopy(BitStream* bs, uint8_t* inp, uint16_t nbits) {
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamFill(BitStream* bs, uint8_t* inp, uint16_t nbits) 
+ * @fn uint64_t BitStreamFill(BitStream* bs, uint8_t byte) 
  *
  * @brief Fills the byte into bit stream
  *
@@ -462,8 +625,8 @@ uint16_t BitStreamCopy(BitStream* bs, uint8_t* inp, uint16_t nbits) {
  * 	byte to be copied in the bitstream
  * @returns number of bits copied into bit stream
  */
-uint16_t BitStreamFill(BitStream* bs, uint8_t byte) {
-   uint16_t bitsCopied = 0;
+uint64_t BitStreamFill(BitStream* bs, uint8_t byte) {
+   uint64_t bitsCopied = 0;
    
    while (bitsCopied < bs->nbits) {
       bitsCopied += BitStreamPutByte(bs, byte, bitsCopied, BITS_PER_BYTE);
@@ -473,7 +636,7 @@ uint16_t BitStreamFill(BitStream* bs, uint8_t byte) {
 }
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamCopyHex(BitStream* bs, uint8_t* inp)
+ * @fn uint64_t BitStreamCopyHex(BitStream* bs, const char* inp)
  *
  * @brief fills the bytes from input HEX ascii buffer into bit stream
  *
@@ -484,9 +647,9 @@ uint16_t BitStreamFill(BitStream* bs, uint8_t byte) {
  * 	hex charcters, else assert(0)
  * @returns number of bits copied into bit stream
  */
-uint16_t BitStreamCopyHex(BitStream* bs, const char* inp) {
+uint64_t BitStreamCopyHex(BitStream* bs, const char* inp) {
    
-   uint16_t size = (strlen(inp) + 1) >> 1;
+   uint64_t size = (strlen(inp) + 1) >> 1;
 
    if (bs) {
       BitStreamRealloc(bs, NULL, size * BITS_PER_BYTE);
@@ -498,7 +661,7 @@ uint16_t BitStreamCopyHex(BitStream* bs, const char* inp) {
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamCopyAscii(BitStream* bs, uint8_t* inp)
+ * @fn uint64_t BitStreamCopyAscii(BitStream* bs, const char* inp)
  *
  * @brief fills the bytes from input ascii buffer into bit stream
  *
@@ -508,15 +671,15 @@ uint16_t BitStreamCopyHex(BitStream* bs, const char* inp) {
  * 	pointer to the data to be copied
  * @returns number of bits copied into bit stream
  */
-uint16_t BitStreamCopyAscii(BitStream* bs, const char* inp) {
+uint64_t BitStreamCopyAscii(BitStream* bs, const char* inp) {
    
-   uint16_t size = strlen(inp);
-   uint16_t bitsCopied = 0;
+   uint64_t size = strlen(inp);
+   uint64_t bitsCopied = 0;
 
    if (bs) {
       BitStreamRealloc(bs, NULL, size * BITS_PER_BYTE);
       if (bs->array != NULL)
-          bitsCopied = BitStreamCopy(bs, inp, size);
+          bitsCopied = BitStreamCopy(bs, (const uint8_t *)inp, size);
    }
    return bitsCopied;
 }
@@ -533,8 +696,8 @@ uint16_t BitStreamCopyAscii(BitStream* bs, const char* inp) {
  */
 BitStream* BitStreamHex2Base64(BitStream *bs) {
    BitStream* out    = NULL;
-   uint16_t   outset = 0;  /* portmanteau of out offset -:) */
-   uint16_t   offset = 0;
+   uint64_t   outset = 0;  /* portmanteau of out offset -:) */
+   uint64_t   offset = 0;
    uint8_t    byte   = 0;
 
    if (bs) {
@@ -592,7 +755,7 @@ BitStream* BitStreamHex2Base64(BitStream *bs) {
 BitStream* BitStreamExclusiveOr(BitStream *bx, BitStream *by) {
    BitStream* bz = NULL;
 
-   uint16_t offsetx, offsety;
+   uint64_t offsetx, offsety;
    uint8_t bytex, bytey;
 
    offsetx = 0;
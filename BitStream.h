@@ -13,6 +13,10 @@
 #include <string.h>
 #include <stdio.h>
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
 /* Macro Definitions */
 /**
  * @def BITS_PER_BYTE
@@ -31,7 +35,7 @@
  * @brief creates a variable to hold byte offset from input param "offset"
  */
 #define DECL_BYTE_OFFSET(a)	\
-	uint16_t a = (offset) / BITS_PER_BYTE;
+	uint64_t a = (offset) / BITS_PER_BYTE;
 
 /**
  * @def DECL_BITS_OFFSET
@@ -41,6 +45,19 @@
 	uint16_t a = (offset) % BITS_PER_BYTE;
 
 /* Type Definitions */
+/**
+ * @enum BitStreamBitOrder
+ * @brief placement of consecutive bits within a byte
+ *
+ * Routines are specialized for an order at compile time, the order is not
+ * stored in the stream. Streams are MSB first unless the routine has an Lsb
+ * suffix
+ */
+typedef enum BitStreamBitOrder {
+   BITSTREAM_MSB_FIRST = 0,  /**< bit offset 0 is 0x80 ("network order") */
+   BITSTREAM_LSB_FIRST       /**< bit offset 0 is 0x01 (DEFLATE) */
+} BitStreamBitOrder;
+
 /**
  * @struct BitStream
  * @brief This represents the bit stream for manipulation
@@ -49,39 +66,58 @@ typedef struct BitStream {
    /**< @brief container for bit stream */
    uint8_t 	*array;
    /**< @brief number of bits in the container */
-   uint16_t	nbits;
+   uint64_t	nbits;
+   /**< @brief start of the file mapping array lies in, NULL when array is
+    * allocated with malloc() (see BitStreamFileMap()) */
+   void		*mapping;
+   /**< @brief length of the mapping in bytes */
+   uint64_t	mappingSize;
 } BitStream;
 
 
-uint16_t BitStreamGetSizeBits(BitStream *bs) ;
+uint64_t BitStreamGetSizeBits(BitStream *bs) ;
 
 uint8_t* BitStreamGetArray(BitStream *bs) ;
 
-BitStream* BitStreamCreate(uint16_t nbits) ;
+BitStream* BitStreamCreate(uint64_t nbits) ;
 
 BitStream* BitStreamCreateHex(const char* s) ;
 
 BitStream* BitStreamCreateAscii(const char* s) ;
 
+void BitStreamRealloc(BitStream* bs, uint8_t *buffer, uint64_t nbits) ;
+
 void BitStreamDelete(BitStream* bs) ;
 
+int BitStreamDetach(BitStream* bs) ;
+
 void BitStreamShow(BitStream* bs) ;
 
-uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset, 
+uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint64_t offset, 
 	uint16_t nbits) ;
 
-uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint16_t offset, 
+uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint64_t offset, 
 		uint16_t nbits) ;
 
-uint16_t BitStreamCopy(BitStream* bs, uint8_t* inp, uint16_t nbits) ;
+uint16_t BitStreamPutByteLsb(BitStream* bs, uint8_t byte, uint64_t offset,
+	uint16_t nbits) ;
+
+uint16_t BitStreamGetByteLsb(BitStream *bs, uint8_t *byte, uint64_t offset,
+	uint16_t nbits) ;
 
-uint16_t BitStreamCopyHex(BitStream* bs, const char* inp) ;
+uint64_t BitStreamCopy(BitStream* bs, const uint8_t* inp, uint64_t nbits) ;
 
-uint16_t BitStreamCopyAscii(BitStream* bs, const char* inp) ;
+uint64_t BitStreamCopyHex(BitStream* bs, const char* inp) ;
 
-uint16_t BitStreamFill(BitStream* bs, uint8_t byte) ;
+uint64_t BitStreamCopyAscii(BitStream* bs, const char* inp) ;
+
+uint64_t BitStreamFill(BitStream* bs, uint8_t byte) ;
 
 BitStream* BitStreamHex2Base64(BitStream *bs) ;
 
 BitStream* BitStreamExclusiveOr(BitStream *bx, BitStream *by) ;
+
+#if defined(__cplusplus)
+}
+#endif
 #endif /* _BITSTREAM_H */
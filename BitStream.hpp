@@ -0,0 +1,400 @@
+/**
+ * @file  BitStream.hpp
+ * @brief Header only C++ layer over the library: an owning, move only bit
+ * 	stream and a non owning view for passing bytes in without copying
+ *
+ * bitstream::Stream owns a ::BitStream and deletes it, mapped streams
+ * included, when it goes out of scope; it is not named BitStream so that
+ * using namespace bitstream does not make the C typedef ambiguous. bitstream::View borrows, from an
+ * owning stream, a C stream, a std::span of bytes or a std::string_view,
+ * and is what every operation takes as input. Operators with an rvalue on
+ * the left and the compound assignments work in the storage of their left
+ * operand, so an expression such as (a & b) ^ c allocates one stream.
+ *
+ * Failures are reported as exceptions: std::bad_alloc when the library
+ * runs out of memory, std::invalid_argument for operands it refuses.
+ * Requires C++20 for std::span.
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+#if !defined(_BITSTREAM_HPP)
+#define _BITSTREAM_HPP
+
+#include <cstdint>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "BitStream.h"
+#include "BitStreamBulk.h"
+#include "BitStreamFile.h"
+#include "BitStreamLogic.h"
+
+namespace bitstream {
+
+/**
+ * @class View
+ * @brief read only window on bits owned by someone else, cheap to copy
+ *
+ * A view of borrowed bytes stays valid as long as the bytes, a view of a
+ * stream as long as the stream is neither resized nor destroyed.
+ */
+class View {
+public:
+   /** @brief empty view of 0 bits */
+   View() noexcept : bs_(&own_), own_{} {}
+
+   /** @brief view of a C stream */
+   View(const ::BitStream *bs) noexcept : bs_(bs ? bs : &own_), own_{} {}
+
+   /** @brief view of bytes, 8 bits each */
+   View(std::span<const uint8_t> bytes) noexcept
+      : View(bytes, bytes.size() * BITS_PER_BYTE) {}
+
+   /** @brief view of the first nbits bits of bytes */
+   View(std::span<const uint8_t> bytes, uint64_t nbits) : bs_(&own_), own_{} {
+      if (nbits > bytes.size() * BITS_PER_BYTE)
+         throw std::invalid_argument("bitstream: more bits than bytes");
+      own_.array = const_cast<uint8_t *>(bytes.data());
+      own_.nbits = nbits;
+   }
+
+   /** @brief view of the characters of a string as bytes, as
+    * BitStreamCreateAscii() without the copy */
+   View(std::string_view s) noexcept
+      : View(std::span<const uint8_t>(
+			reinterpret_cast<const uint8_t *>(s.data()), s.size())) {}
+
+   View(const View &other) noexcept
+      : bs_(other.bs_ == &other.own_ ? &own_ : other.bs_), own_(other.own_) {}
+
+   View& operator=(const View &other) noexcept {
+      own_ = other.own_;
+      bs_ = other.bs_ == &other.own_ ? &own_ : other.bs_;
+      return *this;
+   }
+
+   /** @brief number of bits */
+   uint64_t size() const noexcept { return bs_->nbits; }
+
+   bool empty() const noexcept { return bs_->nbits == 0; }
+
+   /** @brief the bytes holding the bits, the last one may be partial */
+   std::span<const uint8_t> bytes() const noexcept {
+      return { bs_->array, (bs_->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE };
+   }
+
+   /** @brief the C stream, for the library routines that only read it */
+   ::BitStream* get() const noexcept { return const_cast<::BitStream *>(bs_); }
+
+private:
+   const ::BitStream *bs_;   /**< stream viewed, own_ when borrowing bytes */
+   ::BitStream        own_;  /**< C stream over borrowed bytes */
+};
+
+/**
+ * @class Stream
+ * @brief owning handle of a ::BitStream, movable but not copyable
+ *
+ * A moved from stream is empty, 0 bits and no storage, and can be assigned
+ * to or used as an operand again.
+ */
+class Stream {
+public:
+   /** @brief empty stream */
+   Stream() noexcept = default;
+
+   /** @brief stream of nbits zero bits */
+   explicit Stream(uint64_t nbits) : bs_(Check(::BitStreamCreate(nbits))) {}
+
+   /** @brief copy of the bits of a view, the bits of borrowed bytes past
+    * its end are not copied */
+   explicit Stream(View v) : bs_(Check(::BitStreamCreate(v.size()))) {
+      uint64_t r = v.size() % BITS_PER_BYTE;
+
+      if (v.empty())
+         return;
+      memcpy(bs_->array, v.bytes().data(), v.bytes().size());
+      if (r)
+         bs_->array[v.bytes().size() - 1] &= (uint8_t)(0xFF <<
+			 (BITS_PER_BYTE - r));
+   }
+
+   /** @brief copy of bytes */
+   explicit Stream(std::span<const uint8_t> bytes) : Stream(View(bytes)) {}
+
+   /** @brief copy of the characters of a string */
+   explicit Stream(std::string_view s) : Stream(View(s)) {}
+
+   Stream(const Stream &) = delete;
+   Stream& operator=(const Stream &) = delete;
+
+   Stream(Stream &&other) noexcept : bs_(other.release()) {}
+
+   Stream& operator=(Stream &&other) noexcept {
+      if (this != &other)
+         reset(other.release());
+      return *this;
+   }
+
+   ~Stream() { ::BitStreamDelete(bs_); }
+
+   /** @brief takes ownership of a C stream */
+   static Stream adopt(::BitStream *bs) noexcept {
+      Stream s;
+
+      s.bs_ = bs;
+      return s;
+   }
+
+   /** @brief decodes hex, the text need not be NULL terminated */
+   static Stream from_hex(std::string_view hex) {
+      Stream  s((uint64_t)(hex.size() + 1) / 2 * BITS_PER_BYTE);
+      int64_t n = 0;
+
+      if (!hex.empty())
+         n = ::BitStreamHexDecode(hex.data(), hex.size(), s.bs_->array);
+      if (n < 0)
+         throw std::invalid_argument("bitstream: invalid hex");
+      return s;
+   }
+
+   /** @brief maps a container file written by BitStreamFileSave(), see
+    * BitStreamFileMap() */
+   static Stream map(const char *path, BitStreamBitOrder *order = nullptr,
+	   unsigned flags = 0) {
+      ::BitStream *bs = ::BitStreamFileMap(path, order, flags);
+
+      if (bs == nullptr)
+         throw std::runtime_error("bitstream: cannot map file");
+      return adopt(bs);
+   }
+
+   /** @brief copy of the stream, the only way to duplicate one */
+   Stream clone() const { return Stream(view()); }
+
+   /** @brief the C stream, still owned, NULL when empty */
+   ::BitStream* get() const noexcept { return bs_; }
+
+   /** @brief gives up ownership of the C stream */
+   ::BitStream* release() noexcept { return std::exchange(bs_, nullptr); }
+
+   /** @brief deletes the stream held and takes bs instead */
+   void reset(::BitStream *bs = nullptr) noexcept {
+      ::BitStreamDelete(std::exchange(bs_, bs));
+   }
+
+   uint64_t size() const noexcept { return bs_ ? bs_->nbits : 0; }
+
+   bool empty() const noexcept { return size() == 0; }
+
+   std::span<uint8_t> bytes() noexcept {
+      if (bs_ == nullptr)
+         return {};
+      return { bs_->array, (bs_->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE };
+   }
+
+   std::span<const uint8_t> bytes() const noexcept { return view().bytes(); }
+
+   View view() const noexcept { return View(bs_); }
+
+   operator View() const noexcept { return view(); }
+
+   /** @brief bit at offset, which must be within the stream */
+   bool operator[](uint64_t offset) const noexcept {
+      return bs_->array[offset / BITS_PER_BYTE] >>
+	      (BITS_PER_BYTE - 1 - offset % BITS_PER_BYTE) & 1;
+   }
+
+   /*
+    * The assign_ routines store the result of an operation on x and y in
+    * this stream, reusing its storage whatever it held. x and y may be
+    * this stream. The result is as long as x, y must be at least as long.
+    */
+   Stream& assign_and(View x, View y) { return Logic(::BitStreamAnd, x, y); }
+
+   Stream& assign_or(View x, View y) { return Logic(::BitStreamOr, x, y); }
+
+   Stream& assign_and_not(View x, View y) {
+      return Logic(::BitStreamAndNot, x, y);
+   }
+
+   Stream& assign_xor(View x, View y) { return Logic(::BitStreamXor, x, y); }
+
+   Stream& assign_not(View x) {
+      return Settle(::BitStreamNot(Target(x), x.get()));
+   }
+
+   Stream& assign_shift_left(View x, uint64_t n) {
+      return Shift(::BitStreamShiftLeft, x, n);
+   }
+
+   Stream& assign_shift_right(View x, uint64_t n) {
+      return Shift(::BitStreamShiftRight, x, n);
+   }
+
+   Stream& assign_rotate_left(View x, uint64_t n) {
+      return Shift(::BitStreamRotateLeft, x, n);
+   }
+
+   Stream& assign_rotate_right(View x, uint64_t n) {
+      return Shift(::BitStreamRotateRight, x, n);
+   }
+
+   /** @brief the bits of x followed by those of y */
+   Stream& assign_concat(View x, View y) {
+      return Settle(::BitStreamConcat(Target(x, y), x.get(), y.get()));
+   }
+
+   Stream& operator&=(View y) { return assign_and(view(), y); }
+
+   Stream& operator|=(View y) { return assign_or(view(), y); }
+
+   Stream& operator^=(View y) { return assign_xor(view(), y); }
+
+   Stream& operator<<=(uint64_t n) { return assign_shift_left(view(), n); }
+
+   Stream& operator>>=(uint64_t n) { return assign_shift_right(view(), n); }
+
+   /** @brief inverts every bit in place */
+   Stream& flip() { return assign_not(view()); }
+
+   /** @brief appends the bits of y in place */
+   Stream& append(View y) { return assign_concat(view(), y); }
+
+private:
+   ::BitStream *bs_ = nullptr;
+
+   static ::BitStream* Check(::BitStream *bs) {
+      if (bs == nullptr)
+         throw std::bad_alloc();
+      return bs;
+   }
+
+   /*
+    * Destination to hand to the library: this stream, which it works on in
+    * place or resizes, or NULL for a new stream. A new one is needed when
+    * the stream is empty or when a view borrows its bytes without being
+    * the stream, resizing would pull the bits from under that view.
+    */
+   ::BitStream* Target(View x, View y = View()) const noexcept {
+      if (bs_ == nullptr || Aliases(x) || Aliases(y))
+         return nullptr;
+      return bs_;
+   }
+
+   bool Aliases(View v) const noexcept {
+      const uint8_t *p = v.bytes().data();
+
+      return v.get() != bs_ && !v.empty() && bs_->array != nullptr &&
+	      p >= bs_->array && p < bs_->array + bytes().size();
+   }
+
+   /* takes the result if the library made a new stream */
+   Stream& Settle(::BitStream *result) {
+      if (Check(result) != bs_)
+         reset(result);
+      return *this;
+   }
+
+   Stream& Logic(::BitStream* (*op)(::BitStream *, ::BitStream *,
+			   ::BitStream *), View x, View y) {
+      if (y.size() < x.size())
+         throw std::invalid_argument("bitstream: second operand too short");
+      return Settle(op(Target(x, y), x.get(), y.get()));
+   }
+
+   Stream& Shift(::BitStream* (*op)(::BitStream *, ::BitStream *,
+			   uint64_t), View x, uint64_t n) {
+      return Settle(op(Target(x), x.get(), n));
+   }
+};
+
+/*
+ * Binary operators. With a named stream or a view on the left the result is
+ * a new stream, with a temporary on the left it is built in the temporary.
+ */
+inline Stream operator&(View x, View y) {
+   Stream r;
+
+   r.assign_and(x, y);
+   return r;
+}
+
+inline Stream operator&(Stream &&x, View y) {
+   x &= y;
+   return std::move(x);
+}
+
+inline Stream operator|(View x, View y) {
+   Stream r;
+
+   r.assign_or(x, y);
+   return r;
+}
+
+inline Stream operator|(Stream &&x, View y) {
+   x |= y;
+   return std::move(x);
+}
+
+inline Stream operator^(View x, View y) {
+   Stream r;
+
+   r.assign_xor(x, y);
+   return r;
+}
+
+inline Stream operator^(Stream &&x, View y) {
+   x ^= y;
+   return std::move(x);
+}
+
+inline Stream operator~(View x) {
+   Stream r;
+
+   r.assign_not(x);
+   return r;
+}
+
+inline Stream operator~(Stream &&x) {
+   x.flip();
+   return std::move(x);
+}
+
+inline Stream operator<<(View x, uint64_t n) {
+   Stream r;
+
+   r.assign_shift_left(x, n);
+   return r;
+}
+
+inline Stream operator<<(Stream &&x, uint64_t n) {
+   x <<= n;
+   return std::move(x);
+}
+
+inline Stream operator>>(View x, uint64_t n) {
+   Stream r;
+
+   r.assign_shift_right(x, n);
+   return r;
+}
+
+inline Stream operator>>(Stream &&x, uint64_t n) {
+   x >>= n;
+   return std::move(x);
+}
+
+/** @brief the bits of x followed by those of y in a new stream */
+inline Stream concat(View x, View y) {
+   Stream r;
+
+   r.assign_concat(x, y);
+   return r;
+}
+
+} /* namespace bitstream */
+#endif /* _BITSTREAM_HPP */
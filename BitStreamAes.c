@@ -0,0 +1,809 @@
+/**
+ * @file BitStreamAes.c
+ *
+ * @brief Implements AES-128 (FIPS-197) in ECB and CBC modes
+ *
+ * Two implementations sit behind the same key schedule:
+ * 	- software: byte oriented rounds on the 256 byte S-boxes alone,
+ * 	  MixColumns is arithmetic (xtime) rather than tables. It is NOT
+ * 	  constant time: the S-box lookups are indexed by key dependent data
+ * 	  and reading the whole table before each block only narrows what a
+ * 	  cache-timing attacker sees, it does not close the channel. Use it
+ * 	  where AES-NI is missing and no other process can time the cache, or
+ * 	  to check against known-answer vectors.
+ * 	- AES-NI: the x86 AES instructions, constant time. ECB and CBC
+ * 	  decryption keep 8 independent blocks in flight to hide the latency
+ * 	  of the rounds, CBC encryption is serial by construction.
+ *
+ * AES-NI is picked at runtime when the cpu has it, BitStreamAesSelect()
+ * overrides the choice. The choice is published with an atomic store, so a
+ * call racing with it runs whole on either implementation.
+ *
+ * @internal BitStreamAesSelect
+ * 	     BitStreamAesSetKey
+ * 	     BitStreamAesExpandKey
+ * 	     BitStreamAesEcbEncryptBlocks
+ * 	     BitStreamAesEcbDecryptBlocks
+ * 	     BitStreamAesCbcEncryptBlocks
+ * 	     BitStreamAesCbcDecryptBlocks
+ * 	     BitStreamAesEcbEncrypt
+ * 	     BitStreamAesEcbDecrypt
+ * 	     BitStreamAesCbcEncrypt
+ * 	     BitStreamAesCbcDecrypt
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+
+#include "BitStreamAes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_HAVE_AESNI	1
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#define AESNI_TARGET	__attribute__((target("aes,sse2")))
+#endif
+
+/**
+ * @def AESNI_PIPELINE
+ * @brief blocks kept in flight by the AES-NI kernels
+ */
+#define AESNI_PIPELINE	8
+
+/**
+ * @var AesSbox
+ * @brief SubBytes substitution table
+ */
+static const uint8_t AesSbox[256] __attribute__((aligned(64))) = {
+   0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+   0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+   0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+   0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+   0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+   0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+   0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+   0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+   0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+   0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+   0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+   0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+   0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+   0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+   0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+   0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,};
+
+/**
+ * @var AesInvSbox
+ * @brief InvSubBytes substitution table
+ */
+static const uint8_t AesInvSbox[256] __attribute__((aligned(64))) = {
+   0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+   0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+   0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+   0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+   0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+   0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+   0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+   0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+   0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+   0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+   0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+   0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+   0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+   0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+   0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+   0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d,};
+
+/**
+ * @struct AesOps
+ * @brief block routines of one implementation
+ */
+typedef struct AesOps {
+   BitStreamAesImpl impl;
+   void (*ecbEncrypt)(const BitStreamAesKey *, const uint8_t *, uint8_t *,
+		   size_t);
+   void (*ecbDecrypt)(const BitStreamAesKey *, const uint8_t *, uint8_t *,
+		   size_t);
+   void (*cbcEncrypt)(const BitStreamAesKey *, uint8_t *, const uint8_t *,
+		   uint8_t *, size_t);
+   void (*cbcDecrypt)(const BitStreamAesKey *, uint8_t *, const uint8_t *,
+		   uint8_t *, size_t);
+} AesOps;
+
+/**
+ * @fn uint8_t AesXtime(uint8_t x)
+ *
+ * @brief multiplies by x in GF(2^8), without a data dependent branch
+ */
+static inline uint8_t AesXtime(uint8_t x) {
+   return (uint8_t)((x << 1) ^ (0x1b & -(x >> 7)));
+}
+
+/**
+ * @fn void AesMixColumns(uint8_t s[16])
+ *
+ * @brief MixColumns on the column-major state
+ */
+static inline void AesMixColumns(uint8_t s[16]) {
+   int c;
+
+   for (c = 0; c < 16; c += 4) {
+      uint8_t a0 = s[c], a1 = s[c + 1], a2 = s[c + 2], a3 = s[c + 3];
+      uint8_t t = a0 ^ a1 ^ a2 ^ a3;
+
+      s[c]     = a0 ^ t ^ AesXtime(a0 ^ a1);
+      s[c + 1] = a1 ^ t ^ AesXtime(a1 ^ a2);
+      s[c + 2] = a2 ^ t ^ AesXtime(a2 ^ a3);
+      s[c + 3] = a3 ^ t ^ AesXtime(a3 ^ a0);
+   }
+}
+
+/**
+ * @fn void AesInvMixColumns(uint8_t s[16])
+ *
+ * @brief InvMixColumns, folded into a pre-multiplication by {04}x^2+{05}
+ * 	followed by MixColumns
+ */
+static inline void AesInvMixColumns(uint8_t s[16]) {
+   int c;
+
+   for (c = 0; c < 16; c += 4) {
+      uint8_t u = AesXtime(AesXtime(s[c] ^ s[c + 2]));
+      uint8_t v = AesXtime(AesXtime(s[c + 1] ^ s[c + 3]));
+
+      s[c] ^= u;
+      s[c + 1] ^= v;
+      s[c + 2] ^= u;
+      s[c + 3] ^= v;
+   }
+   AesMixColumns(s);
+}
+
+/**
+ * @fn void AesTouchTable(const uint8_t *table)
+ *
+ * @brief reads every cache line of a 256 byte table, so that the lines
+ * 	loaded by a block do not depend on the data. A hardening measure
+ * 	only, the timing of the lookups still does
+ */
+static inline void AesTouchTable(const uint8_t *table) {
+   volatile uint8_t sink;
+   int              i;
+
+   for (i = 0; i < 256; i += 64)
+      sink = table[i];
+   (void)sink;
+}
+
+/**
+ * @fn void AesSoftEncryptBlock(const BitStreamAesKey *aes, const uint8_t *in,
+ * 	uint8_t *out)
+ *
+ * @brief encrypts one block with the software rounds
+ */
+static void AesSoftEncryptBlock(const BitStreamAesKey *aes, const uint8_t *in,
+	uint8_t *out) {
+   uint8_t s[16], t[16];
+   int     r, c, row, i;
+
+   AesTouchTable(AesSbox);
+
+   for (i = 0; i < 16; i++)
+      s[i] = in[i] ^ aes->enc[0][i];
+
+   for (r = 1; r <= AES128_ROUNDS; r++) {
+      /* SubBytes and ShiftRows: row 'row' rotates left by 'row' */
+      for (c = 0; c < 4; c++)
+         for (row = 0; row < 4; row++)
+            t[row + 4 * c] = AesSbox[s[row + 4 * ((c + row) & 3)]];
+      if (r != AES128_ROUNDS)
+         AesMixColumns(t);
+      for (i = 0; i < 16; i++)
+         s[i] = t[i] ^ aes->enc[r][i];
+   }
+   memcpy(out, s, 16);
+}
+
+/**
+ * @fn void AesSoftDecryptBlock(const BitStreamAesKey *aes, const uint8_t *in,
+ * 	uint8_t *out)
+ *
+ * @brief decrypts one block with the software rounds (straight inverse
+ * 	cipher on the encryption round keys)
+ */
+static void AesSoftDecryptBlock(const BitStreamAesKey *aes, const uint8_t *in,
+	uint8_t *out) {
+   uint8_t s[16], t[16];
+   int     r, c, row, i;
+
+   AesTouchTable(AesInvSbox);
+
+   for (i = 0; i < 16; i++)
+      s[i] = in[i] ^ aes->enc[AES128_ROUNDS][i];
+
+   for (r = AES128_ROUNDS - 1; r >= 0; r--) {
+      /* InvShiftRows and InvSubBytes: row 'row' rotates right by 'row' */
+      for (c = 0; c < 4; c++)
+         for (row = 0; row < 4; row++)
+            t[row + 4 * c] = AesInvSbox[s[row + 4 * ((c - row) & 3)]];
+      for (i = 0; i < 16; i++)
+         s[i] = t[i] ^ aes->enc[r][i];
+      if (r != 0)
+         AesInvMixColumns(s);
+   }
+   memcpy(out, s, 16);
+}
+
+static void AesSoftEcbEncrypt(const BitStreamAesKey *aes, const uint8_t *in,
+	uint8_t *out, size_t nblocks) {
+   size_t i;
+
+   for (i = 0; i < nblocks; i++)
+      AesSoftEncryptBlock(aes, in + 16 * i, out + 16 * i);
+}
+
+static void AesSoftEcbDecrypt(const BitStreamAesKey *aes, const uint8_t *in,
+	uint8_t *out, size_t nblocks) {
+   size_t i;
+
+   for (i = 0; i < nblocks; i++)
+      AesSoftDecryptBlock(aes, in + 16 * i, out + 16 * i);
+}
+
+static void AesSoftCbcEncrypt(const BitStreamAesKey *aes, uint8_t *iv,
+	const uint8_t *in, uint8_t *out, size_t nblocks) {
+   uint8_t x[16];
+   size_t  i;
+   int     j;
+
+   for (i = 0; i < nblocks; i++) {
+      for (j = 0; j < 16; j++)
+         x[j] = in[16 * i + j] ^ iv[j];
+      AesSoftEncryptBlock(aes, x, out + 16 * i);
+      memcpy(iv, out + 16 * i, 16);
+   }
+}
+
+static void AesSoftCbcDecrypt(const BitStreamAesKey *aes, uint8_t *iv,
+	const uint8_t *in, uint8_t *out, size_t nblocks) {
+   uint8_t c[16], x[16];
+   size_t  i;
+   int     j;
+
+   for (i = 0; i < nblocks; i++) {
+      memcpy(c, in + 16 * i, 16);  /* in and out may be the same buffer */
+      AesSoftDecryptBlock(aes, c, x);
+      for (j = 0; j < 16; j++)
+         out[16 * i + j] = x[j] ^ iv[j];
+      memcpy(iv, c, 16);
+   }
+}
+
+static const AesOps AesSoftware = {
+   BITSTREAM_AES_SOFTWARE,
+   AesSoftEcbEncrypt, AesSoftEcbDecrypt, AesSoftCbcEncrypt, AesSoftCbcDecrypt
+};
+
+#if defined(AES_HAVE_AESNI)
+/* applies op to the 8 blocks in flight */
+#define AESNI_EACH(op)	\
+   do { b0 = op(b0); b1 = op(b1); b2 = op(b2); b3 = op(b3);	\
+        b4 = op(b4); b5 = op(b5); b6 = op(b6); b7 = op(b7); } while (0)
+
+#define AESNI_LOAD8(p)	\
+   do { b0 = _mm_loadu_si128((const __m128i *)(p) + 0);	\
+        b1 = _mm_loadu_si128((const __m128i *)(p) + 1);	\
+        b2 = _mm_loadu_si128((const __m128i *)(p) + 2);	\
+        b3 = _mm_loadu_si128((const __m128i *)(p) + 3);	\
+        b4 = _mm_loadu_si128((const __m128i *)(p) + 4);	\
+        b5 = _mm_loadu_si128((const __m128i *)(p) + 5);	\
+        b6 = _mm_loadu_si128((const __m128i *)(p) + 6);	\
+        b7 = _mm_loadu_si128((const __m128i *)(p) + 7); } while (0)
+
+#define AESNI_STORE8(p)	\
+   do { _mm_storeu_si128((__m128i *)(p) + 0, b0);	\
+        _mm_storeu_si128((__m128i *)(p) + 1, b1);	\
+        _mm_storeu_si128((__m128i *)(p) + 2, b2);	\
+        _mm_storeu_si128((__m128i *)(p) + 3, b3);	\
+        _mm_storeu_si128((__m128i *)(p) + 4, b4);	\
+        _mm_storeu_si128((__m128i *)(p) + 5, b5);	\
+        _mm_storeu_si128((__m128i *)(p) + 6, b6);	\
+        _mm_storeu_si128((__m128i *)(p) + 7, b7); } while (0)
+
+#define AESNI_XOR(b)	_mm_xor_si128(b, k)
+#define AESNI_ENC(b)	_mm_aesenc_si128(b, k)
+#define AESNI_ENCLAST(b)	_mm_aesenclast_si128(b, k)
+#define AESNI_DEC(b)	_mm_aesdec_si128(b, k)
+#define AESNI_DECLAST(b)	_mm_aesdeclast_si128(b, k)
+
+/**
+ * @fn void AesNiLoadKeys(const uint8_t rk[][16], __m128i *k)
+ *
+ * @brief loads the 11 round keys into registers
+ */
+static AESNI_TARGET inline void AesNiLoadKeys(const uint8_t rk[][16],
+	__m128i *k) {
+   int r;
+
+   for (r = 0; r <= AES128_ROUNDS; r++)
+      k[r] = _mm_load_si128((const __m128i *)rk[r]);
+}
+
+static AESNI_TARGET inline __m128i AesNiEncrypt(const __m128i *rk, __m128i b) {
+   int r;
+
+   b = _mm_xor_si128(b, rk[0]);
+   for (r = 1; r < AES128_ROUNDS; r++)
+      b = _mm_aesenc_si128(b, rk[r]);
+   return _mm_aesenclast_si128(b, rk[AES128_ROUNDS]);
+}
+
+static AESNI_TARGET inline __m128i AesNiDecrypt(const __m128i *rk, __m128i b) {
+   int r;
+
+   b = _mm_xor_si128(b, rk[0]);
+   for (r = 1; r < AES128_ROUNDS; r++)
+      b = _mm_aesdec_si128(b, rk[r]);
+   return _mm_aesdeclast_si128(b, rk[AES128_ROUNDS]);
+}
+
+static AESNI_TARGET void AesNiEcbEncrypt(const BitStreamAesKey *aes,
+	const uint8_t *in, uint8_t *out, size_t nblocks) {
+   __m128i rk[AES128_ROUNDS + 1];
+   __m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+   int     r;
+
+   AesNiLoadKeys(aes->enc, rk);
+
+   for (; nblocks >= AESNI_PIPELINE; nblocks -= AESNI_PIPELINE) {
+      AESNI_LOAD8(in);
+      k = rk[0];
+      AESNI_EACH(AESNI_XOR);
+      for (r = 1; r < AES128_ROUNDS; r++) {
+         k = rk[r];
+         AESNI_EACH(AESNI_ENC);
+      }
+      k = rk[AES128_ROUNDS];
+      AESNI_EACH(AESNI_ENCLAST);
+      AESNI_STORE8(out);
+      in += AESNI_PIPELINE * 16;
+      out += AESNI_PIPELINE * 16;
+   }
+   for (; nblocks; nblocks--, in += 16, out += 16)
+      _mm_storeu_si128((__m128i *)out, AesNiEncrypt(rk,
+			      _mm_loadu_si128((const __m128i *)in)));
+}
+
+static AESNI_TARGET void AesNiEcbDecrypt(const BitStreamAesKey *aes,
+	const uint8_t *in, uint8_t *out, size_t nblocks) {
+   __m128i rk[AES128_ROUNDS + 1];
+   __m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+   int     r;
+
+   AesNiLoadKeys(aes->dec, rk);
+
+   for (; nblocks >= AESNI_PIPELINE; nblocks -= AESNI_PIPELINE) {
+      AESNI_LOAD8(in);
+      k = rk[0];
+      AESNI_EACH(AESNI_XOR);
+      for (r = 1; r < AES128_ROUNDS; r++) {
+         k = rk[r];
+         AESNI_EACH(AESNI_DEC);
+      }
+      k = rk[AES128_ROUNDS];
+      AESNI_EACH(AESNI_DECLAST);
+      AESNI_STORE8(out);
+      in += AESNI_PIPELINE * 16;
+      out += AESNI_PIPELINE * 16;
+   }
+   for (; nblocks; nblocks--, in += 16, out += 16)
+      _mm_storeu_si128((__m128i *)out, AesNiDecrypt(rk,
+			      _mm_loadu_si128((const __m128i *)in)));
+}
+
+static AESNI_TARGET void AesNiCbcEncrypt(const BitStreamAesKey *aes,
+	uint8_t *iv, const uint8_t *in, uint8_t *out, size_t nblocks) {
+   __m128i rk[AES128_ROUNDS + 1];
+   __m128i c = _mm_loadu_si128((const __m128i *)iv);
+
+   AesNiLoadKeys(aes->enc, rk);
+
+   for (; nblocks; nblocks--, in += 16, out += 16) {
+      c = AesNiEncrypt(rk, _mm_xor_si128(c,
+			      _mm_loadu_si128((const __m128i *)in)));
+      _mm_storeu_si128((__m128i *)out, c);
+   }
+   _mm_storeu_si128((__m128i *)iv, c);
+}
+
+static AESNI_TARGET void AesNiCbcDecrypt(const BitStreamAesKey *aes,
+	uint8_t *iv, const uint8_t *in, uint8_t *out, size_t nblocks) {
+   __m128i rk[AES128_ROUNDS + 1];
+   __m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+   __m128i prev = _mm_loadu_si128((const __m128i *)iv);
+   __m128i c[AESNI_PIPELINE];
+   int     r;
+
+   AesNiLoadKeys(aes->dec, rk);
+
+   for (; nblocks >= AESNI_PIPELINE; nblocks -= AESNI_PIPELINE) {
+      AESNI_LOAD8(in);
+      c[0] = b0; c[1] = b1; c[2] = b2; c[3] = b3;
+      c[4] = b4; c[5] = b5; c[6] = b6; c[7] = b7;
+      k = rk[0];
+      AESNI_EACH(AESNI_XOR);
+      for (r = 1; r < AES128_ROUNDS; r++) {
+         k = rk[r];
+         AESNI_EACH(AESNI_DEC);
+      }
+      k = rk[AES128_ROUNDS];
+      AESNI_EACH(AESNI_DECLAST);
+      b0 = _mm_xor_si128(b0, prev);
+      b1 = _mm_xor_si128(b1, c[0]);
+      b2 = _mm_xor_si128(b2, c[1]);
+      b3 = _mm_xor_si128(b3, c[2]);
+      b4 = _mm_xor_si128(b4, c[3]);
+      b5 = _mm_xor_si128(b5, c[4]);
+      b6 = _mm_xor_si128(b6, c[5]);
+      b7 = _mm_xor_si128(b7, c[6]);
+      prev = c[7];
+      AESNI_STORE8(out);
+      in += AESNI_PIPELINE * 16;
+      out += AESNI_PIPELINE * 16;
+   }
+   for (; nblocks; nblocks--, in += 16, out += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)in);
+
+      _mm_storeu_si128((__m128i *)out, _mm_xor_si128(AesNiDecrypt(rk, x),
+			      prev));
+      prev = x;
+   }
+   _mm_storeu_si128((__m128i *)iv, prev);
+}
+
+static const AesOps AesNi = {
+   BITSTREAM_AES_AESNI,
+   AesNiEcbEncrypt, AesNiEcbDecrypt, AesNiCbcEncrypt, AesNiCbcDecrypt
+};
+#endif /* AES_HAVE_AESNI */
+
+static const AesOps  *Aes = NULL;
+static pthread_once_t AesOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @fn const AesOps* AesChoose(BitStreamAesImpl impl)
+ *
+ * @brief implementation for impl, software if the cpu lacks the one asked
+ * 	for
+ */
+static const AesOps* AesChoose(BitStreamAesImpl impl) {
+#if defined(AES_HAVE_AESNI)
+   if (impl != BITSTREAM_AES_SOFTWARE && __builtin_cpu_supports("aes"))
+      return &AesNi;
+#else
+   (void)impl;
+#endif
+   return &AesSoftware;
+}
+
+/**
+ * @fn void AesInit(void)
+ *
+ * @brief picks the implementation on first use
+ */
+static void AesInit(void) {
+   __atomic_store_n(&Aes, AesChoose(BITSTREAM_AES_AUTO), __ATOMIC_RELEASE);
+}
+
+/**
+ * @fn const AesOps* AesGetOps(void)
+ *
+ * @brief implementation in use
+ */
+static inline const AesOps* AesGetOps(void) {
+   pthread_once(&AesOnce, AesInit);
+   return __atomic_load_n(&Aes, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn BitStreamAesImpl BitStreamAesSelect(BitStreamAesImpl impl)
+ *
+ * @brief selects the implementation used by all subsequent calls, meant to
+ * 	be called once at startup (or by tests running the known-answer
+ * 	vectors through each implementation)
+ *
+ * @param [in] impl\n
+ * 	implementation wanted, BITSTREAM_AES_AUTO for the fastest available
+ * @returns implementation selected, software if the one asked for is not
+ * 	available on this cpu
+ */
+BitStreamAesImpl BitStreamAesSelect(BitStreamAesImpl impl) {
+   const AesOps *ops = AesChoose(impl);
+
+   /* after the first use pick, which would otherwise override this one */
+   pthread_once(&AesOnce, AesInit);
+   __atomic_store_n(&Aes, ops, __ATOMIC_RELEASE);
+   return ops->impl;
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn void BitStreamAesExpandKey(BitStreamAesKey *aes, const uint8_t *key)
+ *
+ * @brief expands a 16 byte key into the round keys of both directions
+ *
+ * @param [out] *aes\n
+ * 	expanded key
+ * @param [in] *key\n
+ * 	AES128_KEY_BYTES of key
+ * @returns none
+ */
+void BitStreamAesExpandKey(BitStreamAesKey *aes, const uint8_t *key) {
+   uint8_t rcon = 0x01;
+   int     r, i;
+
+   memcpy(aes->enc[0], key, AES128_KEY_BYTES);
+
+   for (r = 1; r <= AES128_ROUNDS; r++) {
+      const uint8_t *p = aes->enc[r - 1];
+      uint8_t       *k = aes->enc[r];
+
+      /* RotWord, SubWord and Rcon on the last word of the previous key */
+      k[0] = p[0] ^ AesSbox[p[13]] ^ rcon;
+      k[1] = p[1] ^ AesSbox[p[14]];
+      k[2] = p[2] ^ AesSbox[p[15]];
+      k[3] = p[3] ^ AesSbox[p[12]];
+      for (i = 4; i < 16; i++)
+         k[i] = p[i] ^ k[i - 4];
+      rcon = AesXtime(rcon);
+   }
+
+   /* equivalent inverse cipher: reversed keys, inner ones InvMixColumns'd */
+   memcpy(aes->dec[0], aes->enc[AES128_ROUNDS], AES_BLOCK_BYTES);
+   for (r = 1; r < AES128_ROUNDS; r++) {
+      memcpy(aes->dec[r], aes->enc[AES128_ROUNDS - r], AES_BLOCK_BYTES);
+      AesInvMixColumns(aes->dec[r]);
+   }
+   memcpy(aes->dec[AES128_ROUNDS], aes->enc[0], AES_BLOCK_BYTES);
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn int BitStreamAesSetKey(BitStreamAesKey *aes, BitStream *key)
+ *
+ * @brief expands the key held in a bit stream
+ *
+ * @param [out] *aes\n
+ * 	expanded key
+ * @param [in] *key\n
+ * 	bit stream of exactly 128 bits
+ * @returns 0 on success, -1 if the key is not 128 bits
+ */
+int BitStreamAesSetKey(BitStreamAesKey *aes, BitStream *key) {
+   if (aes == NULL || BitStreamGetSizeBits(key) != AES128_KEY_BYTES *
+		   BITS_PER_BYTE)
+      return (-1);
+
+   BitStreamAesExpandKey(aes, BitStreamGetArray(key));
+   return 0;
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn void BitStreamAesEcbEncryptBlocks(const BitStreamAesKey *aes,
+ * 	const uint8_t *in, uint8_t *out, size_t nblocks)
+ *
+ * @brief encrypts whole blocks in ECB mode, in and out may be the same
+ *
+ * @param [in] *aes\n
+ * 	expanded key
+ * @param [in] *in\n
+ * 	plaintext blocks
+ * @param [out] *out\n
+ * 	cipher text blocks
+ * @param [in] nblocks\n
+ * 	number of blocks
+ * @returns none
+ */
+void BitStreamAesEcbEncryptBlocks(const BitStreamAesKey *aes,
+	const uint8_t *in, uint8_t *out, size_t nblocks) {
+   AesGetOps()->ecbEncrypt(aes, in, out, nblocks);
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn void BitStreamAesEcbDecryptBlocks(const BitStreamAesKey *aes,
+ * 	const uint8_t *in, uint8_t *out, size_t nblocks)
+ *
+ * @brief decrypts whole blocks in ECB mode, in and out may be the same
+ *
+ * @param [in] *aes\n
+ * 	expanded key
+ * @param [in] *in\n
+ * 	cipher text blocks
+ * @param [out] *out\n
+ * 	plaintext blocks
+ * @param [in] nblocks\n
+ * 	number of blocks
+ * @returns none
+ */
+void BitStreamAesEcbDecryptBlocks(const BitStreamAesKey *aes,
+	const uint8_t *in, uint8_t *out, size_t nblocks) {
+   AesGetOps()->ecbDecrypt(aes, in, out, nblocks);
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn void BitStreamAesCbcEncryptBlocks(const BitStreamAesKey *aes,
+ * 	uint8_t *iv, const uint8_t *in, uint8_t *out, size_t nblocks)
+ *
+ * @brief encrypts whole blocks in CBC mode, in and out may be the same
+ *
+ * @param [in] *aes\n
+ * 	expanded key
+ * @param [in,out] *iv\n
+ * 	16 byte chaining value, updated so that consecutive calls continue
+ * 	the same message
+ * @param [in] *in\n
+ * 	plaintext blocks
+ * @param [out] *out\n
+ * 	cipher text blocks
+ * @param [in] nblocks\n
+ * 	number of blocks
+ * @returns none
+ */
+void BitStreamAesCbcEncryptBlocks(const BitStreamAesKey *aes, uint8_t *iv,
+	const uint8_t *in, uint8_t *out, size_t nblocks) {
+   AesGetOps()->cbcEncrypt(aes, iv, in, out, nblocks);
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn void BitStreamAesCbcDecryptBlocks(const BitStreamAesKey *aes,
+ * 	uint8_t *iv, const uint8_t *in, uint8_t *out, size_t nblocks)
+ *
+ * @brief decrypts whole blocks in CBC mode, in and out may be the same
+ *
+ * @param [in] *aes\n
+ * 	expanded key
+ * @param [in,out] *iv\n
+ * 	16 byte chaining value, updated so that consecutive calls continue
+ * 	the same message
+ * @param [in] *in\n
+ * 	cipher text blocks
+ * @param [out] *out\n
+ * 	plaintext blocks
+ * @param [in] nblocks\n
+ * 	number of blocks
+ * @returns none
+ */
+void BitStreamAesCbcDecryptBlocks(const BitStreamAesKey *aes, uint8_t *iv,
+	const uint8_t *in, uint8_t *out, size_t nblocks) {
+   AesGetOps()->cbcDecrypt(aes, iv, in, out, nblocks);
+}
+
+/**
+ * @fn BitStream* AesCreateOutput(BitStream *in)
+ *
+ * @brief allocates the output of a stream level call, the input has to be
+ * 	a whole, non zero, number of blocks
+ */
+static BitStream* AesCreateOutput(BitStream *in) {
+   uint64_t nbits = BitStreamGetSizeBits(in);
+
+   if (nbits == 0 || nbits % (AES_BLOCK_BYTES * BITS_PER_BYTE) ||
+       BitStreamGetArray(in) == NULL)
+      return NULL;
+
+   return BitStreamCreate(nbits);
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn BitStream* BitStreamAesEcbEncrypt(BitStream *in,
+ * 	const BitStreamAesKey *aes)
+ *
+ * @brief encrypts the bit stream in ECB mode
+ *
+ * @param [in] *in\n
+ * 	plaintext, a whole number of 128 bit blocks (no padding is added)
+ * @param [in] *aes\n
+ * 	expanded key
+ * @returns newly created bit stream holding the cipher text, NULL on failure
+ */
+BitStream* BitStreamAesEcbEncrypt(BitStream *in, const BitStreamAesKey *aes) {
+   BitStream *out = AesCreateOutput(in);
+
+   if (out)
+      BitStreamAesEcbEncryptBlocks(aes, in->array, out->array,
+		      in->nbits / (AES_BLOCK_BYTES * BITS_PER_BYTE));
+   return out;
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn BitStream* BitStreamAesEcbDecrypt(BitStream *in,
+ * 	const BitStreamAesKey *aes)
+ *
+ * @brief decrypts the bit stream in ECB mode
+ *
+ * @param [in] *in\n
+ * 	cipher text, a whole number of 128 bit blocks
+ * @param [in] *aes\n
+ * 	expanded key
+ * @returns newly created bit stream holding the plaintext, NULL on failure
+ */
+BitStream* BitStreamAesEcbDecrypt(BitStream *in, const BitStreamAesKey *aes) {
+   BitStream *out = AesCreateOutput(in);
+
+   if (out)
+      BitStreamAesEcbDecryptBlocks(aes, in->array, out->array,
+		      in->nbits / (AES_BLOCK_BYTES * BITS_PER_BYTE));
+   return out;
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn BitStream* BitStreamAesCbcEncrypt(BitStream *in,
+ * 	const BitStreamAesKey *aes, BitStream *iv)
+ *
+ * @brief encrypts the bit stream in CBC mode
+ *
+ * @param [in] *in\n
+ * 	plaintext, a whole number of 128 bit blocks (no padding is added)
+ * @param [in] *aes\n
+ * 	expanded key
+ * @param [in] *iv\n
+ * 	128 bit initialization vector
+ * @returns newly created bit stream holding the cipher text, NULL on failure
+ */
+BitStream* BitStreamAesCbcEncrypt(BitStream *in, const BitStreamAesKey *aes,
+	BitStream *iv) {
+   BitStream *out = NULL;
+   uint8_t    chain[AES_BLOCK_BYTES];
+
+   if (BitStreamGetSizeBits(iv) != AES_BLOCK_BYTES * BITS_PER_BYTE)
+      return NULL;
+
+   out = AesCreateOutput(in);
+   if (out) {
+      memcpy(chain, iv->array, AES_BLOCK_BYTES);
+      BitStreamAesCbcEncryptBlocks(aes, chain, in->array, out->array,
+		      in->nbits / (AES_BLOCK_BYTES * BITS_PER_BYTE));
+   }
+   return out;
+}
+
+/**
+ * @ingroup BitStreamAes
+ * @fn BitStream* BitStreamAesCbcDecrypt(BitStream *in,
+ * 	const BitStreamAesKey *aes, BitStream *iv)
+ *
+ * @brief decrypts the bit stream in CBC mode
+ *
+ * @param [in] *in\n
+ * 	cipher text, a whole number of 128 bit blocks
+ * @param [in] *aes\n
+ * 	expanded key
+ * @param [in] *iv\n
+ * 	128 bit initialization vector
+ * @returns newly created bit stream holding the plaintext, NULL on failure
+ */
+BitStream* BitStreamAesCbcDecrypt(BitStream *in, const BitStreamAesKey *aes,
+	BitStream *iv) {
+   BitStream *out = NULL;
+   uint8_t    chain[AES_BLOCK_BYTES];
+
+   if (BitStreamGetSizeBits(iv) != AES_BLOCK_BYTES * BITS_PER_BYTE)
+      return NULL;
+
+   out = AesCreateOutput(in);
+   if (out) {
+      memcpy(chain, iv->array, AES_BLOCK_BYTES);
+      BitStreamAesCbcDecryptBlocks(aes, chain, in->array, out->array,
+		      in->nbits / (AES_BLOCK_BYTES * BITS_PER_BYTE));
+   }
+   return out;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file  BitStreamAes.h
+ * @brief AES-128 block cipher in ECB and CBC modes over bit streams
+ */
+#if !defined(_BITSTREAM_AES_H)
+#define _BITSTREAM_AES_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def AES_BLOCK_BYTES
+ * @brief AES block size in bytes
+ */
+#define AES_BLOCK_BYTES	16
+
+/**
+ * @def AES128_KEY_BYTES
+ * @brief AES-128 key size in bytes
+ */
+#define AES128_KEY_BYTES	16
+
+/**
+ * @def AES128_ROUNDS
+ * @brief number of rounds of AES-128
+ */
+#define AES128_ROUNDS	10
+
+/* Type Definitions */
+/**
+ * @enum BitStreamAesImpl
+ * @brief implementations of the block cipher
+ */
+typedef enum BitStreamAesImpl {
+   BITSTREAM_AES_AUTO = 0,   /**< AES-NI when the cpu has it, else software */
+   BITSTREAM_AES_SOFTWARE,   /**< portable byte oriented implementation, not
+				  constant time (cache-timing) */
+   BITSTREAM_AES_AESNI       /**< x86 AES instructions */
+} BitStreamAesImpl;
+
+/**
+ * @struct BitStreamAesKey
+ * @brief expanded AES-128 key, usable by every implementation
+ */
+typedef struct BitStreamAesKey {
+   /**< @brief round keys of the cipher */
+   uint8_t enc[AES128_ROUNDS + 1][AES_BLOCK_BYTES] __attribute__((aligned(16)));
+   /**< @brief round keys of the equivalent inverse cipher */
+   uint8_t dec[AES128_ROUNDS + 1][AES_BLOCK_BYTES] __attribute__((aligned(16)));
+} BitStreamAesKey;
+
+
+BitStreamAesImpl BitStreamAesSelect(BitStreamAesImpl impl) ;
+
+int BitStreamAesSetKey(BitStreamAesKey *aes, BitStream *key) ;
+
+void BitStreamAesExpandKey(BitStreamAesKey *aes, const uint8_t *key) ;
+
+void BitStreamAesEcbEncryptBlocks(const BitStreamAesKey *aes,
+	const uint8_t *in, uint8_t *out, size_t nblocks) ;
+
+void BitStreamAesEcbDecryptBlocks(const BitStreamAesKey *aes,
+	const uint8_t *in, uint8_t *out, size_t nblocks) ;
+
+void BitStreamAesCbcEncryptBlocks(const BitStreamAesKey *aes, uint8_t *iv,
+	const uint8_t *in, uint8_t *out, size_t nblocks) ;
+
+void BitStreamAesCbcDecryptBlocks(const BitStreamAesKey *aes, uint8_t *iv,
+	const uint8_t *in, uint8_t *out, size_t nblocks) ;
+
+BitStream* BitStreamAesEcbEncrypt(BitStream *in, const BitStreamAesKey *aes) ;
+
+BitStream* BitStreamAesEcbDecrypt(BitStream *in, const BitStreamAesKey *aes) ;
+
+BitStream* BitStreamAesCbcEncrypt(BitStream *in, const BitStreamAesKey *aes,
+	BitStream *iv) ;
+
+BitStream* BitStreamAesCbcDecrypt(BitStream *in, const BitStreamAesKey *aes,
+	BitStream *iv) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_AES_H */
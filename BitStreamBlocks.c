@@ -0,0 +1,248 @@
+/**
+ * @file BitStreamBlocks.c
+ *
+ * @brief Implements counting of repeated blocks within a buffer
+ *
+ * Comparing every pair of blocks costs O(n^2), the blocks are inserted into
+ * a hash set instead and each one that is already present counts as a
+ * duplicate. The set is sized for twice the number of blocks so probe
+ * sequences stay short, and it is kept from one record to the next.
+ *
+ * @internal BitStreamBlockSetCreate
+ * 	     BitStreamBlockSetDelete
+ * 	     BitStreamBlockSetReserve
+ * 	     BitStreamBlockSetCountDuplicates
+ * 	     BitStreamCountDuplicateBlocks
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+
+#include "BitStreamBlocks.h"
+
+/**
+ * @def BLOCKSET_MIN_CAPACITY
+ * @brief smallest table allocated, enough for records of 32 blocks
+ */
+#define BLOCKSET_MIN_CAPACITY	64
+
+/**
+ * @fn uint64_t BlockSetHash(uint64_t lo, uint64_t hi)
+ *
+ * @brief mixes the two halves of a block, the top bits index the table
+ */
+static inline uint64_t BlockSetHash(uint64_t lo, uint64_t hi) {
+   return (lo ^ (hi * 0x9e3779b97f4a7c15ULL)) * 0xc2b2ae3d27d4eb4fULL;
+}
+
+/**
+ * @ingroup BitStreamBlocks
+ * @fn BitStreamBlockSet* BitStreamBlockSetCreate(uint64_t nblocks)
+ *
+ * @brief Creates an empty block set
+ *
+ * @param [in] nblocks\n
+ * 	number of blocks per buffer it is sized for, it grows on demand
+ * @returns pointer to newly created set, NULL on failure
+ */
+BitStreamBlockSet* BitStreamBlockSetCreate(uint64_t nblocks) {
+   BitStreamBlockSet *set;
+
+   set = (BitStreamBlockSet *)calloc(1, sizeof(BitStreamBlockSet));
+   if (set && BitStreamBlockSetReserve(set, nblocks) != 0) {
+      BitStreamBlockSetDelete(set);
+      set = NULL;
+   }
+   return set;
+}
+
+/**
+ * @ingroup BitStreamBlocks
+ * @fn void BitStreamBlockSetDelete(BitStreamBlockSet *set)
+ *
+ * @brief Deletes the block set
+ *
+ * @param [in] *set\n
+ * 	set to delete, may be NULL
+ * @returns none
+ */
+void BitStreamBlockSetDelete(BitStreamBlockSet *set) {
+   if (set != NULL) {
+      free(set->keys);
+      free(set->stamps);
+      free(set);
+   }
+}
+
+/**
+ * @ingroup BitStreamBlocks
+ * @fn int BitStreamBlockSetReserve(BitStreamBlockSet *set, uint64_t nblocks)
+ *
+ * @brief makes room for buffers of nblocks blocks, the table only grows
+ *
+ * @param [in,out] *set\n
+ * 	block set
+ * @param [in] nblocks\n
+ * 	number of blocks to hold
+ * @returns 0 on success, -1 on allocation failure (the set is unchanged)
+ */
+int BitStreamBlockSetReserve(BitStreamBlockSet *set, uint64_t nblocks) {
+   uint64_t  capacity = BLOCKSET_MIN_CAPACITY;
+   uint32_t  shift = 64 - 6;
+   uint64_t *keys;
+   uint32_t *stamps;
+
+   if (set == NULL)
+      return (-1);
+
+   while (capacity < 2 * nblocks) {
+      capacity <<= 1;
+      shift--;
+   }
+   if (capacity <= set->capacity)
+      return 0;
+
+   keys = (uint64_t *)malloc(2 * capacity * sizeof(uint64_t));
+   stamps = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+   if (keys == NULL || stamps == NULL) {
+      free(keys);
+      free(stamps);
+      return (-1);
+   }
+
+   free(set->keys);
+   free(set->stamps);
+   set->keys = keys;
+   set->stamps = stamps;
+   set->capacity = capacity;
+   set->shift = shift;
+   set->generation = 0;
+   return 0;
+}
+
+/**
+ * @ingroup BitStreamBlocks
+ * @fn uint64_t BitStreamBlockSetCountDuplicates(BitStreamBlockSet *set,
+ * 	const uint8_t *buf, uint64_t size, uint32_t blocksize)
+ *
+ * @brief counts the blocks of buf equal to an earlier block of buf
+ *
+ * The set is emptied first, a buffer of n blocks holding d distinct values
+ * has n - d duplicates.
+ *
+ * @param [in,out] *set\n
+ * 	block set, grown if buf has more blocks than it was sized for
+ * @param [in] *buf\n
+ * 	buffer to scan, a trailing partial block is ignored
+ * @param [in] size\n
+ * 	size of buf in bytes
+ * @param [in] blocksize\n
+ * 	size of a block in bytes, 1 to BLOCKSET_MAX_BLOCKSIZE
+ * @returns number of duplicate blocks, 0 if blocksize is out of range or the
+ * 	set cannot grow
+ */
+uint64_t BitStreamBlockSetCountDuplicates(BitStreamBlockSet *set,
+	const uint8_t *buf, uint64_t size, uint32_t blocksize) {
+   uint64_t nblocks, mask, i, dups = 0;
+
+   if (buf == NULL || blocksize == 0 || blocksize > BLOCKSET_MAX_BLOCKSIZE)
+      return 0;
+
+   nblocks = size / blocksize;
+   if (nblocks < 2 || BitStreamBlockSetReserve(set, nblocks) != 0)
+      return 0;
+
+   if (++set->generation == 0) {
+      /* stamps wrapped, older generations would look current again */
+      memset(set->stamps, 0, set->capacity * sizeof(uint32_t));
+      set->generation = 1;
+   }
+   mask = set->capacity - 1;
+
+   for (i = 0; i < nblocks; i++, buf += blocksize) {
+      uint64_t lo = 0, hi = 0, slot;
+
+      if (blocksize == 16) {
+         memcpy(&lo, buf, 8);
+         memcpy(&hi, buf + 8, 8);
+      } else if (blocksize > 8) {
+         memcpy(&lo, buf, 8);
+         memcpy(&hi, buf + 8, blocksize - 8);
+      } else {
+         memcpy(&lo, buf, blocksize);
+      }
+
+      /* linear probing, the table is at most half full */
+      for (slot = BlockSetHash(lo, hi) >> set->shift; ;
+	   slot = (slot + 1) & mask) {
+         if (set->stamps[slot] != set->generation) {
+            set->stamps[slot] = set->generation;
+            set->keys[2 * slot] = lo;
+            set->keys[2 * slot + 1] = hi;
+            break;
+         }
+         if (set->keys[2 * slot] == lo && set->keys[2 * slot + 1] == hi) {
+            dups++;
+            break;
+         }
+      }
+   }
+   return dups;
+}
+
+static pthread_key_t  BlockSetKey;
+static pthread_once_t BlockSetOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @fn void BlockSetFree(void *set)
+ *
+ * @brief releases the set of a thread when it exits
+ */
+static void BlockSetFree(void *set) {
+   BitStreamBlockSetDelete((BitStreamBlockSet *)set);
+}
+
+static void BlockSetInit(void) {
+   pthread_key_create(&BlockSetKey, BlockSetFree);
+}
+
+/**
+ * @ingroup BitStreamBlocks
+ * @fn uint64_t BitStreamCountDuplicateBlocks(BitStream *bs,
+ * 	uint32_t blocksize)
+ *
+ * @brief counts the blocks of the bit stream equal to an earlier block,
+ * 	any count above 0 on a cipher text longer than a few blocks points
+ * 	at ECB mode
+ *
+ * Each thread keeps a block set of its own across calls, so scanning a
+ * corpus record by record does not allocate once the largest record has
+ * been seen.
+ *
+ * @param [in] *bs\n
+ * 	bit stream to scan, trailing partial block is ignored
+ * @param [in] blocksize\n
+ * 	size of a block in bytes, 1 to BLOCKSET_MAX_BLOCKSIZE
+ * @returns number of duplicate blocks
+ */
+uint64_t BitStreamCountDuplicateBlocks(BitStream *bs, uint32_t blocksize) {
+   BitStreamBlockSet *set;
+
+   if (BitStreamGetArray(bs) == NULL)
+      return 0;
+
+   pthread_once(&BlockSetOnce, BlockSetInit);
+
+   set = (BitStreamBlockSet *)pthread_getspecific(BlockSetKey);
+   if (set == NULL) {
+      set = BitStreamBlockSetCreate(0);
+      if (set == NULL || pthread_setspecific(BlockSetKey, set) != 0) {
+         BitStreamBlockSetDelete(set);
+         return 0;
+      }
+   }
+
+   return BitStreamBlockSetCountDuplicates(set, bs->array,
+		   bs->nbits / BITS_PER_BYTE, blocksize);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file  BitStreamBlocks.h
+ * @brief Counting of repeated fixed size blocks, the signature of ECB mode
+ */
+#if !defined(_BITSTREAM_BLOCKS_H)
+#define _BITSTREAM_BLOCKS_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def BLOCKSET_MAX_BLOCKSIZE
+ * @brief largest block, in bytes, the block set can hold
+ */
+#define BLOCKSET_MAX_BLOCKSIZE	16
+
+/* Type Definitions */
+/**
+ * @struct BitStreamBlockSet
+ * @brief open-addressing hash set of 128 bit block values
+ *
+ * A slot is in use only if its stamp equals the current generation, so
+ * emptying the set between records is a single increment and the table is
+ * reused without being cleared or reallocated.
+ */
+typedef struct BitStreamBlockSet {
+   uint64_t *keys;       /**< two words per slot */
+   uint32_t *stamps;     /**< generation that filled the slot */
+   uint64_t  capacity;   /**< number of slots, a power of two */
+   uint32_t  shift;      /**< 64 - log2(capacity) */
+   uint32_t  generation; /**< stamp of the slots in use */
+} BitStreamBlockSet;
+
+
+BitStreamBlockSet* BitStreamBlockSetCreate(uint64_t nblocks) ;
+
+void BitStreamBlockSetDelete(BitStreamBlockSet *set) ;
+
+int BitStreamBlockSetReserve(BitStreamBlockSet *set, uint64_t nblocks) ;
+
+uint64_t BitStreamBlockSetCountDuplicates(BitStreamBlockSet *set,
+	const uint8_t *buf, uint64_t size, uint32_t blocksize) ;
+
+uint64_t BitStreamCountDuplicateBlocks(BitStream *bs, uint32_t blocksize) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_BLOCKS_H */
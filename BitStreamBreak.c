@@ -0,0 +1,288 @@
+/**
+ * @file BitStreamBreak.c
+ *
+ * @brief Implements breaking of repeating-key XOR (Vigenere over bytes)
+ *
+ * Keysizes are ranked by the normalized hamming distance between
+ * consecutive keysize blocks, english text XOR'd under the right keysize
+ * differs in fewer bits than random bytes. For the best few keysizes the
+ * cipher text is transposed into keysize columns, each column is single
+ * byte XOR and is solved from its histogram. The columns are independent
+ * and are solved in parallel.
+ *
+ * @internal BitStreamHammingDistance
+ * 	     BitStreamRankKeysizes
+ * 	     BitStreamBreakRepeatingKeyXor
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include "BitStreamBreak.h"
+#include "BitStreamBulk.h"
+#include "BitStreamParallel.h"
+#include "BitStreamScore.h"
+#include "BitStreamTranspose.h"
+
+/**
+ * @def KEYSIZE_SAMPLE_BYTES
+ * @brief cipher text sampled for ranking keysizes, the distance settles
+ * 	long before the end of a large cipher text
+ */
+#define KEYSIZE_SAMPLE_BYTES	(64 * 1024)
+
+/**
+ * @ingroup BitStreamBreak
+ * @fn uint64_t BitStreamHammingDistance(const uint8_t *x, const uint8_t *y,
+ * 	size_t size)
+ *
+ * @brief number of differing bits between two buffers
+ *
+ * @param [in] *x\n
+ * 	first buffer
+ * @param [in] *y\n
+ * 	second buffer
+ * @param [in] size\n
+ * 	length of both buffers in bytes
+ * @returns number of bit positions at which the buffers differ
+ */
+uint64_t BitStreamHammingDistance(const uint8_t *x, const uint8_t *y,
+	size_t size) {
+   uint64_t dist = 0;
+   size_t   i = 0;
+
+   for (; i + 8 <= size; i += 8) {
+      uint64_t a, b;
+
+      memcpy(&a, x + i, sizeof(a));
+      memcpy(&b, y + i, sizeof(b));
+      dist += __builtin_popcountll(a ^ b);
+   }
+   for (; i < size; i++)
+      dist += __builtin_popcount(x[i] ^ y[i]);
+
+   return dist;
+}
+
+/**
+ * @fn int KeysizeCompare(const void *a, const void *b)
+ *
+ * @brief orders keysizes by distance, smaller keysize first on ties
+ */
+static int KeysizeCompare(const void *a, const void *b) {
+   const BitStreamKeysize *x = (const BitStreamKeysize *)a;
+   const BitStreamKeysize *y = (const BitStreamKeysize *)b;
+
+   if (x->distance != y->distance)
+      return x->distance < y->distance ? -1 : 1;
+   return x->keysize < y->keysize ? -1 : (x->keysize > y->keysize);
+}
+
+/**
+ * @ingroup BitStreamBreak
+ * @fn uint32_t BitStreamRankKeysizes(BitStream *cipher, uint32_t minKeysize,
+ * 	uint32_t maxKeysize, BitStreamKeysize *ranked)
+ *
+ * @brief ranks the keysizes in [minKeysize, maxKeysize] by the normalized
+ * 	hamming distance between consecutive keysize blocks
+ *
+ * All pairs of consecutive blocks within the first KEYSIZE_SAMPLE_BYTES are
+ * compared, which is far steadier than the first couple of blocks alone
+ *
+ * @param [in] *cipher\n
+ * 	cipher bit stream
+ * @param [in] minKeysize\n
+ * 	smallest keysize to try, at least 1
+ * @param [in] maxKeysize\n
+ * 	largest keysize to try, only keysizes with two whole blocks in the
+ * 	cipher text are ranked
+ * @param [out] *ranked\n
+ * 	array of (maxKeysize - minKeysize + 1) entries, filled best first
+ * @returns number of keysizes ranked
+ */
+uint32_t BitStreamRankKeysizes(BitStream *cipher, uint32_t minKeysize,
+	uint32_t maxKeysize, BitStreamKeysize *ranked) {
+   const uint8_t *buf = BitStreamGetArray(cipher);
+   size_t         size = BitStreamGetSizeBits(cipher) / BITS_PER_BYTE;
+   size_t         sample = MIN(size, KEYSIZE_SAMPLE_BYTES);
+   uint32_t       n = 0;
+   uint32_t       k;
+
+   if (buf == NULL || minKeysize == 0)
+      return 0;
+
+   for (k = minKeysize; k <= maxKeysize && 2 * (size_t)k <= size; k++) {
+      size_t   pairs = sample / k > 1 ? sample / k - 1 : 1;
+      uint64_t dist;
+
+      dist = BitStreamHammingDistance(buf, buf + k, pairs * k);
+
+      ranked[n].keysize = k;
+      ranked[n++].distance = (float)dist / (float)(pairs * k);
+   }
+   qsort(ranked, n, sizeof(BitStreamKeysize), KeysizeCompare);
+
+   return n;
+}
+
+/**
+ * @struct ColumnSolve
+ * @brief context of solving the columns of one keysize in parallel, all
+ * 	buffers are allocated once for the largest keysize
+ */
+typedef struct ColumnSolve {
+   const uint8_t *columns;  /**< cipher text transposed into columns */
+   size_t         size;     /**< cipher text length in bytes */
+   uint32_t       keysize;
+   uint8_t       *key;      /**< solved key byte of each column */
+   float         *score;    /**< plaintext score of each column */
+} ColumnSolve;
+
+/**
+ * @fn void ColumnSolveTask(void *ctx, size_t task, unsigned worker)
+ *
+ * @brief solves one column as single byte XOR
+ */
+static void ColumnSolveTask(void *ctx, size_t task, unsigned worker) {
+   ColumnSolve *cs = (ColumnSolve *)ctx;
+   uint32_t     column = (uint32_t)task;
+   size_t       offset = BitStreamColumnOffset(cs->size, cs->keysize, column);
+   size_t       len = BitStreamColumnOffset(cs->size, cs->keysize, column + 1) -
+	   offset;
+   float        scores[256];
+   int          k, best = 0;
+
+   (void)worker;
+
+   EnglishTextScoreSingleByteXor(cs->columns + offset, len, scores);
+   for (k = 1; k < 256; k++) {
+      if (scores[k] > scores[best])
+         best = k;
+   }
+   cs->key[column] = best;
+   cs->score[column] = scores[best] * len;
+}
+
+/**
+ * @fn uint32_t KeyPeriod(const uint8_t *key, uint32_t keysize)
+ *
+ * @brief smallest period of the key, a key solved under a multiple of the
+ * 	true keysize is the true key repeated
+ */
+static uint32_t KeyPeriod(const uint8_t *key, uint32_t keysize) {
+   uint32_t p, i;
+
+   for (p = 1; p < keysize; p++) {
+      if (keysize % p)
+         continue;
+      for (i = p; i < keysize && key[i] == key[i - p]; i++)
+         ;
+      if (i == keysize)
+         return p;
+   }
+   return keysize;
+}
+
+/**
+ * @ingroup BitStreamBreak
+ * @fn BitStream* BitStreamBreakRepeatingKeyXor(BitStream *cipher,
+ * 	uint32_t minKeysize, uint32_t maxKeysize, uint32_t ntries,
+ * 	BitStream **key, unsigned nthreads)
+ *
+ * @brief recovers the key and plaintext of english text encrypted with
+ * 	repeating-key XOR
+ *
+ * The ntries best ranked keysizes are solved column by column, the key
+ * whose plaintext scores best under the character model wins. The scratch
+ * buffers (one transposed copy of the cipher text and per-column results)
+ * are allocated once for all the keysizes tried.
+ *
+ * @param [in] *cipher\n
+ * 	cipher bit stream, trailing partial byte is ignored for the analysis
+ * @param [in] minKeysize\n
+ * 	smallest keysize to consider, at least 1
+ * @param [in] maxKeysize\n
+ * 	largest keysize to consider
+ * @param [in] ntries\n
+ * 	number of best ranked keysizes to solve, at least 1
+ * @param [out] **key\n
+ * 	newly created bit stream holding the key, may be NULL if the caller
+ * 	only wants the plaintext
+ * @param [in] nthreads\n
+ * 	threads to solve the columns and decrypt on, 0 for all cpus
+ * @returns newly created bit stream holding the plaintext, NULL on failure
+ */
+BitStream* BitStreamBreakRepeatingKeyXor(BitStream *cipher,
+	uint32_t minKeysize, uint32_t maxKeysize, uint32_t ntries,
+	BitStream **key, unsigned nthreads) {
+   BitStreamKeysize *ranked = NULL;
+   BitStream        *bestKey = NULL;
+   BitStream        *clear = NULL;
+   ColumnSolve       cs;
+   uint8_t          *columns = NULL;
+   uint8_t          *bestBytes = NULL;
+   float             bestScore = 0.0f;
+   uint32_t          bestKeysize = 0;
+   uint32_t          nranked, t, j;
+
+   if (key)
+      *key = NULL;
+
+   if (cipher == NULL || minKeysize == 0 || maxKeysize < minKeysize ||
+       ntries == 0)
+      return NULL;
+
+   cs.size = BitStreamGetSizeBits(cipher) / BITS_PER_BYTE;
+
+   ranked = (BitStreamKeysize *)malloc((maxKeysize - minKeysize + 1) *
+		   sizeof(BitStreamKeysize));
+   columns = (uint8_t *)malloc(cs.size ? cs.size : 1);
+   cs.key = (uint8_t *)malloc(maxKeysize);
+   cs.score = (float *)malloc(maxKeysize * sizeof(float));
+   bestBytes = (uint8_t *)malloc(maxKeysize);
+
+   if (ranked && columns && cs.key && cs.score && bestBytes) {
+      nranked = BitStreamRankKeysizes(cipher, minKeysize, maxKeysize, ranked);
+      cs.columns = columns;
+
+      for (t = 0; t < MIN(ntries, nranked); t++) {
+         float score = 0.0f;
+
+         cs.keysize = ranked[t].keysize;
+         BitStreamTransposeBytes(BitStreamGetArray(cipher), cs.size,
+			 cs.keysize, columns);
+         BitStreamParallelFor(nthreads, cs.keysize, ColumnSolveTask, &cs);
+
+         for (j = 0; j < cs.keysize; j++)
+            score += cs.score[j];
+         score /= cs.size;
+
+         if (bestKeysize == 0 || score > bestScore) {
+            bestScore = score;
+            bestKeysize = cs.keysize;
+            memcpy(bestBytes, cs.key, cs.keysize);
+         }
+      }
+
+      if (bestKeysize) {
+         bestKeysize = KeyPeriod(bestBytes, bestKeysize);
+         bestKey = BitStreamCreate(bestKeysize * BITS_PER_BYTE);
+         if (bestKey) {
+            BitStreamCopy(bestKey, bestBytes, bestKeysize * BITS_PER_BYTE);
+            clear = BitStreamExclusiveOrParallel(cipher, bestKey, nthreads);
+         }
+      }
+   }
+
+   if (key && clear)
+      *key = bestKey;
+   else
+      BitStreamDelete(bestKey);
+
+   free(bestBytes);
+   free(cs.score);
+   free(cs.key);
+   free(columns);
+   free(ranked);
+
+   return clear;
+}
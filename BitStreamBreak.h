@@ -0,0 +1,38 @@
+/**
+ * @file  BitStreamBreak.h
+ * @brief Cryptanalysis of repeating-key XOR
+ */
+#if !defined(_BITSTREAM_BREAK_H)
+#define _BITSTREAM_BREAK_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Type Definitions */
+/**
+ * @struct BitStreamKeysize
+ * @brief a candidate keysize with its normalized hamming distance
+ */
+typedef struct BitStreamKeysize {
+   uint32_t keysize;   /**< length of the key in bytes */
+   float    distance;  /**< mean differing bits per byte between blocks */
+} BitStreamKeysize;
+
+
+uint64_t BitStreamHammingDistance(const uint8_t *x, const uint8_t *y,
+	size_t size) ;
+
+uint32_t BitStreamRankKeysizes(BitStream *cipher, uint32_t minKeysize,
+	uint32_t maxKeysize, BitStreamKeysize *ranked) ;
+
+BitStream* BitStreamBreakRepeatingKeyXor(BitStream *cipher,
+	uint32_t minKeysize, uint32_t maxKeysize, uint32_t ntries,
+	BitStream **key, unsigned nthreads) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_BREAK_H */
@@ -0,0 +1,374 @@
+/**
+ * @file BitStreamBulk.c
+ *
+ * @brief Implements parallel variants of BitStreamCopyHex(),
+ * 	BitStreamHex2Base64() and BitStreamExclusiveOr() for single very large
+ * 	buffers
+ *
+ * The input is cut at boundaries where the conversion restarts cleanly, an
+ * even number of hex digits, whole 3 byte / 4 character Base64 groups and
+ * multiples of the key length for XOR. Every task converts one such chunk
+ * with a table driven kernel into its own region of an output allocated
+ * once up front, so the threads share nothing but the input and the tables.
+ * Whatever does not fill a whole unit (an odd leading hex digit, a last
+ * partial Base64 group, a trailing partial byte) goes through the serial
+ * routines so the results are identical to theirs.
+ *
+ * @internal BitStreamHexDecode
+ * 	     BitStreamCopyHexParallel
+ * 	     BitStreamHex2Base64Parallel
+ * 	     BitStreamExclusiveOrParallel
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+
+#include "BitStreamBulk.h"
+#include "BitStreamParallel.h"
+
+/**
+ * @def BULK_KEY_SPAN
+ * @brief minimum length of the repeated key XOR'd against the input in one
+ * 	pass, short keys are repeated up to this length
+ */
+#define BULK_KEY_SPAN	4096
+
+/**
+ * @var HexDigit
+ * @brief value of each ascii character as hex digit, -1 if it is not one
+ */
+static int8_t         HexDigit[256];
+static pthread_once_t HexDigitOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @fn void HexDigitInit(void)
+ *
+ * @brief fills HexDigit
+ */
+static void HexDigitInit(void) {
+   int c;
+
+   for (c = 0; c < 256; c++)
+      HexDigit[c] = -1;
+   for (c = 0; c < 10; c++)
+      HexDigit['0' + c] = (int8_t)c;
+   for (c = 0; c < 6; c++) {
+      HexDigit['a' + c] = (int8_t)(10 + c);
+      HexDigit['A' + c] = (int8_t)(10 + c);
+   }
+}
+
+/**
+ * @var Base64Digit
+ * @brief Base64 character of each 6 bit value
+ */
+static const char Base64Digit[64] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * @var Base64Pair
+ * @brief the two Base64 characters of each 12 bit value, in memory order
+ */
+static uint8_t        Base64Pair[4096][2];
+static pthread_once_t Base64PairOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @fn void Base64PairInit(void)
+ *
+ * @brief fills Base64Pair from Base64Digit
+ */
+static void Base64PairInit(void) {
+   unsigned v;
+
+   for (v = 0; v < 4096; v++) {
+      Base64Pair[v][0] = Base64Digit[v >> 6];
+      Base64Pair[v][1] = Base64Digit[v & 0x3F];
+   }
+}
+
+/**
+ * @struct BulkJob
+ * @brief context of one parallel conversion, task i converts the units
+ * 	[i * units, (i + 1) * units) of [0, size)
+ */
+typedef struct BulkJob {
+   const uint8_t *in;
+   uint8_t       *out;
+   size_t         size;     /**< units to convert */
+   size_t         units;    /**< units per task */
+   const uint8_t *key;      /**< XOR key repeated to span bytes */
+   size_t         span;
+   int            bad;      /**< set when invalid input was seen (atomic) */
+} BulkJob;
+
+/**
+ * @fn void HexTask(void *ctx, size_t task, unsigned worker)
+ *
+ * @brief decodes one chunk of hex digit pairs, a unit is one output byte
+ */
+static void HexTask(void *ctx, size_t task, unsigned worker) {
+   BulkJob *job = (BulkJob *)ctx;
+   size_t   i = task * job->units;
+   size_t   end = MIN(i + job->units, job->size);
+
+   (void)worker;
+
+   if (BitStreamHexDecode((const char *)job->in + 2 * i, 2 * (end - i),
+			   job->out + i) < 0)
+      __atomic_store_n(&job->bad, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @fn void Base64Task(void *ctx, size_t task, unsigned worker)
+ *
+ * @brief encodes one chunk of whole Base64 groups, a unit is one group of
+ * 	3 input bytes and 4 output characters
+ */
+static void Base64Task(void *ctx, size_t task, unsigned worker) {
+   BulkJob       *job = (BulkJob *)ctx;
+   size_t         i = task * job->units;
+   size_t         end = MIN(i + job->units, job->size);
+   const uint8_t *in = job->in + 3 * i;
+   uint8_t       *out = job->out + 4 * i;
+
+   (void)worker;
+
+   for (; i < end; i++, in += 3, out += 4) {
+      uint32_t group = (uint32_t)in[0] << 16 | (uint32_t)in[1] << 8 | in[2];
+
+      memcpy(out, Base64Pair[group >> 12], 2);
+      memcpy(out + 2, Base64Pair[group & 0xFFF], 2);
+   }
+}
+
+/**
+ * @fn void XorTask(void *ctx, size_t task, unsigned worker)
+ *
+ * @brief XORs one chunk against the repeated key, a unit is one byte and
+ * 	chunks start at multiples of the repeated key length
+ */
+static void XorTask(void *ctx, size_t task, unsigned worker) {
+   BulkJob       *job = (BulkJob *)ctx;
+   size_t         i = task * job->units;
+   size_t         end = MIN(i + job->units, job->size);
+
+   (void)worker;
+
+   while (i < end) {
+      size_t n = MIN(job->span, end - i);
+      size_t k = 0;
+
+      for (; k + 8 <= n; k += 8) {
+         uint64_t x, y;
+
+         memcpy(&x, job->in + i + k, sizeof(x));
+         memcpy(&y, job->key + k, sizeof(y));
+         x ^= y;
+         memcpy(job->out + i + k, &x, sizeof(x));
+      }
+      for (; k < n; k++)
+         job->out[i + k] = job->in[i + k] ^ job->key[k];
+      i += n;
+   }
+}
+
+/**
+ * @ingroup BitStreamBulk
+ * @fn int64_t BitStreamHexDecode(const char *inp, size_t len, uint8_t *out)
+ *
+ * @brief converts len HEX ascii characters into (len + 1) / 2 bytes
+ *
+ * As with BitStreamCopyHex() an odd leading digit makes a byte of its own.
+ * The input need not be NULL terminated and is checked, so it suits
+ * records cut from a larger buffer.
+ *
+ * @param [in] *inp\n
+ * 	hex characters
+ * @param [in] len\n
+ * 	number of characters to convert
+ * @param [out] *out\n
+ * 	receives the bytes
+ * @returns number of bytes written, -1 if the input holds a character that
+ * 	is not a hex digit (out is then partly written)
+ */
+int64_t BitStreamHexDecode(const char *inp, size_t len, uint8_t *out) {
+   const uint8_t *in = (const uint8_t *)inp;
+   size_t         i, j = 0;
+   int            bad = 0;
+
+   pthread_once(&HexDigitOnce, HexDigitInit);
+   if (len % 2) {
+      bad = HexDigit[in[0]];
+      out[j++] = (uint8_t)bad;
+   }
+   for (i = len % 2; i < len; i += 2) {
+      int hi = HexDigit[in[i]];
+      int lo = HexDigit[in[i + 1]];
+
+      bad |= hi | lo;
+      out[j++] = (uint8_t)((unsigned)hi << 4 | (unsigned)lo);
+   }
+   return bad < 0 ? -1 : (int64_t)j;
+}
+
+/**
+ * @ingroup BitStreamBulk
+ * @fn uint64_t BitStreamCopyHexParallel(BitStream* bs, const char* inp,
+ * 	unsigned nthreads)
+ *
+ * @brief parallel BitStreamCopyHex(), fills the bytes from input HEX ascii
+ * 	buffer into bit stream
+ *
+ * As with BitStreamCopyHex() an odd leading digit makes a byte of its own.
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in
+ * @param [in] *inp\n
+ * 	NULL terminated hex characters
+ * @param [in] nthreads\n
+ * 	threads to use, 0 for all cpus
+ * @returns number of bits copied into bit stream, 0 if the input holds a
+ * 	character that is not a hex digit (the stream content is then
+ * 	undefined)
+ */
+uint64_t BitStreamCopyHexParallel(BitStream* bs, const char* inp,
+	unsigned nthreads) {
+   size_t  len = strlen(inp);
+   size_t  odd = len % 2;
+   BulkJob job = { 0 };
+
+   if (bs == NULL)
+      return ((len + 1) >> 1) * BITS_PER_BYTE;
+
+   BitStreamRealloc(bs, NULL, ((len + 1) >> 1) * BITS_PER_BYTE);
+   if (bs->array == NULL)
+      return 0;
+
+   if (odd && BitStreamHexDecode(inp, 1, bs->array) < 0)
+      return 0;
+
+   job.in = (const uint8_t *)inp + odd;
+   job.out = bs->array + odd;
+   job.size = len / 2;
+   job.units = BULK_TASK_BYTES;
+   BitStreamParallelFor(nthreads, (job.size + job.units - 1) / job.units,
+		   HexTask, &job);
+
+   return job.bad ? 0 : bs->nbits;
+}
+
+/**
+ * @ingroup BitStreamBulk
+ * @fn BitStream* BitStreamHex2Base64Parallel(BitStream *bs,
+ * 	unsigned nthreads)
+ *
+ * @brief parallel BitStreamHex2Base64(), converts a bit stream into the
+ * 	Base64 characters of its bits
+ *
+ * @param [in] *bs\n
+ * 	bit stream to convert
+ * @param [in] nthreads\n
+ * 	threads to use, 0 for all cpus
+ * @returns pointer to Base64 bit stream converted from input, NULL in case
+ * 	of any error
+ */
+BitStream* BitStreamHex2Base64Parallel(BitStream *bs, unsigned nthreads) {
+   BitStream *out;
+   BulkJob    job = { 0 };
+   uint64_t   offset, outset;
+   uint8_t    byte;
+
+   if (bs == NULL)
+      return NULL;
+
+   out = BitStreamCreate((bs->nbits * 4) / 3);
+   if (out == NULL)
+      return NULL;
+
+   pthread_once(&Base64PairOnce, Base64PairInit);
+
+   job.in = bs->array;
+   job.out = out->array;
+   job.size = bs->nbits / 24;
+   job.units = BULK_TASK_BYTES / 3;
+   BitStreamParallelFor(nthreads, (job.size + job.units - 1) / job.units,
+		   Base64Task, &job);
+
+   /* the last partial group as BitStreamHex2Base64() encodes it */
+   offset = job.size * 24;
+   outset = job.size * 4 * BITS_PER_BYTE;
+   while (BitStreamGetByte(bs, &byte, offset, 6) > 0) {
+      if (BitStreamPutByte(out, Base64Digit[byte], outset, BITS_PER_BYTE) <= 0)
+         break;
+      outset += BITS_PER_BYTE;
+      offset += 6;
+   }
+   return out;
+}
+
+/**
+ * @ingroup BitStreamBulk
+ * @fn BitStream* BitStreamExclusiveOrParallel(BitStream *bx, BitStream *by,
+ * 	unsigned nthreads)
+ *
+ * @brief parallel BitStreamExclusiveOr(), XORs bx against by repeated over
+ * 	its length
+ *
+ * A key whose length is not a whole number of bytes falls back to
+ * BitStreamExclusiveOr().
+ *
+ * @param [in] *bx\n
+ *   	Bitstream x
+ * @param [in] *by\n
+ *   	Bitstream y, the key
+ * @param [in] nthreads\n
+ * 	threads to use, 0 for all cpus
+ * @returns Pointer to object of type BitStream holding the result, NULL on
+ * 	error
+ */
+BitStream* BitStreamExclusiveOrParallel(BitStream *bx, BitStream *by,
+	unsigned nthreads) {
+   BitStream *bz;
+   BulkJob    job = { 0 };
+   uint8_t   *key;
+   size_t     keylen, i;
+   uint64_t   offset;
+   uint8_t    bytex, bytey;
+
+   if (bx == NULL || by == NULL || by->nbits == 0)
+      return NULL;
+   if (by->nbits % BITS_PER_BYTE)
+      return BitStreamExclusiveOr(bx, by);
+
+   keylen = by->nbits / BITS_PER_BYTE;
+   job.span = keylen * ((BULK_KEY_SPAN + keylen - 1) / keylen);
+
+   bz = BitStreamCreate(bx->nbits);
+   key = (uint8_t *)malloc(job.span);
+   if (bz == NULL || key == NULL) {
+      BitStreamDelete(bz);
+      free(key);
+      return NULL;
+   }
+   for (i = 0; i < job.span; i += keylen)
+      memcpy(key + i, by->array, keylen);
+
+   job.in = bx->array;
+   job.out = bz->array;
+   job.size = bx->nbits / BITS_PER_BYTE;
+   job.key = key;
+   job.units = job.span > BULK_TASK_BYTES ? job.span :
+	   BULK_TASK_BYTES / job.span * job.span;
+   BitStreamParallelFor(nthreads, (job.size + job.units - 1) / job.units,
+		   XorTask, &job);
+
+   /* a trailing partial byte as BitStreamExclusiveOr() handles it */
+   offset = job.size * BITS_PER_BYTE;
+   if (BitStreamGetByte(bx, &bytex, offset, BITS_PER_BYTE) > 0 &&
+       BitStreamGetByte(by, &bytey, offset % by->nbits, BITS_PER_BYTE))
+      BitStreamPutByte(bz, bytex ^ bytey, offset, BITS_PER_BYTE);
+
+   free(key);
+   return bz;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file  BitStreamBulk.h
+ * @brief Chunk-parallel hex decoding, Base64 encoding and XOR of very large
+ * 	  buffers
+ */
+#if !defined(_BITSTREAM_BULK_H)
+#define _BITSTREAM_BULK_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def BULK_TASK_BYTES
+ * @brief input bytes handed to a thread at a time, large enough for the
+ * 	pool overhead to vanish, small enough to balance the threads
+ */
+#define BULK_TASK_BYTES	(1U << 20)
+
+
+int64_t BitStreamHexDecode(const char *inp, size_t len, uint8_t *out) ;
+
+uint64_t BitStreamCopyHexParallel(BitStream* bs, const char* inp,
+	unsigned nthreads) ;
+
+BitStream* BitStreamHex2Base64Parallel(BitStream *bs, unsigned nthreads) ;
+
+BitStream* BitStreamExclusiveOrParallel(BitStream *bx, BitStream *by,
+	unsigned nthreads) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_BULK_H */
@@ -0,0 +1,325 @@
+/**
+ * @file BitStreamCorpus.c
+ *
+ * @brief Implements loading of record corpora and the key searches over them
+ *
+ * The searches do not print anything, they feed a BitStreamTopK collector
+ * and the caller decrypts and renders the few candidates kept once the
+ * search is over.
+ *
+ * @internal BitStreamCorpusLoadHex
+ * 	     BitStreamCorpusDelete
+ * 	     BitStreamSingleByteXorSearch
+ * 	     BitStreamCorpusSingleByteXor
+ * 	     BitStreamCorpusDetectEcb
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include "BitStreamBlocks.h"
+#include "BitStreamBulk.h"
+#include "BitStreamCorpus.h"
+#include "BitStreamParallel.h"
+#include "BitStreamScore.h"
+
+/**
+ * @def CORPUS_TASK_RECORDS
+ * @brief number of records in one work item of the parallel searches
+ */
+#define CORPUS_TASK_RECORDS	64
+
+/**
+ * @fn BitStream* CorpusDecodeHex(const char *line, size_t len)
+ *
+ * @brief decodes one line, NULL if it is empty or not hex
+ *
+ * BitStreamCreateHex() asserts on bad input, a single stray line must not
+ * abort the load, so the line goes through the checked decoder the
+ * staged pipeline uses.
+ */
+static BitStream* CorpusDecodeHex(const char *line, size_t len) {
+   BitStream *record;
+
+   if (len == 0)
+      return NULL;
+
+   record = BitStreamCreate((uint64_t)(len + 1) / 2 * BITS_PER_BYTE);
+   if (record && BitStreamHexDecode(line, len, record->array) < 0) {
+      BitStreamDelete(record);
+      record = NULL;
+   }
+   return record;
+}
+
+/**
+ * @ingroup BitStreamCorpus
+ * @fn BitStreamCorpus* BitStreamCorpusLoadHex(const char *path)
+ *
+ * @brief loads a file holding one HEX ascii record per line
+ *
+ * Lines that are empty or not hex keep their index with a NULL record so
+ * candidates can be reported by line number, the staged pipeline skips the
+ * same lines.
+ *
+ * @param [in] *path\n
+ * 	file to load
+ * @returns pointer to newly created corpus, NULL on failure
+ */
+BitStreamCorpus* BitStreamCorpusLoadHex(const char *path) {
+   BitStreamCorpus *corpus = NULL;
+   FILE            *fp = NULL;
+   char            *line = NULL;
+   size_t           linecap = 0;
+   ssize_t          len;
+
+   fp = fopen(path, "r");
+   if (fp == NULL)
+      return NULL;
+
+   corpus = (BitStreamCorpus *)calloc(1, sizeof(BitStreamCorpus));
+
+   while (corpus != NULL && (len = getline(&line, &linecap, fp)) >= 0) {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+         line[--len] = '\0';
+
+      if (corpus->count == corpus->capacity) {
+         uint64_t    capacity = corpus->capacity ? 2 * corpus->capacity : 256;
+         BitStream **records = (BitStream **)realloc(corpus->records,
+			 capacity * sizeof(BitStream *));
+         if (records == NULL) {
+            BitStreamCorpusDelete(corpus);
+            corpus = NULL;
+            break;
+         }
+         corpus->records = records;
+         corpus->capacity = capacity;
+      }
+      corpus->records[corpus->count++] = CorpusDecodeHex(line, (size_t)len);
+   }
+   free(line);
+   fclose(fp);
+
+   return corpus;
+}
+
+/**
+ * @ingroup BitStreamCorpus
+ * @fn void BitStreamCorpusDelete(BitStreamCorpus *corpus)
+ *
+ * @brief Deletes the corpus along with all its records
+ *
+ * @param [in] *corpus\n
+ * 	corpus to delete, may be NULL
+ * @returns none
+ */
+void BitStreamCorpusDelete(BitStreamCorpus *corpus) {
+   uint64_t i;
+
+   if (corpus != NULL) {
+      for (i = 0; i < corpus->count; i++)
+         BitStreamDelete(corpus->records[i]);
+      free(corpus->records);
+      free(corpus);
+   }
+}
+
+/**
+ * @ingroup BitStreamCorpus
+ * @fn uint32_t BitStreamSingleByteXorSearch(BitStream *cipher, uint64_t line,
+ * 	BitStreamTopK *topk)
+ *
+ * @brief tries every single byte key on the cipher stream and offers the
+ * 	plaintexts to the collector
+ *
+ * Keys are tried in the order the character model ranks them, which is
+ * cheap to compute from the cipher histogram. The likely keys come first and
+ * raise the collector threshold, so the trigram scoring of the remaining
+ * keys is abandoned within the first few characters.
+ *
+ * @param [in] *cipher\n
+ * 	cipher bit stream, trailing partial byte is ignored
+ * @param [in] line\n
+ * 	record index reported with the candidates
+ * @param [in,out] *topk\n
+ * 	collector to offer the candidates to
+ * @returns number of candidates kept by the collector
+ */
+uint32_t BitStreamSingleByteXorSearch(BitStream *cipher, uint64_t line,
+	BitStreamTopK *topk) {
+   const uint8_t *buf = BitStreamGetArray(cipher);
+   size_t         size = BitStreamGetSizeBits(cipher) / BITS_PER_BYTE;
+   float          unigram[256];
+   uint8_t        order[256];
+   uint32_t       kept = 0;
+   int            i, j;
+
+   if (buf == NULL || size == 0)
+      return 0;
+
+   EnglishTextScoreSingleByteXor(buf, size, unigram);
+
+   /* insertion sort of the keys, best character model score first */
+   for (i = 0; i < 256; i++) {
+      for (j = i; j > 0 && unigram[order[j - 1]] < unigram[i]; j--)
+         order[j] = order[j - 1];
+      order[j] = i;
+   }
+
+   for (i = 0; i < 256; i++) {
+      float score = EnglishTextNgramScoreXor(buf, size, order[i],
+		      BitStreamTopKThreshold(topk));
+
+      if (score != NGRAM_SCORE_PRUNED)
+         kept += BitStreamTopKOffer(topk, score, order[i], line);
+   }
+   return kept;
+}
+
+/**
+ * @struct CorpusSearch
+ * @brief context of a parallel search over a corpus
+ */
+typedef struct CorpusSearch {
+   BitStreamCorpus  *corpus;
+   BitStreamTopK   **local;   /**< one collector per worker */
+   uint32_t          blocksize;
+} CorpusSearch;
+
+/**
+ * @fn void CorpusSingleByteXorTask(void *ctx, size_t task, unsigned worker)
+ *
+ * @brief searches CORPUS_TASK_RECORDS records into the worker's collector
+ */
+static void CorpusSingleByteXorTask(void *ctx, size_t task, unsigned worker) {
+   CorpusSearch *search = (CorpusSearch *)ctx;
+   uint64_t      first = task * CORPUS_TASK_RECORDS;
+   uint64_t      last = MIN(first + CORPUS_TASK_RECORDS, search->corpus->count);
+   uint64_t      i;
+
+   for (i = first; i < last; i++) {
+      if (search->corpus->records[i])
+         BitStreamSingleByteXorSearch(search->corpus->records[i], i,
+			 search->local[worker]);
+   }
+}
+
+/**
+ * @fn void CorpusDetectEcbTask(void *ctx, size_t task, unsigned worker)
+ *
+ * @brief counts duplicate blocks of CORPUS_TASK_RECORDS records into the
+ * 	worker's collector
+ */
+static void CorpusDetectEcbTask(void *ctx, size_t task, unsigned worker) {
+   CorpusSearch *search = (CorpusSearch *)ctx;
+   uint64_t      first = task * CORPUS_TASK_RECORDS;
+   uint64_t      last = MIN(first + CORPUS_TASK_RECORDS, search->corpus->count);
+   uint64_t      i, dups;
+
+   for (i = first; i < last; i++) {
+      dups = BitStreamCountDuplicateBlocks(search->corpus->records[i],
+		      search->blocksize);
+      if (dups)
+         BitStreamTopKOffer(search->local[worker], (float)dups,
+			 search->blocksize, i);
+   }
+}
+
+/**
+ * @fn int CorpusSearchRun(CorpusSearch *search, BitStreamTopK *topk,
+ * 	unsigned nthreads, BitStreamTask fn)
+ *
+ * @brief runs fn over the records of the corpus in tasks of
+ * 	CORPUS_TASK_RECORDS records
+ *
+ * Each thread collects into a collector of its own with the capacity and
+ * floor of topk, they are merged into topk at the end
+ *
+ * @returns 0 on success, -1 on allocation failure
+ */
+static int CorpusSearchRun(CorpusSearch *search, BitStreamTopK *topk,
+	unsigned nthreads, BitStreamTask fn) {
+   unsigned i, n;
+   int      ret = 0;
+
+   n = BitStreamParallelThreads(nthreads);
+
+   search->local = (BitStreamTopK **)calloc(n, sizeof(BitStreamTopK *));
+   if (search->local == NULL)
+      return (-1);
+
+   for (i = 0; i < n && ret == 0; i++) {
+      search->local[i] = BitStreamTopKCreate(topk->capacity, topk->floor);
+      if (search->local[i] == NULL)
+         ret = -1;
+   }
+
+   if (ret == 0) {
+      BitStreamParallelFor(n, (search->corpus->count + CORPUS_TASK_RECORDS -
+			      1) / CORPUS_TASK_RECORDS, fn, search);
+      for (i = 0; i < n; i++)
+         BitStreamTopKMerge(topk, search->local[i]);
+   }
+
+   for (i = 0; i < n; i++)
+      BitStreamTopKDelete(search->local[i]);
+   free(search->local);
+
+   return ret;
+}
+
+/**
+ * @ingroup BitStreamCorpus
+ * @fn int BitStreamCorpusSingleByteXor(BitStreamCorpus *corpus,
+ * 	BitStreamTopK *topk, unsigned nthreads)
+ *
+ * @brief runs the single byte XOR key search over every record of the corpus
+ *
+ * @param [in] *corpus\n
+ * 	records to search
+ * @param [in,out] *topk\n
+ * 	collector receiving the best candidates over the whole corpus
+ * @param [in] nthreads\n
+ * 	threads to use, 0 for all cpus
+ * @returns 0 on success, -1 on allocation failure
+ */
+int BitStreamCorpusSingleByteXor(BitStreamCorpus *corpus, BitStreamTopK *topk,
+	unsigned nthreads) {
+   CorpusSearch search = { corpus, NULL, 0 };
+
+   if (corpus == NULL || topk == NULL)
+      return (-1);
+
+   return CorpusSearchRun(&search, topk, nthreads, CorpusSingleByteXorTask);
+}
+
+/**
+ * @ingroup BitStreamCorpus
+ * @fn int BitStreamCorpusDetectEcb(BitStreamCorpus *corpus,
+ * 	uint32_t blocksize, BitStreamTopK *topk, unsigned nthreads)
+ *
+ * @brief looks for records encrypted in ECB mode, that is records holding
+ * 	the same block more than once
+ *
+ * Records with duplicate blocks are offered with the number of duplicates
+ * as score and blocksize as key.
+ *
+ * @param [in] *corpus\n
+ * 	records to search
+ * @param [in] blocksize\n
+ * 	cipher block size in bytes (16 for AES), 1 to BLOCKSET_MAX_BLOCKSIZE
+ * @param [in,out] *topk\n
+ * 	collector receiving the records with the most duplicates
+ * @param [in] nthreads\n
+ * 	threads to use, 0 for all cpus
+ * @returns 0 on success, -1 on invalid arguments or allocation failure
+ */
+int BitStreamCorpusDetectEcb(BitStreamCorpus *corpus, uint32_t blocksize,
+	BitStreamTopK *topk, unsigned nthreads) {
+   CorpusSearch search = { corpus, NULL, blocksize };
+
+   if (corpus == NULL || topk == NULL || blocksize == 0 ||
+       blocksize > BLOCKSET_MAX_BLOCKSIZE)
+      return (-1);
+
+   return CorpusSearchRun(&search, topk, nthreads, CorpusDetectEcbTask);
+}
@@ -0,0 +1,44 @@
+/**
+ * @file  BitStreamCorpus.h
+ * @brief Collections of records (one bit stream per line of input) and the
+ * 	key searches run over them
+ */
+#if !defined(_BITSTREAM_CORPUS_H)
+#define _BITSTREAM_CORPUS_H
+
+#include "BitStream.h"
+#include "BitStreamTopK.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Type Definitions */
+/**
+ * @struct BitStreamCorpus
+ * @brief records loaded from a file, record i holds line i of the file
+ */
+typedef struct BitStreamCorpus {
+   BitStream **records;  /**< NULL for lines that did not decode */
+   uint64_t    count;    /**< number of records (lines) */
+   uint64_t    capacity; /**< allocated size of records */
+} BitStreamCorpus;
+
+
+BitStreamCorpus* BitStreamCorpusLoadHex(const char *path) ;
+
+void BitStreamCorpusDelete(BitStreamCorpus *corpus) ;
+
+uint32_t BitStreamSingleByteXorSearch(BitStream *cipher, uint64_t line,
+	BitStreamTopK *topk) ;
+
+int BitStreamCorpusSingleByteXor(BitStreamCorpus *corpus, BitStreamTopK *topk,
+	unsigned nthreads) ;
+
+int BitStreamCorpusDetectEcb(BitStreamCorpus *corpus, uint32_t blocksize,
+	BitStreamTopK *topk, unsigned nthreads) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_CORPUS_H */
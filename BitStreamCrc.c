@@ -0,0 +1,525 @@
+/**
+ * @file BitStreamCrc.c
+ *
+ * @brief Implements CRC32 and CRC32C over bytes and bit lengths
+ *
+ * Both are reflected CRCs: each byte is fed from its least significant bit
+ * up, the register starts at all ones and is inverted at the end, so the
+ * byte oriented results are the usual ones (zlib crc32(), iSCSI crc32c). A
+ * trailing partial byte holds its r bits in the most significant positions
+ * of the byte (the bit stream is MSB first), they are fed as the r bit value
+ * BitStreamGetByte() would return, least significant bit first.
+ *
+ * Three implementations, picked at runtime:
+ * 	- slicing-by-8: eight 256 entry tables, 8 bytes per step
+ * 	- SSE4.2: the crc32 instruction, CRC32C polynomial only
+ * 	- PCLMULQDQ: the buffer is folded 64 bytes at a time with carry-less
+ * 	  multiplies by x^n mod P, down to a 16 byte remainder whose CRC the
+ * 	  tables (or crc32 instruction) compute
+ *
+ * The fold constants and the combine operator come from the same GF(2)
+ * arithmetic, computed when the tables are built.
+ *
+ * @internal BitStreamCrcSelect
+ * 	     BitStreamCrc32Update
+ * 	     BitStreamCrc32UpdateBits
+ * 	     BitStreamCrc32Combine
+ * 	     BitStreamCrc32
+ * 	     BitStreamCrc32cUpdate
+ * 	     BitStreamCrc32cUpdateBits
+ * 	     BitStreamCrc32cCombine
+ * 	     BitStreamCrc32c
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+
+#include "BitStreamCrc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRC_HAVE_X86	1
+#include <immintrin.h>
+#include <wmmintrin.h>
+#endif
+
+/**
+ * @def CRC32_POLY
+ * @brief IEEE 802.3 polynomial, reflected
+ */
+#define CRC32_POLY	0xedb88320u
+
+/**
+ * @def CRC32C_POLY
+ * @brief Castagnoli polynomial, reflected
+ */
+#define CRC32C_POLY	0x82f63b78u
+
+/**
+ * @def CRC_FOLD_MIN
+ * @brief smallest buffer folded with carry-less multiplies
+ */
+#define CRC_FOLD_MIN	64
+
+/**
+ * @struct CrcModel
+ * @brief tables and constants of one polynomial
+ */
+typedef struct CrcModel {
+   uint32_t poly;
+   uint32_t table[8][256];   /**< slicing-by-8, table[0] is the bytewise one */
+   uint64_t fold512[2];      /**< constants folding 4 blocks by 512 bits */
+   uint64_t fold128[2];      /**< constants folding 1 block by 128 bits */
+   int      sse42;           /**< crc32 instruction computes this CRC */
+} CrcModel;
+
+static CrcModel       Crc32 = { .poly = CRC32_POLY };
+static CrcModel       Crc32c = { .poly = CRC32C_POLY };
+static pthread_once_t CrcOnce = PTHREAD_ONCE_INIT;
+
+/* implementation in use */
+static int            CrcUseSse42 = 0;
+static int            CrcUsePclmul = 0;
+
+/**
+ * @fn uint32_t CrcMultModP(uint32_t a, uint32_t b, uint32_t poly)
+ *
+ * @brief a(x) * b(x) mod P(x), operands reflected (bit 31 is x^0)
+ */
+static uint32_t CrcMultModP(uint32_t a, uint32_t b, uint32_t poly) {
+   uint32_t m = 1u << 31, p = 0;
+
+   for (;;) {
+      if (a & m) {
+         p ^= b;
+         if ((a & (m - 1)) == 0)
+            break;
+      }
+      m >>= 1;
+      b = b & 1 ? (b >> 1) ^ poly : b >> 1;
+   }
+   return p;
+}
+
+/**
+ * @fn uint32_t CrcXPowModP(uint64_t n, uint32_t poly)
+ *
+ * @brief x^n mod P(x), reflected
+ */
+static uint32_t CrcXPowModP(uint64_t n, uint32_t poly) {
+   uint32_t p = 1u << 31;      /* x^0 */
+   uint32_t sq = 1u << 30;     /* x^1, squared at each bit of n */
+
+   while (n) {
+      if (n & 1)
+         p = CrcMultModP(sq, p, poly);
+      sq = CrcMultModP(sq, sq, poly);
+      n >>= 1;
+   }
+   return p;
+}
+
+/**
+ * @fn uint64_t CrcFoldConstant(uint64_t n, uint32_t poly)
+ *
+ * @brief x^n mod P(x), reflected and shifted left by 1, the form taken by
+ * 	the 64x64 carry-less multiply of reflected operands
+ */
+static uint64_t CrcFoldConstant(uint64_t n, uint32_t poly) {
+   return (uint64_t)CrcXPowModP(n, poly) << 1;
+}
+
+/**
+ * @fn void CrcModelInit(CrcModel *m)
+ *
+ * @brief builds the tables and fold constants of one polynomial
+ */
+static void CrcModelInit(CrcModel *m) {
+   uint32_t i, k, c;
+
+   for (i = 0; i < 256; i++) {
+      c = i;
+      for (k = 0; k < 8; k++)
+         c = c & 1 ? (c >> 1) ^ m->poly : c >> 1;
+      m->table[0][i] = c;
+   }
+   for (i = 0; i < 256; i++)
+      for (k = 1; k < 8; k++)
+         m->table[k][i] = (m->table[k - 1][i] >> 8) ^
+		 m->table[0][m->table[k - 1][i] & 0xff];
+
+   /*
+    * folding a 128 bit block forward by D bits multiplies its first
+    * (lower addressed) 64 bits by x^(D+32) and its last 64 bits by x^(D-32)
+    */
+   m->fold512[0] = CrcFoldConstant(512 + 32, m->poly);
+   m->fold512[1] = CrcFoldConstant(512 - 32, m->poly);
+   m->fold128[0] = CrcFoldConstant(128 + 32, m->poly);
+   m->fold128[1] = CrcFoldConstant(128 - 32, m->poly);
+}
+
+/**
+ * @fn BitStreamCrcImpl CrcSelect(BitStreamCrcImpl impl)
+ *
+ * @brief switches to the best implementation at most as fast as impl
+ */
+static BitStreamCrcImpl CrcSelect(BitStreamCrcImpl impl) {
+   BitStreamCrcImpl selected = BITSTREAM_CRC_TABLE;
+   int              sse42 = 0, pclmul = 0;
+
+#if defined(CRC_HAVE_X86)
+   if (impl != BITSTREAM_CRC_TABLE && __builtin_cpu_supports("sse4.2")) {
+      sse42 = 1;
+      selected = BITSTREAM_CRC_SSE42;
+   }
+   if ((impl == BITSTREAM_CRC_AUTO || impl == BITSTREAM_CRC_PCLMUL) &&
+       __builtin_cpu_supports("pclmul")) {
+      pclmul = 1;
+      selected = BITSTREAM_CRC_PCLMUL;
+   }
+#endif
+   CrcUseSse42 = sse42;
+   CrcUsePclmul = pclmul;
+   return selected;
+}
+
+static void CrcInit(void) {
+   CrcModelInit(&Crc32);
+   CrcModelInit(&Crc32c);
+   Crc32c.sse42 = 1;
+   CrcSelect(BITSTREAM_CRC_AUTO);
+}
+
+/**
+ * @fn uint32_t CrcTableUpdate(const CrcModel *m, uint32_t crc,
+ * 	const uint8_t *buf, size_t size)
+ *
+ * @brief runs the (non inverted) register over buf with slicing-by-8
+ */
+static uint32_t CrcTableUpdate(const CrcModel *m, uint32_t crc,
+	const uint8_t *buf, size_t size) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   for (; size >= 8; size -= 8, buf += 8) {
+      uint64_t w;
+
+      memcpy(&w, buf, 8);
+      w ^= crc;
+      crc = m->table[7][w & 0xff] ^ m->table[6][(w >> 8) & 0xff] ^
+	    m->table[5][(w >> 16) & 0xff] ^ m->table[4][(w >> 24) & 0xff] ^
+	    m->table[3][(w >> 32) & 0xff] ^ m->table[2][(w >> 40) & 0xff] ^
+	    m->table[1][(w >> 48) & 0xff] ^ m->table[0][w >> 56];
+   }
+#endif
+   for (; size; size--, buf++)
+      crc = (crc >> 8) ^ m->table[0][(crc ^ *buf) & 0xff];
+   return crc;
+}
+
+#if defined(CRC_HAVE_X86)
+/**
+ * @fn uint32_t CrcSse42Update(uint32_t crc, const uint8_t *buf, size_t size)
+ *
+ * @brief runs the CRC32C register over buf with the crc32 instruction
+ */
+static __attribute__((target("sse4.2"))) uint32_t CrcSse42Update(uint32_t crc,
+	const uint8_t *buf, size_t size) {
+#if defined(__x86_64__)
+   uint64_t c = crc;
+
+   for (; size >= 8; size -= 8, buf += 8) {
+      uint64_t w;
+
+      memcpy(&w, buf, 8);
+      c = _mm_crc32_u64(c, w);
+   }
+   crc = (uint32_t)c;
+#endif
+   for (; size; size--, buf++)
+      crc = _mm_crc32_u8(crc, *buf);
+   return crc;
+}
+
+/**
+ * @fn __m128i CrcFold(__m128i x, __m128i k, __m128i next)
+ *
+ * @brief moves block x forward by the distance k was built for, onto next
+ */
+static __attribute__((target("pclmul,sse2"))) inline __m128i CrcFold(__m128i x,
+	__m128i k, __m128i next) {
+   return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+			   _mm_clmulepi64_si128(x, k, 0x11)), next);
+}
+
+/**
+ * @fn size_t CrcPclmulFold(const CrcModel *m, uint32_t *crc,
+ * 	const uint8_t *buf, size_t size)
+ *
+ * @brief folds buf (at least CRC_FOLD_MIN bytes) down to a 16 byte block
+ * 	holding the same remainder, and runs the register over it
+ *
+ * @returns bytes of buf consumed, a multiple of 16
+ */
+static __attribute__((target("pclmul,sse2"))) size_t CrcPclmulFold(
+	const CrcModel *m, uint32_t *crc, const uint8_t *buf, size_t size) {
+   const __m128i *p = (const __m128i *)buf;
+   __m128i        k4 = _mm_loadu_si128((const __m128i *)m->fold512);
+   __m128i        k1 = _mm_loadu_si128((const __m128i *)m->fold128);
+   __m128i        x0, x1, x2, x3;
+   uint8_t        rem[16];
+   size_t         n = size / 16;
+
+   /* the register is the first 32 bits of the message to fold */
+   x0 = _mm_xor_si128(_mm_loadu_si128(p), _mm_cvtsi32_si128((int)*crc));
+   x1 = _mm_loadu_si128(p + 1);
+   x2 = _mm_loadu_si128(p + 2);
+   x3 = _mm_loadu_si128(p + 3);
+   p += 4;
+   n -= 4;
+
+   for (; n >= 4; n -= 4, p += 4) {
+      x0 = CrcFold(x0, k4, _mm_loadu_si128(p));
+      x1 = CrcFold(x1, k4, _mm_loadu_si128(p + 1));
+      x2 = CrcFold(x2, k4, _mm_loadu_si128(p + 2));
+      x3 = CrcFold(x3, k4, _mm_loadu_si128(p + 3));
+   }
+
+   x0 = CrcFold(x0, k1, x1);
+   x0 = CrcFold(x0, k1, x2);
+   x0 = CrcFold(x0, k1, x3);
+   for (; n; n--, p++)
+      x0 = CrcFold(x0, k1, _mm_loadu_si128(p));
+
+   _mm_storeu_si128((__m128i *)rem, x0);
+   *crc = m->sse42 && CrcUseSse42 ? CrcSse42Update(0, rem, 16) :
+	  CrcTableUpdate(m, 0, rem, 16);
+   return (const uint8_t *)p - buf;
+}
+#endif /* CRC_HAVE_X86 */
+
+/**
+ * @fn uint32_t CrcUpdate(const CrcModel *m, uint32_t crc, const uint8_t *buf,
+ * 	size_t size)
+ *
+ * @brief runs the (non inverted) register over buf with the fastest
+ * 	implementation selected
+ */
+static uint32_t CrcUpdate(const CrcModel *m, uint32_t crc, const uint8_t *buf,
+	size_t size) {
+#if defined(CRC_HAVE_X86)
+   if (CrcUsePclmul && size >= CRC_FOLD_MIN) {
+      size_t done = CrcPclmulFold(m, &crc, buf, size);
+
+      buf += done;
+      size -= done;
+   }
+   if (m->sse42 && CrcUseSse42)
+      return CrcSse42Update(crc, buf, size);
+#endif
+   return CrcTableUpdate(m, crc, buf, size);
+}
+
+/**
+ * @fn uint32_t CrcUpdateBits(const CrcModel *m, uint32_t crc,
+ * 	const uint8_t *buf, uint64_t nbits)
+ *
+ * @brief continues a finished crc over nbits bits of buf
+ */
+static uint32_t CrcUpdateBits(const CrcModel *m, uint32_t crc,
+	const uint8_t *buf, uint64_t nbits) {
+   uint64_t size = nbits / BITS_PER_BYTE;
+   uint32_t r = nbits % BITS_PER_BYTE;
+
+   pthread_once(&CrcOnce, CrcInit);
+
+   if (buf == NULL)
+      return crc;
+
+   crc = CrcUpdate(m, ~crc, buf, size);
+   if (r) {
+      crc ^= buf[size] >> (BITS_PER_BYTE - r);
+      while (r--)
+         crc = crc & 1 ? (crc >> 1) ^ m->poly : crc >> 1;
+   }
+   return ~crc;
+}
+
+/**
+ * @fn uint32_t CrcCombine(const CrcModel *m, uint32_t crc1, uint32_t crc2,
+ * 	uint64_t nbits2)
+ *
+ * @brief crc of a message from the crcs of its two halves
+ */
+static uint32_t CrcCombine(const CrcModel *m, uint32_t crc1, uint32_t crc2,
+	uint64_t nbits2) {
+   return CrcMultModP(CrcXPowModP(nbits2, m->poly), crc1, m->poly) ^ crc2;
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn BitStreamCrcImpl BitStreamCrcSelect(BitStreamCrcImpl impl)
+ *
+ * @brief selects the implementation used by all subsequent calls, meant to
+ * 	be called once at startup (or by tests comparing the implementations)
+ *
+ * @param [in] impl\n
+ * 	implementation wanted, BITSTREAM_CRC_AUTO for the fastest available
+ * @returns implementation selected, a lesser one if the cpu lacks the
+ * 	instructions of the one asked for
+ */
+BitStreamCrcImpl BitStreamCrcSelect(BitStreamCrcImpl impl) {
+   pthread_once(&CrcOnce, CrcInit);
+   return CrcSelect(impl);
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn uint32_t BitStreamCrc32Update(uint32_t crc, const uint8_t *buf,
+ * 	size_t size)
+ *
+ * @brief continues a CRC32 over size more bytes
+ *
+ * @param [in] crc\n
+ * 	CRC32 of the data so far, 0 to start
+ * @param [in] *buf\n
+ * 	bytes to add
+ * @param [in] size\n
+ * 	number of bytes
+ * @returns CRC32 of the data so far followed by buf
+ */
+uint32_t BitStreamCrc32Update(uint32_t crc, const uint8_t *buf, size_t size) {
+   return CrcUpdateBits(&Crc32, crc, buf, (uint64_t)size * BITS_PER_BYTE);
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn uint32_t BitStreamCrc32UpdateBits(uint32_t crc, const uint8_t *buf,
+ * 	uint64_t nbits)
+ *
+ * @brief continues a CRC32 over nbits more bits
+ *
+ * @param [in] crc\n
+ * 	CRC32 of the data so far, 0 to start
+ * @param [in] *buf\n
+ * 	bits to add, a trailing partial byte holds them in its most
+ * 	significant bits
+ * @param [in] nbits\n
+ * 	number of bits
+ * @returns CRC32 of the data so far followed by the bits of buf
+ */
+uint32_t BitStreamCrc32UpdateBits(uint32_t crc, const uint8_t *buf,
+	uint64_t nbits) {
+   return CrcUpdateBits(&Crc32, crc, buf, nbits);
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn uint32_t BitStreamCrc32Combine(uint32_t crc1, uint32_t crc2,
+ * 	uint64_t nbits2)
+ *
+ * @brief CRC32 of A followed by B from the CRC32s of A and B, so chunks can
+ * 	be checksummed independently (all chunks but the last have to be a
+ * 	whole number of bytes for the result to be the CRC32 of the joined
+ * 	stream)
+ *
+ * @param [in] crc1\n
+ * 	CRC32 of A
+ * @param [in] crc2\n
+ * 	CRC32 of B
+ * @param [in] nbits2\n
+ * 	length of B in bits
+ * @returns CRC32 of A followed by B
+ */
+uint32_t BitStreamCrc32Combine(uint32_t crc1, uint32_t crc2, uint64_t nbits2) {
+   return CrcCombine(&Crc32, crc1, crc2, nbits2);
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn uint32_t BitStreamCrc32(BitStream *bs)
+ *
+ * @brief CRC32 of every bit of the bit stream
+ *
+ * @param [in] *bs\n
+ * 	bit stream to checksum
+ * @returns CRC32, 0 for an empty or invalid stream
+ */
+uint32_t BitStreamCrc32(BitStream *bs) {
+   return CrcUpdateBits(&Crc32, 0, BitStreamGetArray(bs),
+		   BitStreamGetSizeBits(bs));
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn uint32_t BitStreamCrc32cUpdate(uint32_t crc, const uint8_t *buf,
+ * 	size_t size)
+ *
+ * @brief continues a CRC32C over size more bytes
+ *
+ * @param [in] crc\n
+ * 	CRC32C of the data so far, 0 to start
+ * @param [in] *buf\n
+ * 	bytes to add
+ * @param [in] size\n
+ * 	number of bytes
+ * @returns CRC32C of the data so far followed by buf
+ */
+uint32_t BitStreamCrc32cUpdate(uint32_t crc, const uint8_t *buf, size_t size) {
+   return CrcUpdateBits(&Crc32c, crc, buf, (uint64_t)size * BITS_PER_BYTE);
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn uint32_t BitStreamCrc32cUpdateBits(uint32_t crc, const uint8_t *buf,
+ * 	uint64_t nbits)
+ *
+ * @brief continues a CRC32C over nbits more bits
+ *
+ * @param [in] crc\n
+ * 	CRC32C of the data so far, 0 to start
+ * @param [in] *buf\n
+ * 	bits to add, a trailing partial byte holds them in its most
+ * 	significant bits
+ * @param [in] nbits\n
+ * 	number of bits
+ * @returns CRC32C of the data so far followed by the bits of buf
+ */
+uint32_t BitStreamCrc32cUpdateBits(uint32_t crc, const uint8_t *buf,
+	uint64_t nbits) {
+   return CrcUpdateBits(&Crc32c, crc, buf, nbits);
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn uint32_t BitStreamCrc32cCombine(uint32_t crc1, uint32_t crc2,
+ * 	uint64_t nbits2)
+ *
+ * @brief CRC32C of A followed by B from the CRC32Cs of A and B, see
+ * 	BitStreamCrc32Combine()
+ *
+ * @param [in] crc1\n
+ * 	CRC32C of A
+ * @param [in] crc2\n
+ * 	CRC32C of B
+ * @param [in] nbits2\n
+ * 	length of B in bits
+ * @returns CRC32C of A followed by B
+ */
+uint32_t BitStreamCrc32cCombine(uint32_t crc1, uint32_t crc2,
+	uint64_t nbits2) {
+   return CrcCombine(&Crc32c, crc1, crc2, nbits2);
+}
+
+/**
+ * @ingroup BitStreamCrc
+ * @fn uint32_t BitStreamCrc32c(BitStream *bs)
+ *
+ * @brief CRC32C of every bit of the bit stream
+ *
+ * @param [in] *bs\n
+ * 	bit stream to checksum
+ * @returns CRC32C, 0 for an empty or invalid stream
+ */
+uint32_t BitStreamCrc32c(BitStream *bs) {
+   return CrcUpdateBits(&Crc32c, 0, BitStreamGetArray(bs),
+		   BitStreamGetSizeBits(bs));
+}
@@ -0,0 +1,54 @@
+/**
+ * @file  BitStreamCrc.h
+ * @brief CRC32 (IEEE 802.3) and CRC32C (Castagnoli) over bit streams,
+ * 	including lengths that are not a whole number of bytes
+ */
+#if !defined(_BITSTREAM_CRC_H)
+#define _BITSTREAM_CRC_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Type Definitions */
+/**
+ * @enum BitStreamCrcImpl
+ * @brief implementations of the checksums
+ */
+typedef enum BitStreamCrcImpl {
+   BITSTREAM_CRC_AUTO = 0,   /**< fastest the cpu supports */
+   BITSTREAM_CRC_TABLE,      /**< portable slicing-by-8 tables */
+   BITSTREAM_CRC_SSE42,      /**< SSE4.2 crc32 instruction (CRC32C only,
+				  CRC32 falls back to the tables) */
+   BITSTREAM_CRC_PCLMUL      /**< carry-less multiply folding of large
+				  buffers, short ones as BITSTREAM_CRC_SSE42 */
+} BitStreamCrcImpl;
+
+
+BitStreamCrcImpl BitStreamCrcSelect(BitStreamCrcImpl impl) ;
+
+uint32_t BitStreamCrc32Update(uint32_t crc, const uint8_t *buf, size_t size) ;
+
+uint32_t BitStreamCrc32UpdateBits(uint32_t crc, const uint8_t *buf,
+	uint64_t nbits) ;
+
+uint32_t BitStreamCrc32Combine(uint32_t crc1, uint32_t crc2, uint64_t nbits2) ;
+
+uint32_t BitStreamCrc32(BitStream *bs) ;
+
+uint32_t BitStreamCrc32cUpdate(uint32_t crc, const uint8_t *buf, size_t size) ;
+
+uint32_t BitStreamCrc32cUpdateBits(uint32_t crc, const uint8_t *buf,
+	uint64_t nbits) ;
+
+uint32_t BitStreamCrc32cCombine(uint32_t crc1, uint32_t crc2,
+	uint64_t nbits2) ;
+
+uint32_t BitStreamCrc32c(BitStream *bs) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_CRC_H */
@@ -0,0 +1,249 @@
+/**
+ * @file BitStreamFile.c
+ *
+ * @brief Implements saving bit streams to binary container files and
+ * 	mapping them back
+ *
+ * A file is a BITSTREAM_FILE_HEADER byte header followed by the bytes of
+ * the stream as they are in memory, half the size of the hex text and
+ * nothing to decode. Saving hands the header and the payload to a single
+ * writev() into a temporary file next to the target, syncs it and renames
+ * it over the target, so a failed save leaves the previous file whole and
+ * streams mapped from it valid. Loading maps the file copy-on-write and points the stream
+ * into the mapping, pages are read in on first touch and writes to the
+ * stream never reach the file. The header carries its own checksum, the
+ * checksum of the payload costs a pass over it and is only checked when
+ * asked for.
+ *
+ * @internal BitStreamFileSave
+ * 	     BitStreamFileMap
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "BitStreamCrc.h"
+#include "BitStreamFile.h"
+
+/**
+ * @var FileMagic
+ * @brief first bytes of every container file
+ */
+static const uint8_t FileMagic[8] = { 'B', 'i', 't', 'S', 't', 'r', 'm', 0x1a };
+
+/**
+ * @fn void FilePut(uint8_t *p, uint64_t v, unsigned bytes)
+ *
+ * @brief stores the low bytes of v little endian
+ */
+static inline void FilePut(uint8_t *p, uint64_t v, unsigned bytes) {
+   unsigned i;
+
+   for (i = 0; i < bytes; i++)
+      p[i] = (uint8_t)(v >> (8 * i));
+}
+
+/**
+ * @fn uint64_t FileGet(const uint8_t *p, unsigned bytes)
+ *
+ * @brief loads a little endian integer of bytes bytes
+ */
+static inline uint64_t FileGet(const uint8_t *p, unsigned bytes) {
+   uint64_t v = 0;
+   unsigned i;
+
+   for (i = 0; i < bytes; i++)
+      v |= (uint64_t)p[i] << (8 * i);
+   return v;
+}
+
+/**
+ * @ingroup BitStreamFile
+ * @fn int BitStreamFileSave(BitStream *bs, const char *path,
+ * 	BitStreamBitOrder order, unsigned flags)
+ *
+ * @brief writes the stream to a container file, replacing the file
+ *
+ * The file is written as path.tmp, synced and renamed to path, the
+ * previous file is only replaced once the new one is complete.
+ *
+ * @param [in] *bs\n
+ * 	bit stream to save
+ * @param [in] *path\n
+ * 	file to write
+ * @param [in] order\n
+ * 	bit order of the stream, recorded for the reader, the bits are
+ * 	written as they are
+ * @param [in] flags\n
+ * 	BITSTREAM_FILE_CRC to store a checksum of the bits
+ * @returns 0 on success, -1 on failure (errno tells why)
+ */
+int BitStreamFileSave(BitStream *bs, const char *path,
+	BitStreamBitOrder order, unsigned flags) {
+   uint8_t      header[BITSTREAM_FILE_HEADER] = { 0 };
+   struct iovec iov[2], *v = iov;
+   int          fd, n = 2, ret = 0, err;
+   size_t       left;
+   ssize_t      done;
+   char        *tmp;
+
+   if (bs == NULL || (bs->array == NULL && bs->nbits)) {
+      errno = EINVAL;
+      return (-1);
+   }
+
+   flags &= BITSTREAM_FILE_CRC;
+   memcpy(header, FileMagic, sizeof(FileMagic));
+   FilePut(header + 8, BITSTREAM_FILE_VERSION, 2);
+   FilePut(header + 10, order, 1);
+   FilePut(header + 11, flags, 1);
+   FilePut(header + 12, BITSTREAM_FILE_HEADER, 4);
+   FilePut(header + 16, bs->nbits, 8);
+   if (flags & BITSTREAM_FILE_CRC)
+      FilePut(header + 24, BitStreamCrc32c(bs), 4);
+   FilePut(header + 28, BitStreamCrc32cUpdate(0, header, 28), 4);
+
+   iov[0].iov_base = header;
+   iov[0].iov_len = sizeof(header);
+   iov[1].iov_base = bs->array;
+   iov[1].iov_len = (bs->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+   tmp = (char *)malloc(strlen(path) + sizeof(".tmp"));
+   if (tmp == NULL)
+      return (-1);
+   sprintf(tmp, "%s.tmp", path);
+
+   fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      free(tmp);
+      return (-1);
+   }
+
+   /* one call unless the kernel takes less, then carry on where it stopped */
+   left = iov[0].iov_len + iov[1].iov_len;
+   while (left > 0) {
+      done = writev(fd, v, n);
+      if (done < 0) {
+         if (errno == EINTR)
+            continue;
+         ret = -1;
+         break;
+      }
+      left -= done;
+      while (n > 0 && (size_t)done >= v->iov_len) {
+         done -= v->iov_len;
+         v++;
+         n--;
+      }
+      if (n > 0) {
+         v->iov_base = (uint8_t *)v->iov_base + done;
+         v->iov_len -= done;
+      }
+   }
+
+   if (ret == 0 && fsync(fd) < 0)
+      ret = -1;
+   if (close(fd) < 0)
+      ret = -1;
+   if (ret == 0 && rename(tmp, path) < 0)
+      ret = -1;
+
+   if (ret < 0) {
+      err = errno;
+      unlink(tmp);
+      errno = err;
+   }
+   free(tmp);
+   return ret;
+}
+
+/**
+ * @ingroup BitStreamFile
+ * @fn BitStream* BitStreamFileMap(const char *path, BitStreamBitOrder *order,
+ * 	unsigned flags)
+ *
+ * @brief opens a container file as a bit stream pointing into a mapping of
+ * 	the file, nothing is read or copied up front
+ *
+ * The mapping is private, the stream may be written to and the file stays
+ * as it is. BitStreamDelete() unmaps it, resizing the stream moves it to
+ * the heap first (see BitStreamDetach()).
+ *
+ * @param [in] *path\n
+ * 	file to open
+ * @param [out] *order\n
+ * 	receives the bit order recorded in the file, may be NULL
+ * @param [in] flags\n
+ * 	BITSTREAM_FILE_CRC to check the checksum of the bits if the file has
+ * 	one, this reads the whole file
+ * @returns pointer to the mapped bit stream, NULL if the file cannot be
+ * 	opened, is not a container file of a known version or is corrupt
+ */
+BitStream* BitStreamFileMap(const char *path, BitStreamBitOrder *order,
+	unsigned flags) {
+   BitStream     *bs = NULL;
+   struct stat    st;
+   const uint8_t *header;
+   uint8_t       *base;
+   uint64_t       offset, nbits;
+   int            fd;
+
+   fd = open(path, O_RDONLY);
+   if (fd < 0)
+      return NULL;
+
+   if (fstat(fd, &st) < 0 || st.st_size < BITSTREAM_FILE_HEADER) {
+      close(fd);
+      return NULL;
+   }
+
+   base = (uint8_t *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (base == MAP_FAILED)
+      return NULL;
+
+   header = base;
+   offset = FileGet(header + 12, 4);
+   nbits = FileGet(header + 16, 8);
+
+   if (memcmp(header, FileMagic, sizeof(FileMagic)) == 0 &&
+       FileGet(header + 8, 2) <= BITSTREAM_FILE_VERSION &&
+       FileGet(header + 28, 4) == BitStreamCrc32cUpdate(0, header, 28) &&
+       offset >= BITSTREAM_FILE_HEADER &&
+       nbits / BITS_PER_BYTE < (uint64_t)st.st_size &&
+       offset + (nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE <=
+       (uint64_t)st.st_size)
+      bs = BitStreamCreate(0);
+
+   if (bs) {
+      bs->nbits = nbits;
+      bs->array = nbits ? base + offset : NULL;
+      bs->mapping = base;
+      bs->mappingSize = st.st_size;
+
+      if (order)
+         *order = (BitStreamBitOrder)header[10];
+
+      if ((flags & BITSTREAM_FILE_CRC) && (header[11] & BITSTREAM_FILE_CRC) &&
+          FileGet(header + 24, 4) != BitStreamCrc32c(bs)) {
+         BitStreamDelete(bs);
+         bs = NULL;
+      }
+      if (bs && nbits == 0) {
+         /* nothing to map, an empty stream owns no array */
+         munmap(base, st.st_size);
+         bs->mapping = NULL;
+         bs->mappingSize = 0;
+      }
+   } else {
+      munmap(base, st.st_size);
+   }
+   return bs;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file  BitStreamFile.h
+ * @brief Binary container files holding one bit stream, written in a single
+ * 	call and mapped back without copying
+ */
+#if !defined(_BITSTREAM_FILE_H)
+#define _BITSTREAM_FILE_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def BITSTREAM_FILE_VERSION
+ * @brief version of the container written, files of later versions are
+ * 	refused
+ */
+#define BITSTREAM_FILE_VERSION	1
+
+/**
+ * @def BITSTREAM_FILE_HEADER
+ * @brief size of the header, the payload starts at this offset so it is
+ * 	cache line aligned once mapped
+ */
+#define BITSTREAM_FILE_HEADER	64
+
+/**
+ * @def BITSTREAM_FILE_CRC
+ * @brief flag, BitStreamFileSave() stores a CRC32C of the bits,
+ * 	BitStreamFileMap() checks it
+ */
+#define BITSTREAM_FILE_CRC	0x01
+
+/*
+ * Layout of the header, integers little endian
+ *
+ *   0  magic "BitStrm" 0x1a
+ *   8  version (16 bits)
+ *  10  bit order, a BitStreamBitOrder (8 bits)
+ *  11  flags (8 bits)
+ *  12  offset of the payload (32 bits)
+ *  16  number of bits (64 bits)
+ *  24  CRC32C of the bits if BITSTREAM_FILE_CRC is set (32 bits)
+ *  28  CRC32C of bytes 0 to 27 (32 bits)
+ *  32  reserved, zero
+ */
+
+
+int BitStreamFileSave(BitStream *bs, const char *path,
+	BitStreamBitOrder order, unsigned flags) ;
+
+BitStream* BitStreamFileMap(const char *path, BitStreamBitOrder *order,
+	unsigned flags) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_FILE_H */
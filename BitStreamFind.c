@@ -0,0 +1,411 @@
+/**
+ * @file BitStreamFind.c
+ *
+ * @brief Implements the search for a bit pattern at arbitrary bit offsets
+ *
+ * The pattern is laid out once for each of the 8 bit offsets within a byte
+ * it can start at, as bytes and masks of the bits it covers. A match that
+ * starts in byte i at shift s has to agree with two anchor bytes, bytes A
+ * and A+1 of the shifted pattern, at data bytes i+A and i+A+1. The scan
+ * compares 32 data bytes (16 without AVX2) against the anchors of all 8
+ * shifts at once, only positions where the anchors agree are verified, a
+ * word at a time, against the whole shifted pattern.
+ *
+ * The anchor index A is the same for every shift so candidates come out of
+ * the scan in increasing bit offset order.
+ *
+ * @internal BitStreamFindBits
+ * 	     BitStreamFindAllBits
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include "BitStreamFind.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @struct FindPattern
+ * @brief pattern laid out for the 8 shifts
+ */
+typedef struct FindPattern {
+   uint8_t  *bytes;        /**< shift s at bytes + s * stride */
+   uint8_t  *masks;        /**< pattern bits covered by each byte */
+   uint32_t  stride;       /**< bytes per shift, a multiple of 8 */
+   uint32_t  length[8];    /**< bytes spanned at each shift */
+   uint32_t  anchor;       /**< index of the first anchor byte */
+   uint32_t  nbits;        /**< pattern length in bits */
+} FindPattern;
+
+/**
+ * @struct FindState
+ * @brief a search in progress
+ */
+typedef struct FindState {
+   const uint8_t *array;
+   uint64_t       nbits;     /**< bits in the stream */
+   uint64_t       nbytes;    /**< bytes holding them */
+   uint64_t       start;     /**< first bit offset a match may start at */
+   uint64_t      *offsets;   /**< matches found, may be NULL */
+   uint64_t       max;       /**< room in offsets, stop once reached */
+   uint64_t       count;     /**< matches found so far */
+} FindState;
+
+/**
+ * @fn int FindPatternInit(FindPattern *fp, const uint8_t *pattern,
+ * 	uint32_t nbits)
+ *
+ * @brief lays out the pattern for the 8 shifts
+ *
+ * @returns 0 on success, -1 on allocation failure
+ */
+static int FindPatternInit(FindPattern *fp, const uint8_t *pattern,
+	uint32_t nbits) {
+   uint32_t s, p;
+
+   fp->nbits = nbits;
+   fp->stride = ((nbits + 7) / BITS_PER_BYTE + 1 + 7) & ~7u;
+   fp->anchor = nbits > BITS_PER_BYTE ? 1 : 0;
+   fp->bytes = (uint8_t *)calloc(2 * 8, fp->stride);
+   if (fp->bytes == NULL)
+      return (-1);
+   fp->masks = fp->bytes + 8 * fp->stride;
+
+   for (s = 0; s < 8; s++) {
+      uint8_t *b = fp->bytes + s * fp->stride;
+      uint8_t *m = fp->masks + s * fp->stride;
+
+      fp->length[s] = (s + nbits + 7) / BITS_PER_BYTE;
+      for (p = 0; p < nbits; p++) {
+         uint32_t at = s + p;
+         uint8_t  bit = 0x80 >> (at % BITS_PER_BYTE);
+
+         m[at / BITS_PER_BYTE] |= bit;
+         if (pattern[p / BITS_PER_BYTE] & (0x80 >> (p % BITS_PER_BYTE)))
+            b[at / BITS_PER_BYTE] |= bit;
+      }
+   }
+   return 0;
+}
+
+/**
+ * @fn uint64_t FindLoad(const uint8_t *p, uint64_t avail)
+ *
+ * @brief loads up to 8 bytes, zero filling past avail
+ */
+static inline uint64_t FindLoad(const uint8_t *p, uint64_t avail) {
+   uint64_t w = 0;
+
+   memcpy(&w, p, avail < 8 ? avail : 8);
+   return w;
+}
+
+/**
+ * @fn int FindVerify(const FindState *st, const FindPattern *fp, uint64_t i,
+ * 	uint32_t s)
+ *
+ * @brief checks for a match starting at bit s of byte i
+ */
+static inline int FindVerify(const FindState *st, const FindPattern *fp,
+	uint64_t i, uint32_t s) {
+   const uint8_t *b = fp->bytes + s * fp->stride;
+   const uint8_t *m = fp->masks + s * fp->stride;
+   uint64_t       bit = i * BITS_PER_BYTE + s;
+   uint32_t       k;
+
+   if (bit < st->start || bit + fp->nbits > st->nbits)
+      return 0;
+
+   /* the pattern fits, so all fp->length[s] bytes are inside the array */
+   for (k = 0; k < fp->length[s]; k += 8) {
+      uint64_t d = FindLoad(st->array + i + k, st->nbytes - i - k);
+      uint64_t want, mask;
+
+      memcpy(&want, b + k, 8);
+      memcpy(&mask, m + k, 8);
+      if ((d & mask) != want)
+         return 0;
+   }
+   return 1;
+}
+
+/**
+ * @fn int FindCandidate(FindState *st, const FindPattern *fp, uint64_t j,
+ * 	uint32_t shifts)
+ *
+ * @brief verifies the shifts whose anchors agree at data byte j, in
+ * 	increasing bit offset order
+ *
+ * @returns 1 once the search is over (offsets full), 0 to carry on
+ */
+static inline int FindCandidate(FindState *st, const FindPattern *fp,
+	uint64_t j, uint32_t shifts) {
+   uint64_t i;
+   uint32_t s;
+
+   if (j < fp->anchor)
+      return 0;
+   i = j - fp->anchor;
+
+   for (s = 0; s < 8; s++) {
+      if ((shifts & (1u << s)) && FindVerify(st, fp, i, s)) {
+         if (st->offsets)
+            st->offsets[st->count] = i * BITS_PER_BYTE + s;
+         if (++st->count == st->max)
+            return 1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * @fn uint32_t FindAnchorShifts(const FindPattern *fp, const uint8_t *array,
+ * 	uint64_t nbytes, uint64_t j)
+ *
+ * @brief shifts whose anchors agree at data byte j, scalar version
+ */
+static inline uint32_t FindAnchorShifts(const FindPattern *fp,
+	const uint8_t *array, uint64_t nbytes, uint64_t j) {
+   uint32_t a = fp->anchor, s, shifts = 0;
+
+   for (s = 0; s < 8; s++) {
+      const uint8_t *b = fp->bytes + s * fp->stride + a;
+      const uint8_t *m = fp->masks + s * fp->stride + a;
+      uint8_t        next = j + 1 < nbytes ? array[j + 1] : 0;
+
+      if ((array[j] & m[0]) == b[0] && (next & m[1]) == b[1])
+         shifts |= 1u << s;
+   }
+   return shifts;
+}
+
+/**
+ * @fn int FindHits(FindState *st, const FindPattern *fp, uint64_t j,
+ * 	const uint32_t hits[8])
+ *
+ * @brief verifies the candidates of a block scanned by SIMD compares, bit k
+ * 	of hits[s] set if the anchors of shift s agree at data byte j + k
+ *
+ * @returns 1 once the search is over (offsets full), 0 to carry on
+ */
+static inline int FindHits(FindState *st, const FindPattern *fp, uint64_t j,
+	const uint32_t hits[8]) {
+   uint32_t all = 0, shifts, k, s;
+
+   for (s = 0; s < 8; s++)
+      all |= hits[s];
+
+   while (all) {
+      k = __builtin_ctz(all);
+      all &= all - 1;
+      shifts = 0;
+      for (s = 0; s < 8; s++)
+         shifts |= ((hits[s] >> k) & 1) << s;
+      if (FindCandidate(st, fp, j + k, shifts))
+         return 1;
+   }
+   return 0;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @fn int FindScanAvx2(FindState *st, const FindPattern *fp, uint64_t *pj)
+ *
+ * @brief AVX2 scan of 32 data bytes at a time, from *pj on
+ *
+ * @returns 1 once the search is over, 0 with *pj at the bytes left over
+ */
+static __attribute__((target("avx2"))) int FindScanAvx2(FindState *st,
+	const FindPattern *fp, uint64_t *pj) {
+   __m256i  m0[8], b0[8], m1[8], b1[8];
+   uint64_t j = *pj;
+   uint32_t s;
+   int      done = 0;
+
+   for (s = 0; s < 8; s++) {
+      const uint8_t *b = fp->bytes + s * fp->stride + fp->anchor;
+      const uint8_t *m = fp->masks + s * fp->stride + fp->anchor;
+
+      m0[s] = _mm256_set1_epi8((char)m[0]);
+      b0[s] = _mm256_set1_epi8((char)b[0]);
+      m1[s] = _mm256_set1_epi8((char)m[1]);
+      b1[s] = _mm256_set1_epi8((char)b[1]);
+   }
+
+   /* the second anchor is read one byte ahead */
+   for (; !done && j + 33 <= st->nbytes; j += 32) {
+      __m256i  d0 = _mm256_loadu_si256((const __m256i *)(st->array + j));
+      __m256i  d1 = _mm256_loadu_si256((const __m256i *)(st->array + j + 1));
+      __m256i  hit[8], any = _mm256_setzero_si256();
+      uint32_t hits[8];
+
+      for (s = 0; s < 8; s++) {
+         hit[s] = _mm256_and_si256(
+		 _mm256_cmpeq_epi8(_mm256_and_si256(d0, m0[s]), b0[s]),
+		 _mm256_cmpeq_epi8(_mm256_and_si256(d1, m1[s]), b1[s]));
+         any = _mm256_or_si256(any, hit[s]);
+      }
+      if (_mm256_testz_si256(any, any))
+         continue;
+
+      for (s = 0; s < 8; s++)
+         hits[s] = (uint32_t)_mm256_movemask_epi8(hit[s]);
+      done = FindHits(st, fp, j, hits);
+   }
+   *pj = j;
+   return done;
+}
+#endif
+
+/**
+ * @fn void FindScan(FindState *st, const FindPattern *fp)
+ *
+ * @brief runs the search until the end of the stream or offsets are full
+ */
+static void FindScan(FindState *st, const FindPattern *fp) {
+   uint64_t j = st->start / BITS_PER_BYTE + fp->anchor;
+   uint32_t shifts;
+
+#if defined(__x86_64__) || defined(__i386__)
+   if (__builtin_cpu_supports("avx2") && FindScanAvx2(st, fp, &j))
+      return;
+#endif
+
+#if defined(__SSE2__)
+   __m128i  m0[8], b0[8], m1[8], b1[8];
+   uint32_t s;
+
+   for (s = 0; s < 8; s++) {
+      const uint8_t *b = fp->bytes + s * fp->stride + fp->anchor;
+      const uint8_t *m = fp->masks + s * fp->stride + fp->anchor;
+
+      m0[s] = _mm_set1_epi8((char)m[0]);
+      b0[s] = _mm_set1_epi8((char)b[0]);
+      m1[s] = _mm_set1_epi8((char)m[1]);
+      b1[s] = _mm_set1_epi8((char)b[1]);
+   }
+
+   for (; j + 17 <= st->nbytes; j += 16) {
+      __m128i  d0 = _mm_loadu_si128((const __m128i *)(st->array + j));
+      __m128i  d1 = _mm_loadu_si128((const __m128i *)(st->array + j + 1));
+      __m128i  hit[8], any = _mm_setzero_si128();
+      uint32_t hits[8];
+
+      for (s = 0; s < 8; s++) {
+         hit[s] = _mm_and_si128(
+		 _mm_cmpeq_epi8(_mm_and_si128(d0, m0[s]), b0[s]),
+		 _mm_cmpeq_epi8(_mm_and_si128(d1, m1[s]), b1[s]));
+         any = _mm_or_si128(any, hit[s]);
+      }
+      if (_mm_movemask_epi8(any) == 0)
+         continue;
+
+      for (s = 0; s < 8; s++)
+         hits[s] = (uint32_t)_mm_movemask_epi8(hit[s]);
+      if (FindHits(st, fp, j, hits))
+         return;
+   }
+#endif
+
+   for (; j < st->nbytes; j++) {
+      shifts = FindAnchorShifts(fp, st->array, st->nbytes, j);
+      if (shifts && FindCandidate(st, fp, j, shifts))
+         return;
+   }
+}
+
+/**
+ * @fn uint64_t FindRun(BitStream *bs, const uint8_t *pattern,
+ * 	uint32_t patternBits, uint64_t startOffset, uint64_t *offsets,
+ * 	uint64_t maxOffsets)
+ *
+ * @brief common body of the find routines
+ */
+static uint64_t FindRun(BitStream *bs, const uint8_t *pattern,
+	uint32_t patternBits, uint64_t startOffset, uint64_t *offsets,
+	uint64_t maxOffsets) {
+   FindPattern fp;
+   FindState   st;
+
+   if (BitStreamGetArray(bs) == NULL || pattern == NULL || patternBits == 0 ||
+       maxOffsets == 0 || startOffset >= bs->nbits ||
+       patternBits > bs->nbits - startOffset)
+      return 0;
+
+   if (FindPatternInit(&fp, pattern, patternBits) != 0)
+      return 0;
+
+   st.array = bs->array;
+   st.nbits = bs->nbits;
+   st.nbytes = (bs->nbits + 7) / BITS_PER_BYTE;
+   st.start = startOffset;
+   st.offsets = offsets;
+   st.max = maxOffsets;
+   st.count = 0;
+
+   FindScan(&st, &fp);
+
+   free(fp.bytes);
+   return st.count;
+}
+
+/**
+ * @ingroup BitStreamFind
+ * @fn int64_t BitStreamFindBits(BitStream *bs, const uint8_t *pattern,
+ * 	uint32_t patternBits, uint64_t startOffset)
+ *
+ * @brief finds the first occurrence of a bit pattern, which may start at
+ * 	any bit offset (a sync word or frame marker in a capture)
+ *
+ * @param [in] *bs\n
+ * 	bit stream to search
+ * @param [in] *pattern\n
+ * 	pattern, most significant bit of the first byte first
+ * @param [in] patternBits\n
+ * 	length of the pattern in bits
+ * @param [in] startOffset\n
+ * 	first bit offset a match may start at
+ * @returns bit offset of the first match, -1 if there is none
+ */
+int64_t BitStreamFindBits(BitStream *bs, const uint8_t *pattern,
+	uint32_t patternBits, uint64_t startOffset) {
+   uint64_t offset;
+
+   if (FindRun(bs, pattern, patternBits, startOffset, &offset, 1) == 0)
+      return (-1);
+   return (int64_t)offset;
+}
+
+/**
+ * @ingroup BitStreamFind
+ * @fn uint64_t BitStreamFindAllBits(BitStream *bs, const uint8_t *pattern,
+ * 	uint32_t patternBits, uint64_t startOffset, uint64_t *offsets,
+ * 	uint64_t maxOffsets)
+ *
+ * @brief finds the occurrences of a bit pattern, overlapping ones included
+ *
+ * @param [in] *bs\n
+ * 	bit stream to search
+ * @param [in] *pattern\n
+ * 	pattern, most significant bit of the first byte first
+ * @param [in] patternBits\n
+ * 	length of the pattern in bits
+ * @param [in] startOffset\n
+ * 	first bit offset a match may start at
+ * @param [out] *offsets\n
+ * 	bit offsets of the matches in increasing order, NULL to only count
+ * 	them
+ * @param [in] maxOffsets\n
+ * 	size of offsets, the search stops once it is full
+ * @returns number of matches found (at most maxOffsets)
+ */
+uint64_t BitStreamFindAllBits(BitStream *bs, const uint8_t *pattern,
+	uint32_t patternBits, uint64_t startOffset, uint64_t *offsets,
+	uint64_t maxOffsets) {
+   return FindRun(bs, pattern, patternBits, startOffset, offsets, maxOffsets);
+}
@@ -0,0 +1,24 @@
+/**
+ * @file  BitStreamFind.h
+ * @brief Search for a bit pattern starting at any bit offset of a stream
+ */
+#if !defined(_BITSTREAM_FIND_H)
+#define _BITSTREAM_FIND_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+int64_t BitStreamFindBits(BitStream *bs, const uint8_t *pattern,
+	uint32_t patternBits, uint64_t startOffset) ;
+
+uint64_t BitStreamFindAllBits(BitStream *bs, const uint8_t *pattern,
+	uint32_t patternBits, uint64_t startOffset, uint64_t *offsets,
+	uint64_t maxOffsets) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_FIND_H */
@@ -0,0 +1,331 @@
+/**
+ * @file  BitStreamFixed.hpp
+ * @brief Bit streams of a size known at compile time: inline storage,
+ * 	constexpr hex and Base64 codecs and field access resolved at compile
+ * 	time
+ *
+ * Keys, cipher blocks and headers have a fixed size. FixedBitStream<NBits>
+ * holds their bits in the object itself, so it needs no allocation and can
+ * be built by the compiler: a constexpr key or test vector written as hex
+ * or Base64 is decoded at compile time and lands in the binary as bytes,
+ * with nothing to run at startup. Bad text in a constant expression fails
+ * the build, at run time it throws std::invalid_argument.
+ *
+ * get<Offset, Width>() and put<Offset, Width>() take the position of the
+ * field as template arguments. The bounds are checked by static_assert
+ * and the bytes touched, shifts and masks are constants, so a field read
+ * compiles to a load, a shift and an and.
+ *
+ * Requires C++20.
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+#if !defined(_BITSTREAM_FIXED_HPP)
+#define _BITSTREAM_FIXED_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+#include "BitStream.hpp"
+
+namespace bitstream {
+
+namespace fixed {
+
+/** @brief value of a hex digit, -1 if c is not one */
+constexpr int HexValue(char c) noexcept {
+   if (c >= '0' && c <= '9')
+      return c - '0';
+   if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+   return -1;
+}
+
+/** @brief value of a Base64 character, -1 if c is not one */
+constexpr int Base64Value(char c) noexcept {
+   if (c >= 'A' && c <= 'Z')
+      return c - 'A';
+   if (c >= 'a' && c <= 'z')
+      return c - 'a' + 26;
+   if (c >= '0' && c <= '9')
+      return c - '0' + 52;
+   if (c == '+')
+      return 62;
+   if (c == '/')
+      return 63;
+   return -1;
+}
+
+inline constexpr char HexDigits[] = "0123456789abcdef";
+
+inline constexpr char Base64Digits[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/** @brief the low width bits set */
+constexpr uint64_t Mask(unsigned width) noexcept {
+   return width >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+}
+
+} /* namespace fixed */
+
+/**
+ * @class FixedBitStream
+ * @brief NBits bits stored inline, most significant bit first like
+ * 	::BitStream, the bits of the last byte past NBits are kept zero
+ */
+template <uint64_t NBits>
+class FixedBitStream {
+public:
+   static_assert(NBits > 0, "a fixed bit stream holds at least one bit");
+
+   /** @brief number of bits */
+   static constexpr uint64_t nbits = NBits;
+
+   /** @brief number of bytes holding them */
+   static constexpr size_t nbytes = (NBits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+   /** @brief length of the hex text of the stream */
+   static constexpr size_t hexLength = 2 * nbytes;
+
+   /** @brief length of the Base64 text of the stream, padding included */
+   static constexpr size_t base64Length = (nbytes + 2) / 3 * 4;
+
+   /** @brief all bits zero */
+   constexpr FixedBitStream() noexcept : bytes_{} {}
+
+   /** @brief the bits of bytes, those past NBits are cleared */
+   constexpr explicit FixedBitStream(const std::array<uint8_t, nbytes> &bytes)
+	   noexcept : bytes_(bytes) {
+      ClearPad();
+   }
+
+   /**
+    * @brief decodes exactly hexLength hex digits, upper or lower case
+    *
+    * constexpr auto key = FixedBitStream<128>::from_hex("000102...");
+    */
+   static constexpr FixedBitStream from_hex(std::string_view hex) {
+      FixedBitStream s;
+
+      if (hex.size() != hexLength)
+         throw std::invalid_argument("bitstream: wrong hex length");
+      for (size_t i = 0; i < nbytes; i++) {
+         int hi = fixed::HexValue(hex[2 * i]);
+         int lo = fixed::HexValue(hex[2 * i + 1]);
+
+         if (hi < 0 || lo < 0)
+            throw std::invalid_argument("bitstream: invalid hex");
+         s.bytes_[i] = (uint8_t)(hi << 4 | lo);
+      }
+      s.ClearPad();
+      return s;
+   }
+
+   /** @brief decodes exactly base64Length characters of padded Base64 */
+   static constexpr FixedBitStream from_base64(std::string_view text) {
+      FixedBitStream s;
+      size_t         o = 0;
+
+      if (text.size() != base64Length)
+         throw std::invalid_argument("bitstream: wrong Base64 length");
+      for (size_t i = 0; i < text.size(); i += 4) {
+         uint32_t group = 0;
+         size_t   k, n = MIN(nbytes - o, (size_t)3);
+
+         for (k = 0; k < 4; k++) {
+            int v = k <= n ? fixed::Base64Value(text[i + k]) :
+		    (text[i + k] == '=' ? 0 : -1);
+
+            if (v < 0)
+               throw std::invalid_argument("bitstream: invalid Base64");
+            group = group << 6 | (uint32_t)v;
+         }
+         for (k = 0; k < n; k++)
+            s.bytes_[o++] = (uint8_t)(group >> (16 - 8 * k));
+      }
+      s.ClearPad();
+      return s;
+   }
+
+   /** @brief hex text, NULL terminated so data() can be printed */
+   constexpr std::array<char, hexLength + 1> hex() const noexcept {
+      std::array<char, hexLength + 1> out{};
+
+      for (size_t i = 0; i < nbytes; i++) {
+         out[2 * i] = fixed::HexDigits[bytes_[i] >> 4];
+         out[2 * i + 1] = fixed::HexDigits[bytes_[i] & 0x0F];
+      }
+      return out;
+   }
+
+   /** @brief padded Base64 text of the bytes, NULL terminated */
+   constexpr std::array<char, base64Length + 1> base64() const noexcept {
+      std::array<char, base64Length + 1> out{};
+      size_t                             o = 0;
+
+      for (size_t i = 0; i < nbytes; i += 3) {
+         size_t   k, n = MIN(nbytes - i, (size_t)3);
+         uint32_t group = 0;
+
+         for (k = 0; k < 3; k++)
+            group = group << 8 | (k < n ? bytes_[i + k] : 0);
+         for (k = 0; k < 4; k++)
+            out[o++] = k <= n ? fixed::Base64Digits[group >> (18 - 6 * k) &
+		    0x3F] : '=';
+      }
+      return out;
+   }
+
+   /**
+    * @brief the Width bits at bit Offset, right aligned
+    *
+    * A field within 8 bytes is one big endian load, fields straddling a
+    * ninth byte are read as two.
+    */
+   template <uint64_t Offset, unsigned Width>
+   constexpr uint64_t get() const noexcept {
+      static_assert(Width >= 1 && Width <= 64, "width must be 1 to 64 bits");
+      static_assert(Offset + Width <= NBits, "field past the end");
+
+      constexpr unsigned r = Offset % BITS_PER_BYTE;
+      constexpr size_t   first = Offset / BITS_PER_BYTE;
+      constexpr unsigned n = (r + Width + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+      if constexpr (n > 8) {
+         constexpr unsigned low = r + Width - 64;
+
+         return get<Offset, Width - low>() << low |
+		 get<Offset + Width - low, low>();
+      } else {
+         return Load<first, n>() >> (8 * n - r - Width) & fixed::Mask(Width);
+      }
+   }
+
+   /** @brief stores the low Width bits of v at bit Offset */
+   template <uint64_t Offset, unsigned Width>
+   constexpr void put(uint64_t v) noexcept {
+      static_assert(Width >= 1 && Width <= 64, "width must be 1 to 64 bits");
+      static_assert(Offset + Width <= NBits, "field past the end");
+
+      constexpr unsigned r = Offset % BITS_PER_BYTE;
+      constexpr size_t   first = Offset / BITS_PER_BYTE;
+      constexpr unsigned n = (r + Width + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+      if constexpr (n > 8) {
+         constexpr unsigned low = r + Width - 64;
+
+         put<Offset, Width - low>(v >> low);
+         put<Offset + Width - low, low>(v);
+      } else {
+         constexpr unsigned shift = 8 * n - r - Width;
+         constexpr uint64_t mask = fixed::Mask(Width) << shift;
+
+         Store<first, n>((Load<first, n>() & ~mask) | (v << shift & mask));
+      }
+   }
+
+   /** @brief bit at offset, which must be below NBits */
+   constexpr bool operator[](uint64_t offset) const noexcept {
+      return bytes_[offset / BITS_PER_BYTE] >>
+	      (BITS_PER_BYTE - 1 - offset % BITS_PER_BYTE) & 1;
+   }
+
+   constexpr FixedBitStream& operator^=(const FixedBitStream &y) noexcept {
+      for (size_t i = 0; i < nbytes; i++)
+         bytes_[i] ^= y.bytes_[i];
+      return *this;
+   }
+
+   constexpr FixedBitStream& operator&=(const FixedBitStream &y) noexcept {
+      for (size_t i = 0; i < nbytes; i++)
+         bytes_[i] &= y.bytes_[i];
+      return *this;
+   }
+
+   constexpr FixedBitStream& operator|=(const FixedBitStream &y) noexcept {
+      for (size_t i = 0; i < nbytes; i++)
+         bytes_[i] |= y.bytes_[i];
+      return *this;
+   }
+
+   friend constexpr FixedBitStream operator^(FixedBitStream x,
+	   const FixedBitStream &y) noexcept {
+      return x ^= y;
+   }
+
+   friend constexpr FixedBitStream operator&(FixedBitStream x,
+	   const FixedBitStream &y) noexcept {
+      return x &= y;
+   }
+
+   friend constexpr FixedBitStream operator|(FixedBitStream x,
+	   const FixedBitStream &y) noexcept {
+      return x |= y;
+   }
+
+   friend constexpr bool operator==(const FixedBitStream &,
+	   const FixedBitStream &) noexcept = default;
+
+   constexpr const std::array<uint8_t, nbytes>& bytes() const noexcept {
+      return bytes_;
+   }
+
+   constexpr const uint8_t* data() const noexcept { return bytes_.data(); }
+
+   uint8_t* data() noexcept { return bytes_.data(); }
+
+   /** @brief the bits as a view, for the library routines that read them */
+   View view() const noexcept { return View(std::span(bytes_), NBits); }
+
+   operator View() const noexcept { return view(); }
+
+private:
+   std::array<uint8_t, nbytes> bytes_;
+
+   /** @brief N <= 8 bytes from byte First as a big endian integer, one
+    * load and a byte swap outside constant evaluation */
+   template <size_t First, unsigned N>
+   constexpr uint64_t Load() const noexcept {
+      uint64_t w = 0;
+
+      if (!std::is_constant_evaluated()) {
+         memcpy(&w, bytes_.data() + First, N);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+         w = __builtin_bswap64(w);
+#endif
+         return w >> (64 - 8 * N);
+      }
+      for (unsigned i = 0; i < N; i++)
+         w = w << 8 | bytes_[First + i];
+      return w;
+   }
+
+   template <size_t First, unsigned N>
+   constexpr void Store(uint64_t w) noexcept {
+      if (!std::is_constant_evaluated()) {
+         w <<= 64 - 8 * N;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+         w = __builtin_bswap64(w);
+#endif
+         memcpy(bytes_.data() + First, &w, N);
+         return;
+      }
+      for (unsigned i = 0; i < N; i++)
+         bytes_[First + i] = (uint8_t)(w >> (8 * (N - 1 - i)));
+   }
+
+   constexpr void ClearPad() noexcept {
+      if constexpr (NBits % BITS_PER_BYTE != 0)
+         bytes_[nbytes - 1] &= (uint8_t)(0xFF << (BITS_PER_BYTE -
+				 NBits % BITS_PER_BYTE));
+   }
+};
+
+} /* namespace bitstream */
+#endif /* _BITSTREAM_FIXED_HPP */
@@ -0,0 +1,476 @@
+/**
+ * @file BitStreamHistogram.c
+ *
+ * @brief Implements byte, column and bigram histograms
+ *
+ * Counting a byte is a load, an increment and a store of its counter. When
+ * the same value comes again before that store has retired, the next
+ * increment waits on it, which on text (spaces, runs of 'e') or padding
+ * (zeros) holds counting to a fraction of what the cpu can do. Bytes are
+ * therefore spread over HISTOGRAM_BANKS banks of counters in turn, each
+ * bank a 32 bit array that stays in L1, and the banks are summed into the
+ * 64 bit result at the end. The sum is done with AVX2 where available.
+ *
+ * Column histograms are interleaved by nature once there are enough
+ * columns, fewer are counted as a multiple of themselves and folded. Their
+ * banks are 32 bit as well, rows of 64 bit counters are 2KB apart and
+ * every other one falls on the same 4KB alias. Bigram counts alternate
+ * between the result and one extra bank.
+ *
+ * Many short records, lines of a corpus for instance, are counted in one
+ * batch spread over the thread pool, each one straight into its result.
+ *
+ * @internal BitStreamHistogramBytes
+ * 	     BitStreamByteHistogram
+ * 	     BitStreamColumnHistogram
+ * 	     BitStreamBigramHistogram
+ * 	     BitStreamHistogramBatch
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+
+#include "BitStreamHistogram.h"
+#include "BitStreamParallel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HISTOGRAM_HAVE_AVX2	1
+#include <immintrin.h>
+#define AVX2_TARGET	__attribute__((target("avx2")))
+#endif
+
+#define ALWAYS_INLINE	inline __attribute__((always_inline))
+
+/**
+ * @def HISTOGRAM_CHUNK
+ * @brief bytes counted into the 32 bit banks before they are summed, well
+ * 	below the point where a counter could wrap
+ */
+#define HISTOGRAM_CHUNK		((size_t)1 << 30)
+
+/**
+ * @def HISTOGRAM_BIGRAM_BANKED_MIN
+ * @brief bigram counts of buffers shorter than this use no extra bank, its
+ * 	256KB would cost more to clear than it saves
+ */
+#define HISTOGRAM_BIGRAM_BANKED_MIN	((size_t)1 << 18)
+
+/**
+ * @def HISTOGRAM_BATCH_RECORDS
+ * @brief records counted by one task of a batch
+ */
+#define HISTOGRAM_BATCH_RECORDS	64
+
+/**
+ * @typedef HistogramMergeFn
+ * @brief hist[i] += sum of bank[b * n + i] over the nbanks banks, for i in
+ * 	[0, n), n a multiple of 8
+ */
+typedef void (*HistogramMergeFn)(uint64_t *hist, const uint32_t *bank,
+	size_t nbanks, size_t n);
+
+/**
+ * @fn void MergeWords(uint64_t *hist, const uint32_t *bank, size_t nbanks,
+ * 	size_t n)
+ *
+ * @brief portable merge of the banks
+ */
+static void MergeWords(uint64_t *hist, const uint32_t *bank, size_t nbanks,
+	size_t n) {
+   size_t b, i;
+
+   for (b = 0; b < nbanks; b++)
+      for (i = 0; i < n; i++)
+         hist[i] += bank[b * n + i];
+}
+
+#if defined(HISTOGRAM_HAVE_AVX2)
+/**
+ * @fn void MergeAvx2(uint64_t *hist, const uint32_t *bank, size_t nbanks,
+ * 	size_t n)
+ *
+ * @brief merge of the banks 8 counters at a time, summed in 32 bits (a
+ * 	chunk cannot overflow them) then widened and added to the result
+ */
+static AVX2_TARGET void MergeAvx2(uint64_t *hist, const uint32_t *bank,
+	size_t nbanks, size_t n) {
+   size_t b, i;
+
+   for (i = 0; i < n; i += 8) {
+      __m256i s = _mm256_loadu_si256((const __m256i *)(bank + i));
+      __m256i lo, hi;
+
+      for (b = 1; b < nbanks; b++)
+         s = _mm256_add_epi32(s, _mm256_loadu_si256((const __m256i *)
+				 (bank + b * n + i)));
+
+      lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(s));
+      hi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(s, 1));
+      lo = _mm256_add_epi64(lo, _mm256_loadu_si256((const __m256i *)
+			      (hist + i)));
+      hi = _mm256_add_epi64(hi, _mm256_loadu_si256((const __m256i *)
+			      (hist + i + 4)));
+      _mm256_storeu_si256((__m256i *)(hist + i), lo);
+      _mm256_storeu_si256((__m256i *)(hist + i + 4), hi);
+   }
+}
+#endif /* HISTOGRAM_HAVE_AVX2 */
+
+static HistogramMergeFn HistogramMerge = MergeWords;
+static pthread_once_t   HistogramOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @fn void HistogramInit(void)
+ *
+ * @brief picks the merge for this cpu on first use
+ */
+static void HistogramInit(void) {
+#if defined(HISTOGRAM_HAVE_AVX2)
+   if (__builtin_cpu_supports("avx2"))
+      HistogramMerge = MergeAvx2;
+#endif
+}
+
+/**
+ * @fn void HistogramMergeBanks(uint64_t *hist, const uint32_t *bank,
+ * 	size_t nbanks, size_t n)
+ *
+ * @brief adds the banks to the result with the merge picked for this cpu
+ */
+static inline void HistogramMergeBanks(uint64_t *hist, const uint32_t *bank,
+	size_t nbanks, size_t n) {
+   pthread_once(&HistogramOnce, HistogramInit);
+   HistogramMerge(hist, bank, nbanks, n);
+}
+
+/**
+ * @fn void HistogramCountBanks(const uint8_t *buf, size_t size,
+ * 	uint32_t bank[HISTOGRAM_BANKS][256])
+ *
+ * @brief counts the buffer into the banks, 8 bytes per load, byte j of a
+ * 	word to bank j % HISTOGRAM_BANKS
+ */
+static ALWAYS_INLINE void HistogramCountBanks(const uint8_t *buf, size_t size,
+	uint32_t bank[HISTOGRAM_BANKS][256]) {
+   size_t i = 0;
+
+   for (; i + 8 <= size; i += 8) {
+      uint64_t w;
+
+      memcpy(&w, buf + i, 8);
+      bank[0][w & 0xFF]++;
+      bank[1][(w >> 8) & 0xFF]++;
+      bank[2][(w >> 16) & 0xFF]++;
+      bank[3][(w >> 24) & 0xFF]++;
+      bank[0][(w >> 32) & 0xFF]++;
+      bank[1][(w >> 40) & 0xFF]++;
+      bank[2][(w >> 48) & 0xFF]++;
+      bank[3][w >> 56]++;
+   }
+   for (; i < size; i++)
+      bank[0][buf[i]]++;
+}
+
+/**
+ * @fn void HistogramAdd(const uint8_t *buf, size_t size, uint64_t hist[256])
+ *
+ * @brief adds the byte counts of the buffer to hist
+ */
+static void HistogramAdd(const uint8_t *buf, size_t size, uint64_t hist[256]) {
+   uint32_t bank[HISTOGRAM_BANKS][256];
+   size_t   i, n;
+
+   if (size < HISTOGRAM_BANKED_MIN) {
+      for (i = 0; i < size; i++)
+         hist[buf[i]]++;
+      return;
+   }
+
+   while (size > 0) {
+      n = MIN(size, HISTOGRAM_CHUNK);
+      memset(bank, '\0', sizeof(bank));
+      HistogramCountBanks(buf, n, bank);
+      HistogramMergeBanks(hist, &bank[0][0], HISTOGRAM_BANKS, 256);
+      buf += n;
+      size -= n;
+   }
+}
+
+/**
+ * @ingroup BitStreamHistogram
+ * @fn void BitStreamHistogramBytes(const uint8_t *buf, size_t size,
+ * 	BitStreamHistogram hist)
+ *
+ * @brief counts occurrences of each byte value in a buffer
+ *
+ * @param [in] *buf\n
+ * 	buffer to count
+ * @param [in] size\n
+ * 	length of the buffer in bytes
+ * @param [out] hist\n
+ * 	occurrences of each byte value, overwritten
+ * @returns none
+ */
+void BitStreamHistogramBytes(const uint8_t *buf, size_t size,
+	BitStreamHistogram hist) {
+   memset(hist, '\0', sizeof(BitStreamHistogram));
+   HistogramAdd(buf, size, hist);
+}
+
+/**
+ * @ingroup BitStreamHistogram
+ * @fn uint64_t BitStreamByteHistogram(BitStream *bs, BitStreamHistogram hist)
+ *
+ * @brief counts occurrences of each byte value in the stream
+ *
+ * @param [in] *bs\n
+ * 	bit stream, a trailing partial byte is not counted
+ * @param [out] hist\n
+ * 	occurrences of each byte value, overwritten
+ * @returns number of bytes counted
+ */
+uint64_t BitStreamByteHistogram(BitStream *bs, BitStreamHistogram hist) {
+   uint64_t size = bs ? bs->nbits / BITS_PER_BYTE : 0;
+
+   BitStreamHistogramBytes(size ? bs->array : NULL, size, hist);
+   return size;
+}
+
+/**
+ * @fn void HistogramColumns(const uint8_t *buf, size_t size, uint32_t k,
+ * 	uint64_t (*hist)[256])
+ *
+ * @brief adds the counts of byte i to hist[i % k], a row of k bytes at a
+ * 	time
+ */
+static void HistogramColumns(const uint8_t *buf, size_t size, uint32_t k,
+	uint64_t (*hist)[256]) {
+   size_t   i = 0;
+   uint32_t c;
+
+   for (; i + k <= size; i += k)
+      for (c = 0; c < k; c++)
+         hist[c][buf[i + c]]++;
+   for (c = 0; i < size; i++, c++)
+      hist[c][buf[i]]++;
+}
+
+/**
+ * @fn void HistogramColumnBanks(const uint8_t *buf, size_t size, uint32_t k,
+ * 	uint32_t *bank)
+ *
+ * @brief as HistogramColumns() into k banks of 32 bit counters, which unlike
+ * 	64 bit rows 2KB apart do not alias each other every other column
+ */
+static void HistogramColumnBanks(const uint8_t *buf, size_t size, uint32_t k,
+	uint32_t *bank) {
+   size_t   i = 0;
+   uint32_t c;
+
+   for (; i + k <= size; i += k)
+      for (c = 0; c < k; c++)
+         bank[c * 256 + buf[i + c]]++;
+   for (c = 0; i < size; i++, c++)
+      bank[c * 256 + buf[i]]++;
+}
+
+/**
+ * @ingroup BitStreamHistogram
+ * @fn uint64_t BitStreamColumnHistogram(BitStream *bs, uint32_t columns,
+ * 	BitStreamHistogram *hist)
+ *
+ * @brief counts each column of the stream laid out in rows of columns bytes,
+ * 	column c being the bytes c, c + columns, c + 2 * columns...
+ *
+ * These are the histograms of the single byte XORs a repeating key of
+ * columns bytes breaks into, without transposing the stream first.
+ *
+ * @param [in] *bs\n
+ * 	bit stream, a trailing partial byte is not counted
+ * @param [in] columns\n
+ * 	number of columns, at least 1
+ * @param [out] *hist\n
+ * 	columns histograms, overwritten
+ * @returns number of bytes counted, 0 if columns is 0 or memory runs out
+ */
+uint64_t BitStreamColumnHistogram(BitStream *bs, uint32_t columns,
+	BitStreamHistogram *hist) {
+   const uint8_t *buf;
+   uint32_t      *bank;
+   uint64_t       size = bs ? bs->nbits / BITS_PER_BYTE : 0;
+   uint64_t       left;
+   uint32_t       k, c;
+   size_t         n;
+
+   if (columns == 0)
+      return (0);
+   if (columns == 1)
+      return BitStreamByteHistogram(bs, hist[0]);
+
+   memset(hist, '\0', columns * sizeof(BitStreamHistogram));
+   if (size == 0)
+      return (0);
+
+   buf = bs->array;
+   if (size < HISTOGRAM_BANKED_MIN) {
+      HistogramColumns(buf, size, columns, hist);
+      return size;
+   }
+
+   /* too few columns to interleave, count a multiple of them and fold */
+   k = columns * ((HISTOGRAM_BANKS + columns - 1) / columns);
+   bank = (uint32_t *)malloc(k * 256 * sizeof(uint32_t));
+   if (bank == NULL)
+      return (0);
+
+   /* chunks are a multiple of k bytes, every one starts on column 0 */
+   for (left = size; left > 0; left -= n, buf += n) {
+      n = MIN(left, HISTOGRAM_CHUNK / k * k);
+      memset(bank, '\0', k * 256 * sizeof(uint32_t));
+      HistogramColumnBanks(buf, n, k, bank);
+      for (c = 0; c < k; c++)
+         HistogramMergeBanks(hist[c % columns], bank + c * 256, 1, 256);
+   }
+   free(bank);
+   return size;
+}
+
+/**
+ * @fn uint64_t BigramLoadBE64(const uint8_t *p)
+ *
+ * @brief 8 bytes as a big endian word, the first byte on top
+ */
+static ALWAYS_INLINE uint64_t BigramLoadBE64(const uint8_t *p) {
+   uint64_t w;
+
+   memcpy(&w, p, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   return w;
+}
+
+/**
+ * @fn void HistogramBigramsBanked(const uint8_t *buf, size_t size,
+ * 	uint64_t *hist, uint32_t *bank)
+ *
+ * @brief adds the bigrams starting at even offsets to hist and those at odd
+ * 	offsets to bank, reads 8 bytes and the first of the next 8 per step
+ */
+static void HistogramBigramsBanked(const uint8_t *buf, size_t size,
+	uint64_t *hist, uint32_t *bank) {
+   size_t i = 0;
+
+   for (; i + 9 <= size; i += 8) {
+      uint64_t w = BigramLoadBE64(buf + i);
+
+      hist[w >> 48]++;
+      bank[(w >> 40) & 0xFFFF]++;
+      hist[(w >> 32) & 0xFFFF]++;
+      bank[(w >> 24) & 0xFFFF]++;
+      hist[(w >> 16) & 0xFFFF]++;
+      bank[(w >> 8) & 0xFFFF]++;
+      hist[w & 0xFFFF]++;
+      bank[(w & 0xFF) << 8 | buf[i + 8]]++;
+   }
+   for (; i + 1 < size; i++)
+      hist[buf[i] << 8 | buf[i + 1]]++;
+}
+
+/**
+ * @ingroup BitStreamHistogram
+ * @fn uint64_t BitStreamBigramHistogram(BitStream *bs, uint64_t *hist)
+ *
+ * @brief counts the pairs of consecutive bytes of the stream
+ *
+ * @param [in] *bs\n
+ * 	bit stream, a trailing partial byte is not counted
+ * @param [out] *hist\n
+ * 	HISTOGRAM_BIGRAMS counters, bytes a then b counted at a << 8 | b,
+ * 	overwritten
+ * @returns number of bigrams counted, 0 on allocation failure
+ */
+uint64_t BitStreamBigramHistogram(BitStream *bs, uint64_t *hist) {
+   const uint8_t *buf;
+   uint32_t      *bank;
+   uint64_t       size = bs ? bs->nbits / BITS_PER_BYTE : 0;
+   size_t         i, n;
+
+   memset(hist, '\0', HISTOGRAM_BIGRAMS * sizeof(uint64_t));
+   if (size < 2)
+      return (0);
+
+   buf = bs->array;
+   if (size < HISTOGRAM_BIGRAM_BANKED_MIN) {
+      for (i = 0; i + 1 < size; i++)
+         hist[buf[i] << 8 | buf[i + 1]]++;
+      return size - 1;
+   }
+
+   bank = (uint32_t *)malloc(HISTOGRAM_BIGRAMS * sizeof(uint32_t));
+   if (bank == NULL)
+      return (0);
+
+   /* chunks overlap by a byte so the bigram across each boundary counts */
+   for (i = 0; i + 1 < size; i += n - 1) {
+      n = MIN(size - i, HISTOGRAM_CHUNK);
+      memset(bank, '\0', HISTOGRAM_BIGRAMS * sizeof(uint32_t));
+      HistogramBigramsBanked(buf + i, n, hist, bank);
+      HistogramMergeBanks(hist, bank, 1, HISTOGRAM_BIGRAMS);
+   }
+   free(bank);
+   return size - 1;
+}
+
+/**
+ * @struct HistogramBatch
+ * @brief records of a batch and their histograms
+ */
+typedef struct HistogramBatch {
+   BitStream         **records;
+   size_t              n;
+   BitStreamHistogram *hist;
+} HistogramBatch;
+
+/**
+ * @fn void HistogramBatchTask(void *ctx, size_t task, unsigned worker)
+ *
+ * @brief counts HISTOGRAM_BATCH_RECORDS records of the batch
+ */
+static void HistogramBatchTask(void *ctx, size_t task, unsigned worker) {
+   HistogramBatch *batch = (HistogramBatch *)ctx;
+   size_t          r = task * HISTOGRAM_BATCH_RECORDS;
+   size_t          end = MIN(r + HISTOGRAM_BATCH_RECORDS, batch->n);
+
+   (void)worker;
+
+   for (; r < end; r++)
+      BitStreamByteHistogram(batch->records[r], batch->hist[r]);
+}
+
+/**
+ * @ingroup BitStreamHistogram
+ * @fn void BitStreamHistogramBatch(BitStream **records, size_t n,
+ * 	BitStreamHistogram *hist, unsigned nthreads)
+ *
+ * @brief byte histogram of each of many records, spread over the thread
+ * 	pool
+ *
+ * @param [in] **records\n
+ * 	records to count, NULL entries count as empty
+ * @param [in] n\n
+ * 	number of records
+ * @param [out] *hist\n
+ * 	n histograms, hist[r] for records[r], overwritten
+ * @param [in] nthreads\n
+ * 	number of threads, 0 for one per cpu
+ * @returns none
+ */
+void BitStreamHistogramBatch(BitStream **records, size_t n,
+	BitStreamHistogram *hist, unsigned nthreads) {
+   HistogramBatch batch = { records, n, hist };
+
+   BitStreamParallelFor(nthreads, (n + HISTOGRAM_BATCH_RECORDS - 1) /
+		   HISTOGRAM_BATCH_RECORDS, HistogramBatchTask, &batch);
+}
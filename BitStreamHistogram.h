@@ -0,0 +1,62 @@
+/**
+ * @file  BitStreamHistogram.h
+ * @brief Byte, column and bigram histograms of bit streams, for frequency
+ * 	analysis of cipher and plain text
+ */
+#if !defined(_BITSTREAM_HISTOGRAM_H)
+#define _BITSTREAM_HISTOGRAM_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def HISTOGRAM_BANKS
+ * @brief number of interleaved counter banks, consecutive bytes go to
+ * 	different banks so a repeated byte value does not wait on the store of
+ * 	the previous increment of the same counter
+ */
+#define HISTOGRAM_BANKS		4
+
+/**
+ * @def HISTOGRAM_BANKED_MIN
+ * @brief buffers shorter than this are counted straight into the result,
+ * 	clearing and merging the banks would cost more than they save
+ */
+#define HISTOGRAM_BANKED_MIN	1024
+
+/**
+ * @def HISTOGRAM_BIGRAMS
+ * @brief number of byte bigrams, the counter of bytes a then b is at
+ * 	index a << 8 | b
+ */
+#define HISTOGRAM_BIGRAMS	65536
+
+/* Type Definitions */
+/**
+ * @typedef BitStreamHistogram
+ * @brief occurrences of each byte value
+ */
+typedef uint64_t BitStreamHistogram[256];
+
+
+void BitStreamHistogramBytes(const uint8_t *buf, size_t size,
+	BitStreamHistogram hist) ;
+
+uint64_t BitStreamByteHistogram(BitStream *bs, BitStreamHistogram hist) ;
+
+uint64_t BitStreamColumnHistogram(BitStream *bs, uint32_t columns,
+	BitStreamHistogram *hist) ;
+
+uint64_t BitStreamBigramHistogram(BitStream *bs, uint64_t *hist) ;
+
+void BitStreamHistogramBatch(BitStream **records, size_t n,
+	BitStreamHistogram *hist, unsigned nthreads) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_HISTOGRAM_H */
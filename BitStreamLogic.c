@@ -0,0 +1,882 @@
+/**
+ * @file BitStreamLogic.c
+ *
+ * @brief Implements bitwise operations on whole streams
+ *
+ * Every operation runs on the byte array with one of two sets of kernels,
+ * 64 bit words or AVX2 vectors picked at runtime. AND, OR, ANDNOT, XOR and
+ * NOT are byte for byte. Since a stream is most significant bit first, shifting
+ * it by n bits is moving the bytes by n / 8 and shifting every byte by
+ * r = n % 8 while carrying the bits it loses into its neighbour:
+ *
+ *   left  (towards offset 0)  out[b] = in[b] << r | in[b + 1] >> (8 - r)
+ *   right (away from 0)       out[b] = in[b] >> r | in[b - 1] << (8 - r)
+ *
+ * The left kernel runs upwards and the right one downwards, every byte is
+ * read before the byte it moves to is written, so a stream can be shifted
+ * within its own buffer. Rotates shift in place and put back the bits that
+ * fell off, concatenation copies the second stream behind the first at any
+ * bit offset with the same kernel.
+ *
+ * All operations take a destination: NULL for a new stream, one of the
+ * operands to work in place, or any other stream, which is resized. Bits
+ * past the end of a result are cleared.
+ *
+ * @internal BitStreamLogicSelect
+ * 	     BitStreamCopyBits
+ * 	     BitStreamAnd
+ * 	     BitStreamOr
+ * 	     BitStreamAndNot
+ * 	     BitStreamXor
+ * 	     BitStreamNot
+ * 	     BitStreamShiftLeft
+ * 	     BitStreamShiftRight
+ * 	     BitStreamRotateLeft
+ * 	     BitStreamRotateRight
+ * 	     BitStreamConcat
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+
+#include "BitStreamLogic.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LOGIC_HAVE_AVX2	1
+#include <immintrin.h>
+#define AVX2_TARGET	__attribute__((target("avx2")))
+#endif
+
+#define ALWAYS_INLINE	inline __attribute__((always_inline))
+
+/**
+ * @enum LogicOp
+ * @brief byte for byte operations
+ */
+typedef enum LogicOp {
+   LOGIC_AND = 0,
+   LOGIC_OR,
+   LOGIC_ANDNOT,
+   LOGIC_XOR,
+   LOGIC_NOT,
+   LOGIC_OPS
+} LogicOp;
+
+/**
+ * @typedef LogicKernel
+ * @brief out[i] = x[i] op y[i] for i in [0, n), y is NULL for LOGIC_NOT,
+ * 	out may be x or y
+ */
+typedef void (*LogicKernel)(uint8_t *out, const uint8_t *x, const uint8_t *y,
+	size_t n);
+
+/**
+ * @typedef ShiftKernel
+ * @brief the left or right byte shift of the file comment for b in [0, n)
+ * 	with 1 <= r <= 7, reading in[0..n] (left) or in[-1..n-1] (right)
+ */
+typedef void (*ShiftKernel)(uint8_t *out, const uint8_t *in, size_t n,
+	unsigned r);
+
+/**
+ * @struct LogicOps
+ * @brief kernels of one implementation
+ */
+typedef struct LogicOps {
+   BitStreamLogicImpl impl;
+   LogicKernel        logic[LOGIC_OPS];
+   ShiftKernel        left;
+   ShiftKernel        right;
+} LogicOps;
+
+static ALWAYS_INLINE uint64_t LogicLoadBE64(const uint8_t *p) {
+   uint64_t w;
+
+   memcpy(&w, p, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   return w;
+}
+
+static ALWAYS_INLINE void LogicStoreBE64(uint8_t *p, uint64_t w) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   memcpy(p, &w, 8);
+}
+
+/**
+ * @fn uint64_t LogicApply(LogicOp op, uint64_t x, uint64_t y)
+ *
+ * @brief op on a word, op is a constant once inlined
+ */
+static ALWAYS_INLINE uint64_t LogicApply(LogicOp op, uint64_t x, uint64_t y) {
+   switch (op) {
+   case LOGIC_AND:    return x & y;
+   case LOGIC_OR:     return x | y;
+   case LOGIC_ANDNOT: return x & ~y;
+   case LOGIC_XOR:    return x ^ y;
+   default:           return ~x;
+   }
+}
+
+/**
+ * @fn void LogicWords(LogicOp op, uint8_t *out, const uint8_t *x,
+ * 	const uint8_t *y, size_t n)
+ *
+ * @brief 64 bit word kernel of op, also finishes the tails of the vector one
+ */
+static ALWAYS_INLINE void LogicWords(LogicOp op, uint8_t *out,
+	const uint8_t *x, const uint8_t *y, size_t n) {
+   uint64_t a, b = 0;
+   size_t   i = 0;
+
+   for (; i + 8 <= n; i += 8) {
+      memcpy(&a, x + i, 8);
+      if (op != LOGIC_NOT)
+         memcpy(&b, y + i, 8);
+      a = LogicApply(op, a, b);
+      memcpy(out + i, &a, 8);
+   }
+   for (; i < n; i++)
+      out[i] = (uint8_t)LogicApply(op, x[i], op != LOGIC_NOT ? y[i] : 0);
+}
+
+/**
+ * @fn void ShiftLeftWords(uint8_t *out, const uint8_t *in, size_t n,
+ * 	unsigned r)
+ *
+ * @brief left byte shift, 8 bytes at a time as one big endian word
+ */
+static ALWAYS_INLINE void ShiftLeftWords(uint8_t *out, const uint8_t *in,
+	size_t n, unsigned r) {
+   size_t b = 0;
+
+   for (; b + 8 <= n; b += 8)
+      LogicStoreBE64(out + b, LogicLoadBE64(in + b) << r |
+		      in[b + 8] >> (8 - r));
+   for (; b < n; b++)
+      out[b] = (uint8_t)(in[b] << r | in[b + 1] >> (8 - r));
+}
+
+/**
+ * @fn void ShiftRightWords(uint8_t *out, const uint8_t *in, size_t n,
+ * 	unsigned r)
+ *
+ * @brief right byte shift, 8 bytes at a time from the top down
+ */
+static ALWAYS_INLINE void ShiftRightWords(uint8_t *out, const uint8_t *in,
+	size_t n, unsigned r) {
+   size_t b = n;
+
+   for (; b % 8; b--)
+      out[b - 1] = (uint8_t)(in[b - 1] >> r | in[b - 2] << (8 - r));
+   for (; b >= 8; b -= 8)
+      LogicStoreBE64(out + b - 8, LogicLoadBE64(in + b - 8) >> r |
+		      (uint64_t)in[b - 9] << (64 - r));
+}
+
+static void WordAnd(uint8_t *out, const uint8_t *x, const uint8_t *y,
+	size_t n) {
+   LogicWords(LOGIC_AND, out, x, y, n);
+}
+
+static void WordOr(uint8_t *out, const uint8_t *x, const uint8_t *y,
+	size_t n) {
+   LogicWords(LOGIC_OR, out, x, y, n);
+}
+
+static void WordAndNot(uint8_t *out, const uint8_t *x, const uint8_t *y,
+	size_t n) {
+   LogicWords(LOGIC_ANDNOT, out, x, y, n);
+}
+
+static void WordXor(uint8_t *out, const uint8_t *x, const uint8_t *y,
+	size_t n) {
+   LogicWords(LOGIC_XOR, out, x, y, n);
+}
+
+static void WordNot(uint8_t *out, const uint8_t *x, const uint8_t *y,
+	size_t n) {
+   LogicWords(LOGIC_NOT, out, x, y, n);
+}
+
+static void WordLeft(uint8_t *out, const uint8_t *in, size_t n, unsigned r) {
+   ShiftLeftWords(out, in, n, r);
+}
+
+static void WordRight(uint8_t *out, const uint8_t *in, size_t n, unsigned r) {
+   ShiftRightWords(out, in, n, r);
+}
+
+static const LogicOps LogicWord = {
+   BITSTREAM_LOGIC_WORD,
+   { WordAnd, WordOr, WordAndNot, WordXor, WordNot }, WordLeft, WordRight
+};
+
+#if defined(LOGIC_HAVE_AVX2)
+/**
+ * @fn void LogicVectors(LogicOp op, uint8_t *out, const uint8_t *x,
+ * 	const uint8_t *y, size_t n)
+ *
+ * @brief AVX2 kernel of op, 64 bytes per iteration
+ */
+static ALWAYS_INLINE AVX2_TARGET void LogicVectors(LogicOp op, uint8_t *out,
+	const uint8_t *x, const uint8_t *y, size_t n) {
+   __m256i ones = _mm256_set1_epi8(-1);
+   size_t  i = 0;
+
+   for (; i + 64 <= n; i += 64) {
+      __m256i a0 = _mm256_loadu_si256((const __m256i *)(x + i));
+      __m256i a1 = _mm256_loadu_si256((const __m256i *)(x + i + 32));
+      __m256i b0 = ones, b1 = ones;
+
+      if (op != LOGIC_NOT) {
+         b0 = _mm256_loadu_si256((const __m256i *)(y + i));
+         b1 = _mm256_loadu_si256((const __m256i *)(y + i + 32));
+      }
+      switch (op) {
+      case LOGIC_AND:
+         a0 = _mm256_and_si256(a0, b0);
+         a1 = _mm256_and_si256(a1, b1);
+         break;
+      case LOGIC_OR:
+         a0 = _mm256_or_si256(a0, b0);
+         a1 = _mm256_or_si256(a1, b1);
+         break;
+      case LOGIC_ANDNOT:
+         a0 = _mm256_andnot_si256(b0, a0);
+         a1 = _mm256_andnot_si256(b1, a1);
+         break;
+      default:
+         /* XOR, and NOT as XOR with ones */
+         a0 = _mm256_xor_si256(a0, b0);
+         a1 = _mm256_xor_si256(a1, b1);
+         break;
+      }
+      _mm256_storeu_si256((__m256i *)(out + i), a0);
+      _mm256_storeu_si256((__m256i *)(out + i + 32), a1);
+   }
+   LogicWords(op, out + i, x + i, op != LOGIC_NOT ? y + i : NULL, n - i);
+}
+
+/**
+ * @fn __m256i ShiftBytes(__m256i v, __m256i w, unsigned r)
+ *
+ * @brief v << r | w >> (8 - r) in each byte, AVX2 shifts 16 bit lanes
+ * 	so the bits crossing into the other byte of a lane are masked off
+ */
+static ALWAYS_INLINE AVX2_TARGET __m256i ShiftBytes(__m256i v, __m256i w,
+	unsigned r) {
+   __m128i l = _mm_cvtsi32_si128(r);
+   __m128i rr = _mm_cvtsi32_si128(8 - r);
+
+   v = _mm256_and_si256(_mm256_sll_epi16(v, l),
+		   _mm256_set1_epi8((char)(0xFF << r)));
+   w = _mm256_and_si256(_mm256_srl_epi16(w, rr),
+		   _mm256_set1_epi8((char)(0xFF >> (8 - r))));
+   return _mm256_or_si256(v, w);
+}
+
+static AVX2_TARGET void Avx2And(uint8_t *out, const uint8_t *x,
+	const uint8_t *y, size_t n) {
+   LogicVectors(LOGIC_AND, out, x, y, n);
+}
+
+static AVX2_TARGET void Avx2Or(uint8_t *out, const uint8_t *x,
+	const uint8_t *y, size_t n) {
+   LogicVectors(LOGIC_OR, out, x, y, n);
+}
+
+static AVX2_TARGET void Avx2AndNot(uint8_t *out, const uint8_t *x,
+	const uint8_t *y, size_t n) {
+   LogicVectors(LOGIC_ANDNOT, out, x, y, n);
+}
+
+static AVX2_TARGET void Avx2Xor(uint8_t *out, const uint8_t *x,
+	const uint8_t *y, size_t n) {
+   LogicVectors(LOGIC_XOR, out, x, y, n);
+}
+
+static AVX2_TARGET void Avx2Not(uint8_t *out, const uint8_t *x,
+	const uint8_t *y, size_t n) {
+   LogicVectors(LOGIC_NOT, out, x, y, n);
+}
+
+/**
+ * @fn void Avx2Left(uint8_t *out, const uint8_t *in, size_t n, unsigned r)
+ *
+ * @brief left byte shift, 32 bytes at a time, upwards
+ */
+static AVX2_TARGET void Avx2Left(uint8_t *out, const uint8_t *in, size_t n,
+	unsigned r) {
+   size_t b = 0;
+
+   for (; b + 32 <= n; b += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(in + b));
+      __m256i w = _mm256_loadu_si256((const __m256i *)(in + b + 1));
+
+      _mm256_storeu_si256((__m256i *)(out + b), ShiftBytes(v, w, r));
+   }
+   ShiftLeftWords(out + b, in + b, n - b, r);
+}
+
+/**
+ * @fn void Avx2Right(uint8_t *out, const uint8_t *in, size_t n, unsigned r)
+ *
+ * @brief right byte shift, 32 bytes at a time, downwards
+ */
+static AVX2_TARGET void Avx2Right(uint8_t *out, const uint8_t *in, size_t n,
+	unsigned r) {
+   size_t b = n;
+
+   for (; b % 32; b--)
+      out[b - 1] = (uint8_t)(in[b - 1] >> r | in[b - 2] << (8 - r));
+   for (; b >= 32; b -= 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(in + b - 33));
+      __m256i w = _mm256_loadu_si256((const __m256i *)(in + b - 32));
+
+      /* out = w >> r | v << (8 - r), the left shift by 8 - r */
+      _mm256_storeu_si256((__m256i *)(out + b - 32), ShiftBytes(v, w,
+			      8 - r));
+   }
+}
+
+static const LogicOps LogicAvx2 = {
+   BITSTREAM_LOGIC_AVX2,
+   { Avx2And, Avx2Or, Avx2AndNot, Avx2Xor, Avx2Not }, Avx2Left, Avx2Right
+};
+#endif /* LOGIC_HAVE_AVX2 */
+
+static const LogicOps *Logic = NULL;
+static pthread_once_t  LogicOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @fn const LogicOps* LogicChoose(BitStreamLogicImpl impl)
+ *
+ * @brief kernels of impl, the word ones if the cpu lacks what impl needs
+ */
+static const LogicOps* LogicChoose(BitStreamLogicImpl impl) {
+#if defined(LOGIC_HAVE_AVX2)
+   if (impl != BITSTREAM_LOGIC_WORD && __builtin_cpu_supports("avx2"))
+      return &LogicAvx2;
+#endif
+   (void)impl;
+   return &LogicWord;
+}
+
+/**
+ * @fn void LogicInit(void)
+ *
+ * @brief picks the implementation on first use
+ */
+static void LogicInit(void) {
+   if (Logic == NULL)
+      Logic = LogicChoose(BITSTREAM_LOGIC_AUTO);
+}
+
+/**
+ * @fn const LogicOps* LogicGetOps(void)
+ *
+ * @brief implementation in use
+ */
+static inline const LogicOps* LogicGetOps(void) {
+   pthread_once(&LogicOnce, LogicInit);
+   return Logic;
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStreamLogicImpl BitStreamLogicSelect(BitStreamLogicImpl impl)
+ *
+ * @brief selects the kernels used by all subsequent calls, meant to be
+ * 	called once at startup (or by tests comparing the implementations)
+ *
+ * @param [in] impl\n
+ * 	implementation wanted, BITSTREAM_LOGIC_AUTO for the fastest available
+ * @returns implementation selected, words if the one asked for is not
+ * 	available on this cpu
+ */
+BitStreamLogicImpl BitStreamLogicSelect(BitStreamLogicImpl impl) {
+   pthread_once(&LogicOnce, LogicInit);
+   Logic = LogicChoose(impl);
+   return Logic->impl;
+}
+
+/**
+ * @fn void LogicClearBits(uint8_t *buf, uint64_t from, uint64_t to)
+ *
+ * @brief clears the bits [from, to) of buf
+ */
+static void LogicClearBits(uint8_t *buf, uint64_t from, uint64_t to) {
+   uint64_t first = (from + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+   uint64_t last = to / BITS_PER_BYTE;
+
+   if (from >= to)
+      return;
+
+   if (first > last) {
+      /* within one byte */
+      buf[last] &= (uint8_t)~((0xFF >> (from % BITS_PER_BYTE)) &
+		      (0xFF << (BITS_PER_BYTE - to % BITS_PER_BYTE)));
+      return;
+   }
+   if (from % BITS_PER_BYTE)
+      buf[first - 1] &= (uint8_t)(0xFF << (BITS_PER_BYTE -
+			      from % BITS_PER_BYTE));
+   memset(buf + first, 0, last - first);
+   if (to % BITS_PER_BYTE)
+      buf[last] &= (uint8_t)(0xFF >> (to % BITS_PER_BYTE));
+}
+
+/**
+ * @fn void LogicClearPad(BitStream *bs)
+ *
+ * @brief clears the bits of the last byte that lie past the end
+ */
+static inline void LogicClearPad(BitStream *bs) {
+   if (bs->nbits % BITS_PER_BYTE)
+      bs->array[bs->nbits / BITS_PER_BYTE] &= (uint8_t)(0xFF <<
+		      (BITS_PER_BYTE - bs->nbits % BITS_PER_BYTE));
+}
+
+/**
+ * @fn BitStream* LogicTarget(BitStream *dst, BitStream *bx, BitStream *by,
+ * 	uint64_t nbits)
+ *
+ * @brief stream receiving a result of nbits, a new one if dst is NULL, dst
+ * 	itself if it is an operand, else dst resized
+ *
+ * @returns the stream, NULL on allocation failure
+ */
+static BitStream* LogicTarget(BitStream *dst, BitStream *bx, BitStream *by,
+	uint64_t nbits) {
+   if (dst == NULL)
+      return BitStreamCreate(nbits);
+
+   if (dst != bx && dst != by)
+      BitStreamRealloc(dst, NULL, nbits);
+   if (nbits && dst->array == NULL)
+      return NULL;
+
+   dst->nbits = nbits;
+   return dst;
+}
+
+/**
+ * @fn uint8_t LogicGetBits(const uint8_t *buf, uint64_t offset, unsigned n)
+ *
+ * @brief the n <= 8 bits at offset, right aligned, touching the next byte
+ * 	only if the bits reach into it
+ */
+static inline uint8_t LogicGetBits(const uint8_t *buf, uint64_t offset,
+	unsigned n) {
+   const uint8_t *p = buf + offset / BITS_PER_BYTE;
+   unsigned       j = offset % BITS_PER_BYTE;
+   unsigned       v = (unsigned)p[0] << 8;
+
+   if (j + n > BITS_PER_BYTE)
+      v |= p[1];
+   return (uint8_t)((v << j) >> (16 - n));
+}
+
+/**
+ * @fn void LogicPutBits(uint8_t *buf, uint64_t offset, uint8_t v,
+ * 	unsigned n)
+ *
+ * @brief stores the n low bits of v at offset, the bits must not cross a
+ * 	byte boundary
+ */
+static inline void LogicPutBits(uint8_t *buf, uint64_t offset, uint8_t v,
+	unsigned n) {
+   unsigned shift = BITS_PER_BYTE - offset % BITS_PER_BYTE - n;
+   uint8_t  mask = (uint8_t)(((1U << n) - 1) << shift);
+
+   buf[offset / BITS_PER_BYTE] = (uint8_t)((buf[offset / BITS_PER_BYTE] &
+			   ~mask) | ((v << shift) & mask));
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn void BitStreamCopyBits(uint8_t *dst, uint64_t dstOffset,
+ * 	const uint8_t *src, uint64_t srcOffset, uint64_t nbits)
+ *
+ * @brief copies nbits bits between any two bit offsets, the bits of dst
+ * 	around the copy are kept
+ *
+ * @param [out] *dst\n
+ * 	destination buffer
+ * @param [in] dstOffset\n
+ * 	bit offset of the copy in dst
+ * @param [in] *src\n
+ * 	source buffer, the bits copied must not overlap those written
+ * @param [in] srcOffset\n
+ * 	bit offset of the bits to copy in src
+ * @param [in] nbits\n
+ * 	number of bits to copy
+ * @returns none
+ */
+void BitStreamCopyBits(uint8_t *dst, uint64_t dstOffset, const uint8_t *src,
+	uint64_t srcOffset, uint64_t nbits) {
+   uint64_t bytes;
+   unsigned n, s;
+
+   /* up to the next byte boundary of dst */
+   if (nbits && dstOffset % BITS_PER_BYTE) {
+      n = (unsigned)MIN(BITS_PER_BYTE - dstOffset % BITS_PER_BYTE, nbits);
+      LogicPutBits(dst, dstOffset, LogicGetBits(src, srcOffset, n), n);
+      dstOffset += n;
+      srcOffset += n;
+      nbits -= n;
+   }
+
+   bytes = nbits / BITS_PER_BYTE;
+   s = srcOffset % BITS_PER_BYTE;
+   if (bytes) {
+      if (s == 0)
+         memcpy(dst + dstOffset / BITS_PER_BYTE,
+			 src + srcOffset / BITS_PER_BYTE, bytes);
+      else
+         LogicGetOps()->left(dst + dstOffset / BITS_PER_BYTE,
+			 src + srcOffset / BITS_PER_BYTE, bytes, s);
+      dstOffset += bytes * BITS_PER_BYTE;
+      srcOffset += bytes * BITS_PER_BYTE;
+   }
+
+   n = nbits % BITS_PER_BYTE;
+   if (n)
+      LogicPutBits(dst, dstOffset, LogicGetBits(src, srcOffset, n), n);
+}
+
+/**
+ * @fn BitStream* LogicRun(LogicOp op, BitStream *dst, BitStream *bx,
+ * 	BitStream *by)
+ *
+ * @brief dst = bx op by over the length of bx
+ */
+static BitStream* LogicRun(LogicOp op, BitStream *dst, BitStream *bx,
+	BitStream *by) {
+   if (bx == NULL || (op != LOGIC_NOT && (by == NULL ||
+				   by->nbits < bx->nbits)))
+      return NULL;
+
+   dst = LogicTarget(dst, bx, by, bx->nbits);
+   if (dst && dst->nbits) {
+      LogicGetOps()->logic[op](dst->array, bx->array,
+		      op != LOGIC_NOT ? by->array : NULL,
+		      (dst->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE);
+      LogicClearPad(dst);
+   }
+   return dst;
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamAnd(BitStream *dst, BitStream *bx, BitStream *by)
+ *
+ * @brief dst = bx AND by
+ *
+ * @param [out] *dst\n
+ * 	result, NULL for a new stream, bx or by to work in place
+ * @param [in] *bx\n
+ * 	first operand, its length is the length of the result
+ * @param [in] *by\n
+ * 	second operand, at least as long as bx
+ * @returns the result, NULL on invalid operands or allocation failure
+ */
+BitStream* BitStreamAnd(BitStream *dst, BitStream *bx, BitStream *by) {
+   return LogicRun(LOGIC_AND, dst, bx, by);
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamOr(BitStream *dst, BitStream *bx, BitStream *by)
+ *
+ * @brief dst = bx OR by, operands as for BitStreamAnd()
+ *
+ * @returns the result, NULL on invalid operands or allocation failure
+ */
+BitStream* BitStreamOr(BitStream *dst, BitStream *bx, BitStream *by) {
+   return LogicRun(LOGIC_OR, dst, bx, by);
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamAndNot(BitStream *dst, BitStream *bx,
+ * 	BitStream *by)
+ *
+ * @brief dst = bx AND NOT by, clears the bits of bx set in the mask by,
+ * 	operands as for BitStreamAnd()
+ *
+ * @returns the result, NULL on invalid operands or allocation failure
+ */
+BitStream* BitStreamAndNot(BitStream *dst, BitStream *bx, BitStream *by) {
+   return LogicRun(LOGIC_ANDNOT, dst, bx, by);
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamXor(BitStream *dst, BitStream *bx, BitStream *by)
+ *
+ * @brief dst = bx XOR by, operands as for BitStreamAnd(), unlike
+ * 	BitStreamExclusiveOr() by does not repeat and bx may be overwritten
+ *
+ * @returns the result, NULL on invalid operands or allocation failure
+ */
+BitStream* BitStreamXor(BitStream *dst, BitStream *bx, BitStream *by) {
+   return LogicRun(LOGIC_XOR, dst, bx, by);
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamNot(BitStream *dst, BitStream *bx)
+ *
+ * @brief dst = NOT bx
+ *
+ * @param [out] *dst\n
+ * 	result, NULL for a new stream, bx to work in place
+ * @param [in] *bx\n
+ * 	operand
+ * @returns the result, NULL on allocation failure
+ */
+BitStream* BitStreamNot(BitStream *dst, BitStream *bx) {
+   return LogicRun(LOGIC_NOT, dst, bx, NULL);
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamShiftLeft(BitStream *dst, BitStream *bs,
+ * 	uint64_t n)
+ *
+ * @brief logical shift towards offset 0, bit i of the result is bit i + n
+ * 	of bs, zeros come in at the end
+ *
+ * @param [out] *dst\n
+ * 	result, NULL for a new stream, bs to work in place
+ * @param [in] *bs\n
+ * 	stream to shift
+ * @param [in] n\n
+ * 	number of bits to shift by, any value
+ * @returns the result, NULL on allocation failure
+ */
+BitStream* BitStreamShiftLeft(BitStream *dst, BitStream *bs, uint64_t n) {
+   uint64_t nbits, bytes, q;
+   unsigned r;
+
+   if (bs == NULL || (dst = LogicTarget(dst, bs, NULL, bs->nbits)) == NULL)
+      return NULL;
+
+   nbits = bs->nbits;
+   bytes = (nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+   if (n < nbits) {
+      q = n / BITS_PER_BYTE;
+      r = n % BITS_PER_BYTE;
+      if (r == 0) {
+         memmove(dst->array, bs->array + q, bytes - q);
+      } else {
+         LogicGetOps()->left(dst->array, bs->array + q, bytes - q - 1, r);
+         dst->array[bytes - q - 1] = (uint8_t)(bs->array[bytes - 1] << r);
+      }
+   }
+   if (bytes)
+      LogicClearBits(dst->array, n < nbits ? nbits - n : 0,
+		      bytes * BITS_PER_BYTE);
+   return dst;
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamShiftRight(BitStream *dst, BitStream *bs,
+ * 	uint64_t n)
+ *
+ * @brief logical shift away from offset 0, bit i + n of the result is bit i
+ * 	of bs, zeros come in at the start
+ *
+ * @param [out] *dst\n
+ * 	result, NULL for a new stream, bs to work in place
+ * @param [in] *bs\n
+ * 	stream to shift
+ * @param [in] n\n
+ * 	number of bits to shift by, any value
+ * @returns the result, NULL on allocation failure
+ */
+BitStream* BitStreamShiftRight(BitStream *dst, BitStream *bs, uint64_t n) {
+   uint64_t nbits, bytes, q;
+   unsigned r;
+
+   if (bs == NULL || (dst = LogicTarget(dst, bs, NULL, bs->nbits)) == NULL)
+      return NULL;
+
+   nbits = bs->nbits;
+   bytes = (nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+   if (n < nbits) {
+      q = n / BITS_PER_BYTE;
+      r = n % BITS_PER_BYTE;
+      if (r == 0) {
+         memmove(dst->array + q, bs->array, bytes - q);
+      } else {
+         LogicGetOps()->right(dst->array + q + 1, bs->array + 1,
+			 bytes - q - 1, r);
+         dst->array[q] = (uint8_t)(bs->array[0] >> r);
+      }
+   }
+   if (bytes) {
+      LogicClearBits(dst->array, 0, MIN(n, nbits));
+      LogicClearPad(dst);
+   }
+   return dst;
+}
+
+/**
+ * @fn BitStream* LogicRotateInPlace(BitStream *bs, uint64_t k)
+ *
+ * @brief rotates bs by 0 < k < nbits towards offset 0, the shorter of the
+ * 	two pieces is set aside while the other is shifted in place
+ */
+static BitStream* LogicRotateInPlace(BitStream *bs, uint64_t k) {
+   uint64_t nbits = bs->nbits;
+   uint64_t m = nbits - k;
+   uint8_t *tmp;
+
+   tmp = (uint8_t *)malloc((MIN(k, m) + BITS_PER_BYTE - 1) / BITS_PER_BYTE);
+   if (tmp == NULL)
+      return NULL;
+
+   if (k <= m) {
+      BitStreamCopyBits(tmp, 0, bs->array, 0, k);
+      BitStreamShiftLeft(bs, bs, k);
+      BitStreamCopyBits(bs->array, m, tmp, 0, k);
+   } else {
+      BitStreamCopyBits(tmp, 0, bs->array, k, m);
+      BitStreamShiftRight(bs, bs, m);
+      BitStreamCopyBits(bs->array, 0, tmp, 0, m);
+   }
+   free(tmp);
+   return bs;
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamRotateLeft(BitStream *dst, BitStream *bs,
+ * 	uint64_t n)
+ *
+ * @brief rotation towards offset 0, bit i of the result is bit
+ * 	(i + n) % nbits of bs
+ *
+ * @param [out] *dst\n
+ * 	result, NULL for a new stream, bs to work in place
+ * @param [in] *bs\n
+ * 	stream to rotate
+ * @param [in] n\n
+ * 	number of bits to rotate by, any value
+ * @returns the result, NULL on allocation failure
+ */
+BitStream* BitStreamRotateLeft(BitStream *dst, BitStream *bs, uint64_t n) {
+   uint64_t nbits, k;
+
+   if (bs == NULL)
+      return NULL;
+
+   nbits = bs->nbits;
+   k = nbits ? n % nbits : 0;
+
+   if (dst == bs) {
+      if (k)
+         return LogicRotateInPlace(bs, k);
+      LogicClearPad(bs);
+      return bs;
+   }
+
+   dst = LogicTarget(dst, bs, NULL, nbits);
+   if (dst && nbits) {
+      BitStreamCopyBits(dst->array, 0, bs->array, k, nbits - k);
+      BitStreamCopyBits(dst->array, nbits - k, bs->array, 0, k);
+      LogicClearPad(dst);
+   }
+   return dst;
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamRotateRight(BitStream *dst, BitStream *bs,
+ * 	uint64_t n)
+ *
+ * @brief rotation away from offset 0, bit (i + n) % nbits of the result is
+ * 	bit i of bs
+ *
+ * @param [out] *dst\n
+ * 	result, NULL for a new stream, bs to work in place
+ * @param [in] *bs\n
+ * 	stream to rotate
+ * @param [in] n\n
+ * 	number of bits to rotate by, any value
+ * @returns the result, NULL on allocation failure
+ */
+BitStream* BitStreamRotateRight(BitStream *dst, BitStream *bs, uint64_t n) {
+   uint64_t nbits;
+
+   if (bs == NULL)
+      return NULL;
+
+   nbits = bs->nbits;
+   return BitStreamRotateLeft(dst, bs, nbits ? nbits - n % nbits : 0);
+}
+
+/**
+ * @ingroup BitStreamLogic
+ * @fn BitStream* BitStreamConcat(BitStream *dst, BitStream *bx,
+ * 	BitStream *by)
+ *
+ * @brief dst = the bits of bx followed by the bits of by, whatever their
+ * 	lengths
+ *
+ * @param [out] *dst\n
+ * 	result, NULL for a new stream, bx to append by to it, or any other
+ * 	stream
+ * @param [in] *bx\n
+ * 	first part
+ * @param [in] *by\n
+ * 	second part, may be bx
+ * @returns the result, NULL on allocation failure
+ */
+BitStream* BitStreamConcat(BitStream *dst, BitStream *bx, BitStream *by) {
+   BitStream *tmp;
+   uint64_t   a, b;
+
+   if (bx == NULL || by == NULL)
+      return NULL;
+
+   a = bx->nbits;
+   b = by->nbits;
+
+   if (dst == by && dst != bx) {
+      /* prepending, build the result aside and hand its array over */
+      tmp = BitStreamConcat(NULL, bx, by);
+      if (tmp == NULL)
+         return NULL;
+      BitStreamRealloc(dst, tmp->array, a + b);
+      free(tmp);
+      return dst;
+   }
+
+   if (dst == NULL) {
+      dst = BitStreamCreate(a + b);
+   } else {
+      BitStreamRealloc(dst, NULL, a + b);
+      if (a + b && dst->array == NULL)
+         return NULL;
+   }
+   if (dst == NULL || a + b == 0)
+      return dst;
+
+   if (dst != bx && a)
+      memcpy(dst->array, bx->array, (a + BITS_PER_BYTE - 1) / BITS_PER_BYTE);
+   BitStreamCopyBits(dst->array, a, by->array, 0, b);
+   LogicClearPad(dst);
+
+   return dst;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file  BitStreamLogic.h
+ * @brief Bitwise operations on whole streams: AND, OR, ANDNOT, XOR, NOT,
+ * 	shifts, rotates and concatenation
+ */
+#if !defined(_BITSTREAM_LOGIC_H)
+#define _BITSTREAM_LOGIC_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Type Definitions */
+/**
+ * @enum BitStreamLogicImpl
+ * @brief implementations of the word kernels
+ */
+typedef enum BitStreamLogicImpl {
+   BITSTREAM_LOGIC_AUTO = 0,   /**< fastest the cpu supports */
+   BITSTREAM_LOGIC_WORD,       /**< portable 64 bit words */
+   BITSTREAM_LOGIC_AVX2        /**< 256 bit AVX2 vectors */
+} BitStreamLogicImpl;
+
+
+BitStreamLogicImpl BitStreamLogicSelect(BitStreamLogicImpl impl) ;
+
+void BitStreamCopyBits(uint8_t *dst, uint64_t dstOffset, const uint8_t *src,
+	uint64_t srcOffset, uint64_t nbits) ;
+
+BitStream* BitStreamAnd(BitStream *dst, BitStream *bx, BitStream *by) ;
+
+BitStream* BitStreamOr(BitStream *dst, BitStream *bx, BitStream *by) ;
+
+BitStream* BitStreamAndNot(BitStream *dst, BitStream *bx, BitStream *by) ;
+
+BitStream* BitStreamXor(BitStream *dst, BitStream *bx, BitStream *by) ;
+
+BitStream* BitStreamNot(BitStream *dst, BitStream *bx) ;
+
+BitStream* BitStreamShiftLeft(BitStream *dst, BitStream *bs, uint64_t n) ;
+
+BitStream* BitStreamShiftRight(BitStream *dst, BitStream *bs, uint64_t n) ;
+
+BitStream* BitStreamRotateLeft(BitStream *dst, BitStream *bs, uint64_t n) ;
+
+BitStream* BitStreamRotateRight(BitStream *dst, BitStream *bs, uint64_t n) ;
+
+BitStream* BitStreamConcat(BitStream *dst, BitStream *bx, BitStream *by) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_LOGIC_H */
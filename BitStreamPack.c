@@ -0,0 +1,395 @@
+/**
+ * @file BitStreamPack.c
+ *
+ * @brief Implements bulk packing of integer arrays into bit fields
+ *
+ * Field i of width w occupies bits [offset + i*w, offset + (i+1)*w) of the
+ * stream, most significant bit first like BitStreamPutByte(). Packing
+ * collects fields in a 64 bit accumulator and stores it a whole big-endian
+ * word at a time, unpacking reads each field with one unaligned word load
+ * (and one more byte for fields wider than 56 bits).
+ *
+ * The kernels are instantiated for each element size and for the common
+ * widths, 1 to 16, 24, 32, 48 and 64 bits, so the shifts and masks are
+ * constants the compiler can unroll around. Byte aligned fields as wide as
+ * the element are a byte swapping copy. The kernels are scalar, there is no
+ * SIMD variant: every field of an odd width sits at a different bit
+ * position, and the unrolled loops of constant shifts serve all widths
+ * without one vector routine per width.
+ *
+ * @internal BitStreamPack8
+ * 	     BitStreamPack16
+ * 	     BitStreamPack32
+ * 	     BitStreamPack64
+ * 	     BitStreamUnpack8
+ * 	     BitStreamUnpack16
+ * 	     BitStreamUnpack32
+ * 	     BitStreamUnpack64
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include "BitStreamPack.h"
+
+#define ALWAYS_INLINE	inline __attribute__((always_inline))
+
+/**
+ * @fn uint64_t PackLoadValue(const void *values, uint64_t i, unsigned size)
+ *
+ * @brief element i of an array of size byte integers
+ */
+static ALWAYS_INLINE uint64_t PackLoadValue(const void *values, uint64_t i,
+	unsigned size) {
+   switch (size) {
+   case 1: return ((const uint8_t *)values)[i];
+   case 2: return ((const uint16_t *)values)[i];
+   case 4: return ((const uint32_t *)values)[i];
+   default: return ((const uint64_t *)values)[i];
+   }
+}
+
+/**
+ * @fn void PackStoreValue(void *values, uint64_t i, unsigned size,
+ * 	uint64_t v)
+ *
+ * @brief stores element i of an array of size byte integers
+ */
+static ALWAYS_INLINE void PackStoreValue(void *values, uint64_t i,
+	unsigned size, uint64_t v) {
+   switch (size) {
+   case 1: ((uint8_t *)values)[i] = (uint8_t)v; break;
+   case 2: ((uint16_t *)values)[i] = (uint16_t)v; break;
+   case 4: ((uint32_t *)values)[i] = (uint32_t)v; break;
+   default: ((uint64_t *)values)[i] = v; break;
+   }
+}
+
+static ALWAYS_INLINE uint64_t PackLoadBE64(const uint8_t *p) {
+   uint64_t w;
+
+   memcpy(&w, p, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   return w;
+}
+
+static ALWAYS_INLINE void PackStoreBE64(uint8_t *p, uint64_t w) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   memcpy(p, &w, 8);
+}
+
+/**
+ * @fn void PackKernel(uint8_t *array, uint64_t offset, const void *values,
+ * 	unsigned size, uint64_t count, uint32_t width)
+ *
+ * @brief packs count fields, all of which fit in the stream
+ *
+ * The accumulator holds nacc pending bits right aligned, it starts with the
+ * bits of the first byte in front of offset so whole bytes can be stored.
+ * Bits above nacc are left over from earlier values and are shifted out
+ * before they can reach memory.
+ */
+static ALWAYS_INLINE void PackKernel(uint8_t *array, uint64_t offset,
+	const void *values, unsigned size, uint64_t count, uint32_t width) {
+   uint8_t  *out = array + offset / BITS_PER_BYTE;
+   uint32_t  nacc = offset % BITS_PER_BYTE;
+   uint64_t  acc = nacc ? out[0] >> (BITS_PER_BYTE - nacc) : 0;
+   uint64_t  mask = width == 64 ? ~0ULL : (1ULL << (width & 63)) - 1;
+   uint64_t  i;
+
+   for (i = 0; i < count; i++) {
+      uint64_t v = PackLoadValue(values, i, size) & mask;
+
+      if (nacc + width < 64) {
+         acc = (acc << width) | v;
+         nacc += width;
+      } else {
+         uint32_t r = 64 - nacc;   /* bits of v completing the word */
+
+         PackStoreBE64(out, (nacc ? acc << (r & 63) : 0) |
+			 (v >> (width - r)));
+         out += 8;
+         acc = v;
+         nacc = width - r;
+      }
+   }
+
+   for (; nacc >= BITS_PER_BYTE; nacc -= BITS_PER_BYTE)
+      *out++ = (uint8_t)(acc >> (nacc - BITS_PER_BYTE));
+   if (nacc)
+      *out = (*out & (0xff >> nacc)) |
+	     (uint8_t)(acc << (BITS_PER_BYTE - nacc));
+}
+
+/**
+ * @fn void UnpackKernel(const uint8_t *array, uint64_t nbytes,
+ * 	uint64_t offset, void *values, unsigned size, uint64_t count,
+ * 	uint32_t width)
+ *
+ * @brief unpacks count fields, all of which are inside the stream
+ */
+static ALWAYS_INLINE void UnpackKernel(const uint8_t *array, uint64_t nbytes,
+	uint64_t offset, void *values, unsigned size, uint64_t count,
+	uint32_t width) {
+   uint64_t i, fast = 0;
+
+   /* fields whose word (and extra byte) can be loaded in place */
+   if (nbytes >= 9 && offset <= (nbytes - 9) * BITS_PER_BYTE + 7)
+      fast = MIN(count, ((nbytes - 9) * BITS_PER_BYTE + 7 - offset) / width +
+		      1);
+
+   for (i = 0; i < fast; i++) {
+      uint64_t       p = offset + i * width;
+      const uint8_t *b = array + p / BITS_PER_BYTE;
+      uint32_t       s = p % BITS_PER_BYTE;
+      uint64_t       x = PackLoadBE64(b) << s;
+
+      if (width + 7 > 64)
+         x |= (uint64_t)b[8] >> (BITS_PER_BYTE - s);
+      PackStoreValue(values, i, size, x >> (64 - width));
+   }
+
+   for (; i < count; i++) {
+      uint64_t       p = offset + i * width;
+      uint64_t       byte = p / BITS_PER_BYTE;
+      uint32_t       s = p % BITS_PER_BYTE;
+      uint8_t        tail[16] = { 0 };
+      uint64_t       x;
+
+      memcpy(tail, array + byte, MIN(nbytes - byte, 9));
+      x = (PackLoadBE64(tail) << s) | ((uint64_t)tail[8] >> (BITS_PER_BYTE -
+			      s));
+      PackStoreValue(values, i, size, x >> (64 - width));
+   }
+}
+
+/**
+ * @def PACK_SPECIALIZE
+ * @brief expands stmt(w) for each specialized width w fitting the element,
+ * 	stmt(width) otherwise
+ */
+#define PACK_SPECIALIZE(size, width, stmt)	\
+   switch (width) {	\
+   PACK_CASE(size, 1, stmt)  PACK_CASE(size, 2, stmt)	\
+   PACK_CASE(size, 3, stmt)  PACK_CASE(size, 4, stmt)	\
+   PACK_CASE(size, 5, stmt)  PACK_CASE(size, 6, stmt)	\
+   PACK_CASE(size, 7, stmt)  PACK_CASE(size, 8, stmt)	\
+   PACK_CASE(size, 9, stmt)  PACK_CASE(size, 10, stmt)	\
+   PACK_CASE(size, 11, stmt) PACK_CASE(size, 12, stmt)	\
+   PACK_CASE(size, 13, stmt) PACK_CASE(size, 14, stmt)	\
+   PACK_CASE(size, 15, stmt) PACK_CASE(size, 16, stmt)	\
+   PACK_CASE(size, 24, stmt) PACK_CASE(size, 32, stmt)	\
+   PACK_CASE(size, 48, stmt) PACK_CASE(size, 64, stmt)	\
+   default: stmt(width); break;	\
+   }
+
+/**
+ * @def PACK_CASE
+ * @brief case w of PACK_SPECIALIZE, a width wider than the element falls
+ * 	through the following cases to the generic stmt(width)
+ */
+#define PACK_CASE(size, w, stmt)	\
+   case w: if (w <= (size) * BITS_PER_BYTE) { stmt(w); break; }	\
+	   __attribute__((fallthrough));
+
+/**
+ * @fn uint64_t PackFields(BitStream *bs, uint64_t offset, const void *values,
+ * 	unsigned size, uint64_t count, uint32_t width)
+ *
+ * @brief common body of the pack routines
+ */
+static ALWAYS_INLINE uint64_t PackFields(BitStream *bs, uint64_t offset,
+	const void *values, unsigned size, uint64_t count, uint32_t width) {
+   uint64_t i;
+
+   if (BitStreamGetArray(bs) == NULL || values == NULL || width == 0 ||
+       width > size * BITS_PER_BYTE || offset >= bs->nbits)
+      return 0;
+
+   count = MIN(count, (bs->nbits - offset) / width);
+
+   if (width == size * BITS_PER_BYTE && offset % BITS_PER_BYTE == 0) {
+      uint8_t *out = bs->array + offset / BITS_PER_BYTE;
+
+      for (i = 0; i < count; i++, out += size) {
+         uint64_t v = PackLoadValue(values, i, size);
+         uint8_t  be[8];
+
+         PackStoreBE64(be, v << (64 - width));
+         memcpy(out, be, size);
+      }
+      return count;
+   }
+
+#define PACK_STMT(w)	PackKernel(bs->array, offset, values, size, count, w)
+   PACK_SPECIALIZE(size, width, PACK_STMT)
+#undef PACK_STMT
+   return count;
+}
+
+/**
+ * @fn uint64_t UnpackFields(BitStream *bs, uint64_t offset, void *values,
+ * 	unsigned size, uint64_t count, uint32_t width)
+ *
+ * @brief common body of the unpack routines
+ */
+static ALWAYS_INLINE uint64_t UnpackFields(BitStream *bs, uint64_t offset,
+	void *values, unsigned size, uint64_t count, uint32_t width) {
+   uint64_t nbytes, i;
+
+   if (BitStreamGetArray(bs) == NULL || values == NULL || width == 0 ||
+       width > size * BITS_PER_BYTE || offset >= bs->nbits)
+      return 0;
+
+   count = MIN(count, (bs->nbits - offset) / width);
+   nbytes = (bs->nbits + 7) / BITS_PER_BYTE;
+
+   if (width == size * BITS_PER_BYTE && offset % BITS_PER_BYTE == 0) {
+      const uint8_t *in = bs->array + offset / BITS_PER_BYTE;
+
+      for (i = 0; i < count; i++, in += size) {
+         uint8_t be[8] = { 0 };
+
+         memcpy(be, in, size);
+         PackStoreValue(values, i, size, PackLoadBE64(be) >> (64 - width));
+      }
+      return count;
+   }
+
+#define UNPACK_STMT(w)	\
+   UnpackKernel(bs->array, nbytes, offset, values, size, count, w)
+   PACK_SPECIALIZE(size, width, UNPACK_STMT)
+#undef UNPACK_STMT
+   return count;
+}
+
+/**
+ * @ingroup BitStreamPack
+ * @fn uint64_t BitStreamPack8(BitStream *bs, uint64_t offset,
+ * 	const uint8_t *values, uint64_t count, uint32_t width)
+ *
+ * @brief stores count values as consecutive width bit fields
+ *
+ * @param [in,out] *bs\n
+ * 	bit stream to store into, bits outside the fields are preserved
+ * @param [in] offset\n
+ * 	bit offset of the first field
+ * @param [in] *values\n
+ * 	values to store, only their low width bits are
+ * @param [in] count\n
+ * 	number of values
+ * @param [in] width\n
+ * 	bits per field, 1 to 8
+ * @returns number of values stored, fewer than count if the stream ends
+ * 	first, 0 on invalid arguments
+ */
+uint64_t BitStreamPack8(BitStream *bs, uint64_t offset, const uint8_t *values,
+	uint64_t count, uint32_t width) {
+   return PackFields(bs, offset, values, 1, count, width);
+}
+
+/**
+ * @ingroup BitStreamPack
+ * @fn uint64_t BitStreamPack16(BitStream *bs, uint64_t offset,
+ * 	const uint16_t *values, uint64_t count, uint32_t width)
+ *
+ * @brief stores count values as consecutive width bit fields, width 1 to
+ * 	16, see BitStreamPack8()
+ */
+uint64_t BitStreamPack16(BitStream *bs, uint64_t offset,
+	const uint16_t *values, uint64_t count, uint32_t width) {
+   return PackFields(bs, offset, values, 2, count, width);
+}
+
+/**
+ * @ingroup BitStreamPack
+ * @fn uint64_t BitStreamPack32(BitStream *bs, uint64_t offset,
+ * 	const uint32_t *values, uint64_t count, uint32_t width)
+ *
+ * @brief stores count values as consecutive width bit fields, width 1 to
+ * 	32, see BitStreamPack8()
+ */
+uint64_t BitStreamPack32(BitStream *bs, uint64_t offset,
+	const uint32_t *values, uint64_t count, uint32_t width) {
+   return PackFields(bs, offset, values, 4, count, width);
+}
+
+/**
+ * @ingroup BitStreamPack
+ * @fn uint64_t BitStreamPack64(BitStream *bs, uint64_t offset,
+ * 	const uint64_t *values, uint64_t count, uint32_t width)
+ *
+ * @brief stores count values as consecutive width bit fields, width 1 to
+ * 	64, see BitStreamPack8()
+ */
+uint64_t BitStreamPack64(BitStream *bs, uint64_t offset,
+	const uint64_t *values, uint64_t count, uint32_t width) {
+   return PackFields(bs, offset, values, 8, count, width);
+}
+
+/**
+ * @ingroup BitStreamPack
+ * @fn uint64_t BitStreamUnpack8(BitStream *bs, uint64_t offset,
+ * 	uint8_t *values, uint64_t count, uint32_t width)
+ *
+ * @brief loads count consecutive width bit fields
+ *
+ * @param [in] *bs\n
+ * 	bit stream to load from
+ * @param [in] offset\n
+ * 	bit offset of the first field
+ * @param [out] *values\n
+ * 	values of the fields, zero extended
+ * @param [in] count\n
+ * 	number of fields
+ * @param [in] width\n
+ * 	bits per field, 1 to 8
+ * @returns number of values loaded, fewer than count if the stream ends
+ * 	first, 0 on invalid arguments
+ */
+uint64_t BitStreamUnpack8(BitStream *bs, uint64_t offset, uint8_t *values,
+	uint64_t count, uint32_t width) {
+   return UnpackFields(bs, offset, values, 1, count, width);
+}
+
+/**
+ * @ingroup BitStreamPack
+ * @fn uint64_t BitStreamUnpack16(BitStream *bs, uint64_t offset,
+ * 	uint16_t *values, uint64_t count, uint32_t width)
+ *
+ * @brief loads count consecutive width bit fields, width 1 to 16, see
+ * 	BitStreamUnpack8()
+ */
+uint64_t BitStreamUnpack16(BitStream *bs, uint64_t offset, uint16_t *values,
+	uint64_t count, uint32_t width) {
+   return UnpackFields(bs, offset, values, 2, count, width);
+}
+
+/**
+ * @ingroup BitStreamPack
+ * @fn uint64_t BitStreamUnpack32(BitStream *bs, uint64_t offset,
+ * 	uint32_t *values, uint64_t count, uint32_t width)
+ *
+ * @brief loads count consecutive width bit fields, width 1 to 32, see
+ * 	BitStreamUnpack8()
+ */
+uint64_t BitStreamUnpack32(BitStream *bs, uint64_t offset, uint32_t *values,
+	uint64_t count, uint32_t width) {
+   return UnpackFields(bs, offset, values, 4, count, width);
+}
+
+/**
+ * @ingroup BitStreamPack
+ * @fn uint64_t BitStreamUnpack64(BitStream *bs, uint64_t offset,
+ * 	uint64_t *values, uint64_t count, uint32_t width)
+ *
+ * @brief loads count consecutive width bit fields, width 1 to 64, see
+ * 	BitStreamUnpack8()
+ */
+uint64_t BitStreamUnpack64(BitStream *bs, uint64_t offset, uint64_t *values,
+	uint64_t count, uint32_t width) {
+   return UnpackFields(bs, offset, values, 8, count, width);
+}
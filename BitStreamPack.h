@@ -0,0 +1,41 @@
+/**
+ * @file  BitStreamPack.h
+ * @brief Bulk packing of integer arrays into fixed width bit fields and back
+ */
+#if !defined(_BITSTREAM_PACK_H)
+#define _BITSTREAM_PACK_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+uint64_t BitStreamPack8(BitStream *bs, uint64_t offset, const uint8_t *values,
+	uint64_t count, uint32_t width) ;
+
+uint64_t BitStreamPack16(BitStream *bs, uint64_t offset,
+	const uint16_t *values, uint64_t count, uint32_t width) ;
+
+uint64_t BitStreamPack32(BitStream *bs, uint64_t offset,
+	const uint32_t *values, uint64_t count, uint32_t width) ;
+
+uint64_t BitStreamPack64(BitStream *bs, uint64_t offset,
+	const uint64_t *values, uint64_t count, uint32_t width) ;
+
+uint64_t BitStreamUnpack8(BitStream *bs, uint64_t offset, uint8_t *values,
+	uint64_t count, uint32_t width) ;
+
+uint64_t BitStreamUnpack16(BitStream *bs, uint64_t offset, uint16_t *values,
+	uint64_t count, uint32_t width) ;
+
+uint64_t BitStreamUnpack32(BitStream *bs, uint64_t offset, uint32_t *values,
+	uint64_t count, uint32_t width) ;
+
+uint64_t BitStreamUnpack64(BitStream *bs, uint64_t offset, uint64_t *values,
+	uint64_t count, uint32_t width) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_PACK_H */
@@ -0,0 +1,209 @@
+/**
+ * @file BitStreamParallel.c
+ *
+ * @brief Implements the thread pool behind the parallel routines
+ *
+ * Workers are created once, on the first parallel call, and sleep between
+ * jobs. A job is a range of task indices, the calling thread and the workers
+ * claim indices from a shared atomic counter until the range is exhausted so
+ * uneven tasks balance themselves. One job runs at a time, a job started
+ * from inside a task runs inline on the calling worker.
+ *
+ * @internal BitStreamParallelThreads
+ * 	     BitStreamParallelFor
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "BitStreamParallel.h"
+
+/**
+ * @def POOL_MAX_THREADS
+ * @brief upper limit on the number of threads in the pool (caller included)
+ */
+#define POOL_MAX_THREADS	256
+
+/**
+ * @struct BitStreamPool
+ * @brief state shared between the caller and the workers of the pool
+ */
+typedef struct BitStreamPool {
+   pthread_mutex_t  jobLock;    /**< serializes jobs */
+   pthread_mutex_t  lock;       /**< protects the fields below */
+   pthread_cond_t   start;      /**< signalled when a job is posted */
+   pthread_cond_t   done;       /**< signalled when the last worker leaves */
+   unsigned         nworkers;   /**< threads in the pool besides callers */
+   uint64_t         generation; /**< incremented for every job */
+   unsigned         active;     /**< workers still running the job */
+
+   BitStreamTask    fn;         /**< job being run */
+   void            *ctx;
+   size_t           ntasks;
+   unsigned         nthreads;   /**< workers with index < nthreads take part */
+   size_t           next;       /**< next task index to claim (atomic) */
+} BitStreamPool;
+
+static BitStreamPool  Pool = {
+   .jobLock = PTHREAD_MUTEX_INITIALIZER,
+   .lock = PTHREAD_MUTEX_INITIALIZER,
+   .start = PTHREAD_COND_INITIALIZER,
+   .done = PTHREAD_COND_INITIALIZER
+};
+static pthread_once_t PoolOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @var PoolInside
+ * @brief set on threads currently running a task, nested jobs run inline
+ */
+static __thread int   PoolInside;
+
+/**
+ * @fn void PoolRun(unsigned worker)
+ *
+ * @brief claims and runs tasks of the current job until none are left
+ *
+ * @param [in] worker\n
+ * 	index of the calling thread within the job
+ * @returns none
+ */
+static void PoolRun(unsigned worker) {
+   size_t task;
+
+   PoolInside = 1;
+   while ((task = __atomic_fetch_add(&Pool.next, 1, __ATOMIC_RELAXED)) <
+	  Pool.ntasks) {
+      Pool.fn(Pool.ctx, task, worker);
+   }
+   PoolInside = 0;
+}
+
+/**
+ * @fn void* PoolWorker(void *arg)
+ *
+ * @brief body of the pool threads, waits for jobs and takes part in those
+ * 	that asked for enough threads
+ *
+ * @param [in] *arg\n
+ * 	index of the worker, workers are numbered from 1 (0 is the caller)
+ * @returns never
+ */
+static void* PoolWorker(void *arg) {
+   unsigned worker = (unsigned)(uintptr_t)arg;
+   uint64_t seen = 0;
+   int      takePart;
+
+   for (;;) {
+      pthread_mutex_lock(&Pool.lock);
+      while (Pool.generation == seen)
+         pthread_cond_wait(&Pool.start, &Pool.lock);
+      seen = Pool.generation;
+      takePart = worker < Pool.nthreads;
+      pthread_mutex_unlock(&Pool.lock);
+
+      if (takePart) {
+         PoolRun(worker);
+
+         pthread_mutex_lock(&Pool.lock);
+         if (--Pool.active == 0)
+            pthread_cond_signal(&Pool.done);
+         pthread_mutex_unlock(&Pool.lock);
+      }
+   }
+   return NULL;
+}
+
+/**
+ * @fn void PoolInit(void)
+ *
+ * @brief starts one worker per online cpu besides the calling thread
+ */
+static void PoolInit(void) {
+   long     ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+   unsigned i;
+
+   ncpu = ncpu < 1 ? 1 : MIN(ncpu, POOL_MAX_THREADS);
+
+   for (i = 1; i < (unsigned)ncpu; i++) {
+      pthread_t tid;
+
+      if (pthread_create(&tid, NULL, PoolWorker, (void *)(uintptr_t)i) != 0)
+         break;
+      pthread_detach(tid);
+   }
+   Pool.nworkers = i - 1;
+}
+
+/**
+ * @ingroup BitStreamParallel
+ * @fn unsigned BitStreamParallelThreads(unsigned nthreads)
+ *
+ * @brief number of threads a parallel call asking for nthreads gets
+ *
+ * @param [in] nthreads\n
+ * 	threads asked for, 0 for all the pool has
+ * @returns threads that will run the job, caller included (at least 1)
+ */
+unsigned BitStreamParallelThreads(unsigned nthreads) {
+   pthread_once(&PoolOnce, PoolInit);
+
+   if (nthreads == 0 || nthreads > Pool.nworkers + 1)
+      nthreads = Pool.nworkers + 1;
+   return nthreads;
+}
+
+/**
+ * @ingroup BitStreamParallel
+ * @fn void BitStreamParallelFor(unsigned nthreads, size_t ntasks,
+ * 	BitStreamTask fn, void *ctx)
+ *
+ * @brief runs fn(ctx, task, worker) for every task in [0, ntasks) on up to
+ * 	nthreads threads and returns once all of them have completed
+ *
+ * @param [in] nthreads\n
+ * 	threads to use, caller included, 0 for all the pool has. Worker
+ * 	indices passed to fn are below BitStreamParallelThreads(nthreads)
+ * @param [in] ntasks\n
+ * 	number of work items
+ * @param [in] fn\n
+ * 	routine run for each work item
+ * @param [in] *ctx\n
+ * 	context passed to fn
+ * @returns none
+ */
+void BitStreamParallelFor(unsigned nthreads, size_t ntasks, BitStreamTask fn,
+	void *ctx) {
+   size_t task;
+
+   nthreads = BitStreamParallelThreads(nthreads);
+
+   if (nthreads == 1 || ntasks <= 1 || PoolInside) {
+      for (task = 0; task < ntasks; task++)
+         fn(ctx, task, 0);
+      return;
+   }
+
+   pthread_mutex_lock(&Pool.jobLock);
+
+   pthread_mutex_lock(&Pool.lock);
+   Pool.fn = fn;
+   Pool.ctx = ctx;
+   Pool.ntasks = ntasks;
+   Pool.nthreads = nthreads;
+   Pool.next = 0;
+   Pool.active = nthreads - 1;
+   Pool.generation++;
+   pthread_cond_broadcast(&Pool.start);
+   pthread_mutex_unlock(&Pool.lock);
+
+   PoolRun(0);
+
+   pthread_mutex_lock(&Pool.lock);
+   while (Pool.active)
+      pthread_cond_wait(&Pool.done, &Pool.lock);
+   pthread_mutex_unlock(&Pool.lock);
+
+   pthread_mutex_unlock(&Pool.jobLock);
+}
@@ -0,0 +1,38 @@
+/**
+ * @file  BitStreamParallel.h
+ * @brief Thread pool the library spreads independent work items over
+ */
+#if !defined(_BITSTREAM_PARALLEL_H)
+#define _BITSTREAM_PARALLEL_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Type Definitions */
+/**
+ * @typedef BitStreamTask
+ * @brief work item run by BitStreamParallelFor()
+ *
+ * @param ctx\n
+ * 	context passed to BitStreamParallelFor()
+ * @param task\n
+ * 	index of the work item, [0, ntasks)
+ * @param worker\n
+ * 	index of the thread running it, [0, nthreads), items run by the same
+ * 	worker never overlap so per-worker state needs no locking
+ */
+typedef void (*BitStreamTask)(void *ctx, size_t task, unsigned worker);
+
+
+unsigned BitStreamParallelThreads(unsigned nthreads) ;
+
+void BitStreamParallelFor(unsigned nthreads, size_t ntasks, BitStreamTask fn,
+	void *ctx) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_PARALLEL_H */
@@ -0,0 +1,541 @@
+/**
+ * @file BitStreamPipeline.c
+ *
+ * @brief Implements the staged key search over a file of HEX records
+ *
+ * A run is four stages connected by BitStreamRing rings:
+ *
+ *   reader --> decoders --> searchers --> reporter (calling thread)
+ *      ^                                     |
+ *      +------------- free batches ----------+
+ *
+ * The unit of work is a batch of up to PIPELINE_BATCH_RECORDS lines. The
+ * reader fills a free batch with lines, a decoder converts them into the
+ * record streams of the batch, a searcher runs the key search over them
+ * into the collector of the batch, and the reporter merges that collector
+ * into the one of the pipeline before handing the batch back to the reader.
+ * A fixed number of batches circulates, so their buffers reach the size of
+ * the largest lines once and are reused from then on, and a slow stage
+ * holds back the reader instead of letting batches pile up in memory. Disk
+ * reads and reporting overlap with the search rather than taking turns.
+ *
+ * @internal BitStreamPipelineCreate
+ * 	     BitStreamPipelineDelete
+ * 	     BitStreamPipelineRunHex
+ * 	     BitStreamPipelineResults
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "BitStreamBulk.h"
+#include "BitStreamPipeline.h"
+#include "BitStreamRing.h"
+
+/**
+ * @struct PipelineBatch
+ * @brief lines of the input and the records decoded from them, line i of
+ * 	the batch is line first + i of the file
+ */
+typedef struct PipelineBatch {
+   uint64_t       first;
+   uint32_t       count;
+   char          *text;      /**< the lines, '\0' terminated */
+   size_t         textSize;
+   size_t         textCap;
+   size_t         start[PIPELINE_BATCH_RECORDS];   /**< offset into text */
+   size_t         length[PIPELINE_BATCH_RECORDS];
+   BitStream      records[PIPELINE_BATCH_RECORDS]; /**< empty if invalid */
+   uint64_t       recordCap[PIPELINE_BATCH_RECORDS]; /**< bytes allocated */
+   BitStreamTopK *topk;      /**< candidates of this batch */
+} PipelineBatch;
+
+/**
+ * @struct PipelineRun
+ * @brief state shared by the threads of one run
+ */
+typedef struct PipelineRun {
+   BitStreamPipeline *pipeline;
+   FILE              *fp;
+   BitStreamRing     *decode;   /**< reader to decoders */
+   BitStreamRing     *search;   /**< decoders to searchers */
+   BitStreamRing     *report;   /**< searchers to reporter */
+   BitStreamRing     *free;     /**< reporter back to reader */
+   PipelineBatch     *batches;
+   uint32_t           nbatches;
+   float              threshold; /**< of the pipeline collector (atomic) */
+   int                error;    /**< set on allocation failure (atomic) */
+} PipelineRun;
+
+/**
+ * @fn void PipelineError(PipelineRun *run)
+ *
+ * @brief records that part of the input was not searched
+ */
+static void PipelineError(PipelineRun *run) {
+   __atomic_store_n(&run->error, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @fn int PipelineBatchAppend(PipelineBatch *batch, const char *line,
+ * 	size_t len)
+ *
+ * @brief adds a line to the batch, growing its text buffer if needed
+ *
+ * @returns 0 on success, -1 on allocation failure
+ */
+static int PipelineBatchAppend(PipelineBatch *batch, const char *line,
+	size_t len) {
+   if (batch->textSize + len + 1 > batch->textCap) {
+      size_t cap = batch->textCap ? batch->textCap : 2 * PIPELINE_BATCH_TEXT;
+      char  *text;
+
+      while (cap < batch->textSize + len + 1)
+         cap *= 2;
+      text = (char *)realloc(batch->text, cap);
+      if (text == NULL)
+         return (-1);
+      batch->text = text;
+      batch->textCap = cap;
+   }
+   batch->start[batch->count] = batch->textSize;
+   batch->length[batch->count++] = len;
+   memcpy(batch->text + batch->textSize, line, len);
+   batch->text[batch->textSize + len] = '\0';
+   batch->textSize += len + 1;
+
+   return 0;
+}
+
+/**
+ * @fn void* PipelineReader(void *arg)
+ *
+ * @brief reader stage, cuts the file into batches of lines
+ */
+static void* PipelineReader(void *arg) {
+   PipelineRun   *run = (PipelineRun *)arg;
+   PipelineBatch *batch = NULL;
+   char          *line = NULL;
+   size_t         linecap = 0;
+   ssize_t        len;
+   uint64_t       lineNo = 0;
+
+   while ((len = getline(&line, &linecap, run->fp)) >= 0) {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+         line[--len] = '\0';
+
+      if (batch == NULL) {
+         batch = (PipelineBatch *)BitStreamRingPop(run->free);
+         batch->first = lineNo;
+         batch->count = 0;
+         batch->textSize = 0;
+      }
+      if (PipelineBatchAppend(batch, line, len) < 0) {
+         PipelineError(run);
+         break;
+      }
+      lineNo++;
+
+      if (batch->count == PIPELINE_BATCH_RECORDS ||
+          batch->textSize >= PIPELINE_BATCH_TEXT) {
+         BitStreamRingPush(run->decode, batch);
+         batch = NULL;
+      }
+   }
+   if (batch)
+      BitStreamRingPush(run->decode, batch);
+
+   free(line);
+   BitStreamRingClose(run->decode);
+   return NULL;
+}
+
+/**
+ * @fn void* PipelineDecoder(void *arg)
+ *
+ * @brief decoder stage, converts the lines of each batch into its records,
+ * 	empty lines and lines that are not hex give empty records
+ */
+static void* PipelineDecoder(void *arg) {
+   PipelineRun   *run = (PipelineRun *)arg;
+   PipelineBatch *batch;
+   uint32_t       i;
+
+   while ((batch = (PipelineBatch *)BitStreamRingPop(run->decode)) != NULL) {
+      for (i = 0; i < batch->count; i++) {
+         BitStream *record = &batch->records[i];
+         size_t     bytes = (batch->length[i] + 1) / 2;
+
+         record->nbits = 0;
+         if (bytes == 0)
+            continue;
+
+         if (bytes > batch->recordCap[i]) {
+            uint8_t *array = (uint8_t *)realloc(record->array, bytes);
+
+            if (array == NULL) {
+               PipelineError(run);
+               continue;
+            }
+            record->array = array;
+            batch->recordCap[i] = bytes;
+         }
+         if (BitStreamHexDecode(batch->text + batch->start[i],
+				 batch->length[i], record->array) >= 0)
+            record->nbits = bytes * BITS_PER_BYTE;
+      }
+      BitStreamRingPush(run->search, batch);
+   }
+   BitStreamRingClose(run->search);
+   return NULL;
+}
+
+/**
+ * @fn void* PipelineSearcher(void *arg)
+ *
+ * @brief searcher stage, runs the key search over the records of each batch
+ * 	into the collector of the batch
+ *
+ * The collector of the batch starts out with the threshold the reporter
+ * last published, candidates the pipeline would turn down are pruned as
+ * early as they would be with a single collector.
+ */
+static void* PipelineSearcher(void *arg) {
+   PipelineRun       *run = (PipelineRun *)arg;
+   BitStreamPipeline *pipeline = run->pipeline;
+   PipelineBatch     *batch;
+   uint32_t           i;
+
+   while ((batch = (PipelineBatch *)BitStreamRingPop(run->search)) != NULL) {
+      BitStreamTopKReset(batch->topk);
+      __atomic_load(&run->threshold, &batch->topk->floor, __ATOMIC_RELAXED);
+
+      for (i = 0; i < batch->count; i++) {
+         if (batch->records[i].nbits)
+            pipeline->search(&batch->records[i], batch->first + i,
+			    batch->topk, pipeline->ctx);
+      }
+      BitStreamRingPush(run->report, batch);
+   }
+   BitStreamRingClose(run->report);
+   return NULL;
+}
+
+/**
+ * @fn void PipelineKeep(BitStreamPipeline *pipeline, uint64_t line,
+ * 	BitStream *record)
+ *
+ * @brief keeps a copy of the record of a candidate that entered the
+ * 	collector, the batch holding it is about to be reused
+ */
+static void PipelineKeep(BitStreamPipeline *pipeline, uint64_t line,
+	BitStream *record) {
+   BitStream *copy;
+   uint32_t   i;
+
+   for (i = 0; i < pipeline->nkept; i++) {
+      if (pipeline->keptLine[i] == line)
+         return;
+   }
+   copy = BitStreamCreate(record->nbits);
+   if (copy)
+      memcpy(copy->array, record->array,
+		      (record->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE);
+
+   pipeline->kept[pipeline->nkept] = copy;
+   pipeline->keptLine[pipeline->nkept++] = line;
+}
+
+/**
+ * @fn void PipelinePrune(BitStreamPipeline *pipeline)
+ *
+ * @brief drops the copies of records no candidate of the collector refers
+ * 	to anymore
+ */
+static void PipelinePrune(BitStreamPipeline *pipeline) {
+   uint32_t i, j, n = 0;
+
+   for (i = 0; i < pipeline->nkept; i++) {
+      for (j = 0; j < pipeline->topk->count; j++) {
+         if (pipeline->topk->heap[j].line == pipeline->keptLine[i])
+            break;
+      }
+      if (j < pipeline->topk->count) {
+         pipeline->kept[n] = pipeline->kept[i];
+         pipeline->keptLine[n++] = pipeline->keptLine[i];
+      } else {
+         BitStreamDelete(pipeline->kept[i]);
+      }
+   }
+   pipeline->nkept = n;
+}
+
+/**
+ * @fn void PipelineMerge(BitStreamPipeline *pipeline, PipelineBatch *batch,
+ * 	BitStreamPipelineReport report, void *ctx)
+ *
+ * @brief reporter stage, offers the candidates of a batch to the collector
+ * 	of the pipeline and reports those it keeps
+ */
+static void PipelineMerge(BitStreamPipeline *pipeline, PipelineBatch *batch,
+	BitStreamPipelineReport report, void *ctx) {
+   uint32_t i;
+
+   for (i = 0; i < batch->topk->count; i++) {
+      BitStreamCandidate candidate = batch->topk->heap[i];
+      BitStream         *record = &batch->records[candidate.line -
+	      batch->first];
+
+      if (BitStreamTopKOffer(pipeline->topk, candidate.score, candidate.key,
+			      candidate.line)) {
+         if (report)
+            report(ctx, &candidate, record);
+         PipelineKeep(pipeline, candidate.line, record);
+      }
+   }
+   PipelinePrune(pipeline);
+}
+
+/**
+ * @ingroup BitStreamPipeline
+ * @fn BitStreamPipeline* BitStreamPipelineCreate(
+ * 	BitStreamPipelineSearch search, void *ctx, uint32_t capacity,
+ * 	float floor, unsigned nthreads)
+ *
+ * @brief Creates a pipeline running search over the records of a file
+ *
+ * @param [in] search\n
+ * 	key search run on every record
+ * @param [in] *ctx\n
+ * 	context passed to search
+ * @param [in] capacity\n
+ * 	number of best candidates kept over the whole file
+ * @param [in] floor\n
+ * 	minimum score of a candidate to be kept
+ * @param [in] nthreads\n
+ * 	threads to decode and search with, 0 for all cpus. The reader thread
+ * 	and the calling thread come on top
+ * @returns pointer to newly created pipeline, NULL on failure
+ */
+BitStreamPipeline* BitStreamPipelineCreate(BitStreamPipelineSearch search,
+	void *ctx, uint32_t capacity, float floor, unsigned nthreads) {
+   BitStreamPipeline *pipeline;
+
+   if (search == NULL || capacity == 0)
+      return NULL;
+
+   if (nthreads == 0) {
+      long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+      nthreads = ncpu < 1 ? 1 : (unsigned)ncpu;
+   }
+
+   pipeline = (BitStreamPipeline *)calloc(1, sizeof(BitStreamPipeline));
+   if (pipeline == NULL)
+      return NULL;
+
+   pipeline->search = search;
+   pipeline->ctx = ctx;
+   /* decoding is cheap next to a key search, one decoder feeds 8 searchers */
+   pipeline->decoders = 1 + nthreads / 8;
+   pipeline->searchers = nthreads > pipeline->decoders ?
+	   nthreads - pipeline->decoders : 1;
+
+   pipeline->topk = BitStreamTopKCreate(capacity, floor);
+   /* before pruning, the kept candidates and those of one batch */
+   pipeline->kept = (BitStream **)calloc(2 * capacity, sizeof(BitStream *));
+   pipeline->keptLine = (uint64_t *)calloc(2 * capacity, sizeof(uint64_t));
+
+   if (!pipeline->topk || !pipeline->kept || !pipeline->keptLine) {
+      BitStreamPipelineDelete(pipeline);
+      pipeline = NULL;
+   }
+   return pipeline;
+}
+
+/**
+ * @ingroup BitStreamPipeline
+ * @fn void BitStreamPipelineDelete(BitStreamPipeline *pipeline)
+ *
+ * @brief Deletes the pipeline along with its results
+ *
+ * @param [in] *pipeline\n
+ * 	pipeline to delete, may be NULL
+ * @returns none
+ */
+void BitStreamPipelineDelete(BitStreamPipeline *pipeline) {
+   uint32_t i;
+
+   if (pipeline) {
+      for (i = 0; i < pipeline->nkept; i++)
+         BitStreamDelete(pipeline->kept[i]);
+      free(pipeline->kept);
+      free(pipeline->keptLine);
+      BitStreamTopKDelete(pipeline->topk);
+      free(pipeline);
+   }
+}
+
+/**
+ * @fn void PipelineRunDelete(PipelineRun *run)
+ *
+ * @brief releases the rings and batches of a run
+ */
+static void PipelineRunDelete(PipelineRun *run) {
+   uint32_t i, j;
+
+   if (run->batches) {
+      for (i = 0; i < run->nbatches; i++) {
+         for (j = 0; j < PIPELINE_BATCH_RECORDS; j++)
+            free(run->batches[i].records[j].array);
+         free(run->batches[i].text);
+         BitStreamTopKDelete(run->batches[i].topk);
+      }
+      free(run->batches);
+   }
+   BitStreamRingDelete(run->decode);
+   BitStreamRingDelete(run->search);
+   BitStreamRingDelete(run->report);
+   BitStreamRingDelete(run->free);
+}
+
+/**
+ * @ingroup BitStreamPipeline
+ * @fn int BitStreamPipelineRunHex(BitStreamPipeline *pipeline,
+ * 	const char *path, BitStreamPipelineReport report, void *ctx)
+ *
+ * @brief runs the search over a file holding one HEX ascii record per line
+ *
+ * The candidates of a previous run are dropped. Lines that are empty or not
+ * hex are skipped but keep their index.
+ *
+ * @param [in,out] *pipeline\n
+ * 	pipeline to run
+ * @param [in] *path\n
+ * 	file to search
+ * @param [in] report\n
+ * 	called for candidates as they enter the collector, may be NULL
+ * @param [in] *ctx\n
+ * 	context passed to report
+ * @returns 0 on success, -1 if the file could not be opened or part of it
+ * 	was not searched for lack of memory
+ */
+int BitStreamPipelineRunHex(BitStreamPipeline *pipeline, const char *path,
+	BitStreamPipelineReport report, void *ctx) {
+   PipelineRun    run = { .pipeline = pipeline };
+   PipelineBatch *batch;
+   pthread_t     *tids;
+   unsigned       nstages = pipeline->decoders + pipeline->searchers;
+   unsigned       i, started = 0;
+   int            ret = -1;
+
+   BitStreamTopKReset(pipeline->topk);
+   PipelinePrune(pipeline);
+
+   /* enough batches to fill every ring with one more in every stage */
+   run.nbatches = 3 * PIPELINE_RING_SLOTS + nstages + 1;
+   run.batches = (PipelineBatch *)calloc(run.nbatches, sizeof(PipelineBatch));
+   run.decode = BitStreamRingCreate(PIPELINE_RING_SLOTS, 1,
+		   pipeline->decoders);
+   run.search = BitStreamRingCreate(PIPELINE_RING_SLOTS, pipeline->decoders,
+		   pipeline->searchers);
+   run.report = BitStreamRingCreate(PIPELINE_RING_SLOTS, pipeline->searchers,
+		   1);
+   run.free = BitStreamRingCreate(run.nbatches, 1, 1);
+   tids = (pthread_t *)malloc((nstages + 1) * sizeof(pthread_t));
+   run.threshold = pipeline->topk->floor;
+
+   if (run.batches && run.decode && run.search && run.report && run.free &&
+       tids && (run.fp = fopen(path, "r")) != NULL) {
+      ret = 0;
+      for (i = 0; i < run.nbatches && ret == 0; i++) {
+         run.batches[i].topk = BitStreamTopKCreate(pipeline->topk->capacity,
+			 pipeline->topk->floor);
+         if (run.batches[i].topk == NULL)
+            ret = -1;
+         BitStreamRingPush(run.free, &run.batches[i]);
+      }
+   }
+
+   if (ret == 0) {
+      /* downstream first, a stage that fails to start is closed for */
+      for (i = 0; i < pipeline->searchers; i++) {
+         if (pthread_create(&tids[started], NULL, PipelineSearcher, &run)) {
+            BitStreamRingClose(run.report);
+            PipelineError(&run);
+         } else {
+            started++;
+         }
+      }
+      for (i = 0; i < pipeline->decoders; i++) {
+         if (pthread_create(&tids[started], NULL, PipelineDecoder, &run)) {
+            BitStreamRingClose(run.search);
+            PipelineError(&run);
+         } else {
+            started++;
+         }
+      }
+      if (run.error ||
+          pthread_create(&tids[started], NULL, PipelineReader, &run)) {
+         BitStreamRingClose(run.decode);
+         PipelineError(&run);
+      } else {
+         started++;
+      }
+
+      while ((batch = (PipelineBatch *)BitStreamRingPop(run.report)) != NULL) {
+         float threshold;
+
+         PipelineMerge(pipeline, batch, report, ctx);
+         BitStreamRingPush(run.free, batch);
+
+         threshold = BitStreamTopKThreshold(pipeline->topk);
+         __atomic_store(&run.threshold, &threshold, __ATOMIC_RELAXED);
+      }
+      for (i = 0; i < started; i++)
+         pthread_join(tids[i], NULL);
+
+      ret = run.error ? -1 : 0;
+   }
+
+   if (run.fp)
+      fclose(run.fp);
+   free(tids);
+   PipelineRunDelete(&run);
+
+   return ret;
+}
+
+/**
+ * @ingroup BitStreamPipeline
+ * @fn uint32_t BitStreamPipelineResults(BitStreamPipeline *pipeline,
+ * 	BitStreamCandidate *out, BitStream **records)
+ *
+ * @brief copies the candidates of the last run out, best first
+ *
+ * @param [in] *pipeline\n
+ * 	pipeline that was run
+ * @param [out] *out\n
+ * 	receives the candidates, room for the capacity of the pipeline
+ * @param [out] **records\n
+ * 	receives the record of each candidate, owned by the pipeline and valid
+ * 	until the next run, NULL if it could not be copied. May be NULL
+ * @returns number of candidates copied
+ */
+uint32_t BitStreamPipelineResults(BitStreamPipeline *pipeline,
+	BitStreamCandidate *out, BitStream **records) {
+   uint32_t i, j, n;
+
+   n = BitStreamTopKResults(pipeline->topk, out);
+
+   for (i = 0; records && i < n; i++) {
+      records[i] = NULL;
+      for (j = 0; j < pipeline->nkept; j++) {
+         if (pipeline->keptLine[j] == out[i].line)
+            records[i] = pipeline->kept[j];
+      }
+   }
+   return n;
+}
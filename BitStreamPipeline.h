@@ -0,0 +1,105 @@
+/**
+ * @file  BitStreamPipeline.h
+ * @brief Staged execution of a key search over a file of records, reading,
+ * 	decoding, searching and reporting run on threads of their own
+ */
+#if !defined(_BITSTREAM_PIPELINE_H)
+#define _BITSTREAM_PIPELINE_H
+
+#include "BitStream.h"
+#include "BitStreamTopK.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def PIPELINE_BATCH_RECORDS
+ * @brief maximum number of records passed between stages at a time
+ */
+#define PIPELINE_BATCH_RECORDS	256
+
+/**
+ * @def PIPELINE_BATCH_TEXT
+ * @brief a batch is passed on once its lines hold this many characters
+ */
+#define PIPELINE_BATCH_TEXT	(256 * 1024)
+
+/**
+ * @def PIPELINE_RING_SLOTS
+ * @brief batches a stage may run ahead of the next one
+ */
+#define PIPELINE_RING_SLOTS	8
+
+/* Type Definitions */
+/**
+ * @typedef BitStreamPipelineSearch
+ * @brief key search run on every record, BitStreamSingleByteXorSearch()
+ * 	with a context
+ *
+ * @param record\n
+ * 	decoded record, never empty
+ * @param line\n
+ * 	index of the record in the file
+ * @param topk\n
+ * 	collector to offer the candidates to
+ * @param ctx\n
+ * 	context given to BitStreamPipelineCreate()
+ * @returns number of candidates kept by the collector
+ */
+typedef uint32_t (*BitStreamPipelineSearch)(BitStream *record, uint64_t line,
+	BitStreamTopK *topk, void *ctx);
+
+/**
+ * @typedef BitStreamPipelineReport
+ * @brief called on the reporting thread for every candidate that enters the
+ * 	collector of the pipeline, while the search goes on
+ *
+ * @param ctx\n
+ * 	context given to BitStreamPipelineRunHex()
+ * @param candidate\n
+ * 	candidate kept, it may be displaced by a better one later
+ * @param record\n
+ * 	record of the candidate, valid during the call only
+ */
+typedef void (*BitStreamPipelineReport)(void *ctx,
+	const BitStreamCandidate *candidate, BitStream *record);
+
+/**
+ * @struct BitStreamPipeline
+ * @brief a key search and the threads it is staged over
+ *
+ * One thread reads lines, decoders turn batches of lines into records,
+ * searchers run the key search over them and the calling thread merges
+ * the candidates of each batch into topk. Batches travel through lock-free
+ * rings and go back to the reader through a free list, their buffers are
+ * reused rather than reallocated.
+ */
+typedef struct BitStreamPipeline {
+   BitStreamPipelineSearch  search;
+   void                    *ctx;
+   unsigned                 decoders;   /**< threads decoding hex */
+   unsigned                 searchers;  /**< threads searching keys */
+   BitStreamTopK           *topk;       /**< best candidates of the last run */
+   BitStream              **kept;       /**< copies of their records */
+   uint64_t                *keptLine;   /**< line of each copy */
+   uint32_t                 nkept;
+} BitStreamPipeline;
+
+
+BitStreamPipeline* BitStreamPipelineCreate(BitStreamPipelineSearch search,
+	void *ctx, uint32_t capacity, float floor, unsigned nthreads) ;
+
+void BitStreamPipelineDelete(BitStreamPipeline *pipeline) ;
+
+int BitStreamPipelineRunHex(BitStreamPipeline *pipeline, const char *path,
+	BitStreamPipelineReport report, void *ctx) ;
+
+uint32_t BitStreamPipelineResults(BitStreamPipeline *pipeline,
+	BitStreamCandidate *out, BitStream **records) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_PIPELINE_H */
@@ -0,0 +1,644 @@
+/**
+ * @file BitStreamReader.c
+ *
+ * @brief Implements the slow paths of the sequential bit reader and writer
+ *
+ * The reader cache is refilled with one unaligned big-endian load at the
+ * byte holding the next bit, shifted by the bit offset within that byte, so
+ * a refill always leaves at least 57 bits. The writer accumulates into a
+ * 64 bit register and stores it a whole word at a time. Unary codes are
+ * read with a leading zero count over the cache, not bit by bit.
+ *
+ * The Lsb routines are the same cursors for least significant bit first
+ * streams (DEFLATE and the like), where the cache holds the next bit in its
+ * least significant position and words are loaded little-endian. Both
+ * orders come from the same kernels, specialized on a constant order
+ * argument, so there is no per call branch on the order.
+ *
+ * @internal BitStreamReaderInit
+ * 	     BitStreamReaderRefill
+ * 	     BitStreamReaderSkip
+ * 	     BitStreamReaderGetLong
+ * 	     BitStreamReaderUnary
+ * 	     BitStreamReaderExpGolomb
+ * 	     BitStreamReaderSignedExpGolomb
+ * 	     BitStreamWriterInit
+ * 	     BitStreamWriterFlushWord
+ * 	     BitStreamWriterUnary
+ * 	     BitStreamWriterExpGolomb
+ * 	     BitStreamWriterSignedExpGolomb
+ * 	     BitStreamWriterFinish
+ * 	     BitStreamReaderRefillLsb
+ * 	     BitStreamReaderSkipLsb
+ * 	     BitStreamReaderGetLongLsb
+ * 	     BitStreamWriterInitLsb
+ * 	     BitStreamWriterFlushWordLsb
+ * 	     BitStreamWriterFinishLsb
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include "BitStreamReader.h"
+
+/**
+ * @def WRITER_MIN_GROWTH
+ * @brief smallest size in bits a writer grows a stream to
+ */
+#define WRITER_MIN_GROWTH	1024
+
+#define ALWAYS_INLINE	inline __attribute__((always_inline))
+
+static inline uint64_t ReaderLoadBE64(const uint8_t *p) {
+   uint64_t w;
+
+   memcpy(&w, p, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   return w;
+}
+
+static inline void WriterStoreBE64(uint8_t *p, uint64_t w) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   memcpy(p, &w, 8);
+}
+
+static inline uint64_t ReaderLoadLE64(const uint8_t *p) {
+   uint64_t w;
+
+   memcpy(&w, p, 8);
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   return w;
+}
+
+static inline void WriterStoreLE64(uint8_t *p, uint64_t w) {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+   w = __builtin_bswap64(w);
+#endif
+   memcpy(p, &w, 8);
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn int BitStreamReaderInit(BitStreamReader *r, BitStream *bs,
+ * 	uint64_t offset)
+ *
+ * @brief positions a reader on a bit stream
+ *
+ * @param [out] *r\n
+ * 	reader
+ * @param [in] *bs\n
+ * 	bit stream to read, it must outlive the reader
+ * @param [in] offset\n
+ * 	bit offset of the first bit to read
+ * @returns 0 on success, -1 if the stream is invalid or offset past its end
+ */
+int BitStreamReaderInit(BitStreamReader *r, BitStream *bs, uint64_t offset) {
+   if (r == NULL || BitStreamGetArray(bs) == NULL || offset > bs->nbits)
+      return (-1);
+
+   r->array = bs->array;
+   r->nbits = bs->nbits;
+   r->pos = offset;
+   r->cache = 0;
+   r->count = 0;
+   return 0;
+}
+
+/**
+ * @fn void ReaderRefill(BitStreamReader *r, BitStreamBitOrder order)
+ *
+ * @brief reloads the cache from the next bit on
+ */
+static ALWAYS_INLINE void ReaderRefill(BitStreamReader *r,
+	BitStreamBitOrder order) {
+   uint64_t byte = r->pos / BITS_PER_BYTE;
+   uint64_t nbytes = (r->nbits + 7) / BITS_PER_BYTE;
+   uint32_t s = r->pos % BITS_PER_BYTE;
+   uint64_t w;
+
+   if (byte + 8 <= nbytes) {
+      w = order == BITSTREAM_LSB_FIRST ? ReaderLoadLE64(r->array + byte) :
+	  ReaderLoadBE64(r->array + byte);
+   } else {
+      uint8_t tail[8] = { 0 };
+
+      if (byte < nbytes)
+         memcpy(tail, r->array + byte, nbytes - byte);
+      w = order == BITSTREAM_LSB_FIRST ? ReaderLoadLE64(tail) :
+	  ReaderLoadBE64(tail);
+   }
+   r->cache = order == BITSTREAM_LSB_FIRST ? w >> s : w << s;
+   r->count = 64 - s;
+
+   /* bits of the last byte past the end of the stream read as zero */
+   if (r->pos + r->count > r->nbits) {
+      uint64_t valid = r->nbits > r->pos ? r->nbits - r->pos : 0;
+
+      if (order == BITSTREAM_LSB_FIRST)
+         r->cache &= (1ULL << valid) - 1;
+      else
+         r->cache &= valid ? ~0ULL << (64 - valid) : 0;
+   }
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn void BitStreamReaderRefill(BitStreamReader *r)
+ *
+ * @brief reloads the cache from the next bit on, it then holds at least
+ * 	BITSTREAM_READER_MAX_PEEK bits (zeros past the end of the stream)
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @returns none
+ */
+void BitStreamReaderRefill(BitStreamReader *r) {
+   ReaderRefill(r, BITSTREAM_MSB_FIRST);
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn void BitStreamReaderRefillLsb(BitStreamReader *r)
+ *
+ * @brief BitStreamReaderRefill() of an LSB first stream
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @returns none
+ */
+void BitStreamReaderRefillLsb(BitStreamReader *r) {
+   ReaderRefill(r, BITSTREAM_LSB_FIRST);
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn void BitStreamReaderSkip(BitStreamReader *r, uint64_t nbits)
+ *
+ * @brief moves the reader nbits bits forward
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @param [in] nbits\n
+ * 	bits to skip, any number
+ * @returns none
+ */
+void BitStreamReaderSkip(BitStreamReader *r, uint64_t nbits) {
+   if (nbits < r->count) {
+      BitStreamReaderConsume(r, (uint32_t)nbits);
+   } else {
+      r->pos += nbits;
+      r->cache = 0;
+      r->count = 0;
+   }
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn void BitStreamReaderSkipLsb(BitStreamReader *r, uint64_t nbits)
+ *
+ * @brief BitStreamReaderSkip() of an LSB first stream
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @param [in] nbits\n
+ * 	bits to skip, any number
+ * @returns none
+ */
+void BitStreamReaderSkipLsb(BitStreamReader *r, uint64_t nbits) {
+   if (nbits < r->count) {
+      BitStreamReaderConsumeLsb(r, (uint32_t)nbits);
+   } else {
+      r->pos += nbits;
+      r->cache = 0;
+      r->count = 0;
+   }
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn uint64_t BitStreamReaderGetLong(BitStreamReader *r, uint32_t nbits)
+ *
+ * @brief reads fields wider than a single peek returns, in two parts
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @param [in] nbits\n
+ * 	bits to read, 0 to 64
+ * @returns value of the bits read
+ */
+uint64_t BitStreamReaderGetLong(BitStreamReader *r, uint32_t nbits) {
+   uint64_t hi;
+
+   if (nbits == 0)
+      return 0;
+   if (nbits <= BITSTREAM_READER_MAX_PEEK)
+      return BitStreamReaderGet(r, nbits);
+
+   hi = BitStreamReaderGet(r, nbits - 32);
+   return (hi << 32) | BitStreamReaderGet(r, 32);
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn uint64_t BitStreamReaderGetLongLsb(BitStreamReader *r, uint32_t nbits)
+ *
+ * @brief BitStreamReaderGetLong() of an LSB first stream, the first bit read
+ * 	is the least significant bit of the value
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @param [in] nbits\n
+ * 	bits to read, 0 to 64
+ * @returns value of the bits read
+ */
+uint64_t BitStreamReaderGetLongLsb(BitStreamReader *r, uint32_t nbits) {
+   uint64_t lo;
+
+   if (nbits == 0)
+      return 0;
+   if (nbits <= BITSTREAM_READER_MAX_PEEK)
+      return BitStreamReaderGetLsb(r, nbits);
+
+   lo = BitStreamReaderGetLsb(r, 32);
+   return lo | (BitStreamReaderGetLsb(r, nbits - 32) << 32);
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn uint32_t BitStreamReaderUnary(BitStreamReader *r)
+ *
+ * @brief reads a unary code, zeros terminated by a one
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @returns number of zeros read, the terminating one is consumed. If the
+ * 	stream ends first the zeros up to its end, the reader is left in
+ * 	overrun
+ */
+uint32_t BitStreamReaderUnary(BitStreamReader *r) {
+   uint32_t n = 0, z;
+
+   for (;;) {
+      if (r->cache) {
+         /* bits below count are zero once shifted, so z < count */
+         z = __builtin_clzll(r->cache);
+         BitStreamReaderConsume(r, z);
+         BitStreamReaderConsume(r, 1);   /* z + 1 may be 64 */
+         return n + z;
+      }
+      n += r->count;
+      r->pos += r->count;
+      r->count = 0;
+      if (r->pos >= r->nbits) {
+         /* the zeros past the end were padding */
+         n -= (uint32_t)(r->pos - r->nbits);
+         r->pos = r->nbits + 1;
+         return n;
+      }
+      BitStreamReaderRefill(r);
+   }
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn uint64_t BitStreamReaderExpGolomb(BitStreamReader *r)
+ *
+ * @brief reads an unsigned Exp-Golomb code (ue(v) of H.264): n zeros, a
+ * 	one and n more bits
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @returns value decoded, UINT64_MAX if the prefix holds 64 zeros or more
+ */
+uint64_t BitStreamReaderExpGolomb(BitStreamReader *r) {
+   uint32_t z = BitStreamReaderUnary(r);
+
+   if (z >= 64)
+      return UINT64_MAX;
+   return ((1ULL << z) - 1) + BitStreamReaderGetLong(r, z);
+}
+
+/**
+ * @ingroup BitStreamReader
+ * @fn int64_t BitStreamReaderSignedExpGolomb(BitStreamReader *r)
+ *
+ * @brief reads a signed Exp-Golomb code (se(v) of H.264), code k stands
+ * 	for (k + 1) / 2 when odd and -k / 2 when even
+ *
+ * @param [in,out] *r\n
+ * 	reader
+ * @returns value decoded
+ */
+int64_t BitStreamReaderSignedExpGolomb(BitStreamReader *r) {
+   uint64_t k = BitStreamReaderExpGolomb(r);
+
+   return k & 1 ? (int64_t)(k / 2 + 1) : -(int64_t)(k / 2);
+}
+
+/**
+ * @fn int WriterReserve(BitStreamWriter *w, uint64_t nbytes)
+ *
+ * @brief makes sure the stream holds nbytes bytes, growing it if needed
+ *
+ * @returns 1 if the bytes can be written, 0 if the stream could not grow
+ */
+static int WriterReserve(BitStreamWriter *w, uint64_t nbytes) {
+   BitStream *bs = w->bs;
+   uint64_t   size = (bs->nbits + 7) / BITS_PER_BYTE;
+   uint64_t   nbits;
+   uint8_t   *array;
+
+   if (nbytes <= size)
+      return 1;
+   if (w->error)
+      return 0;
+   if (bs->mapping && BitStreamDetach(bs) < 0) {
+      w->error = 1;
+      return 0;
+   }
+
+   nbits = bs->nbits > WRITER_MIN_GROWTH / 2 ? 2 * bs->nbits :
+	   WRITER_MIN_GROWTH;
+   if (nbits < nbytes * BITS_PER_BYTE)
+      nbits = nbytes * BITS_PER_BYTE;
+
+   array = (uint8_t *)realloc(bs->array, (nbits + 7) / BITS_PER_BYTE);
+   if (array == NULL) {
+      w->error = 1;
+      return 0;
+   }
+   memset(array + size, 0, (nbits + 7) / BITS_PER_BYTE - size);
+   bs->array = array;
+   bs->nbits = nbits;
+   return 1;
+}
+
+/**
+ * @fn int WriterInit(BitStreamWriter *w, BitStream *bs, uint64_t offset,
+ * 	BitStreamBitOrder order)
+ *
+ * @brief positions a writer, the accumulator starts with the bits of the
+ * 	first byte in front of offset
+ */
+static ALWAYS_INLINE int WriterInit(BitStreamWriter *w, BitStream *bs,
+	uint64_t offset, BitStreamBitOrder order) {
+   if (w == NULL || bs == NULL || offset > bs->nbits ||
+       (bs->array == NULL && bs->nbits))
+      return (-1);
+
+   w->bs = bs;
+   w->byte = offset / BITS_PER_BYTE;
+   w->count = offset % BITS_PER_BYTE;
+   w->acc = 0;
+   if (w->count)
+      w->acc = order == BITSTREAM_LSB_FIRST ?
+	       (uint64_t)(bs->array[w->byte] & ((1u << w->count) - 1)) :
+	       (uint64_t)(bs->array[w->byte] >> (BITS_PER_BYTE - w->count));
+   w->nbits = bs->nbits;
+   w->error = 0;
+   return 0;
+}
+
+/**
+ * @fn void WriterFlushWord(BitStreamWriter *w, uint64_t v, uint32_t nbits,
+ * 	BitStreamBitOrder order)
+ *
+ * @brief stores the word v completes and keeps the rest of v
+ */
+static ALWAYS_INLINE void WriterFlushWord(BitStreamWriter *w, uint64_t v,
+	uint32_t nbits, BitStreamBitOrder order) {
+   uint32_t r = 64 - w->count;   /* bits of v completing the word */
+   uint64_t word;
+
+   if (order == BITSTREAM_LSB_FIRST) {
+      word = w->acc | (v << (w->count & 63));
+      if (WriterReserve(w, w->byte + 8))
+         WriterStoreLE64(w->bs->array + w->byte, word);
+      w->acc = w->count ? v >> (r & 63) : 0;
+   } else {
+      word = (w->count ? w->acc << (r & 63) : 0) | (v >> (nbits - r));
+      if (WriterReserve(w, w->byte + 8))
+         WriterStoreBE64(w->bs->array + w->byte, word);
+      w->acc = v;
+   }
+   w->byte += 8;
+   w->count = nbits - r;
+}
+
+/**
+ * @fn int64_t WriterFinish(BitStreamWriter *w, BitStreamBitOrder order)
+ *
+ * @brief stores the bits still in the accumulator
+ */
+static ALWAYS_INLINE int64_t WriterFinish(BitStreamWriter *w,
+	BitStreamBitOrder order) {
+   uint64_t end = BitStreamWriterTell(w);
+   uint8_t *out;
+   uint32_t n = w->count;
+
+   if (WriterReserve(w, (end + 7) / BITS_PER_BYTE)) {
+      out = w->bs->array + w->byte;
+      if (order == BITSTREAM_LSB_FIRST) {
+         for (; n >= BITS_PER_BYTE; n -= BITS_PER_BYTE, w->acc >>= 8)
+            *out++ = (uint8_t)w->acc;
+         if (n)
+            *out = (*out & (0xff << n)) | ((uint8_t)w->acc & ((1u << n) - 1));
+      } else {
+         for (; n >= BITS_PER_BYTE; n -= BITS_PER_BYTE)
+            *out++ = (uint8_t)(w->acc >> (n - BITS_PER_BYTE));
+         if (n)
+            *out = (*out & (0xff >> n)) |
+		   (uint8_t)(w->acc << (BITS_PER_BYTE - n));
+      }
+   }
+   w->count = 0;
+
+   if (w->error)
+      return (-1);
+
+   /* grown past the end, by WriterReserve() or within the last byte */
+   if (end > w->nbits || w->bs->nbits > w->nbits)
+      w->bs->nbits = end > w->nbits ? end : w->nbits;
+   return (int64_t)end;
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn int BitStreamWriterInit(BitStreamWriter *w, BitStream *bs,
+ * 	uint64_t offset)
+ *
+ * @brief positions a writer on a bit stream
+ *
+ * @param [out] *w\n
+ * 	writer
+ * @param [in,out] *bs\n
+ * 	bit stream to write to, may be empty, it is grown as needed and must
+ * 	not be used until BitStreamWriterFinish()
+ * @param [in] offset\n
+ * 	bit offset of the first bit to write
+ * @returns 0 on success, -1 if offset is past the end of the stream
+ */
+int BitStreamWriterInit(BitStreamWriter *w, BitStream *bs, uint64_t offset) {
+   return WriterInit(w, bs, offset, BITSTREAM_MSB_FIRST);
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn int BitStreamWriterInitLsb(BitStreamWriter *w, BitStream *bs,
+ * 	uint64_t offset)
+ *
+ * @brief BitStreamWriterInit() of an LSB first stream
+ *
+ * @param [out] *w\n
+ * 	writer
+ * @param [in,out] *bs\n
+ * 	bit stream to write to
+ * @param [in] offset\n
+ * 	bit offset of the first bit to write
+ * @returns 0 on success, -1 if offset is past the end of the stream
+ */
+int BitStreamWriterInitLsb(BitStreamWriter *w, BitStream *bs,
+	uint64_t offset) {
+   return WriterInit(w, bs, offset, BITSTREAM_LSB_FIRST);
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn void BitStreamWriterFlushWord(BitStreamWriter *w, uint64_t v,
+ * 	uint32_t nbits)
+ *
+ * @brief writes v when it completes the accumulator, called by
+ * 	BitStreamWriterPut()
+ *
+ * @param [in,out] *w\n
+ * 	writer
+ * @param [in] v\n
+ * 	value, already masked to nbits
+ * @param [in] nbits\n
+ * 	bits of v, at least 64 - w->count
+ * @returns none
+ */
+void BitStreamWriterFlushWord(BitStreamWriter *w, uint64_t v, uint32_t nbits) {
+   WriterFlushWord(w, v, nbits, BITSTREAM_MSB_FIRST);
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn void BitStreamWriterFlushWordLsb(BitStreamWriter *w, uint64_t v,
+ * 	uint32_t nbits)
+ *
+ * @brief BitStreamWriterFlushWord() of an LSB first stream
+ *
+ * @param [in,out] *w\n
+ * 	writer
+ * @param [in] v\n
+ * 	value, already masked to nbits
+ * @param [in] nbits\n
+ * 	bits of v, at least 64 - w->count
+ * @returns none
+ */
+void BitStreamWriterFlushWordLsb(BitStreamWriter *w, uint64_t v,
+	uint32_t nbits) {
+   WriterFlushWord(w, v, nbits, BITSTREAM_LSB_FIRST);
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn void BitStreamWriterUnary(BitStreamWriter *w, uint32_t n)
+ *
+ * @brief writes n zeros and a one
+ *
+ * @param [in,out] *w\n
+ * 	writer
+ * @param [in] n\n
+ * 	value to code
+ * @returns none
+ */
+void BitStreamWriterUnary(BitStreamWriter *w, uint32_t n) {
+   for (; n >= 32; n -= 32)
+      BitStreamWriterPut(w, 0, 32);
+   BitStreamWriterPut(w, 1, n + 1);
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn void BitStreamWriterExpGolomb(BitStreamWriter *w, uint64_t v)
+ *
+ * @brief writes an unsigned Exp-Golomb code
+ *
+ * @param [in,out] *w\n
+ * 	writer
+ * @param [in] v\n
+ * 	value to code, below UINT64_MAX (the writer is put in error otherwise)
+ * @returns none
+ */
+void BitStreamWriterExpGolomb(BitStreamWriter *w, uint64_t v) {
+   uint32_t len;
+
+   if (v == UINT64_MAX) {
+      w->error = 1;
+      return;
+   }
+   len = 64 - __builtin_clzll(v + 1);
+   if (len > 1)
+      BitStreamWriterPut(w, 0, len - 1);
+   BitStreamWriterPut(w, v + 1, len);
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn void BitStreamWriterSignedExpGolomb(BitStreamWriter *w, int64_t v)
+ *
+ * @brief writes a signed Exp-Golomb code
+ *
+ * @param [in,out] *w\n
+ * 	writer
+ * @param [in] v\n
+ * 	value to code, above INT64_MIN (the writer is put in error otherwise)
+ * @returns none
+ */
+void BitStreamWriterSignedExpGolomb(BitStreamWriter *w, int64_t v) {
+   if (v == INT64_MIN) {
+      w->error = 1;
+      return;
+   }
+   BitStreamWriterExpGolomb(w, v > 0 ? 2 * (uint64_t)v - 1 :
+		   2 * (uint64_t)(-v));
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn int64_t BitStreamWriterFinish(BitStreamWriter *w)
+ *
+ * @brief stores the bits still in the accumulator
+ *
+ * A stream the writer grew ends at the last bit written, otherwise its size
+ * is unchanged
+ *
+ * @param [in,out] *w\n
+ * 	writer
+ * @returns bit offset following the last bit written, -1 if the stream
+ * 	could not be grown (or a value could not be coded) along the way
+ */
+int64_t BitStreamWriterFinish(BitStreamWriter *w) {
+   return WriterFinish(w, BITSTREAM_MSB_FIRST);
+}
+
+/**
+ * @ingroup BitStreamWriter
+ * @fn int64_t BitStreamWriterFinishLsb(BitStreamWriter *w)
+ *
+ * @brief BitStreamWriterFinish() of an LSB first stream
+ *
+ * @param [in,out] *w\n
+ * 	writer
+ * @returns bit offset following the last bit written, -1 on error
+ */
+int64_t BitStreamWriterFinishLsb(BitStreamWriter *w) {
+   return WriterFinish(w, BITSTREAM_LSB_FIRST);
+}
@@ -0,0 +1,253 @@
+/**
+ * @file  BitStreamReader.h
+ * @brief Sequential bit reader and writer over a bit stream, for variable
+ * 	length codes (unary, Exp-Golomb, Huffman tables indexed by a peek)
+ *
+ * The per-bit operations are inline, the refills and flushes they fall
+ * back on once per word are in BitStreamReader.c. A cursor reads or writes
+ * one bit order only, the Lsb routines are used throughout for LSB first
+ * streams.
+ */
+#if !defined(_BITSTREAM_READER_H)
+#define _BITSTREAM_READER_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def BITSTREAM_READER_MAX_PEEK
+ * @brief most bits a single peek can return, a refill leaves at least this
+ * 	many bits in the cache
+ */
+#define BITSTREAM_READER_MAX_PEEK	57
+
+/* Type Definitions */
+/**
+ * @struct BitStreamReader
+ * @brief read cursor, the cache holds the bits from pos on (next bit in
+ * 	the most significant position, the least significant one for the Lsb
+ * 	routines)
+ *
+ * Reads past the end of the stream return zero bits, check
+ * BitStreamReaderOverrun() once a batch of codes has been decoded rather
+ * than after every read.
+ */
+typedef struct BitStreamReader {
+   const uint8_t *array;
+   uint64_t       nbits;    /**< size of the stream in bits */
+   uint64_t       pos;      /**< offset of the next bit to read */
+   uint64_t       cache;    /**< bits from pos on, most significant first */
+   uint32_t       count;    /**< valid bits in cache */
+} BitStreamReader;
+
+/**
+ * @struct BitStreamWriter
+ * @brief write cursor, whole 64 bit words are stored into the stream
+ *
+ * The stream is grown when the writer runs past its end, the bits in front
+ * of the first one written and after the last one are preserved.
+ */
+typedef struct BitStreamWriter {
+   BitStream *bs;
+   uint64_t   byte;     /**< byte the accumulator is stored to */
+   uint64_t   acc;      /**< pending bits, right aligned */
+   uint32_t   count;    /**< pending bits in acc, below 64 */
+   uint64_t   nbits;    /**< size of the stream before writing */
+   int        error;    /**< the stream could not be grown */
+} BitStreamWriter;
+
+
+int BitStreamReaderInit(BitStreamReader *r, BitStream *bs, uint64_t offset) ;
+
+void BitStreamReaderRefill(BitStreamReader *r) ;
+
+void BitStreamReaderSkip(BitStreamReader *r, uint64_t nbits) ;
+
+uint64_t BitStreamReaderGetLong(BitStreamReader *r, uint32_t nbits) ;
+
+uint32_t BitStreamReaderUnary(BitStreamReader *r) ;
+
+uint64_t BitStreamReaderExpGolomb(BitStreamReader *r) ;
+
+int64_t BitStreamReaderSignedExpGolomb(BitStreamReader *r) ;
+
+int BitStreamWriterInit(BitStreamWriter *w, BitStream *bs, uint64_t offset) ;
+
+void BitStreamWriterFlushWord(BitStreamWriter *w, uint64_t v, uint32_t nbits) ;
+
+void BitStreamWriterUnary(BitStreamWriter *w, uint32_t n) ;
+
+void BitStreamWriterExpGolomb(BitStreamWriter *w, uint64_t v) ;
+
+void BitStreamWriterSignedExpGolomb(BitStreamWriter *w, int64_t v) ;
+
+int64_t BitStreamWriterFinish(BitStreamWriter *w) ;
+
+void BitStreamReaderRefillLsb(BitStreamReader *r) ;
+
+void BitStreamReaderSkipLsb(BitStreamReader *r, uint64_t nbits) ;
+
+uint64_t BitStreamReaderGetLongLsb(BitStreamReader *r, uint32_t nbits) ;
+
+int BitStreamWriterInitLsb(BitStreamWriter *w, BitStream *bs,
+	uint64_t offset) ;
+
+void BitStreamWriterFlushWordLsb(BitStreamWriter *w, uint64_t v,
+	uint32_t nbits) ;
+
+int64_t BitStreamWriterFinishLsb(BitStreamWriter *w) ;
+
+/**
+ * @fn uint64_t BitStreamReaderPeek(BitStreamReader *r, uint32_t nbits)
+ *
+ * @brief next nbits bits (1 to BITSTREAM_READER_MAX_PEEK) without
+ * 	consuming them
+ */
+static inline uint64_t BitStreamReaderPeek(BitStreamReader *r,
+	uint32_t nbits) {
+   if (r->count < nbits)
+      BitStreamReaderRefill(r);
+   return r->cache >> (64 - nbits);
+}
+
+/**
+ * @fn void BitStreamReaderConsume(BitStreamReader *r, uint32_t nbits)
+ *
+ * @brief drops nbits bits that were peeked at
+ */
+static inline void BitStreamReaderConsume(BitStreamReader *r, uint32_t nbits) {
+   r->cache <<= nbits;
+   r->count -= nbits;
+   r->pos += nbits;
+}
+
+/**
+ * @fn uint64_t BitStreamReaderGet(BitStreamReader *r, uint32_t nbits)
+ *
+ * @brief reads the next nbits bits (0 to 64)
+ */
+static inline uint64_t BitStreamReaderGet(BitStreamReader *r, uint32_t nbits) {
+   uint64_t v;
+
+   if (nbits == 0 || nbits > BITSTREAM_READER_MAX_PEEK)
+      return BitStreamReaderGetLong(r, nbits);
+
+   v = BitStreamReaderPeek(r, nbits);
+   BitStreamReaderConsume(r, nbits);
+   return v;
+}
+
+/**
+ * @fn uint64_t BitStreamReaderTell(BitStreamReader *r)
+ *
+ * @brief bit offset of the next bit to read
+ */
+static inline uint64_t BitStreamReaderTell(BitStreamReader *r) {
+   return r->pos;
+}
+
+/**
+ * @fn int BitStreamReaderOverrun(BitStreamReader *r)
+ *
+ * @brief 1 if bits past the end of the stream have been read
+ */
+static inline int BitStreamReaderOverrun(BitStreamReader *r) {
+   return r->pos > r->nbits;
+}
+
+/**
+ * @fn void BitStreamWriterPut(BitStreamWriter *w, uint64_t v,
+ * 	uint32_t nbits)
+ *
+ * @brief writes the low nbits bits of v (1 to 64)
+ */
+static inline void BitStreamWriterPut(BitStreamWriter *w, uint64_t v,
+	uint32_t nbits) {
+   if (nbits < 64)
+      v &= (1ULL << nbits) - 1;
+   if (w->count + nbits < 64) {
+      w->acc = (w->acc << nbits) | v;
+      w->count += nbits;
+   } else {
+      BitStreamWriterFlushWord(w, v, nbits);
+   }
+}
+
+/**
+ * @fn uint64_t BitStreamReaderPeekLsb(BitStreamReader *r, uint32_t nbits)
+ *
+ * @brief next nbits bits (1 to BITSTREAM_READER_MAX_PEEK) of an LSB first
+ * 	stream, the next bit in the least significant position
+ */
+static inline uint64_t BitStreamReaderPeekLsb(BitStreamReader *r,
+	uint32_t nbits) {
+   if (r->count < nbits)
+      BitStreamReaderRefillLsb(r);
+   return r->cache & ((1ULL << nbits) - 1);
+}
+
+/**
+ * @fn void BitStreamReaderConsumeLsb(BitStreamReader *r, uint32_t nbits)
+ *
+ * @brief drops nbits bits of an LSB first stream that were peeked at
+ */
+static inline void BitStreamReaderConsumeLsb(BitStreamReader *r,
+	uint32_t nbits) {
+   r->cache >>= nbits;
+   r->count -= nbits;
+   r->pos += nbits;
+}
+
+/**
+ * @fn uint64_t BitStreamReaderGetLsb(BitStreamReader *r, uint32_t nbits)
+ *
+ * @brief reads the next nbits bits (0 to 64) of an LSB first stream
+ */
+static inline uint64_t BitStreamReaderGetLsb(BitStreamReader *r,
+	uint32_t nbits) {
+   uint64_t v;
+
+   if (nbits == 0 || nbits > BITSTREAM_READER_MAX_PEEK)
+      return BitStreamReaderGetLongLsb(r, nbits);
+
+   v = BitStreamReaderPeekLsb(r, nbits);
+   BitStreamReaderConsumeLsb(r, nbits);
+   return v;
+}
+
+/**
+ * @fn void BitStreamWriterPutLsb(BitStreamWriter *w, uint64_t v,
+ * 	uint32_t nbits)
+ *
+ * @brief writes the low nbits bits of v (1 to 64) to an LSB first stream,
+ * 	least significant bit first
+ */
+static inline void BitStreamWriterPutLsb(BitStreamWriter *w, uint64_t v,
+	uint32_t nbits) {
+   if (nbits < 64)
+      v &= (1ULL << nbits) - 1;
+   if (w->count + nbits < 64) {
+      w->acc |= v << w->count;
+      w->count += nbits;
+   } else {
+      BitStreamWriterFlushWordLsb(w, v, nbits);
+   }
+}
+
+/**
+ * @fn uint64_t BitStreamWriterTell(BitStreamWriter *w)
+ *
+ * @brief bit offset of the next bit to write
+ */
+static inline uint64_t BitStreamWriterTell(BitStreamWriter *w) {
+   return w->byte * BITS_PER_BYTE + w->count;
+}
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_READER_H */
@@ -0,0 +1,264 @@
+/**
+ * @file BitStreamReverse.c
+ *
+ * @brief Implements reversal of the bits within each byte of a buffer
+ *
+ * Bit offset k is bit 7 - (k % 8) of its byte in an MSB first stream and
+ * bit k % 8 in an LSB first one, so reversing every byte converts a stream
+ * between the two orders, a trailing partial byte included.
+ *
+ * Bytes are reversed 32 (AVX2) or 16 (SSSE3) at a time with two nibble
+ * lookups through pshufb, or 8 at a time with swaps of bits, pairs and
+ * nibbles within a 64 bit word when neither is available. The fastest the
+ * cpu supports is picked on first use, BitStreamReverseSelect() overrides
+ * the choice.
+ *
+ * @internal BitStreamReverseSelect
+ * 	     BitStreamReverseBitsBytes
+ * 	     BitStreamReverseBitOrder
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <pthread.h>
+
+#include "BitStreamReverse.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REVERSE_HAVE_X86	1
+#include <immintrin.h>
+#endif
+
+/**
+ * @fn uint64_t ReverseWord(uint64_t x)
+ *
+ * @brief reverses the bits of each of the 8 bytes of x
+ */
+static inline uint64_t ReverseWord(uint64_t x) {
+   x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+   x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+   x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+   return x;
+}
+
+/**
+ * @fn void ReverseScalar(const uint8_t *in, uint8_t *out, size_t size)
+ *
+ * @brief reverses the bytes of in a word at a time, then the tail
+ */
+static void ReverseScalar(const uint8_t *in, uint8_t *out, size_t size) {
+   uint64_t x;
+
+   for (; size >= 8; size -= 8, in += 8, out += 8) {
+      memcpy(&x, in, 8);
+      x = ReverseWord(x);
+      memcpy(out, &x, 8);
+   }
+   if (size) {
+      x = 0;
+      memcpy(&x, in, size);
+      x = ReverseWord(x);
+      memcpy(out, &x, size);
+   }
+}
+
+/**
+ * @struct ReverseOps
+ * @brief an implementation, its kernel reverses a multiple of its vector
+ * 	size and leaves the rest of the bytes to ReverseScalar()
+ */
+typedef struct ReverseOps {
+   BitStreamReverseImpl impl;
+   size_t (*kernel)(const uint8_t *in, uint8_t *out, size_t size);
+} ReverseOps;
+
+/**
+ * @fn size_t ReverseNone(const uint8_t *in, uint8_t *out, size_t size)
+ *
+ * @brief kernel of the scalar implementation, leaves every byte
+ */
+static size_t ReverseNone(const uint8_t *in, uint8_t *out, size_t size) {
+   (void)in;
+   (void)out;
+   (void)size;
+   return 0;
+}
+
+static const ReverseOps ReverseWords = { BITSTREAM_REVERSE_SCALAR,
+					 ReverseNone };
+
+#if defined(REVERSE_HAVE_X86)
+/* bit reversed nibbles, in the low and in the high half of a byte */
+#define REVERSE_NIBBLE_LO	\
+   0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,	\
+   0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
+#define REVERSE_NIBBLE_HI	\
+   0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,	\
+   0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0
+
+/**
+ * @fn size_t ReverseSsse3(const uint8_t *in, uint8_t *out, size_t size)
+ *
+ * @brief reverses 16 bytes at a time
+ *
+ * @returns bytes done, a multiple of 16
+ */
+static __attribute__((target("ssse3"))) size_t ReverseSsse3(const uint8_t *in,
+	uint8_t *out, size_t size) {
+   const __m128i lo = _mm_setr_epi8(REVERSE_NIBBLE_LO);
+   const __m128i hi = _mm_setr_epi8(REVERSE_NIBBLE_HI);
+   const __m128i mask = _mm_set1_epi8(0x0f);
+   size_t        i;
+
+   /*
+    * the low nibble of a byte is looked up in hi, it becomes the reversed
+    * high nibble, and the high nibble in lo
+    */
+   for (i = 0; i + 16 <= size; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+
+      x = _mm_or_si128(_mm_shuffle_epi8(hi, _mm_and_si128(x, mask)),
+		       _mm_shuffle_epi8(lo, _mm_and_si128(_mm_srli_epi16(x, 4),
+					       mask)));
+      _mm_storeu_si128((__m128i *)(out + i), x);
+   }
+   return i;
+}
+
+/**
+ * @fn size_t ReverseAvx2(const uint8_t *in, uint8_t *out, size_t size)
+ *
+ * @brief reverses 32 bytes at a time
+ *
+ * @returns bytes done, a multiple of 32
+ */
+static __attribute__((target("avx2"))) size_t ReverseAvx2(const uint8_t *in,
+	uint8_t *out, size_t size) {
+   const __m256i lo = _mm256_setr_epi8(REVERSE_NIBBLE_LO, REVERSE_NIBBLE_LO);
+   const __m256i hi = _mm256_setr_epi8(REVERSE_NIBBLE_HI, REVERSE_NIBBLE_HI);
+   const __m256i mask = _mm256_set1_epi8(0x0f);
+   size_t        i;
+
+   for (i = 0; i + 32 <= size; i += 32) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+
+      x = _mm256_or_si256(_mm256_shuffle_epi8(hi, _mm256_and_si256(x, mask)),
+		      _mm256_shuffle_epi8(lo, _mm256_and_si256(
+				      _mm256_srli_epi16(x, 4), mask)));
+      _mm256_storeu_si256((__m256i *)(out + i), x);
+   }
+   return i;
+}
+
+static const ReverseOps ReverseSsse3Ops = { BITSTREAM_REVERSE_SSSE3,
+					    ReverseSsse3 };
+static const ReverseOps ReverseAvx2Ops = { BITSTREAM_REVERSE_AVX2,
+					   ReverseAvx2 };
+#endif /* REVERSE_HAVE_X86 */
+
+static const ReverseOps *Reverse = NULL;
+static pthread_once_t    ReverseOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @fn const ReverseOps* ReverseChoose(BitStreamReverseImpl impl)
+ *
+ * @brief implementation for impl, the next one down if the cpu lacks what
+ * 	impl needs
+ */
+static const ReverseOps* ReverseChoose(BitStreamReverseImpl impl) {
+#if defined(REVERSE_HAVE_X86)
+   if ((impl == BITSTREAM_REVERSE_AUTO || impl == BITSTREAM_REVERSE_AVX2) &&
+       __builtin_cpu_supports("avx2"))
+      return &ReverseAvx2Ops;
+   if (impl != BITSTREAM_REVERSE_SCALAR && __builtin_cpu_supports("ssse3"))
+      return &ReverseSsse3Ops;
+#endif
+   (void)impl;
+   return &ReverseWords;
+}
+
+/**
+ * @fn void ReverseInit(void)
+ *
+ * @brief picks the implementation on first use
+ */
+static void ReverseInit(void) {
+   __atomic_store_n(&Reverse, ReverseChoose(BITSTREAM_REVERSE_AUTO),
+		   __ATOMIC_RELEASE);
+}
+
+/**
+ * @fn const ReverseOps* ReverseGetOps(void)
+ *
+ * @brief implementation in use
+ */
+static inline const ReverseOps* ReverseGetOps(void) {
+   pthread_once(&ReverseOnce, ReverseInit);
+   return __atomic_load_n(&Reverse, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @ingroup BitStreamReverse
+ * @fn BitStreamReverseImpl BitStreamReverseSelect(BitStreamReverseImpl impl)
+ *
+ * @brief selects the implementation used by all subsequent calls, meant to
+ * 	be called once at startup (or by tests comparing the implementations)
+ *
+ * @param [in] impl\n
+ * 	implementation wanted, BITSTREAM_REVERSE_AUTO for the fastest available
+ * @returns implementation selected, a slower one if the one asked for is
+ * 	not available on this cpu
+ */
+BitStreamReverseImpl BitStreamReverseSelect(BitStreamReverseImpl impl) {
+   const ReverseOps *ops = ReverseChoose(impl);
+
+   /* after the first use pick, which would otherwise override this one */
+   pthread_once(&ReverseOnce, ReverseInit);
+   __atomic_store_n(&Reverse, ops, __ATOMIC_RELEASE);
+   return ops->impl;
+}
+
+/**
+ * @ingroup BitStreamReverse
+ * @fn void BitStreamReverseBitsBytes(const uint8_t *in, uint8_t *out,
+ * 	size_t size)
+ *
+ * @brief reverses the order of the bits within each byte
+ *
+ * @param [in] *in\n
+ * 	bytes to reverse
+ * @param [out] *out\n
+ * 	reversed bytes, may be in itself
+ * @param [in] size\n
+ * 	number of bytes
+ * @returns none
+ */
+void BitStreamReverseBitsBytes(const uint8_t *in, uint8_t *out, size_t size) {
+   size_t done = ReverseGetOps()->kernel(in, out, size);
+
+   ReverseScalar(in + done, out + done, size - done);
+}
+
+/**
+ * @ingroup BitStreamReverse
+ * @fn BitStream* BitStreamReverseBitOrder(BitStream *bs)
+ *
+ * @brief converts an MSB first stream to LSB first, or back
+ *
+ * @param [in] *bs\n
+ * 	bit stream to convert
+ * @returns newly created bit stream holding the same bits in the other
+ * 	order, NULL on failure
+ */
+BitStream* BitStreamReverseBitOrder(BitStream *bs) {
+   BitStream *out;
+
+   if (BitStreamGetArray(bs) == NULL)
+      return NULL;
+
+   out = BitStreamCreate(bs->nbits);
+   if (out)
+      BitStreamReverseBitsBytes(bs->array, out->array,
+		      (bs->nbits + 7) / BITS_PER_BYTE);
+   return out;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file  BitStreamReverse.h
+ * @brief Conversion of bit streams between MSB first and LSB first order
+ */
+#if !defined(_BITSTREAM_REVERSE_H)
+#define _BITSTREAM_REVERSE_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Type Definitions */
+/**
+ * @enum BitStreamReverseImpl
+ * @brief implementations of the byte reversal
+ */
+typedef enum BitStreamReverseImpl {
+   BITSTREAM_REVERSE_AUTO = 0,   /**< fastest the cpu supports */
+   BITSTREAM_REVERSE_SCALAR,     /**< portable 64 bit words */
+   BITSTREAM_REVERSE_SSSE3,      /**< 128 bit SSSE3 nibble lookups */
+   BITSTREAM_REVERSE_AVX2        /**< 256 bit AVX2 nibble lookups */
+} BitStreamReverseImpl;
+
+
+BitStreamReverseImpl BitStreamReverseSelect(BitStreamReverseImpl impl) ;
+
+void BitStreamReverseBitsBytes(const uint8_t *in, uint8_t *out, size_t size) ;
+
+BitStream* BitStreamReverseBitOrder(BitStream *bs) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_REVERSE_H */
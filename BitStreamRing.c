@@ -0,0 +1,272 @@
+/**
+ * @file BitStreamRing.c
+ *
+ * @brief Implements bounded lock-free rings of pointers
+ *
+ * Rings with several producers or consumers follow the bounded queue of
+ * D. Vyukov: every slot carries a sequence number, a producer owns slot
+ * pos once its sequence equals pos and a consumer once it equals pos + 1,
+ * the position itself is claimed with a compare and swap. A ring between
+ * one producer and one consumer needs none of that, the producer publishes
+ * head, the consumer publishes tail and each keeps a copy of the other's
+ * index so the shared line is only read when the ring looks full or empty.
+ *
+ * A full ring pushes back on its producers and an empty one holds its
+ * consumers, the blocking calls spin briefly and then yield the cpu.
+ *
+ * @internal BitStreamRingCreate
+ * 	     BitStreamRingDelete
+ * 	     BitStreamRingTryPush
+ * 	     BitStreamRingTryPop
+ * 	     BitStreamRingPush
+ * 	     BitStreamRingPop
+ * 	     BitStreamRingClose
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <sched.h>
+
+#include "BitStreamRing.h"
+
+/**
+ * @def RING_SPINS
+ * @brief attempts a blocking call makes before it starts yielding the cpu
+ */
+#define RING_SPINS	64
+
+/**
+ * @def RING_PAUSE
+ * @brief spin loop hint, a plain compiler barrier where the cpu has none
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define RING_PAUSE()	__builtin_ia32_pause()
+#else
+#define RING_PAUSE()	__atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/**
+ * @fn void RingBackoff(unsigned *attempt)
+ *
+ * @brief waits a little before the next attempt of a blocking call
+ */
+static inline void RingBackoff(unsigned *attempt) {
+   if (++*attempt < RING_SPINS)
+      RING_PAUSE();
+   else
+      sched_yield();
+}
+
+/**
+ * @ingroup BitStreamRing
+ * @fn BitStreamRing* BitStreamRingCreate(uint32_t slots, unsigned producers,
+ * 	unsigned consumers)
+ *
+ * @brief Creates an empty ring
+ *
+ * @param [in] slots\n
+ * 	capacity, rounded up to a power of 2
+ * @param [in] producers\n
+ * 	number of threads pushing, each of them closes the ring when done
+ * @param [in] consumers\n
+ * 	number of threads popping
+ * @returns pointer to the new ring, NULL on failure
+ */
+BitStreamRing* BitStreamRingCreate(uint32_t slots, unsigned producers,
+	unsigned consumers) {
+   BitStreamRing *ring;
+   uint64_t       size = 2, i;
+
+   if (producers == 0 || consumers == 0)
+      return NULL;
+
+   while (size < slots)
+      size <<= 1;
+
+   ring = (BitStreamRing *)aligned_alloc(64, sizeof(BitStreamRing));
+   if (ring == NULL)
+      return NULL;
+   memset(ring, 0, sizeof(BitStreamRing));
+
+   ring->slots = (BitStreamRingSlot *)malloc(size * sizeof(BitStreamRingSlot));
+   if (ring->slots == NULL) {
+      free(ring);
+      return NULL;
+   }
+   for (i = 0; i < size; i++)
+      ring->slots[i].seq = i;
+
+   ring->mask = size - 1;
+   ring->spsc = producers == 1 && consumers == 1;
+   ring->producers = producers;
+
+   return ring;
+}
+
+/**
+ * @ingroup BitStreamRing
+ * @fn void BitStreamRingDelete(BitStreamRing *ring)
+ *
+ * @brief Deletes the ring, the items still in it are not touched
+ *
+ * @param [in] *ring\n
+ * 	ring to delete, may be NULL
+ * @returns none
+ */
+void BitStreamRingDelete(BitStreamRing *ring) {
+   if (ring) {
+      free(ring->slots);
+      free(ring);
+   }
+}
+
+/**
+ * @ingroup BitStreamRing
+ * @fn int BitStreamRingTryPush(BitStreamRing *ring, void *item)
+ *
+ * @brief appends item to the ring unless it is full
+ *
+ * @param [in] *ring\n
+ * 	ring to push to
+ * @param [in] *item\n
+ * 	item to push
+ * @returns 1 if the item was pushed, 0 if the ring is full
+ */
+int BitStreamRingTryPush(BitStreamRing *ring, void *item) {
+   BitStreamRingSlot *slot;
+   uint64_t           pos, seq;
+
+   if (ring->spsc) {
+      pos = ring->head;
+      if (pos - ring->tailSeen > ring->mask) {
+         ring->tailSeen = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+         if (pos - ring->tailSeen > ring->mask)
+            return 0;
+      }
+      ring->slots[pos & ring->mask].item = item;
+      __atomic_store_n(&ring->head, pos + 1, __ATOMIC_RELEASE);
+      return 1;
+   }
+
+   pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+   for (;;) {
+      slot = &ring->slots[pos & ring->mask];
+      seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+      if (seq == pos) {
+         if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+				 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      } else if ((int64_t)(seq - pos) < 0) {
+         return 0;
+      } else {
+         pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+      }
+   }
+   slot->item = item;
+   __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+   return 1;
+}
+
+/**
+ * @ingroup BitStreamRing
+ * @fn void* BitStreamRingTryPop(BitStreamRing *ring)
+ *
+ * @brief removes the oldest item of the ring unless it is empty
+ *
+ * @param [in] *ring\n
+ * 	ring to pop from
+ * @returns the item, NULL if the ring is empty
+ */
+void* BitStreamRingTryPop(BitStreamRing *ring) {
+   BitStreamRingSlot *slot;
+   uint64_t           pos, seq;
+   void              *item;
+
+   if (ring->spsc) {
+      pos = ring->tail;
+      if (pos == ring->headSeen) {
+         ring->headSeen = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+         if (pos == ring->headSeen)
+            return NULL;
+      }
+      item = ring->slots[pos & ring->mask].item;
+      __atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELEASE);
+      return item;
+   }
+
+   pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+   for (;;) {
+      slot = &ring->slots[pos & ring->mask];
+      seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+      if (seq == pos + 1) {
+         if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+				 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      } else if ((int64_t)(seq - (pos + 1)) < 0) {
+         return NULL;
+      } else {
+         pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+      }
+   }
+   item = slot->item;
+   __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+   return item;
+}
+
+/**
+ * @ingroup BitStreamRing
+ * @fn void BitStreamRingPush(BitStreamRing *ring, void *item)
+ *
+ * @brief appends item to the ring, waiting for a consumer to make room
+ *
+ * @param [in] *ring\n
+ * 	ring to push to
+ * @param [in] *item\n
+ * 	item to push, not NULL
+ * @returns none
+ */
+void BitStreamRingPush(BitStreamRing *ring, void *item) {
+   unsigned attempt = 0;
+
+   while (!BitStreamRingTryPush(ring, item))
+      RingBackoff(&attempt);
+}
+
+/**
+ * @ingroup BitStreamRing
+ * @fn void* BitStreamRingPop(BitStreamRing *ring)
+ *
+ * @brief removes the oldest item of the ring, waiting for one to arrive
+ *
+ * @param [in] *ring\n
+ * 	ring to pop from
+ * @returns the item, NULL once the ring is closed and drained
+ */
+void* BitStreamRingPop(BitStreamRing *ring) {
+   unsigned attempt = 0;
+   void    *item;
+
+   while ((item = BitStreamRingTryPop(ring)) == NULL) {
+      /* every push happened before the last close, look once more */
+      if (__atomic_load_n(&ring->producers, __ATOMIC_ACQUIRE) == 0)
+         return BitStreamRingTryPop(ring);
+      RingBackoff(&attempt);
+   }
+   return item;
+}
+
+/**
+ * @ingroup BitStreamRing
+ * @fn void BitStreamRingClose(BitStreamRing *ring)
+ *
+ * @brief tells the consumers that the calling producer will push no more
+ *
+ * @param [in] *ring\n
+ * 	ring the producer is done with
+ * @returns none
+ */
+void BitStreamRingClose(BitStreamRing *ring) {
+   __atomic_sub_fetch(&ring->producers, 1, __ATOMIC_RELEASE);
+}
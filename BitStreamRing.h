@@ -0,0 +1,67 @@
+/**
+ * @file  BitStreamRing.h
+ * @brief Bounded lock-free queues of pointers between threads
+ */
+#if !defined(_BITSTREAM_RING_H)
+#define _BITSTREAM_RING_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Type Definitions */
+/**
+ * @struct BitStreamRingSlot
+ * @brief one entry of a ring, seq tells producers and consumers whose turn
+ * 	it is (multi producer / multi consumer rings only)
+ */
+typedef struct BitStreamRingSlot {
+   uint64_t  seq;
+   void     *item;
+} BitStreamRingSlot;
+
+/**
+ * @struct BitStreamRing
+ * @brief bounded queue of pointers
+ *
+ * A ring with one producer and one consumer only publishes head and tail,
+ * others claim slots with a compare and swap on the sequence of each slot.
+ * Producers and consumers touch different cache lines. The ring is closed
+ * once each of its producers has called BitStreamRingClose(), consumers then
+ * drain what is left and get NULL.
+ */
+typedef struct BitStreamRing {
+   BitStreamRingSlot *slots;
+   uint64_t           mask;       /**< number of slots - 1 */
+   int                spsc;       /**< single producer and single consumer */
+   unsigned           producers;  /**< producers yet to close (atomic) */
+
+   uint64_t           head __attribute__((aligned(64))); /**< next push */
+   uint64_t           tailSeen;   /**< producer's copy of tail (spsc) */
+
+   uint64_t           tail __attribute__((aligned(64))); /**< next pop */
+   uint64_t           headSeen;   /**< consumer's copy of head (spsc) */
+} BitStreamRing;
+
+
+BitStreamRing* BitStreamRingCreate(uint32_t slots, unsigned producers,
+	unsigned consumers) ;
+
+void BitStreamRingDelete(BitStreamRing *ring) ;
+
+int BitStreamRingTryPush(BitStreamRing *ring, void *item) ;
+
+void* BitStreamRingTryPop(BitStreamRing *ring) ;
+
+void BitStreamRingPush(BitStreamRing *ring, void *item) ;
+
+void* BitStreamRingPop(BitStreamRing *ring) ;
+
+void BitStreamRingClose(BitStreamRing *ring) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_RING_H */
@@ -0,0 +1,753 @@
+/**
+ * @file BitStreamScore.c
+ *
+ * @brief Implements scoring of candidate plaintexts against english text
+ *
+ * The byte classification (printable, space, letter, word boundaries) runs
+ * 16 bytes at a time with range compares, the letter frequencies come out of
+ * a byte histogram. Everything the scores are measured against is held in
+ * constant tables below. The only exception is the trigram model, its 64KB
+ * of tables are built from the seed lists on first use.
+ *
+ * @internal EnglishTextScoreCalc
+ * 	     EnglishTextLogLikelihood
+ * 	     EnglishTextScoreSingleByteXor
+ * 	     BitStreamSingleByteXorKey
+ * 	     EnglishTextNgramScore
+ * 	     EnglishTextNgramScoreXor
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include <math.h>
+#include <pthread.h>
+
+#include "BitStreamHistogram.h"
+#include "BitStreamScore.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @var EnglishLetterFrequency
+ * @brief relative frequency of letters 'a' to 'z' in english text, case
+ * 	folded (the ETAOIN SHRDLU histogram)
+ */
+static const float EnglishLetterFrequency[26] = {
+   0.08167f, 0.01492f, 0.02782f, 0.04253f, 0.12702f, 0.02228f, 0.02015f,
+   0.06094f, 0.06966f, 0.00153f, 0.00772f, 0.04025f, 0.02406f, 0.06749f,
+   0.07507f, 0.01929f, 0.00095f, 0.05987f, 0.06327f, 0.09056f, 0.02758f,
+   0.00978f, 0.02360f, 0.00150f, 0.01974f, 0.00074f
+};
+
+/**
+ * @var EnglishLogProb
+ * @brief natural log of the probability of each byte value in english text
+ *
+ * Letters take 80% of the mass (4% of it upper case), space 15%, common
+ * punctuation 3%, digits and line breaks the rest. Other printables share
+ * 0.05% and every non-printable byte is given 1e-6.
+ */
+static const float EnglishLogProb[256] = {
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f,  -7.8137f,  -5.7342f, -13.8051f, -13.8051f,  -7.8137f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+    -1.8867f,  -6.7150f,  -6.4919f, -10.7260f, -10.7260f, -10.7260f, -10.7260f,  -5.3933f,
+   -10.7260f, -10.7260f, -10.7260f, -10.7260f,  -4.7001f,  -6.3096f,  -4.7001f, -10.7260f,
+    -7.5905f,  -7.5905f,  -7.5905f,  -7.5905f,  -7.5905f,  -7.5905f,  -7.5905f,  -7.5905f,
+    -7.5905f,  -7.5905f,  -7.0027f,  -7.0027f, -10.7260f, -10.7260f, -10.7260f,  -6.7150f,
+   -10.7260f,  -5.9345f,  -7.7803f,  -7.0125f,  -6.5881f,  -5.4934f,  -7.2330f,  -7.3319f,
+    -6.2283f,  -6.0934f,  -9.9321f,  -8.2964f,  -6.6412f,  -7.1554f,  -6.1254f,  -6.0188f,
+    -7.3775f, -10.3376f,  -6.2449f,  -6.1897f,  -5.8311f,  -7.0198f,  -8.0552f,  -7.1763f,
+    -9.9321f,  -7.3570f, -10.6943f, -10.7260f, -10.7260f, -10.7260f, -10.7260f, -10.7260f,
+   -10.7260f,  -2.7565f,  -4.6023f,  -3.8345f,  -3.4100f,  -2.3153f,  -4.0549f,  -4.1538f,
+    -3.0503f,  -2.9153f,  -6.7541f,  -5.1183f,  -3.4632f,  -3.9773f,  -2.9474f,  -2.8407f,
+    -4.1994f,  -7.1595f,  -3.0668f,  -3.0116f,  -2.6531f,  -3.8417f,  -4.8771f,  -3.9983f,
+    -6.7541f,  -4.1789f,  -7.5162f, -10.7260f, -10.7260f, -10.7260f, -10.7260f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+   -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f, -13.8051f,
+};
+
+/**
+ * @struct ByteClassCount
+ * @brief counts gathered by the classification pass over the text
+ */
+typedef struct ByteClassCount {
+   uint32_t printable; /**< bytes in [0x20, 0x7e] */
+   uint32_t spaces;    /**< ' ' bytes */
+   uint32_t letters;   /**< [A-Za-z] bytes */
+   uint32_t words;     /**< non-space bytes following a space or the start */
+} ByteClassCount;
+
+/**
+ * @fn void ByteClassCountCalc(ByteClassCount* cnt, const uint8_t *buf,
+ * 	size_t size)
+ *
+ * @brief classifies each byte of the buffer as printable, space and letter
+ * 	and counts the words (runs of non-space bytes) in the same pass
+ *
+ * With SSE2 the classes are computed for 16 bytes at a time with unsigned
+ * range compares (biased into the signed range), reduced to bit masks and
+ * counted with popcount. Word starts are the non-space bits whose preceding
+ * bit is a space, the carry between blocks is the last bit of the mask.
+ *
+ * @param [out] *cnt\n
+ * 	counts, overwritten
+ * @param [in] *buf\n
+ * 	text to classify
+ * @param [in] size\n
+ * 	length of the text in bytes
+ * @returns none
+ */
+static void ByteClassCountCalc(ByteClassCount* cnt, const uint8_t *buf,
+	size_t size) {
+   size_t   i = 0;
+   uint32_t prevSpace = 1; /* start of text behaves as a space */
+
+   memset(cnt, '\0', sizeof(*cnt));
+
+#if defined(__SSE2__)
+   {
+      /* x in [lo, hi] <=> (int8)(x + 0x80 - lo) < (int8)(0x80 + hi - lo + 1) */
+      const __m128i printBias  = _mm_set1_epi8((char)(0x80 - 0x20));
+      const __m128i printLimit = _mm_set1_epi8((char)(0x80 + 0x7f - 0x20));
+      const __m128i alphaBias  = _mm_set1_epi8((char)(0x80 - 'a'));
+      const __m128i alphaLimit = _mm_set1_epi8((char)(0x80 + 'z' - 'a' + 1));
+      const __m128i caseFold   = _mm_set1_epi8(0x20);
+      const __m128i space      = _mm_set1_epi8(' ');
+
+      for (; i + 16 <= size; i += 16) {
+         __m128i  v = _mm_loadu_si128((const __m128i *)(buf + i));
+         uint32_t p, s, a, w;
+
+         p = _mm_movemask_epi8(_mm_cmplt_epi8(_mm_add_epi8(v, printBias),
+				 printLimit));
+         s = _mm_movemask_epi8(_mm_cmpeq_epi8(v, space));
+         a = _mm_movemask_epi8(_mm_cmplt_epi8(_mm_add_epi8(
+				 _mm_or_si128(v, caseFold), alphaBias), alphaLimit));
+         w = ~s & ((s << 1) | prevSpace) & 0xFFFF;
+
+         cnt->printable += __builtin_popcount(p);
+         cnt->spaces    += __builtin_popcount(s);
+         cnt->letters   += __builtin_popcount(a);
+         cnt->words     += __builtin_popcount(w);
+         prevSpace = (s >> 15) & 1;
+      }
+   }
+#endif
+   for (; i < size; i++) {
+      uint8_t  c = buf[i];
+      uint32_t isSpace = (c == ' ');
+
+      cnt->printable += (uint8_t)(c - 0x20) < 0x5f;
+      cnt->spaces    += isSpace;
+      cnt->letters   += (uint8_t)((c | 0x20) - 'a') < 26;
+      cnt->words     += !isSpace && prevSpace;
+      prevSpace = isSpace;
+   }
+}
+
+/**
+ * @fn uint32_t EtaoinChiSquared(const BitStreamHistogram hist,
+ * 	uint32_t letters)
+ *
+ * @brief chi-squared distance between the case folded letter histogram and
+ * 	the english letter frequencies
+ *
+ * @param [in] hist\n
+ * 	byte histogram of the text
+ * @param [in] letters\n
+ * 	total number of letters in the text
+ * @returns distance, saturated at ETAOIN_SCORE_MAX
+ */
+static uint32_t EtaoinChiSquared(const BitStreamHistogram hist,
+	uint32_t letters) {
+   float chi = 0.0f;
+   int   i;
+
+   if (letters == 0)
+      return ETAOIN_SCORE_MAX;
+
+   for (i = 0; i < 26; i++) {
+      float expected = letters * EnglishLetterFrequency[i];
+      float diff = (float)(hist['a' + i] + hist['A' + i]) - expected;
+
+      chi += diff * diff / expected;
+   }
+   return chi < ETAOIN_SCORE_MAX ? (uint32_t)(chi + 0.5f) : ETAOIN_SCORE_MAX;
+}
+
+/**
+ * @ingroup BitStreamScore
+ * @fn float EnglishTextScoreCalc(EnglishTextScore* score, const uint8_t *buf,
+ * 	size_t size)
+ *
+ * @brief Calculates "score" for english language coherency
+ *
+ * @param [out] *score\n
+ * 	pointer to score parameter structure to be filled
+ * @param [in] *buf\n
+ * 	buffer to be parsed for calculating the english language score
+ * @param [in] size\n
+ * 	length of the buffer in bytes
+ * @returns mean log-probability per character, higher is more english like
+ */
+float EnglishTextScoreCalc(EnglishTextScore* score, const uint8_t *buf,
+	size_t size) {
+   ByteClassCount     cnt;
+   BitStreamHistogram hist;
+   float              ll = 0.0f;
+   int                b;
+
+   ByteClassCountCalc(&cnt, buf, size);
+   BitStreamHistogramBytes(buf, size, hist);
+
+   for (b = 0; b < 256; b++)
+      ll += hist[b] * EnglishLogProb[b];
+
+   score->NonPrintScore = size - cnt.printable;
+   score->LetterCount = cnt.letters;
+   score->SpaceCount = cnt.spaces;
+   score->WordCount = cnt.words;
+   score->WordLengthScore = cnt.words ? size / cnt.words : WORDLEN_SCORE_NONE;
+   score->EtaoinScore = EtaoinChiSquared(hist, cnt.letters);
+   score->LogLikelihood = size ? ll / size : EnglishLogProb[0];
+
+   return score->LogLikelihood;
+}
+
+/**
+ * @ingroup BitStreamScore
+ * @fn float EnglishTextLogLikelihood(const uint8_t *buf, size_t size)
+ *
+ * @brief mean log-probability per character of the buffer under the english
+ * 	character model, cheaper than EnglishTextScoreCalc() when only the
+ * 	ranking is needed
+ *
+ * @param [in] *buf\n
+ * 	buffer to be scored
+ * @param [in] size\n
+ * 	length of the buffer in bytes
+ * @returns mean log-probability per character, higher is more english like
+ */
+float EnglishTextLogLikelihood(const uint8_t *buf, size_t size) {
+   float  ll[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+   size_t i = 0;
+
+   if (size == 0)
+      return EnglishLogProb[0];
+
+   for (; i + 4 <= size; i += 4) {
+      ll[0] += EnglishLogProb[buf[i]];
+      ll[1] += EnglishLogProb[buf[i + 1]];
+      ll[2] += EnglishLogProb[buf[i + 2]];
+      ll[3] += EnglishLogProb[buf[i + 3]];
+   }
+   for (; i < size; i++)
+      ll[0] += EnglishLogProb[buf[i]];
+
+   return (ll[0] + ll[1] + ll[2] + ll[3]) / size;
+}
+
+/**
+ * @ingroup BitStreamScore
+ * @fn void EnglishTextScoreSingleByteXor(const uint8_t *buf, size_t size,
+ * 	float scores[256])
+ *
+ * @brief scores the buffer decrypted under each of the 256 single byte keys
+ * 	without decrypting it
+ *
+ * XOR with a single byte only permutes the byte histogram, the plaintext
+ * for key k holds hist[v] occurrences of (v ^ k). The cipher text is counted
+ * once and each key is scored over the distinct byte values alone.
+ *
+ * @param [in] *buf\n
+ * 	cipher text
+ * @param [in] size\n
+ * 	length of the cipher text in bytes
+ * @param [out] scores\n
+ * 	mean log-probability per character of the plaintext under each key
+ * @returns none
+ */
+void EnglishTextScoreSingleByteXor(const uint8_t *buf, size_t size,
+	float scores[256]) {
+   BitStreamHistogram hist;
+   uint8_t            value[256];
+   float              count[256];
+   int                n = 0;
+   int                b, k;
+
+   BitStreamHistogramBytes(buf, size, hist);
+
+   for (b = 0; b < 256; b++) {
+      if (hist[b]) {
+         value[n] = b;
+         count[n++] = (float)hist[b] / (size ? size : 1);
+      }
+   }
+   for (k = 0; k < 256; k++) {
+      float s = 0.0f;
+
+      for (b = 0; b < n; b++)
+         s += count[b] * EnglishLogProb[value[b] ^ k];
+      scores[k] = n ? s : EnglishLogProb[0];
+   }
+}
+
+/**
+ * @ingroup BitStreamScore
+ * @fn uint8_t BitStreamSingleByteXorKey(BitStream *cipher, float *score)
+ *
+ * @brief finds the single byte key under which the cipher stream decrypts to
+ * 	the most english like plaintext
+ *
+ * @param [in] *cipher\n
+ * 	cipher bit stream, trailing partial byte is ignored
+ * @param [out] *score\n
+ * 	mean log-probability per character of the plaintext, may be NULL
+ * @returns most likely key
+ */
+uint8_t BitStreamSingleByteXorKey(BitStream *cipher, float *score) {
+   float   scores[256];
+   uint8_t best = 0;
+   int     k;
+
+   EnglishTextScoreSingleByteXor(BitStreamGetArray(cipher),
+		   BitStreamGetSizeBits(cipher) / BITS_PER_BYTE, scores);
+
+   for (k = 1; k < 256; k++) {
+      if (scores[k] > scores[best])
+         best = k;
+   }
+   if (score)
+      *score = scores[best];
+
+   return best;
+}
+
+/**
+ * @def NGRAM_SYMBOLS
+ * @brief size of the alphabet the n-gram model works on, bytes are folded
+ * 	into these symbols by NgramSymbolOf[]
+ */
+#define NGRAM_SYMBOLS	32
+
+/**
+ * @def NGRAM_SCALE
+ * @brief fixed point scale of the n-gram tables, log-probabilities in nats
+ * 	are stored as int16_t multiplied by this
+ */
+#define NGRAM_SCALE	256
+
+/**
+ * @def NGRAM_PRUNE_STRIDE
+ * @brief number of characters scored between checks against the threshold
+ */
+#define NGRAM_PRUNE_STRIDE	16
+
+/* n-gram symbols besides the letters 1..26 */
+#define NGRAM_SPACE	0
+#define NGRAM_DIGIT	27
+#define NGRAM_STOP	28	/* . , ; : ! ? */
+#define NGRAM_QUOTE	29	/* ' " - */
+#define NGRAM_BREAK	30	/* \n \r \t */
+#define NGRAM_OTHER	31	/* other printables and non-printables */
+
+/**
+ * @struct NgramSeed
+ * @brief frequency of a common letter sequence in english text, in percent
+ * 	of all sequences of that length (spaces included)
+ */
+typedef struct NgramSeed {
+   const char *gram;
+   float       percent;
+} NgramSeed;
+
+/**
+ * @var EnglishBigramSeed
+ * @brief common english bigrams, ' ' marks a word boundary. The tables are
+ * 	grown from these on top of the character model, pairs not listed
+ * 	fall back to the product of their character probabilities
+ */
+static const NgramSeed EnglishBigramSeed[] = {
+   { "e ", 3.20f }, { " t", 2.70f }, { "th", 2.60f }, { "he", 2.30f },
+   { "s ", 2.20f }, { " a", 1.90f }, { "d ", 1.80f }, { "in", 1.80f },
+   { "t ", 1.60f }, { "er", 1.55f }, { "an", 1.50f }, { "re", 1.40f },
+   { "n ", 1.40f }, { " s", 1.20f }, { " o", 1.20f }, { " i", 1.10f },
+   { " w", 1.00f }, { "on", 1.30f }, { "y ", 1.10f }, { "at", 1.10f },
+   { "en", 1.10f }, { "r ", 1.00f }, { "nd", 1.00f }, { " c", 0.90f },
+   { "ti", 1.00f }, { "es", 1.00f }, { "or", 0.95f }, { "te", 0.90f },
+   { "o ", 0.80f }, { " h", 0.80f }, { " b", 0.80f }, { "ed", 0.90f },
+   { "is", 0.85f }, { "it", 0.85f }, { "al", 0.80f }, { "ar", 0.80f },
+   { "st", 0.80f }, { "to", 0.80f }, { "nt", 0.80f }, { " m", 0.70f },
+   { " f", 0.70f }, { " p", 0.70f }, { "f ", 0.70f }, { "l ", 0.60f },
+   { "ng", 0.70f }, { "se", 0.70f }, { "ha", 0.70f }, { "as", 0.65f },
+   { "ou", 0.65f }, { "io", 0.60f }, { "le", 0.60f }, { "ve", 0.60f },
+   { "co", 0.60f }, { "me", 0.60f }, { "de", 0.55f }, { "hi", 0.55f },
+   { "ri", 0.55f }, { "ro", 0.55f }, { "ic", 0.50f }, { "ne", 0.50f },
+   { "ea", 0.50f }, { "ra", 0.50f }, { "ce", 0.50f }, { " d", 0.50f },
+   { " l", 0.45f }, { " n", 0.40f }, { " r", 0.40f }, { " e", 0.40f },
+   { "h ", 0.40f }, { "g ", 0.40f }, { "li", 0.45f }, { "ch", 0.45f },
+   { "ll", 0.45f }, { "be", 0.45f }, { "ma", 0.40f }, { "si", 0.40f },
+   { "om", 0.40f }, { "ur", 0.40f }, { "ca", 0.40f }, { "el", 0.40f },
+   { "ta", 0.40f }, { "la", 0.40f }, { "ns", 0.35f }, { "di", 0.35f },
+   { "fo", 0.35f }, { "ho", 0.35f }, { "pe", 0.35f }, { "ec", 0.35f },
+   { "pr", 0.35f }, { "no", 0.35f }, { "ct", 0.35f }, { "us", 0.35f },
+   { "ac", 0.30f }, { "ot", 0.30f }, { "il", 0.30f }, { "tr", 0.30f },
+   { "ly", 0.30f }, { "nc", 0.30f }, { "et", 0.30f }, { "ut", 0.30f },
+   { "ss", 0.30f }, { "so", 0.30f }, { "rs", 0.30f }, { "un", 0.30f },
+   { "lo", 0.30f }, { "wa", 0.30f }, { "ge", 0.30f }, { "ie", 0.30f },
+   { "wh", 0.30f }, { "ee", 0.30f }, { "wi", 0.30f }, { "em", 0.30f },
+   { "ad", 0.30f }, { "ol", 0.25f }, { "rt", 0.25f }, { "po", 0.25f },
+   { "we", 0.25f }, { "na", 0.25f }, { "ul", 0.25f }, { "ni", 0.25f },
+   { "ts", 0.25f }, { "mo", 0.25f }, { "ow", 0.25f }, { "pa", 0.25f },
+   { "im", 0.25f }, { "mi", 0.25f }, { "ai", 0.25f }, { "sh", 0.25f },
+   { "ir", 0.20f }, { "su", 0.20f }, { "id", 0.20f }, { "os", 0.20f },
+   { "iv", 0.20f }, { "ia", 0.20f }, { "am", 0.20f }, { "fi", 0.20f },
+   { "ci", 0.20f }, { "vi", 0.20f }, { "pl", 0.20f }, { "ig", 0.20f },
+   { "tu", 0.20f }, { "ev", 0.20f }, { "ld", 0.20f }, { "ry", 0.20f },
+   { "mp", 0.20f }, { "fe", 0.20f }, { "bl", 0.15f }, { "ab", 0.15f },
+   { "gh", 0.15f }, { "ty", 0.15f }, { "op", 0.15f }, { "wo", 0.15f },
+   { "sa", 0.15f }, { "ay", 0.15f }, { "ex", 0.15f }, { "ke", 0.15f },
+   { "fr", 0.15f }, { "oo", 0.15f }, { "av", 0.15f }, { "ag", 0.15f },
+   { "if", 0.15f }, { "ap", 0.15f }, { "gr", 0.15f }, { "od", 0.15f },
+   { "bo", 0.15f }, { "sp", 0.15f }, { "rd", 0.15f }, { "do", 0.15f },
+   { "uc", 0.15f }, { "bu", 0.15f }, { "ei", 0.15f }, { "ov", 0.15f },
+   { "by", 0.10f }, { "rm", 0.10f }, { "ep", 0.10f }, { "tt", 0.10f },
+   { "oc", 0.10f }, { "fa", 0.10f }, { "ef", 0.10f }, { "cu", 0.10f },
+   { "rn", 0.10f }, { "sc", 0.10f }, { "gi", 0.10f }, { "da", 0.10f },
+   { "yo", 0.10f }, { "cr", 0.10f }, { "cl", 0.10f }, { "du", 0.10f },
+   { "ga", 0.10f }, { "qu", 0.10f }, { "ue", 0.10f }, { "ff", 0.10f },
+   { "ba", 0.10f }, { "ey", 0.10f }, { "ls", 0.10f }, { "va", 0.10f },
+   { "um", 0.10f }, { "pp", 0.10f }, { "ua", 0.10f }, { "up", 0.10f },
+   { "lu", 0.10f }, { "go", 0.10f }, { "ht", 0.10f }, { "ru", 0.10f },
+   { "ug", 0.10f }, { "ds", 0.10f }, { "lt", 0.10f }, { "pi", 0.10f },
+   { "rc", 0.10f }, { "rr", 0.10f }, { "eg", 0.10f }, { "au", 0.10f },
+   { "ck", 0.10f }, { "ew", 0.10f }, { "mu", 0.10f }, { "br", 0.10f },
+   { "bi", 0.10f }, { "pt", 0.10f }, { "ak", 0.10f }, { "pu", 0.10f },
+   { "ui", 0.10f }, { "rg", 0.10f }, { "ib", 0.10f }, { "tl", 0.10f },
+   { "ny", 0.10f }, { "ki", 0.10f }, { "rk", 0.10f }, { "ys", 0.10f },
+   { "ob", 0.10f }, { "mm", 0.10f }, { "fu", 0.10f }, { "ph", 0.10f },
+   { "og", 0.10f }, { "ms", 0.10f }, { "ye", 0.10f }, { "ud", 0.10f },
+   { "mb", 0.10f }, { "ip", 0.10f }, { "ub", 0.10f }, { "oi", 0.10f },
+   { "rl", 0.10f }, { "gu", 0.10f }, { "dr", 0.10f }, { "hr", 0.10f },
+   { "cc", 0.10f }, { "tw", 0.10f }, { "ft", 0.10f }, { "wn", 0.10f },
+   { "nu", 0.10f }, { "af", 0.10f }, { "hu", 0.10f }, { "nn", 0.10f },
+   { "eo", 0.10f }, { "vo", 0.10f }, { "rv", 0.10f }, { "nf", 0.05f },
+   { "xp", 0.05f }, { "gn", 0.05f }, { "sm", 0.05f }, { "fl", 0.05f },
+   { "iz", 0.05f }, { "ok", 0.05f }, { "nl", 0.05f }, { "my", 0.05f },
+   { "gl", 0.05f }, { "aw", 0.05f }, { "ju", 0.05f }, { "oa", 0.05f },
+   { "eq", 0.05f }, { "sy", 0.05f }, { "sl", 0.05f }, { "ps", 0.05f },
+   { "jo", 0.05f }, { "lf", 0.05f }, { "nv", 0.05f }, { "je", 0.05f },
+   { "nk", 0.05f }, { "kn", 0.05f }, { "gs", 0.05f }, { "dy", 0.05f },
+   { "hy", 0.05f }, { "ze", 0.05f }, { "ks", 0.05f }, { "xt", 0.05f },
+   { "bs", 0.05f }, { "ik", 0.05f }, { "dd", 0.05f }, { "cy", 0.05f },
+   { "rp", 0.05f }, { "sk", 0.05f }, { "xi", 0.05f }, { "oe", 0.05f },
+   { "oy", 0.05f }, { "ws", 0.05f }, { "lv", 0.05f }, { "dl", 0.05f },
+   { "rf", 0.05f }, { "eu", 0.05f }, { "dg", 0.05f }, { "wr", 0.05f },
+   { "xa", 0.05f }, { "yi", 0.05f }, { "nm", 0.05f }, { "eb", 0.05f },
+   { "rb", 0.05f }, { "tm", 0.05f }, { "xc", 0.05f }, { "eh", 0.05f },
+   { "tc", 0.05f }, { "gy", 0.05f }, { "ja", 0.05f }, { "hn", 0.05f },
+   { "yp", 0.05f }, { "za", 0.05f }, { "gg", 0.05f }, { "ym", 0.05f },
+   { "sw", 0.05f }, { "bj", 0.05f }, { "lm", 0.05f }, { "cs", 0.05f },
+   { "ii", 0.05f }, { "ix", 0.05f }, { "xe", 0.05f }, { "oh", 0.05f },
+   { "e.", 0.30f }, { "s.", 0.20f }, { "d.", 0.10f }, { "e,", 0.25f },
+   { "s,", 0.20f }, { "d,", 0.10f }, { "y,", 0.05f }, { "t.", 0.05f },
+   { ". ", 0.45f }, { ", ", 0.50f }, { "'s", 0.10f }, { "n'", 0.05f },
+   { "e\n", 0.05f }, { "g\n", 0.02f }, { "s\n", 0.02f }, { "n\n", 0.02f },
+   { "t\n", 0.02f }, { "d\n", 0.02f }, { "y\n", 0.02f }, { "r\n", 0.02f },
+};
+
+/**
+ * @var EnglishTrigramSeed
+ * @brief common english trigrams, ' ' marks a word boundary
+ */
+static const NgramSeed EnglishTrigramSeed[] = {
+   { " th", 1.60f }, { "the", 1.50f }, { "he ", 1.20f }, { "nd ", 0.60f },
+   { " an", 0.60f }, { "and", 0.55f }, { "ing", 0.55f }, { "ng ", 0.50f },
+   { " of", 0.50f }, { "of ", 0.50f }, { "ed ", 0.45f }, { " to", 0.45f },
+   { "to ", 0.35f }, { " in", 0.40f }, { "in ", 0.25f }, { "er ", 0.35f },
+   { "is ", 0.30f }, { "ion", 0.30f }, { "es ", 0.30f }, { "ent", 0.30f },
+   { "on ", 0.30f }, { "re ", 0.25f }, { " a ", 0.25f }, { "at ", 0.25f },
+   { "her", 0.25f }, { "tha", 0.25f }, { "hat", 0.25f }, { " wa", 0.22f },
+   { "as ", 0.22f }, { "for", 0.22f }, { " fo", 0.20f }, { "or ", 0.20f },
+   { "ter", 0.20f }, { "ere", 0.20f }, { "tio", 0.20f }, { " co", 0.20f },
+   { " be", 0.20f }, { " it", 0.18f }, { "it ", 0.16f }, { "was", 0.16f },
+   { " hi", 0.16f }, { "his", 0.14f }, { " re", 0.16f }, { "ly ", 0.15f },
+   { "st ", 0.14f }, { " wi", 0.14f }, { "ith", 0.14f }, { "wit", 0.12f },
+   { "th ", 0.12f }, { " ha", 0.14f }, { "ve ", 0.12f }, { " ma", 0.12f },
+   { " wh", 0.14f }, { " he", 0.14f }, { "all", 0.12f }, { "ati", 0.12f },
+   { "ver", 0.12f }, { "est", 0.12f }, { "ers", 0.12f }, { "ate", 0.12f },
+   { "rs ", 0.10f }, { " on", 0.12f }, { " st", 0.12f }, { " pr", 0.12f },
+   { "nt ", 0.12f }, { "ns ", 0.08f }, { "ts ", 0.08f }, { "y t", 0.08f },
+   { "e t", 0.20f }, { "e a", 0.10f }, { "s t", 0.12f }, { "d t", 0.10f },
+   { "n t", 0.10f }, { "t t", 0.05f }, { "e s", 0.08f }, { "e o", 0.06f },
+   { " yo", 0.08f }, { "you", 0.08f }, { "ou ", 0.06f }, { " no", 0.08f },
+   { " is", 0.10f }, { " we", 0.06f }, { " so", 0.06f }, { " my", 0.05f },
+   { "me ", 0.10f }, { "ll ", 0.08f }, { "ng\n", 0.02f }, { "e.\n", 0.02f },
+   { "'s ", 0.08f }, { "n't", 0.05f }, { "'t ", 0.05f }, { ". t", 0.05f },
+   { ", a", 0.05f }, { "e, ", 0.10f }, { "s, ", 0.08f }, { "e. ", 0.10f },
+};
+
+/**
+ * @struct NgramModel
+ * @brief tables of the trigram model, built once by NgramModelInit()
+ *
+ * Trigram holds log P(c | a b) for the 32 symbol alphabet (64KB, stays in
+ * L2), Bias holds log P(byte | symbol) which splits a symbol between the
+ * bytes mapping to it (upper/lower case, printable/non-printable)
+ */
+typedef struct NgramModel {
+   int16_t  Trigram[NGRAM_SYMBOLS * NGRAM_SYMBOLS * NGRAM_SYMBOLS];
+   int16_t  Bias[256];
+   uint8_t  SymbolOf[256];
+   int32_t  MaxStep;   /**< largest score a single character can add */
+} NgramModel;
+
+static NgramModel      EnglishNgram;
+static pthread_once_t  EnglishNgramOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @fn uint8_t NgramSymbol(uint8_t c)
+ *
+ * @brief folds a byte into the n-gram alphabet
+ *
+ * @param [in] c\n
+ * 	byte to fold
+ * @returns symbol in [0, NGRAM_SYMBOLS)
+ */
+static uint8_t NgramSymbol(uint8_t c) {
+   if (c == ' ')
+      return NGRAM_SPACE;
+   if ((uint8_t)((c | 0x20) - 'a') < 26)
+      return 1 + ((c | 0x20) - 'a');
+   if (c >= '0' && c <= '9')
+      return NGRAM_DIGIT;
+   if (c && strchr(".,;:!?", c))
+      return NGRAM_STOP;
+   if (c && strchr("'\"-", c))
+      return NGRAM_QUOTE;
+   if (c == '\n' || c == '\r' || c == '\t')
+      return NGRAM_BREAK;
+   return NGRAM_OTHER;
+}
+
+/**
+ * @fn int16_t NgramQuantize(double p)
+ *
+ * @brief converts a probability into the fixed point log used in the tables
+ *
+ * @param [in] p\n
+ * 	probability, > 0
+ * @returns log(p) * NGRAM_SCALE rounded
+ */
+static int16_t NgramQuantize(double p) {
+   return (int16_t)lrint(log(p) * NGRAM_SCALE);
+}
+
+/**
+ * @fn void NgramModelInit(void)
+ *
+ * @brief builds the trigram tables from the seed lists
+ *
+ * The character model (EnglishLogProb) gives P(symbol). Bigram joint
+ * probabilities are the seeds plus a share of P(a)P(c) for every pair, the
+ * trigram joint probabilities are the seeds plus a share of the bigram
+ * chain P(a b)P(c|b). Normalizing each context gives the conditionals, so
+ * pairs and triples never seen in the seeds are scored by backing off to
+ * the smaller model rather than rejected.
+ */
+static void NgramModelInit(void) {
+   static double uni[NGRAM_SYMBOLS];
+   static double bi[NGRAM_SYMBOLS][NGRAM_SYMBOLS];
+   static double tri[NGRAM_SYMBOLS][NGRAM_SYMBOLS][NGRAM_SYMBOLS];
+   NgramModel *m = &EnglishNgram;
+   int32_t     maxTri = INT16_MIN, maxBias = INT16_MIN;
+   int         a, b, c;
+   size_t      i;
+
+   memset(uni, '\0', sizeof(uni));
+   for (c = 0; c < 256; c++) {
+      m->SymbolOf[c] = NgramSymbol(c);
+      uni[m->SymbolOf[c]] += exp(EnglishLogProb[c]);
+   }
+   for (c = 0; c < 256; c++) {
+      m->Bias[c] = NgramQuantize(exp(EnglishLogProb[c]) / uni[m->SymbolOf[c]]);
+      maxBias = m->Bias[c] > maxBias ? m->Bias[c] : maxBias;
+   }
+
+   /* bigram joint probabilities, then P(c | b) */
+   for (a = 0; a < NGRAM_SYMBOLS; a++)
+      for (b = 0; b < NGRAM_SYMBOLS; b++)
+         bi[a][b] = 0.2 * uni[a] * uni[b];
+   for (i = 0; i < sizeof(EnglishBigramSeed)/sizeof(EnglishBigramSeed[0]); i++) {
+      const char *g = EnglishBigramSeed[i].gram;
+      bi[NgramSymbol(g[0])][NgramSymbol(g[1])] +=
+	      EnglishBigramSeed[i].percent / 100.0;
+   }
+
+   /* trigram joint probabilities from the bigram chain and the seeds */
+   for (a = 0; a < NGRAM_SYMBOLS; a++) {
+      for (b = 0; b < NGRAM_SYMBOLS; b++) {
+         double rowb = 0.0;
+
+         for (c = 0; c < NGRAM_SYMBOLS; c++)
+            rowb += bi[b][c];
+         for (c = 0; c < NGRAM_SYMBOLS; c++)
+            tri[a][b][c] = 0.5 * bi[a][b] * bi[b][c] / rowb;
+      }
+   }
+   for (i = 0; i < sizeof(EnglishTrigramSeed)/sizeof(EnglishTrigramSeed[0]);
+	i++) {
+      const char *g = EnglishTrigramSeed[i].gram;
+      tri[NgramSymbol(g[0])][NgramSymbol(g[1])][NgramSymbol(g[2])] +=
+	      EnglishTrigramSeed[i].percent / 100.0;
+   }
+
+   for (a = 0; a < NGRAM_SYMBOLS; a++) {
+      for (b = 0; b < NGRAM_SYMBOLS; b++) {
+         double   row = 0.0;
+         int16_t *t = &m->Trigram[(a * NGRAM_SYMBOLS + b) * NGRAM_SYMBOLS];
+
+         for (c = 0; c < NGRAM_SYMBOLS; c++)
+            row += tri[a][b][c];
+         for (c = 0; c < NGRAM_SYMBOLS; c++) {
+            t[c] = NgramQuantize(tri[a][b][c] / row);
+            maxTri = t[c] > maxTri ? t[c] : maxTri;
+         }
+      }
+   }
+   m->MaxStep = maxTri + maxBias;
+}
+
+/**
+ * @fn float NgramScore(const uint8_t *buf, size_t size, uint8_t key,
+ * 	float threshold)
+ *
+ * @brief scores buf ^ key under the trigram model, abandoning the text once
+ * 	its mean score cannot reach the threshold anymore
+ *
+ * The text is scored as if preceded by two spaces so that its first word is
+ * scored like any other. Every NGRAM_PRUNE_STRIDE characters the score so
+ * far plus MaxStep for each remaining character is compared against the
+ * threshold.
+ *
+ * @param [in] *buf\n
+ * 	text to score
+ * @param [in] size\n
+ * 	length of the text in bytes
+ * @param [in] key\n
+ * 	byte every character is xor'd with before scoring, 0 for plain text
+ * @param [in] threshold\n
+ * 	mean score per character the text has to reach
+ * @returns mean log-probability per character, NGRAM_SCORE_PRUNED if the
+ * 	text was abandoned
+ */
+static inline float NgramScore(const uint8_t *buf, size_t size, uint8_t key,
+	float threshold) {
+   const NgramModel *m = &EnglishNgram;
+   int64_t  acc = 0;
+   int64_t  need;
+   double   t;
+   uint32_t ctx = (NGRAM_SPACE << 5) | NGRAM_SPACE;
+   size_t   i, stop;
+
+   if (size == 0)
+      return NGRAM_SCORE_PRUNED;
+
+   /* the threshold is the float score of a text kept earlier, rounded
+    * from its integer sum. A text tying with it must not be abandoned (the
+    * collector settles ties by line) so the rounding is given back: float
+    * scores are within a few units of 2^-24 of the sum.
+    * NGRAM_SCORE_PRUNED and other thresholds out of reach of an int64_t
+    * (NaN included) are clamped, the conversion itself would be undefined */
+   t = (double)threshold * NGRAM_SCALE * (double)size;
+   t = floor(t - fabs(t) * 1.0e-6) - 1;
+   if (!(t > (double)INT64_MIN))
+      need = INT64_MIN;
+   else if (t >= (double)INT64_MAX)
+      need = INT64_MAX;
+   else
+      need = (int64_t)t;
+
+   for (i = 0; i < size; i = stop) {
+      stop = MIN(i + NGRAM_PRUNE_STRIDE, size);
+
+      for (; i < stop; i++) {
+         uint8_t c = buf[i] ^ key;
+
+         ctx = ((ctx << 5) | m->SymbolOf[c]) & 0x7FFF;
+         acc += m->Trigram[ctx] + m->Bias[c];
+      }
+      if (acc + (int64_t)(size - stop) * m->MaxStep < need)
+         return NGRAM_SCORE_PRUNED;
+   }
+   return (float)acc / ((float)NGRAM_SCALE * size);
+}
+
+/**
+ * @ingroup BitStreamScore
+ * @fn float EnglishTextNgramScore(const uint8_t *buf, size_t size,
+ * 	float threshold)
+ *
+ * @brief scores the text with the english trigram model
+ *
+ * Catches what the character model cannot, such as "etaoin" letters in a
+ * random order. Candidates are abandoned as soon as they cannot reach the
+ * threshold, pass the score of the worst candidate kept so far (or
+ * NGRAM_SCORE_PRUNED to score every text in full).
+ *
+ * @param [in] *buf\n
+ * 	text to score
+ * @param [in] size\n
+ * 	length of the text in bytes
+ * @param [in] threshold\n
+ * 	mean score per character the text has to reach
+ * @returns mean log-probability per character, higher is more english like,
+ * 	NGRAM_SCORE_PRUNED if the text cannot reach the threshold
+ */
+float EnglishTextNgramScore(const uint8_t *buf, size_t size, float threshold) {
+   pthread_once(&EnglishNgramOnce, NgramModelInit);
+   return NgramScore(buf, size, 0, threshold);
+}
+
+/**
+ * @ingroup BitStreamScore
+ * @fn float EnglishTextNgramScoreXor(const uint8_t *buf, size_t size,
+ * 	uint8_t key, float threshold)
+ *
+ * @brief same as EnglishTextNgramScore() for the text decrypted with a
+ * 	single byte key, the plaintext is never materialized
+ *
+ * @param [in] *buf\n
+ * 	cipher text to score
+ * @param [in] size\n
+ * 	length of the cipher text in bytes
+ * @param [in] key\n
+ * 	single byte key
+ * @param [in] threshold\n
+ * 	mean score per character the text has to reach
+ * @returns mean log-probability per character of the plaintext,
+ * 	NGRAM_SCORE_PRUNED if it cannot reach the threshold
+ */
+float EnglishTextNgramScoreXor(const uint8_t *buf, size_t size, uint8_t key,
+	float threshold) {
+   pthread_once(&EnglishNgramOnce, NgramModelInit);
+   return NgramScore(buf, size, key, threshold);
+}
@@ -0,0 +1,80 @@
+/**
+ * @file  BitStreamScore.h
+ * @brief Scoring of candidate plaintexts for closeness to english text,
+ * 	  used by the XOR key searches
+ */
+#if !defined(_BITSTREAM_SCORE_H)
+#define _BITSTREAM_SCORE_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def ETAOIN_SCORE_MAX
+ * @brief chi-squared score is saturated to this value, also reported when
+ * 	the text holds no letters at all
+ */
+#define ETAOIN_SCORE_MAX	65535
+
+/**
+ * @def WORDLEN_SCORE_NONE
+ * @brief word length score reported when the text holds no words
+ */
+#define WORDLEN_SCORE_NONE	100
+
+/**
+ * @def NGRAM_SCORE_PRUNED
+ * @brief returned by the n-gram scorer for text abandoned below threshold
+ */
+#define NGRAM_SCORE_PRUNED	(-1.0e30f)
+
+/* Type Definitions */
+/**
+ * @struct EnglishTextScore
+ *
+ * @brief parameters to measure closeness of string to english text
+ *
+ * All the counts are gathered in a single pass over the text, the caller
+ * decides which of them qualify the text as english
+ */
+typedef struct EnglishTextScore {
+   /**< typically text contains 4.79 letters per word */
+   uint32_t WordLengthScore;
+
+   uint32_t EtaoinScore;    /**< chi-squared distance to etaoin histogram */
+
+   uint32_t NonPrintScore;  /**< number of non-printable characters */
+
+   uint32_t LetterCount;    /**< number of [A-Za-z] characters */
+
+   uint32_t SpaceCount;     /**< number of ' ' characters */
+
+   uint32_t WordCount;      /**< number of runs of non-space characters */
+
+   float    LogLikelihood;  /**< mean log-probability per character */
+} EnglishTextScore;
+
+
+float EnglishTextScoreCalc(EnglishTextScore* score, const uint8_t *buf,
+	size_t size) ;
+
+float EnglishTextLogLikelihood(const uint8_t *buf, size_t size) ;
+
+void EnglishTextScoreSingleByteXor(const uint8_t *buf, size_t size,
+	float scores[256]) ;
+
+uint8_t BitStreamSingleByteXorKey(BitStream *cipher, float *score) ;
+
+float EnglishTextNgramScore(const uint8_t *buf, size_t size, float threshold) ;
+
+float EnglishTextNgramScoreXor(const uint8_t *buf, size_t size, uint8_t key,
+	float threshold) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_SCORE_H */
@@ -0,0 +1,473 @@
+/**
+ * @file BitStreamSparse.c
+ *
+ * @brief Implements the run-length representation of mostly constant bit
+ * 	streams
+ *
+ * A stream of megabytes of zeros with a few bits set is held as the list
+ * of runs of bytes that are not zero plus those bytes, memory is then
+ * proportional to the bits set rather than to the length. The constant,
+ * the fill, may also be 0xFF for masks that are mostly ones. Reads look
+ * up the run holding a byte, popcount and XOR only visit the runs and
+ * skip the fill between them.
+ *
+ * Runs closer than BITSTREAM_SPARSE_GAP bytes are merged, which bounds the
+ * overhead of a stream whose set bits are scattered to about the size of
+ * the dense array.
+ *
+ * @internal BitStreamSparseCreate
+ * 	     BitStreamSparseDelete
+ * 	     BitStreamSparseAppend
+ * 	     BitStreamSparseFromDense
+ * 	     BitStreamSparseToDense
+ * 	     BitStreamSparseMemory
+ * 	     BitStreamSparseGetByte
+ * 	     BitStreamSparsePopcount
+ * 	     BitStreamSparseExclusiveOr
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include "BitStreamLogic.h"
+#include "BitStreamSparse.h"
+
+/**
+ * @fn uint8_t SparsePad(const BitStreamSparse *sp, uint64_t offset,
+ * 	uint8_t byte)
+ *
+ * @brief byte as stored at offset, the bits past the end of the stream
+ * 	are replaced by fill bits
+ */
+static inline uint8_t SparsePad(const BitStreamSparse *sp, uint64_t offset,
+	uint8_t byte) {
+   uint8_t valid;
+
+   if (offset != sp->nbits / BITS_PER_BYTE || sp->nbits % BITS_PER_BYTE == 0)
+      return byte;
+
+   valid = (uint8_t)(0xFF << (BITS_PER_BYTE - sp->nbits % BITS_PER_BYTE));
+   return (uint8_t)((byte & valid) | (sp->fill & ~valid));
+}
+
+/**
+ * @fn int SparseReserve(BitStreamSparse *sp, uint64_t runs, uint64_t bytes)
+ *
+ * @brief makes room for runs more runs and bytes more literal bytes
+ *
+ * @returns 0 on success, -1 on allocation failure
+ */
+static int SparseReserve(BitStreamSparse *sp, uint64_t runs, uint64_t bytes) {
+   uint64_t n;
+   void    *p;
+
+   if (sp->nruns + runs > sp->maxRuns) {
+      n = sp->maxRuns ? sp->maxRuns : 16;
+      while (n < sp->nruns + runs)
+         n *= 2;
+      p = realloc(sp->runs, n * sizeof(BitStreamSparseRun));
+      if (p == NULL)
+         return (-1);
+      sp->runs = (BitStreamSparseRun *)p;
+      sp->maxRuns = n;
+   }
+
+   if (sp->nbytes + bytes > sp->maxBytes) {
+      n = sp->maxBytes ? sp->maxBytes : 256;
+      while (n < sp->nbytes + bytes)
+         n *= 2;
+      p = realloc(sp->bytes, n);
+      if (p == NULL)
+         return (-1);
+      sp->bytes = (uint8_t *)p;
+      sp->maxBytes = n;
+   }
+   return (0);
+}
+
+/**
+ * @fn const BitStreamSparseRun* SparseFind(const BitStreamSparse *sp,
+ * 	uint64_t offset)
+ *
+ * @brief run holding the byte at offset, NULL if the byte is fill
+ */
+static const BitStreamSparseRun* SparseFind(const BitStreamSparse *sp,
+	uint64_t offset) {
+   uint64_t lo = 0, hi = sp->nruns, mid;
+
+   /* first run starting past offset */
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (sp->runs[mid].offset <= offset)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   if (lo == 0 || offset >= sp->runs[lo - 1].offset + sp->runs[lo - 1].length)
+      return NULL;
+   return &sp->runs[lo - 1];
+}
+
+/**
+ * @fn uint8_t SparseByte(const BitStreamSparse *sp, uint64_t offset)
+ *
+ * @brief byte at offset as stored
+ */
+static inline uint8_t SparseByte(const BitStreamSparse *sp, uint64_t offset) {
+   const BitStreamSparseRun *run = SparseFind(sp, offset);
+
+   if (run == NULL)
+      return sp->fill;
+   return sp->bytes[run->data + offset - run->offset];
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn BitStreamSparse* BitStreamSparseCreate(uint64_t nbits, uint8_t fill)
+ *
+ * @brief creates a sparse stream of nbits bits all equal to the fill,
+ * 	it holds no runs and allocates nothing for the bits
+ *
+ * @param [in] nbits\n
+ * 	number of bits in the stream
+ * @param [in] fill\n
+ * 	0x00 or 0xFF
+ * @returns pointer to the sparse stream, NULL on an invalid fill or
+ * 	allocation failure
+ */
+BitStreamSparse* BitStreamSparseCreate(uint64_t nbits, uint8_t fill) {
+   BitStreamSparse *sp;
+
+   if (fill != 0x00 && fill != 0xFF)
+      return NULL;
+
+   sp = (BitStreamSparse *)calloc(1, sizeof(BitStreamSparse));
+   if (sp) {
+      sp->nbits = nbits;
+      sp->fill = fill;
+   }
+   return sp;
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn void BitStreamSparseDelete(BitStreamSparse *sp)
+ *
+ * @brief deletes the sparse stream and its runs
+ *
+ * @param [in] *sp\n
+ * 	sparse stream, may be NULL
+ * @returns none
+ */
+void BitStreamSparseDelete(BitStreamSparse *sp) {
+   if (sp) {
+      free(sp->runs);
+      free(sp->bytes);
+      free(sp);
+   }
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn int BitStreamSparseAppend(BitStreamSparse *sp, uint64_t offset,
+ * 	const uint8_t *data, uint64_t n)
+ *
+ * @brief sets n bytes at a byte offset past the last run, which builds a
+ * 	sparse stream without ever holding it dense
+ *
+ * @param [in] *sp\n
+ * 	sparse stream
+ * @param [in] offset\n
+ * 	offset in bytes, not before the end of the last run
+ * @param [in] *data\n
+ * 	bytes to set, stored as they are even where they equal the fill
+ * @param [in] n\n
+ * 	number of bytes, all within the stream
+ * @returns 0 on success, -1 on an offset out of order or out of the stream
+ * 	or on allocation failure
+ */
+int BitStreamSparseAppend(BitStreamSparse *sp, uint64_t offset,
+	const uint8_t *data, uint64_t n) {
+   BitStreamSparseRun *last = NULL;
+   uint64_t            end, gap = 0, i;
+
+   if (sp == NULL || (n && data == NULL))
+      return (-1);
+   if (n == 0)
+      return (0);
+
+   if (sp->nruns) {
+      last = &sp->runs[sp->nruns - 1];
+      end = last->offset + last->length;
+      if (offset < end)
+         return (-1);
+      gap = offset - end;
+      if (gap >= BITSTREAM_SPARSE_GAP)
+         last = NULL;
+   }
+   if (offset + n < offset ||
+       offset + n > (sp->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE)
+      return (-1);
+
+   if (SparseReserve(sp, last ? 0 : 1, last ? gap + n : n) < 0)
+      return (-1);
+
+   if (last) {
+      /* close enough to extend the last run over the gap */
+      memset(sp->bytes + sp->nbytes, sp->fill, gap);
+      sp->nbytes += gap;
+      last = &sp->runs[sp->nruns - 1];
+      last->length += gap + n;
+   } else {
+      sp->runs[sp->nruns].offset = offset;
+      sp->runs[sp->nruns].length = n;
+      sp->runs[sp->nruns].data = sp->nbytes;
+      sp->nruns++;
+   }
+
+   memcpy(sp->bytes + sp->nbytes, data, n);
+   i = sp->nbytes + n - 1;
+   sp->bytes[i] = SparsePad(sp, offset + n - 1, sp->bytes[i]);
+   sp->nbytes += n;
+   return (0);
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn BitStreamSparse* BitStreamSparseFromDense(BitStream *bs)
+ *
+ * @brief converts a dense stream, the fill is whichever of 0x00 and 0xFF
+ * 	bytes is more common
+ *
+ * @param [in] *bs\n
+ * 	dense bit stream
+ * @returns pointer to the sparse stream, NULL on allocation failure
+ */
+BitStreamSparse* BitStreamSparseFromDense(BitStream *bs) {
+   BitStreamSparse *sp;
+   const uint8_t   *a;
+   uint64_t         full, zeros = 0, ones = 0, i, start, gap, fillWord;
+   uint8_t          fill, last;
+
+   if (bs == NULL || (bs->nbits && bs->array == NULL))
+      return NULL;
+
+   a = bs->array;
+   full = bs->nbits / BITS_PER_BYTE;
+   for (i = 0; i < full; i++) {
+      zeros += a[i] == 0x00;
+      ones += a[i] == 0xFF;
+   }
+   fill = ones > zeros ? 0xFF : 0x00;
+
+   sp = BitStreamSparseCreate(bs->nbits, fill);
+   if (sp == NULL)
+      return NULL;
+
+   memset(&fillWord, fill, sizeof(fillWord));
+   i = 0;
+   while (i < full) {
+      uint64_t w;
+
+      /* skip fill a word at a time */
+      while (i + 8 <= full && (memcpy(&w, a + i, 8), w == fillWord))
+         i += 8;
+      while (i < full && a[i] == fill)
+         i++;
+      if (i == full)
+         break;
+
+      /* the run ends at the first gap worth a run of its own */
+      start = i;
+      for (gap = 0; i < full && gap < BITSTREAM_SPARSE_GAP; i++)
+         gap = a[i] == fill ? gap + 1 : 0;
+      if (BitStreamSparseAppend(sp, start, a + start, i - gap - start) < 0) {
+         BitStreamSparseDelete(sp);
+         return NULL;
+      }
+   }
+
+   if (bs->nbits % BITS_PER_BYTE) {
+      last = SparsePad(sp, full, a[full]);
+      if (last != fill && BitStreamSparseAppend(sp, full, &last, 1) < 0) {
+         BitStreamSparseDelete(sp);
+         return NULL;
+      }
+   }
+   return sp;
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn BitStream* BitStreamSparseToDense(BitStreamSparse *sp)
+ *
+ * @brief converts a sparse stream back to an ordinary one
+ *
+ * @param [in] *sp\n
+ * 	sparse stream
+ * @returns pointer to the new bit stream, NULL on allocation failure
+ */
+BitStream* BitStreamSparseToDense(BitStreamSparse *sp) {
+   BitStream *bs;
+   uint64_t   bytes, r;
+
+   if (sp == NULL)
+      return NULL;
+
+   bs = BitStreamCreate(sp->nbits);
+   if (bs == NULL || sp->nbits == 0)
+      return bs;
+
+   bytes = (sp->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+   memset(bs->array, sp->fill, bytes);
+   for (r = 0; r < sp->nruns; r++)
+      memcpy(bs->array + sp->runs[r].offset, sp->bytes + sp->runs[r].data,
+		      sp->runs[r].length);
+
+   if (sp->nbits % BITS_PER_BYTE)
+      bs->array[bytes - 1] &= (uint8_t)(0xFF << (BITS_PER_BYTE -
+			      sp->nbits % BITS_PER_BYTE));
+   return bs;
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn uint64_t BitStreamSparseMemory(BitStreamSparse *sp)
+ *
+ * @brief bytes of memory held by the sparse stream, to compare with the
+ * 	(nbits + 7) / 8 of the dense form
+ *
+ * @param [in] *sp\n
+ * 	sparse stream
+ * @returns bytes allocated
+ */
+uint64_t BitStreamSparseMemory(BitStreamSparse *sp) {
+   if (sp == NULL)
+      return (0);
+   return sizeof(BitStreamSparse) + sp->maxRuns * sizeof(BitStreamSparseRun) +
+	   sp->maxBytes;
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn uint16_t BitStreamSparseGetByte(BitStreamSparse *sp, uint8_t *byte,
+ * 	uint64_t offset, uint16_t nbits)
+ *
+ * @brief fetches maximum 1 byte of data at offset (in bits), the
+ * 	counterpart of BitStreamGetByte() with the same alignment of the bits
+ *
+ * @param [in] *sp\n
+ * 	sparse stream
+ * @param [out] *byte\n
+ * 	bits fetched, right aligned if fewer than 8
+ * @param [in] offset\n
+ * 	offset in bits of the first bit
+ * @param [in] nbits\n
+ * 	number of bits to fetch, at most 8
+ * @returns number of bits fetched, 0 at or past the end of the stream
+ */
+uint16_t BitStreamSparseGetByte(BitStreamSparse *sp, uint8_t *byte,
+	uint64_t offset, uint16_t nbits) {
+   DECL_BYTE_OFFSET(i);
+   DECL_BITS_OFFSET(j);
+   unsigned v;
+
+   if (offset >= sp->nbits)
+      return (0);
+
+   nbits = MIN(MIN(nbits, BITS_PER_BYTE), sp->nbits - offset);
+
+   v = (unsigned)SparseByte(sp, i) << 8;
+   if (j + nbits > BITS_PER_BYTE)
+      v |= SparseByte(sp, i + 1);
+
+   *byte = (uint8_t)(((v << j) & 0xFFFF) >> (16 - nbits));
+   return nbits;
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn uint64_t BitStreamSparsePopcount(BitStreamSparse *sp)
+ *
+ * @brief number of bits set, counted over the runs only
+ *
+ * @param [in] *sp\n
+ * 	sparse stream
+ * @returns number of bits set in the stream
+ */
+uint64_t BitStreamSparsePopcount(BitStreamSparse *sp) {
+   uint64_t count = 0, i, w;
+
+   if (sp == NULL)
+      return (0);
+
+   for (i = 0; i + 8 <= sp->nbytes; i += 8) {
+      memcpy(&w, sp->bytes + i, 8);
+      count += __builtin_popcountll(w);
+   }
+   for (; i < sp->nbytes; i++)
+      count += __builtin_popcount(sp->bytes[i]);
+
+   /* the pad bits of the last byte are fill, they cancel out here */
+   if (sp->fill)
+      return sp->nbits - (sp->nbytes * BITS_PER_BYTE - count);
+   return count;
+}
+
+/**
+ * @ingroup BitStreamSparse
+ * @fn BitStream* BitStreamSparseExclusiveOr(BitStream *dst, BitStream *bx,
+ * 	BitStreamSparse *sp)
+ *
+ * @brief dst = bx XOR sp, with a fill of zeros only the bytes under the
+ * 	runs are touched when working in place
+ *
+ * @param [out] *dst\n
+ * 	result, NULL for a new stream, bx to work in place or any other
+ * 	stream, which is resized
+ * @param [in] *bx\n
+ * 	dense operand, its length is the length of the result
+ * @param [in] *sp\n
+ * 	sparse operand, at least as long as bx
+ * @returns the result, NULL on invalid operands or allocation failure
+ */
+BitStream* BitStreamSparseExclusiveOr(BitStream *dst, BitStream *bx,
+	BitStreamSparse *sp) {
+   uint64_t bytes, r, k, n;
+   uint8_t *out;
+   const uint8_t *lit;
+
+   if (bx == NULL || sp == NULL || sp->nbits < bx->nbits)
+      return NULL;
+
+   bytes = (bx->nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+   if (sp->fill) {
+      /* XOR with ones everywhere, then undo it under the runs */
+      dst = BitStreamNot(dst, bx);
+   } else if (dst != bx) {
+      if (dst == NULL) {
+         dst = BitStreamCreate(bx->nbits);
+      } else {
+         BitStreamRealloc(dst, NULL, bx->nbits);
+         if (bytes && dst->array == NULL)
+            return NULL;
+      }
+      if (dst && bytes)
+         memcpy(dst->array, bx->array, bytes);
+   }
+   if (dst == NULL || bytes == 0)
+      return dst;
+
+   out = dst->array;
+   for (r = 0; r < sp->nruns && sp->runs[r].offset < bytes; r++) {
+      n = MIN(sp->runs[r].length, bytes - sp->runs[r].offset);
+      lit = sp->bytes + sp->runs[r].data;
+      for (k = 0; k < n; k++)
+         out[sp->runs[r].offset + k] ^= lit[k] ^ sp->fill;
+   }
+
+   if (bx->nbits % BITS_PER_BYTE)
+      out[bytes - 1] &= (uint8_t)(0xFF << (BITS_PER_BYTE -
+			      bx->nbits % BITS_PER_BYTE));
+   return dst;
+}
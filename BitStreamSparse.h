@@ -0,0 +1,78 @@
+/**
+ * @file  BitStreamSparse.h
+ * @brief Run-length representation of mostly constant bit streams, such as
+ * 	padding, masks and sparse flag maps
+ */
+#if !defined(_BITSTREAM_SPARSE_H)
+#define _BITSTREAM_SPARSE_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Macro Definitions */
+/**
+ * @def BITSTREAM_SPARSE_GAP
+ * @brief runs of literal bytes separated by fewer fill bytes than this are
+ * 	kept as one run, a gap that short costs less than a run descriptor
+ */
+#define BITSTREAM_SPARSE_GAP	16
+
+/* Type Definitions */
+/**
+ * @struct BitStreamSparseRun
+ * @brief bytes of the stream that differ from the fill byte
+ */
+typedef struct BitStreamSparseRun {
+   uint64_t offset;  /**< offset in bytes of the run in the stream */
+   uint64_t length;  /**< number of bytes in the run */
+   uint64_t data;    /**< index of the first byte of the run in bytes */
+} BitStreamSparseRun;
+
+/**
+ * @struct BitStreamSparse
+ * @brief bit stream held as runs of literal bytes over a constant fill
+ *
+ * Every byte outside the runs is fill, 0x00 or 0xFF. Runs are sorted,
+ * do not overlap and are not adjacent. The bits of the last byte past
+ * nbits are stored as fill bits so that rule holds for that byte too.
+ */
+typedef struct BitStreamSparse {
+   uint64_t            nbits;    /**< number of bits in the stream */
+   uint8_t             fill;     /**< value of the bytes outside the runs */
+   BitStreamSparseRun *runs;     /**< runs in stream order */
+   uint64_t            nruns;    /**< number of runs */
+   uint64_t            maxRuns;  /**< runs allocated */
+   uint8_t            *bytes;    /**< literal bytes of all runs */
+   uint64_t            nbytes;   /**< number of literal bytes */
+   uint64_t            maxBytes; /**< literal bytes allocated */
+} BitStreamSparse;
+
+
+BitStreamSparse* BitStreamSparseCreate(uint64_t nbits, uint8_t fill) ;
+
+void BitStreamSparseDelete(BitStreamSparse *sp) ;
+
+int BitStreamSparseAppend(BitStreamSparse *sp, uint64_t offset,
+	const uint8_t *data, uint64_t n) ;
+
+BitStreamSparse* BitStreamSparseFromDense(BitStream *bs) ;
+
+BitStream* BitStreamSparseToDense(BitStreamSparse *sp) ;
+
+uint64_t BitStreamSparseMemory(BitStreamSparse *sp) ;
+
+uint16_t BitStreamSparseGetByte(BitStreamSparse *sp, uint8_t *byte,
+	uint64_t offset, uint16_t nbits) ;
+
+uint64_t BitStreamSparsePopcount(BitStreamSparse *sp) ;
+
+BitStream* BitStreamSparseExclusiveOr(BitStream *dst, BitStream *bx,
+	BitStreamSparse *sp) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_SPARSE_H */
@@ -0,0 +1,271 @@
+/**
+ * @file BitStreamTopK.c
+ *
+ * @brief Implements the bounded top-K candidate collector
+ *
+ * Searches running on several threads each feed a collector of their own
+ * and merge them once done, merging costs O(K log K) whatever the number of
+ * candidates offered.
+ *
+ * @internal BitStreamTopKCreate
+ * 	     BitStreamTopKDelete
+ * 	     BitStreamTopKReset
+ * 	     BitStreamTopKThreshold
+ * 	     BitStreamTopKOffer
+ * 	     BitStreamTopKMerge
+ * 	     BitStreamTopKResults
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include "BitStreamTopK.h"
+
+/**
+ * @fn int TopKWorse(const BitStreamCandidate *x, const BitStreamCandidate *y)
+ *
+ * @brief total order of the candidates, score descending then line and key
+ * 	ascending, so which candidates are kept and in what order they come
+ * 	out does not depend on the order they were offered in
+ *
+ * @returns nonzero if x ranks after y
+ */
+static inline int TopKWorse(const BitStreamCandidate *x,
+	const BitStreamCandidate *y) {
+   if (x->score != y->score)
+      return x->score < y->score;
+   if (x->line != y->line)
+      return x->line > y->line;
+   return x->key > y->key;
+}
+
+/**
+ * @fn void TopKSiftDown(BitStreamCandidate *heap, uint32_t count, uint32_t i)
+ *
+ * @brief restores the heap property below node i, the worst candidate
+ * 	under TopKWorse() is at the root
+ *
+ * @param [in,out] *heap\n
+ * 	heap array
+ * @param [in] count\n
+ * 	number of nodes in the heap
+ * @param [in] i\n
+ * 	node whose candidate may be larger than its children
+ * @returns none
+ */
+static void TopKSiftDown(BitStreamCandidate *heap, uint32_t count, uint32_t i) {
+   BitStreamCandidate c = heap[i];
+
+   for (;;) {
+      uint32_t child = 2 * i + 1;
+
+      if (child >= count)
+         break;
+      if (child + 1 < count && TopKWorse(&heap[child + 1], &heap[child]))
+         child++;
+      if (!TopKWorse(&heap[child], &c))
+         break;
+      heap[i] = heap[child];
+      i = child;
+   }
+   heap[i] = c;
+}
+
+/**
+ * @fn void TopKSiftUp(BitStreamCandidate *heap, uint32_t i)
+ *
+ * @brief restores the heap property above node i
+ *
+ * @param [in,out] *heap\n
+ * 	heap array
+ * @param [in] i\n
+ * 	node whose candidate may be smaller than its parent
+ * @returns none
+ */
+static void TopKSiftUp(BitStreamCandidate *heap, uint32_t i) {
+   BitStreamCandidate c = heap[i];
+
+   while (i > 0 && TopKWorse(&c, &heap[(i - 1) / 2])) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+   }
+   heap[i] = c;
+}
+
+/**
+ * @ingroup BitStreamTopK
+ * @fn BitStreamTopK* BitStreamTopKCreate(uint32_t capacity, float floor)
+ *
+ * @brief Creates a collector keeping the best capacity candidates
+ *
+ * @param [in] capacity\n
+ * 	number of candidates to keep, at least 1
+ * @param [in] floor\n
+ * 	candidates scoring below this are never kept
+ * @returns pointer to newly created collector, NULL on failure
+ */
+BitStreamTopK* BitStreamTopKCreate(uint32_t capacity, float floor) {
+   BitStreamTopK *topk = NULL;
+
+   if (capacity == 0)
+      return NULL;
+
+   topk = (BitStreamTopK *)malloc(sizeof(BitStreamTopK));
+   if (topk != NULL) {
+      topk->heap = (BitStreamCandidate *)malloc(capacity *
+		      sizeof(BitStreamCandidate));
+      if (topk->heap == NULL) {
+         free(topk);
+         return NULL;
+      }
+      topk->capacity = capacity;
+      topk->count = 0;
+      topk->floor = floor;
+   }
+   return topk;
+}
+
+/**
+ * @ingroup BitStreamTopK
+ * @fn void BitStreamTopKDelete(BitStreamTopK *topk)
+ *
+ * @brief Deletes the collector
+ *
+ * @param [in] *topk\n
+ * 	collector to delete, may be NULL
+ * @returns none
+ */
+void BitStreamTopKDelete(BitStreamTopK *topk) {
+   if (topk != NULL) {
+      free(topk->heap);
+      free(topk);
+   }
+}
+
+/**
+ * @ingroup BitStreamTopK
+ * @fn void BitStreamTopKReset(BitStreamTopK *topk)
+ *
+ * @brief drops all the candidates, the collector can be reused for another
+ * 	search without reallocation
+ *
+ * @param [in,out] *topk\n
+ * 	collector to empty
+ * @returns none
+ */
+void BitStreamTopKReset(BitStreamTopK *topk) {
+   if (topk)
+      topk->count = 0;
+}
+
+/**
+ * @ingroup BitStreamTopK
+ * @fn float BitStreamTopKThreshold(BitStreamTopK *topk)
+ *
+ * @brief score a new candidate has to beat to be kept
+ *
+ * @param [in] *topk\n
+ * 	collector
+ * @returns the floor until the collector is full, then the larger of the
+ * 	floor and the worst score kept
+ */
+float BitStreamTopKThreshold(BitStreamTopK *topk) {
+   if (topk->count < topk->capacity || topk->heap[0].score < topk->floor)
+      return topk->floor;
+   return topk->heap[0].score;
+}
+
+/**
+ * @ingroup BitStreamTopK
+ * @fn int BitStreamTopKOffer(BitStreamTopK *topk, float score, uint32_t key,
+ * 	uint64_t line)
+ *
+ * @brief offers a candidate to the collector, it is kept if it beats the
+ * 	threshold, evicting the worst candidate kept when full
+ *
+ * @param [in,out] *topk\n
+ * 	collector
+ * @param [in] score\n
+ * 	score of the candidate
+ * @param [in] key\n
+ * 	key of the candidate
+ * @param [in] line\n
+ * 	record index of the candidate
+ * @returns 1 if the candidate is kept, 0 otherwise
+ */
+int BitStreamTopKOffer(BitStreamTopK *topk, float score, uint32_t key,
+	uint64_t line) {
+   BitStreamCandidate c;
+
+   if (score < topk->floor)
+      return 0;
+
+   c.score = score;
+   c.key = key;
+   c.line = line;
+
+   if (topk->count < topk->capacity) {
+      topk->heap[topk->count] = c;
+      TopKSiftUp(topk->heap, topk->count++);
+      return 1;
+   }
+   /* ties on score are settled by line and key, as in the results */
+   if (!TopKWorse(&topk->heap[0], &c))
+      return 0;
+
+   topk->heap[0] = c;
+   TopKSiftDown(topk->heap, topk->count, 0);
+   return 1;
+}
+
+/**
+ * @ingroup BitStreamTopK
+ * @fn void BitStreamTopKMerge(BitStreamTopK *dst, BitStreamTopK *src)
+ *
+ * @brief offers all the candidates of src to dst, src is left unchanged
+ *
+ * @param [in,out] *dst\n
+ * 	collector to merge into
+ * @param [in] *src\n
+ * 	collector to merge from, typically filled by another thread
+ * @returns none
+ */
+void BitStreamTopKMerge(BitStreamTopK *dst, BitStreamTopK *src) {
+   uint32_t i;
+
+   for (i = 0; i < src->count; i++) {
+      BitStreamCandidate *c = &src->heap[i];
+
+      BitStreamTopKOffer(dst, c->score, c->key, c->line);
+   }
+}
+
+/**
+ * @fn int TopKCompare(const void *a, const void *b)
+ *
+ * @brief qsort() comparison of the candidates, best first under TopKWorse()
+ */
+static int TopKCompare(const void *a, const void *b) {
+   const BitStreamCandidate *x = (const BitStreamCandidate *)a;
+   const BitStreamCandidate *y = (const BitStreamCandidate *)b;
+
+   return TopKWorse(x, y) - TopKWorse(y, x);
+}
+
+/**
+ * @ingroup BitStreamTopK
+ * @fn uint32_t BitStreamTopKResults(BitStreamTopK *topk,
+ * 	BitStreamCandidate *out)
+ *
+ * @brief copies the kept candidates out, best first
+ *
+ * @param [in] *topk\n
+ * 	collector
+ * @param [out] *out\n
+ * 	array of at least topk->capacity candidates
+ * @returns number of candidates copied
+ */
+uint32_t BitStreamTopKResults(BitStreamTopK *topk, BitStreamCandidate *out) {
+   memcpy(out, topk->heap, topk->count * sizeof(BitStreamCandidate));
+   qsort(out, topk->count, sizeof(BitStreamCandidate), TopKCompare);
+   return topk->count;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file  BitStreamTopK.h
+ * @brief Bounded collection of the best scoring candidates of a search
+ */
+#if !defined(_BITSTREAM_TOPK_H)
+#define _BITSTREAM_TOPK_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Type Definitions */
+/**
+ * @struct BitStreamCandidate
+ * @brief one result of a key search, enough to decrypt it again later
+ */
+typedef struct BitStreamCandidate {
+   float    score;   /**< higher is better */
+   uint32_t key;     /**< key the record was decrypted with */
+   uint64_t line;    /**< index of the record in the corpus */
+} BitStreamCandidate;
+
+/**
+ * @struct BitStreamTopK
+ * @brief keeps the best capacity candidates offered to it
+ *
+ * The candidates are held in a min-heap on score, ties ranked by line then
+ * key, so the worst candidate kept is at the root and decides whether a new
+ * one gets in. Which candidates are kept does not depend on the order they
+ * are offered in. Searches read BitStreamTopKThreshold() to abandon
+ * candidates that cannot get in, a candidate tying with it may still get in
+ * on its line.
+ */
+typedef struct BitStreamTopK {
+   BitStreamCandidate *heap;     /**< min-heap of kept candidates */
+   uint32_t            capacity; /**< maximum number of candidates kept */
+   uint32_t            count;    /**< number of candidates kept */
+   float               floor;    /**< minimum score to be kept at all */
+} BitStreamTopK;
+
+
+BitStreamTopK* BitStreamTopKCreate(uint32_t capacity, float floor) ;
+
+void BitStreamTopKDelete(BitStreamTopK *topk) ;
+
+void BitStreamTopKReset(BitStreamTopK *topk) ;
+
+float BitStreamTopKThreshold(BitStreamTopK *topk) ;
+
+int BitStreamTopKOffer(BitStreamTopK *topk, float score, uint32_t key,
+	uint64_t line) ;
+
+void BitStreamTopKMerge(BitStreamTopK *dst, BitStreamTopK *src) ;
+
+uint32_t BitStreamTopKResults(BitStreamTopK *topk, BitStreamCandidate *out) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_TOPK_H */
@@ -0,0 +1,328 @@
+/**
+ * @file BitStreamTranspose.c
+ *
+ * @brief Implements transposition of a byte stream into k columns
+ *
+ * Column j holds bytes j, j + k, j + 2k, ... of the input, the columns are
+ * written one after the other into a single output. With rows = size / k
+ * and rem = size % k, the first rem columns hold rows + 1 bytes and column j
+ * starts at j * rows + min(j, rem) (BitStreamColumnOffset).
+ *
+ * The input is walked in tiles of TRANSPOSE_TILE_ROWS rows: a tile of the
+ * input sits in L1 while each column receives a run of consecutive bytes,
+ * so both sides stream sequentially through memory. Power of two k up to 16
+ * are done 16 rows at a time in SSE2 registers by repeatedly splitting the
+ * bytes into even and odd positions, each split halves the stride. The
+ * other k get a tile loop specialized for the constant k.
+ *
+ * @internal BitStreamColumnOffset
+ * 	     BitStreamTransposeBytes
+ * 	     BitStreamUntransposeBytes
+ * 	     BitStreamTranspose
+ * 	     BitStreamUntranspose
+ *
+ * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
+ */
+
+#include "BitStreamTranspose.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @def TRANSPOSE_TILE_ROWS
+ * @brief rows per tile, a tile of 40 columns is 2.5KB of input
+ */
+#define TRANSPOSE_TILE_ROWS	64
+
+/**
+ * @def TRANSPOSE_MAX_SPECIALIZED
+ * @brief largest k with a tile loop specialized for it
+ */
+#define TRANSPOSE_MAX_SPECIALIZED	40
+
+#define ALWAYS_INLINE	inline __attribute__((always_inline))
+
+/**
+ * @ingroup BitStreamTranspose
+ * @fn uint64_t BitStreamColumnOffset(uint64_t size, uint32_t k,
+ * 	uint32_t column)
+ *
+ * @brief offset of a column within the transposed output
+ *
+ * @param [in] size\n
+ * 	length of the input in bytes
+ * @param [in] k\n
+ * 	number of columns
+ * @param [in] column\n
+ * 	column index, column k gives the end of the last column
+ * @returns offset of the first byte of the column
+ */
+uint64_t BitStreamColumnOffset(uint64_t size, uint32_t k, uint32_t column) {
+   return column * (size / k) + MIN(column, size % k);
+}
+
+/**
+ * @fn void TransposeTiles(const uint8_t *in, uint64_t size, uint32_t k,
+ * 	uint8_t *out, uint64_t first, int inverse)
+ *
+ * @brief scalar transposition (or its inverse) from row first onwards, tile
+ * 	by tile, including the trailing partial row
+ *
+ * Always inlined so that each call site with a constant k and direction
+ * gets its own unrolled copy
+ */
+static ALWAYS_INLINE void TransposeTiles(const uint8_t *in, uint64_t size,
+	uint32_t k, uint8_t *out, uint64_t first, int inverse) {
+   uint64_t rows = size / k;
+   uint64_t rem = size % k;
+   uint64_t r0, r;
+   uint32_t j;
+
+   for (r0 = first; r0 < rows; r0 += TRANSPOSE_TILE_ROWS) {
+      uint64_t r1 = MIN(r0 + TRANSPOSE_TILE_ROWS, rows);
+
+      for (j = 0; j < k; j++) {
+         uint64_t col = j * rows + MIN(j, rem);
+
+         if (inverse) {
+            for (r = r0; r < r1; r++)
+               out[r * k + j] = in[col + r];
+         } else {
+            for (r = r0; r < r1; r++)
+               out[col + r] = in[r * k + j];
+         }
+      }
+   }
+   for (j = 0; j < rem; j++) {
+      uint64_t col = j * rows + j;
+
+      if (inverse)
+         out[rows * k + j] = in[col + rows];
+      else
+         out[col + rows] = in[rows * k + j];
+   }
+}
+
+#if defined(__SSE2__)
+/**
+ * @fn uint64_t TransposeSse2(const uint8_t *in, uint64_t size, uint32_t k,
+ * 	uint8_t *out, int inverse)
+ *
+ * @brief transposition (or its inverse) of the whole groups of 16 rows for
+ * 	k a power of two up to 16
+ *
+ * The 16 * k bytes of 16 rows are loaded into k registers. Splitting a run
+ * of registers into the bytes at even and at odd positions (mask/shift and
+ * pack) separates the columns by the lowest bit of their index, repeating
+ * it within each half log2(k) times leaves one column per register, in bit
+ * reversed column order. The inverse interleaves the halves back with
+ * unpacklo/unpackhi in the opposite order.
+ *
+ * @returns number of rows done, the remaining rows are left to the tiles
+ */
+static ALWAYS_INLINE uint64_t TransposeSse2(const uint8_t *in, uint64_t size,
+	uint32_t k, uint8_t *out, int inverse) {
+   const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+   uint64_t      rows = size / k;
+   uint64_t      rem = size % k;
+   uint64_t      col[16];
+   uint64_t      r;
+   __m128i       v[16], t[16];
+   uint32_t      g, b, i, s, bits = __builtin_ctz(k);
+
+   /* column held by register g once split: g with its bits reversed */
+   for (g = 0; g < k; g++) {
+      uint32_t c = 0;
+
+      for (b = 0; b < bits; b++)
+         c |= ((g >> b) & 1) << (bits - 1 - b);
+      col[g] = c * rows + MIN(c, rem);
+   }
+
+   for (r = 0; r + 16 <= rows; r += 16) {
+      if (!inverse) {
+         for (i = 0; i < k; i++)
+            v[i] = _mm_loadu_si128((const __m128i *)(in + r * k + 16 * i));
+
+         for (s = k; s >= 2; s /= 2) {
+            for (b = 0; b < k; b += s) {
+               for (i = 0; i < s / 2; i++) {
+                  __m128i x = v[b + 2 * i], y = v[b + 2 * i + 1];
+
+                  t[b + i] = _mm_packus_epi16(_mm_and_si128(x, lowBytes),
+				  _mm_and_si128(y, lowBytes));
+                  t[b + s / 2 + i] = _mm_packus_epi16(_mm_srli_epi16(x, 8),
+				  _mm_srli_epi16(y, 8));
+               }
+            }
+            memcpy(v, t, k * sizeof(__m128i));
+         }
+
+         for (g = 0; g < k; g++)
+            _mm_storeu_si128((__m128i *)(out + col[g] + r), v[g]);
+      } else {
+         for (g = 0; g < k; g++)
+            v[g] = _mm_loadu_si128((const __m128i *)(in + col[g] + r));
+
+         for (s = 2; s <= k; s *= 2) {
+            for (b = 0; b < k; b += s) {
+               for (i = 0; i < s / 2; i++) {
+                  __m128i x = v[b + i], y = v[b + s / 2 + i];
+
+                  t[b + 2 * i] = _mm_unpacklo_epi8(x, y);
+                  t[b + 2 * i + 1] = _mm_unpackhi_epi8(x, y);
+               }
+            }
+            memcpy(v, t, k * sizeof(__m128i));
+         }
+
+         for (i = 0; i < k; i++)
+            _mm_storeu_si128((__m128i *)(out + r * k + 16 * i), v[i]);
+      }
+   }
+   return r;
+}
+#endif
+
+/**
+ * @fn void Transpose(const uint8_t *in, uint64_t size, uint32_t k,
+ * 	uint8_t *out, int inverse)
+ *
+ * @brief dispatches to the kernel specialized for k
+ */
+static void Transpose(const uint8_t *in, uint64_t size, uint32_t k,
+	uint8_t *out, int inverse) {
+   uint64_t done;
+
+   if (k <= 1) {
+      memcpy(out, in, size);
+      return;
+   }
+
+   switch (k) {
+#if defined(__SSE2__)
+#define TRANSPOSE_POW2_CASE(n)	\
+   case n: done = TransposeSse2(in, size, n, out, inverse);	\
+	   TransposeTiles(in, size, n, out, done, inverse); return;
+#else
+#define TRANSPOSE_POW2_CASE(n)	\
+   case n: TransposeTiles(in, size, n, out, 0, inverse); return;
+#endif
+#define TRANSPOSE_CASE(n)	\
+   case n: TransposeTiles(in, size, n, out, 0, inverse); return;
+   TRANSPOSE_POW2_CASE(2)  TRANSPOSE_CASE(3)  TRANSPOSE_POW2_CASE(4)
+   TRANSPOSE_CASE(5)  TRANSPOSE_CASE(6)  TRANSPOSE_CASE(7)
+   TRANSPOSE_POW2_CASE(8)  TRANSPOSE_CASE(9)  TRANSPOSE_CASE(10)
+   TRANSPOSE_CASE(11) TRANSPOSE_CASE(12) TRANSPOSE_CASE(13) TRANSPOSE_CASE(14)
+   TRANSPOSE_CASE(15) TRANSPOSE_POW2_CASE(16) TRANSPOSE_CASE(17)
+   TRANSPOSE_CASE(18) TRANSPOSE_CASE(19) TRANSPOSE_CASE(20) TRANSPOSE_CASE(21)
+   TRANSPOSE_CASE(22) TRANSPOSE_CASE(23) TRANSPOSE_CASE(24) TRANSPOSE_CASE(25)
+   TRANSPOSE_CASE(26) TRANSPOSE_CASE(27) TRANSPOSE_CASE(28) TRANSPOSE_CASE(29)
+   TRANSPOSE_CASE(30) TRANSPOSE_CASE(31) TRANSPOSE_CASE(32) TRANSPOSE_CASE(33)
+   TRANSPOSE_CASE(34) TRANSPOSE_CASE(35) TRANSPOSE_CASE(36) TRANSPOSE_CASE(37)
+   TRANSPOSE_CASE(38) TRANSPOSE_CASE(39) TRANSPOSE_CASE(40)
+#undef TRANSPOSE_POW2_CASE
+#undef TRANSPOSE_CASE
+   default:
+      TransposeTiles(in, size, k, out, 0, inverse);
+   }
+}
+
+/**
+ * @ingroup BitStreamTranspose
+ * @fn void BitStreamTransposeBytes(const uint8_t *in, uint64_t size,
+ * 	uint32_t k, uint8_t *out)
+ *
+ * @brief splits the buffer into k columns written one after the other
+ *
+ * @param [in] *in\n
+ * 	buffer to transpose
+ * @param [in] size\n
+ * 	length of the buffer in bytes
+ * @param [in] k\n
+ * 	number of columns
+ * @param [out] *out\n
+ * 	buffer of size bytes receiving the columns, must not overlap in
+ * @returns none
+ */
+void BitStreamTransposeBytes(const uint8_t *in, uint64_t size, uint32_t k,
+	uint8_t *out) {
+   Transpose(in, size, k, out, 0);
+}
+
+/**
+ * @ingroup BitStreamTranspose
+ * @fn void BitStreamUntransposeBytes(const uint8_t *in, uint64_t size,
+ * 	uint32_t k, uint8_t *out)
+ *
+ * @brief interleaves k consecutive columns back into the original order,
+ * 	the inverse of BitStreamTransposeBytes()
+ *
+ * @param [in] *in\n
+ * 	columns to interleave
+ * @param [in] size\n
+ * 	length of the buffer in bytes
+ * @param [in] k\n
+ * 	number of columns
+ * @param [out] *out\n
+ * 	buffer of size bytes receiving the interleaved bytes, must not
+ * 	overlap in
+ * @returns none
+ */
+void BitStreamUntransposeBytes(const uint8_t *in, uint64_t size, uint32_t k,
+	uint8_t *out) {
+   Transpose(in, size, k, out, 1);
+}
+
+/**
+ * @fn BitStream* TransposeStream(BitStream *bs, uint32_t k, int inverse)
+ *
+ * @brief allocates the output stream and runs the kernel over the whole
+ * 	bytes of bs
+ */
+static BitStream* TransposeStream(BitStream *bs, uint32_t k, int inverse) {
+   BitStream *out = NULL;
+   uint64_t   size = BitStreamGetSizeBits(bs) / BITS_PER_BYTE;
+
+   if (bs && bs->array && size && k) {
+      out = BitStreamCreate(size * BITS_PER_BYTE);
+      if (out)
+         Transpose(bs->array, size, k, out->array, inverse);
+   }
+   return out;
+}
+
+/**
+ * @ingroup BitStreamTranspose
+ * @fn BitStream* BitStreamTranspose(BitStream *bs, uint32_t k)
+ *
+ * @brief splits the stream into k columns (every k-th byte), written one
+ * 	after the other, column j starts at byte BitStreamColumnOffset()
+ *
+ * @param [in] *bs\n
+ * 	bit stream to transpose, trailing partial byte is ignored
+ * @param [in] k\n
+ * 	number of columns, typically a keysize
+ * @returns newly created bit stream holding the columns, NULL on failure
+ */
+BitStream* BitStreamTranspose(BitStream *bs, uint32_t k) {
+   return TransposeStream(bs, k, 0);
+}
+
+/**
+ * @ingroup BitStreamTranspose
+ * @fn BitStream* BitStreamUntranspose(BitStream *bs, uint32_t k)
+ *
+ * @brief interleaves k columns back, the inverse of BitStreamTranspose()
+ *
+ * @param [in] *bs\n
+ * 	bit stream holding the columns
+ * @param [in] k\n
+ * 	number of columns
+ * @returns newly created bit stream in the original order, NULL on failure
+ */
+BitStream* BitStreamUntranspose(BitStream *bs, uint32_t k) {
+   return TransposeStream(bs, k, 1);
+}
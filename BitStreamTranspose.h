@@ -0,0 +1,29 @@
+/**
+ * @file  BitStreamTranspose.h
+ * @brief Splitting of a stream into k columns (every k-th byte) and back
+ */
+#if !defined(_BITSTREAM_TRANSPOSE_H)
+#define _BITSTREAM_TRANSPOSE_H
+
+#include "BitStream.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+uint64_t BitStreamColumnOffset(uint64_t size, uint32_t k, uint32_t column) ;
+
+void BitStreamTransposeBytes(const uint8_t *in, uint64_t size, uint32_t k,
+	uint8_t *out) ;
+
+void BitStreamUntransposeBytes(const uint8_t *in, uint64_t size, uint32_t k,
+	uint8_t *out) ;
+
+BitStream* BitStreamTranspose(BitStream *bs, uint32_t k) ;
+
+BitStream* BitStreamUntranspose(BitStream *bs, uint32_t k) ;
+
+#if defined(__cplusplus)
+}
+#endif
+#endif /* _BITSTREAM_TRANSPOSE_H */
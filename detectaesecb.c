@@ -0,0 +1,125 @@
+#include "BitStream.h"
+#include "BitStreamBlocks.h"
+#include "BitStreamCorpus.h"
+#include "BitStreamPipeline.h"
+
+/**
+ * the cryptopals crypto challenges
+ *
+ * Set 1 / Challenge 8
+ *
+ * Detect AES in ECB mode
+ *
+ * In this file are a bunch of hex-encoded ciphertexts.
+ *
+ * One of them has been encrypted with ECB.
+ *
+ * Detect it.
+ *
+ * Remember that the problem with ECB is that it is stateless and
+ * deterministic; the same 16 byte plaintext block will always produce the
+ * same 16 byte ciphertext.
+ */
+
+/**
+ * @def AES_BLOCKSIZE
+ * @brief AES block size in bytes
+ */
+#define AES_BLOCKSIZE	16
+
+/**
+ * @def TOP_CANDIDATES
+ * @brief number of records with the most repeated blocks shown
+ */
+#define TOP_CANDIDATES	3
+
+/**
+ * @fn uint32_t DetectEcbSearch(BitStream *record, uint64_t line,
+ * 	BitStreamTopK *topk, void *ctx)
+ *
+ * @brief offers records with repeated blocks, the pipeline search of the
+ * 	staged mode
+ */
+static uint32_t DetectEcbSearch(BitStream *record, uint64_t line,
+	BitStreamTopK *topk, void *ctx) {
+   uint64_t dups = BitStreamCountDuplicateBlocks(record, AES_BLOCKSIZE);
+
+   (void)ctx;
+   return dups ? BitStreamTopKOffer(topk, (float)dups, AES_BLOCKSIZE, line) : 0;
+}
+
+/**
+ * @fn int DetectStaged(const char *path)
+ *
+ * @brief staged mode, the file is read, decoded and searched by threads of
+ * 	their own and never held in memory as a whole
+ */
+static int DetectStaged(const char *path) {
+   BitStreamPipeline  *pipeline;
+   BitStreamCandidate best[TOP_CANDIDATES];
+   BitStream          *records[TOP_CANDIDATES];
+   uint32_t           i, n;
+   int                ret = -1;
+
+   pipeline = BitStreamPipelineCreate(DetectEcbSearch, NULL, TOP_CANDIDATES,
+		   1.0f, 0);
+   if (!pipeline)
+      return (-1);
+
+   if (BitStreamPipelineRunHex(pipeline, path, NULL, NULL) == 0) {
+      ret = 0;
+      n = BitStreamPipelineResults(pipeline, best, records);
+
+      for (i = 0; i < n; i++) {
+         printf("line %llu repeated blocks %.0f\n",
+			 (unsigned long long)best[i].line, best[i].score);
+         BitStreamShow(records[i]);
+      }
+   } else {
+      fprintf(stderr, "detectaesecb: cannot search %s\n", path);
+   }
+   BitStreamPipelineDelete(pipeline);
+
+   return ret;
+}
+
+/**
+ * usage: detectaesecb [-s] [file]
+ *
+ * file holds one hex encoded ciphertext per line, the challenge's 8.txt
+ * (not shipped, download it next to 4.txt) when not given.
+ */
+int main(int argc, char **argv) {
+   BitStreamCorpus    *corpus;
+   BitStreamTopK      *topk;
+   BitStreamCandidate best[TOP_CANDIDATES];
+   const char         *path;
+   uint32_t           i, n;
+
+   /* -s: staged search, for files too large to load */
+   if (argc > 1 && strcmp(argv[1], "-s") == 0)
+      return DetectStaged(argc > 2 ? argv[2] : "8.txt");
+
+   path = argc > 1 ? argv[1] : "8.txt";
+   corpus = BitStreamCorpusLoadHex(path);
+   if (!corpus) {
+      fprintf(stderr, "detectaesecb: cannot load %s\n", path);
+      return (-1);
+   }
+
+   /* a single repeated block is enough to qualify */
+   topk = BitStreamTopKCreate(TOP_CANDIDATES, 1.0f);
+   if (topk && BitStreamCorpusDetectEcb(corpus, AES_BLOCKSIZE, topk, 0) == 0) {
+      n = BitStreamTopKResults(topk, best);
+
+      for (i = 0; i < n; i++) {
+         printf("line %llu repeated blocks %.0f\n",
+			 (unsigned long long)best[i].line, best[i].score);
+         BitStreamShow(corpus->records[best[i].line]);
+      }
+   }
+   BitStreamTopKDelete(topk);
+   BitStreamCorpusDelete(corpus);
+
+   return 0;
+}
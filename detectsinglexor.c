@@ -1,4 +1,7 @@
 #include "BitStream.h"
+#include "BitStreamCorpus.h"
+#include "BitStreamPipeline.h"
+#include "BitStreamScore.h"
 
 /**
  * the cryptopals crypto challenges
@@ -22,158 +25,129 @@
  */
 
 /**
- * @def WORDLEN_SCORE_HIGH
- * @brief maximum word length score to qualify as english text
+ * @def NGRAM_SCORE_LOW
+ * @brief minimum mean trigram score per character to qualify as english
+ * 	text, lines of english score above -5 (short ones with capitals are
+ * 	the lowest) while the best garbage line in 4.txt scores -5.5
  */
-#define WORDLEN_SCORE_HIGH	6
+#define NGRAM_SCORE_LOW	(-5.0f)
 
 /**
- * @def WORDLEN_SCORE_LOW
- * @brief mininum word length score to qualify as english text
+ * @def TOP_CANDIDATES
+ * @brief number of best candidates decrypted and shown
  */
-#define WORDLEN_SCORE_LOW	3
+#define TOP_CANDIDATES	3
 
 /**
- * @def NONPRINT_SCORE_HIGH
- * @brief upper limit on allowed non-printable characters 
- */
-#define NONPRINT_SCORE_HIGH	3
-
-/**
- * @def NONPRINT_SCORE_LOW
- * @brief for now we don't allow any non-printable characters except '\r\n'
+ * @fn uint32_t SingleByteXorSearch(BitStream *record, uint64_t line,
+ * 	BitStreamTopK *topk, void *ctx)
+ *
+ * @brief BitStreamSingleByteXorSearch() as a pipeline search
  */
-#define NONPRINT_SCORE_LOW	0
+static uint32_t SingleByteXorSearch(BitStream *record, uint64_t line,
+	BitStreamTopK *topk, void *ctx) {
+   (void)ctx;
+   return BitStreamSingleByteXorSearch(record, line, topk);
+}
 
 /**
- * @def struct EnglishTextScore
+ * @fn void ShowCandidate(const BitStreamCandidate *candidate,
+ * 	BitStream *record)
  *
- * @breif parameters to measure closeness of string to english text
- *
- * This structure is not yet complete neither is the function operating on it
- * as several other parameters need to be considered before being able to filter
- * out seemingly looking garbled text
+ * @brief prints a candidate followed by its decrypted record
  */
-typedef struct EnglishTextScore {
-   uint16_t WordLengthScore;/**< typically text contains 5 letters per word */
-
-   uint16_t EtaoinScore;    /**< correlation to std etaoin histogram */
-
-   uint16_t NonPrintScore;  /**< number of non-printable characters in string */
-} EnglishTextScore;
-
-int CountNonPrintsInStream(uint8_t * buf, uint16_t size) {
-   int count = 0;
-   int i = 0;
-   while (i < size) {
-     if (!isprint(buf[i]))
-        count ++;
-     i ++;
+static void ShowCandidate(const BitStreamCandidate *candidate,
+	BitStream *record) {
+   BitStream *key, *clear = NULL;
+
+   key = BitStreamCreate(BITS_PER_BYTE);
+   if (key) {
+      BitStreamPutByte(key, candidate->key, 0, BITS_PER_BYTE);
+
+      clear = BitStreamExclusiveOr(record, key);
+      if (clear) {
+         printf("line %llu key %02x score %.3f\n",
+			 (unsigned long long)candidate->line, candidate->key,
+			 candidate->score);
+         BitStreamShow(clear);
+      }
    }
-   return count;
+   BitStreamDelete(clear);
+   BitStreamDelete(key);
 }
 
 /**
- * @fn int CountWordsInStream(uint8_t* buf, uint16_t size)
+ * @fn void ReportCandidate(void *ctx, const BitStreamCandidate *candidate,
+ * 	BitStream *record)
  *
- * @brief quick and dirty word counting function 
- * 	this function find words separated by spaces alone! Multiple instances 
- * 	of spaces are taken as one separator
- * @param [in] buf\n
- * 	buffer in which we've to count words from
- * @param [in] size\n
- * 	length of the buffer in bytes
- * @returns number of words counted in the sentence
+ * @brief notes candidates while the staged search is still running
  */
-
-int CountWordsInStream(uint8_t* buf, uint16_t size) {
-   int count = 0;
-   int i = 0;
-   while (i < size) {
-      while (i < size && buf[i] != ' ') 
-	i ++;
-      count ++;
-      while (i < size && buf[i] == ' ')
-	i ++;
-   }
-   return count;
+static void ReportCandidate(void *ctx, const BitStreamCandidate *candidate,
+	BitStream *record) {
+   (void)ctx;
+   (void)record;
+   fprintf(stderr, "candidate line %llu key %02x score %.3f\n",
+		   (unsigned long long)candidate->line, candidate->key,
+		   candidate->score);
 }
 
 /**
- * @fn int EnglishTextScoreCalc(EnglishTextScore* score, uint8_t *buf, 
- * 	uint16_t size) 
- *
- * @brief Calculates "score" for english language coherency
+ * @fn int DetectStaged(const char *path)
  *
- * @param [out] *score\n
- * 	pointer to score parameter structure to be filled 
- * @param [in] *buf\n
- * 	buffer to be parsed for calcualting the english language score
- * @param [in] size\n
- * 	length of the buffer in bytes
- * @returns average normalised score for the parsed text (should it be float?) 
+ * @brief staged mode, the file is read, decoded, searched and reported by
+ * 	threads of their own and never held in memory as a whole
  */
+static int DetectStaged(const char *path) {
+   BitStreamPipeline  *pipeline;
+   BitStreamCandidate best[TOP_CANDIDATES];
+   BitStream          *records[TOP_CANDIDATES];
+   uint32_t           i, n;
+   int                ret = -1;
+
+   pipeline = BitStreamPipelineCreate(SingleByteXorSearch, NULL,
+		   TOP_CANDIDATES, NGRAM_SCORE_LOW, 0);
+   if (!pipeline)
+      return (-1);
+
+   if (BitStreamPipelineRunHex(pipeline, path, ReportCandidate, NULL) == 0) {
+      ret = 0;
+      n = BitStreamPipelineResults(pipeline, best, records);
+
+      for (i = 0; i < n; i++) {
+         if (records[i])
+            ShowCandidate(&best[i], records[i]);
+      }
+   } else {
+      fprintf(stderr, "detectsinglexor: cannot search %s\n", path);
+   }
+   BitStreamPipelineDelete(pipeline);
 
-int EnglishTextScoreCalc(EnglishTextScore* score, uint8_t *buf, uint16_t size) {
-    uint16_t nWords;
-
-    score->NonPrintScore = CountNonPrintsInStream(buf, size);
-
-    nWords = CountWordsInStream(buf, size);
-    if (nWords > 0)
-       score->WordLengthScore = size / nWords;
-    else
-       score->WordLengthScore = 100; /* out of range */
-
-    if ((score->WordLengthScore < WORDLEN_SCORE_HIGH && score->WordLengthScore
-		    > WORDLEN_SCORE_LOW) &&
-        (score->NonPrintScore < NONPRINT_SCORE_HIGH && score->NonPrintScore 
-	            > NONPRINT_SCORE_LOW) 
-       )
-       return score->WordLengthScore; 
-    else 
-       return (-1);
+   return ret;
 }
 
-int main() {
-   BitStream        *cipher, *clear;
-   BitStream        *key;
-   int 	      	    i;
-   uint16_t         size;
-   char             buffer[256];
-   FILE	            *fp = NULL;
-   EnglishTextScore score;
-
-   fp = fopen("4.txt", "r");
-   if (!fp) 
+int main(int argc, char **argv) {
+   BitStreamCorpus    *corpus;
+   BitStreamTopK      *topk;
+   BitStreamCandidate best[TOP_CANDIDATES];
+   uint32_t           i, n;
+
+   /* -s: staged search, for files too large to load */
+   if (argc > 1 && strcmp(argv[1], "-s") == 0)
+      return DetectStaged(argc > 2 ? argv[2] : "4.txt");
+
+   corpus = BitStreamCorpusLoadHex("4.txt");
+   if (!corpus) 
       return (-1);
 
-   memset(buffer, '\0', sizeof(buffer));
-
-   while (fgets(buffer, sizeof(buffer) - 1, fp)) {
-     buffer[strlen(buffer) - 1] = '\0';
-     cipher = BitStreamCreateHex(buffer); 
-
-     if (cipher) {
-        for (i = 53; i < 255; i++) { /* key = 0 means clear text */
-	   key = BitStreamCreate(BITS_PER_BYTE);
-	   if (key) {
-	      BitStreamPutByte(key, i, 0, BITS_PER_BYTE);
-	   
-              clear = BitStreamExclusiveOr(cipher, key);
-
-	      size = (BitStreamGetSizeBits(clear) + BITS_PER_BYTE - 1)/
-			   BITS_PER_BYTE;
-	      if (EnglishTextScoreCalc(&score, BitStreamGetArray(clear),size) 
-			      > 0) {
-	         BitStreamShow(clear);
-	      }
-
-	      BitStreamDelete(clear);
-           }
-	   BitStreamDelete(key);
-        }
-     }
-     memset(buffer, '\0', sizeof(buffer));
+   topk = BitStreamTopKCreate(TOP_CANDIDATES, NGRAM_SCORE_LOW);
+   if (topk && BitStreamCorpusSingleByteXor(corpus, topk, 0) == 0) {
+      n = BitStreamTopKResults(topk, best);
+
+      for (i = 0; i < n; i++)
+         ShowCandidate(&best[i], corpus->records[best[i].line]);
    }
+   BitStreamTopKDelete(topk);
+   BitStreamCorpusDelete(corpus);
+
+   return 0;
 }
@@ -27,7 +27,7 @@
  * promise, we aren't wasting your time with this.
  */
 int main() {
-   BitStream *key, *cipher, *clear;
+   BitStream *key, *cipher, *clear = NULL;
 
    cipher = BitStreamCreateAscii("Burning 'em, if you ain't quick and nimble\nI go crazy when I hear a cymbal");
    key = BitStreamCreateAscii("ICE");
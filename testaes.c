@@ -0,0 +1,84 @@
+#include "BitStream.h"
+#include "BitStreamAes.h"
+
+/**
+ * Known-answer test of AES-128
+ *
+ * Runs the example vector of FIPS-197 appendix C.1 through every
+ * implementation this cpu has, in both directions, in ECB and in CBC mode
+ * (a single block with a zero IV is the same as ECB).
+ */
+
+static const uint8_t Key[AES128_KEY_BYTES] = {
+   0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+   0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+
+static const uint8_t Plain[AES_BLOCK_BYTES] = {
+   0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+   0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+
+static const uint8_t Cipher[AES_BLOCK_BYTES] = {
+   0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+   0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+};
+
+/**
+ * @fn int Check(const char *name, const char *what, const uint8_t *got,
+ * 	const uint8_t *want)
+ *
+ * @brief compares a block against the expected one
+ */
+static int Check(const char *name, const char *what, const uint8_t *got,
+	const uint8_t *want) {
+   if (memcmp(got, want, AES_BLOCK_BYTES) == 0)
+      return 0;
+
+   fprintf(stderr, "%s: %s mismatch\n", name, what);
+   return 1;
+}
+
+/**
+ * @fn int TestImpl(BitStreamAesImpl impl, const char *name)
+ *
+ * @brief runs the vector through one implementation
+ *
+ * @returns number of failures, 0 if the implementation is not available
+ */
+static int TestImpl(BitStreamAesImpl impl, const char *name) {
+   BitStreamAesKey aes;
+   uint8_t         out[AES_BLOCK_BYTES];
+   uint8_t         iv[AES_BLOCK_BYTES];
+   int             failed = 0;
+
+   if (BitStreamAesSelect(impl) != impl) {
+      printf("%s: not available, skipped\n", name);
+      return 0;
+   }
+   BitStreamAesExpandKey(&aes, Key);
+
+   BitStreamAesEcbEncryptBlocks(&aes, Plain, out, 1);
+   failed += Check(name, "ecb encrypt", out, Cipher);
+   BitStreamAesEcbDecryptBlocks(&aes, Cipher, out, 1);
+   failed += Check(name, "ecb decrypt", out, Plain);
+
+   memset(iv, '\0', sizeof(iv));
+   BitStreamAesCbcEncryptBlocks(&aes, iv, Plain, out, 1);
+   failed += Check(name, "cbc encrypt", out, Cipher);
+   memset(iv, '\0', sizeof(iv));
+   BitStreamAesCbcDecryptBlocks(&aes, iv, Cipher, out, 1);
+   failed += Check(name, "cbc decrypt", out, Plain);
+
+   printf("%s: %s\n", name, failed ? "FAILED" : "ok");
+   return failed;
+}
+
+int main(void) {
+   int failed = 0;
+
+   failed += TestImpl(BITSTREAM_AES_SOFTWARE, "software");
+   failed += TestImpl(BITSTREAM_AES_AESNI, "aes-ni");
+
+   return failed ? 1 : 0;
+}
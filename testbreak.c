@@ -0,0 +1,81 @@
+#include "BitStream.h"
+#include "BitStreamBreak.h"
+
+/**
+ * Round trip of the repeating-key XOR breaker
+ *
+ * English text is encrypted the way repeatkeyxor does it, with
+ * BitStreamExclusiveOr() against a repeated key, and
+ * BitStreamBreakRepeatingKeyXor() must give back both the key and the text,
+ * on one thread and on several.
+ */
+
+static const char *Text =
+   "It was the best of times, it was the worst of times, it was the age of "
+   "wisdom, it was the age of foolishness, it was the epoch of belief, it "
+   "was the epoch of incredulity, it was the season of Light, it was the "
+   "season of Darkness, it was the spring of hope, it was the winter of "
+   "despair, we had everything before us, we had nothing before us, we were "
+   "all going direct to Heaven, we were all going direct the other way - in "
+   "short, the period was so far like the present period, that some of its "
+   "noisiest authorities insisted on its being received, for good or for "
+   "evil, in the superlative degree of comparison only. There were a king "
+   "with a large jaw and a queen with a plain face, on the throne of "
+   "England; there were a king with a large jaw and a queen with a fair "
+   "face, on the throne of France. In both countries it was clearer than "
+   "crystal to the lords of the State preserves of loaves and fishes, that "
+   "things in general were settled for ever.";
+
+static const char *Keys[] = {
+   "ICE", "Terminator X: Bring the noise", "k3y!", "cryptopals"
+};
+
+/**
+ * @fn int Break(const char *secret, unsigned nthreads)
+ *
+ * @brief encrypts the text with secret and breaks it
+ *
+ * @returns 0 if key and text were recovered, 1 otherwise
+ */
+static int Break(const char *secret, unsigned nthreads) {
+   BitStream *plain, *key, *cipher, *clear = NULL, *found = NULL;
+   int        failed = 1;
+
+   plain = BitStreamCreateAscii(Text);
+   key = BitStreamCreateAscii(secret);
+   cipher = plain && key ? BitStreamExclusiveOr(plain, key) : NULL;
+
+   if (cipher)
+      clear = BitStreamBreakRepeatingKeyXor(cipher, 2, 40, 3, &found,
+		      nthreads);
+
+   if (clear && found && found->nbits == key->nbits &&
+       memcmp(found->array, key->array, key->nbits / BITS_PER_BYTE) == 0 &&
+       clear->nbits == plain->nbits &&
+       memcmp(clear->array, plain->array, plain->nbits / BITS_PER_BYTE) == 0)
+      failed = 0;
+   else
+      fprintf(stderr, "key \"%s\" on %u threads not recovered\n", secret,
+		      nthreads);
+
+   BitStreamDelete(found);
+   BitStreamDelete(clear);
+   BitStreamDelete(cipher);
+   BitStreamDelete(key);
+   BitStreamDelete(plain);
+
+   return failed;
+}
+
+int main(void) {
+   unsigned i;
+   int      failed = 0;
+
+   for (i = 0; i < sizeof(Keys) / sizeof(Keys[0]); i++) {
+      failed += Break(Keys[i], 1);
+      failed += Break(Keys[i], 4);
+   }
+
+   printf("break: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
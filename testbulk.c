@@ -0,0 +1,209 @@
+#include "BitStream.h"
+#include "BitStreamBulk.h"
+
+/**
+ * Chunk-parallel conversions against their serial versions
+ *
+ * Inputs end just before, on and just after the BULK_TASK_BYTES chunk
+ * boundaries (and, for XOR, keys longer than a chunk or whose repetitions
+ * do not divide one), streams carry trailing partial bytes, and each size
+ * runs on one thread and on several: the parallel hex decode, Base64
+ * encode and XOR must give the bytes of BitStreamCopyHex(),
+ * BitStreamHex2Base64() and BitStreamExclusiveOr(). A non hex digit at a
+ * chunk boundary must fail the decode, and a stream XORed with itself must
+ * give zeros.
+ */
+
+#define T		BULK_TASK_BYTES
+
+static const unsigned Threads[] = { 1, 3, 0 };
+
+static uint64_t       Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+/**
+ * @fn int Same(BitStream *x, BitStream *y)
+ *
+ * @brief 1 if both streams hold the same bits
+ */
+static int Same(BitStream *x, BitStream *y) {
+   return x && y && x->nbits == y->nbits && (x->nbits == 0 ||
+	  memcmp(x->array, y->array, (x->nbits + 7) / BITS_PER_BYTE) == 0);
+}
+
+/**
+ * @fn BitStream* RandomStream(uint64_t nbits)
+ *
+ * @brief stream of nbits random bits
+ */
+static BitStream* RandomStream(uint64_t nbits) {
+   BitStream *bs = BitStreamCreate(nbits);
+   uint64_t   i;
+
+   for (i = 0; bs && i < (nbits + 7) / BITS_PER_BYTE; i++)
+      bs->array[i] = (uint8_t)Random();
+   return bs;
+}
+
+/**
+ * @fn int TestHex(size_t len)
+ *
+ * @brief decodes len random hex digits
+ */
+static int TestHex(size_t len) {
+   static const char Digits[] = "0123456789abcdefABCDEF";
+   BitStream *want, *got;
+   char      *hex;
+   size_t     i, bad;
+   unsigned   t;
+   int        failed = 0;
+
+   hex = (char *)malloc(len + 1);
+   want = BitStreamCreate(0);
+   got = BitStreamCreate(0);
+   if (hex == NULL || want == NULL || got == NULL)
+      return 1;
+   for (i = 0; i < len; i++)
+      hex[i] = Digits[Random() % 22];
+   hex[len] = '\0';
+
+   BitStreamCopyHex(want, hex);
+   for (t = 0; t < sizeof(Threads) / sizeof(Threads[0]); t++)
+      if (BitStreamCopyHexParallel(got, hex, Threads[t]) != want->nbits ||
+          !Same(got, want))
+         failed = 1;
+
+   /* a bad digit on either side of a chunk boundary, and the last one */
+   for (i = 0; i < 3 && len > 2; i++) {
+      bad = i == 2 ? len - 1 : MIN(len % 2 + 2 * T - i, len - 1);
+      hex[bad] = 'g';
+      if (BitStreamCopyHexParallel(got, hex, 3) != 0)
+         failed = 1;
+      hex[bad] = '0';
+   }
+
+   if (failed)
+      fprintf(stderr, "hex decode of %zu digits: mismatch\n", len);
+   BitStreamDelete(got);
+   BitStreamDelete(want);
+   free(hex);
+   return failed;
+}
+
+/**
+ * @fn int TestBase64(uint64_t nbits)
+ *
+ * @brief encodes nbits random bits
+ */
+static int TestBase64(uint64_t nbits) {
+   BitStream *bs, *want, *got;
+   unsigned   t;
+   int        failed = 0;
+
+   bs = RandomStream(nbits);
+   want = bs ? BitStreamHex2Base64(bs) : NULL;
+   if (want == NULL)
+      return 1;
+
+   for (t = 0; t < sizeof(Threads) / sizeof(Threads[0]); t++) {
+      got = BitStreamHex2Base64Parallel(bs, Threads[t]);
+      if (!Same(got, want))
+         failed = 1;
+      BitStreamDelete(got);
+   }
+
+   if (failed)
+      fprintf(stderr, "base64 of %llu bits: mismatch\n",
+		      (unsigned long long)nbits);
+   BitStreamDelete(want);
+   BitStreamDelete(bs);
+   return failed;
+}
+
+/**
+ * @fn int TestXor(uint64_t nbits, uint64_t keybits)
+ *
+ * @brief XORs nbits random bits against a random key of keybits
+ */
+static int TestXor(uint64_t nbits, uint64_t keybits) {
+   BitStream *bs, *key, *want, *got;
+   uint64_t   i;
+   unsigned   t;
+   int        failed = 0;
+
+   bs = RandomStream(nbits);
+   key = RandomStream(keybits);
+   want = bs && key ? BitStreamExclusiveOr(bs, key) : NULL;
+   if (want == NULL)
+      return 1;
+
+   for (t = 0; t < sizeof(Threads) / sizeof(Threads[0]); t++) {
+      got = BitStreamExclusiveOrParallel(bs, key, Threads[t]);
+      if (!Same(got, want))
+         failed = 1;
+      BitStreamDelete(got);
+   }
+
+   /* the stream as its own key */
+   if (nbits % BITS_PER_BYTE == 0) {
+      got = BitStreamExclusiveOrParallel(bs, bs, 3);
+      for (i = 0; got && i < nbits / BITS_PER_BYTE; i++)
+         if (got->array[i])
+            break;
+      if (got == NULL || got->nbits != nbits || i != nbits / BITS_PER_BYTE)
+         failed = 1;
+      BitStreamDelete(got);
+   }
+
+   if (failed)
+      fprintf(stderr, "xor of %llu bits with a %llu bit key: mismatch\n",
+		      (unsigned long long)nbits, (unsigned long long)keybits);
+   BitStreamDelete(want);
+   BitStreamDelete(key);
+   BitStreamDelete(bs);
+   return failed;
+}
+
+int main(void) {
+   static const size_t Bytes[] = {
+      1, 2, 3, 1000, T - 1, T, T + 1, 2 * T - 1, 2 * T, 2 * T + 1
+   };
+   static const uint64_t Keys[] = {
+      8, 24, 32, 8 * 4096, 8 * 4097, 8 * 5000, 8 * 3, 8 * (T + 5), 12, 37
+   };
+   unsigned b, k;
+   int      failed = 0;
+
+   for (b = 0; b < sizeof(Bytes) / sizeof(Bytes[0]); b++) {
+      failed += TestHex(2 * Bytes[b]);
+      failed += TestHex(2 * Bytes[b] - 1);
+      failed += TestHex(2 * Bytes[b] + 1);
+   }
+   failed += TestHex(0);
+
+   /* groups of 3 bytes, T / 3 groups a chunk */
+   for (b = 0; b < sizeof(Bytes) / sizeof(Bytes[0]); b++) {
+      failed += TestBase64(Bytes[b] * BITS_PER_BYTE);
+      failed += TestBase64(Bytes[b] * BITS_PER_BYTE + 5);
+   }
+   failed += TestBase64(T / 3 * 3 * BITS_PER_BYTE);
+   failed += TestBase64((T / 3 * 3 + 3) * BITS_PER_BYTE);
+
+   for (b = 0; b < sizeof(Bytes) / sizeof(Bytes[0]); b++)
+      for (k = 0; k < sizeof(Keys) / sizeof(Keys[0]); k++) {
+         /* the serial XOR is slow, chunk sized inputs take a few keys */
+         if (Bytes[b] > T && (Keys[k] % BITS_PER_BYTE || k % 3 != 1))
+            continue;
+         failed += TestXor(Bytes[b] * BITS_PER_BYTE, Keys[k]);
+         failed += TestXor(Bytes[b] * BITS_PER_BYTE + 3, Keys[k]);
+      }
+
+   printf("bulk: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+#include "BitStream.hpp"
+
+/**
+ * C++ layer against a bit by bit reference
+ *
+ * Streams of lengths around byte and word boundaries go through every
+ * operator, with named streams, temporaries and views of borrowed bytes on
+ * the left and in place on the operand itself, and each result must match
+ * the bits computed one at a time. The file is compiled with the namespace
+ * pulled in, so the C typedef ::BitStream and bitstream::Stream have to
+ * live side by side.
+ */
+
+using namespace bitstream;
+
+#define MAX_BITS	300
+
+static const uint64_t Lengths[] = { 0, 1, 7, 8, 9, 63, 64, 65, 130, 299 };
+
+static uint64_t       Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+static inline int Bit(std::span<const uint8_t> buf, uint64_t i) {
+   return buf[i / BITS_PER_BYTE] >> (BITS_PER_BYTE - 1 - i % BITS_PER_BYTE) & 1;
+}
+
+/**
+ * @fn int Same(View got, const int *want, uint64_t nbits)
+ *
+ * @brief compares the bits of got with want, and the pad bits with zero
+ */
+static int Same(View got, const int *want, uint64_t nbits) {
+   uint64_t i;
+
+   if (got.size() != nbits)
+      return 0;
+   for (i = 0; i < nbits; i++)
+      if (Bit(got.bytes(), i) != want[i])
+         return 0;
+   for (; i < got.bytes().size() * BITS_PER_BYTE; i++)
+      if (Bit(got.bytes(), i))
+         return 0;
+   return 1;
+}
+
+/**
+ * @fn int TestLength(uint64_t nbits)
+ *
+ * @returns the number of mismatches
+ */
+static int TestLength(uint64_t nbits) {
+   static uint8_t bytesX[MAX_BITS / BITS_PER_BYTE + 1];
+   static uint8_t bytesY[MAX_BITS / BITS_PER_BYTE + 1];
+   int            x[MAX_BITS], y[MAX_BITS], want[2 * MAX_BITS];
+   uint64_t       i, n, size = (nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+   int            failed = 0;
+
+   for (i = 0; i < sizeof(bytesX); i++) {
+      bytesX[i] = (uint8_t)Random();
+      bytesY[i] = (uint8_t)Random();
+   }
+   for (i = 0; i < nbits; i++) {
+      x[i] = Bit(bytesX, i);
+      y[i] = Bit(bytesY, i);
+   }
+
+   /* a view of borrowed bytes on one side, a stream copied from them on the
+    * other, and the C stream under it must be reachable unqualified */
+   View   vy(std::span<const uint8_t>(bytesY, size), nbits);
+   Stream sx(View(std::span<const uint8_t>(bytesX, size), nbits));
+   const BitStream *c = sx.get();
+
+   if (nbits && (c == nullptr || c->nbits != nbits))
+      failed++;
+
+   for (i = 0; i < nbits; i++)
+      want[i] = x[i] & y[i];
+   failed += !Same(sx & vy, want, nbits);
+   failed += !Same(sx.clone() & vy, want, nbits);
+
+   for (i = 0; i < nbits; i++)
+      want[i] = x[i] | y[i];
+   failed += !Same(sx | vy, want, nbits);
+   failed += !Same(sx.clone() | vy, want, nbits);
+
+   for (i = 0; i < nbits; i++)
+      want[i] = x[i] & !y[i];
+   failed += !Same(Stream().assign_and_not(sx, vy), want, nbits);
+
+   for (i = 0; i < nbits; i++)
+      want[i] = x[i] ^ y[i];
+   failed += !Same(sx ^ vy, want, nbits);
+   failed += !Same(sx.clone() ^ vy, want, nbits);
+
+   for (i = 0; i < nbits; i++)
+      want[i] = !x[i];
+   failed += !Same(~sx, want, nbits);
+   failed += !Same(~sx.clone(), want, nbits);
+
+   /* (x & y) ^ x is x & ~y, worked out in the first temporary */
+   for (i = 0; i < nbits; i++)
+      want[i] = x[i] & !y[i];
+   failed += !Same((sx & vy) ^ sx, want, nbits);
+
+   for (n = 0; n <= nbits + 1; n += 1 + n / 3) {
+      for (i = 0; i < nbits; i++)
+         want[i] = i + n < nbits ? x[i + n] : 0;
+      failed += !Same(sx << n, want, nbits);
+      failed += !Same(sx.clone() << n, want, nbits);
+
+      for (i = 0; i < nbits; i++)
+         want[i] = i >= n ? x[i - n] : 0;
+      failed += !Same(sx >> n, want, nbits);
+      failed += !Same(sx.clone() >> n, want, nbits);
+
+      if (nbits == 0)
+         continue;
+      for (i = 0; i < nbits; i++)
+         want[i] = x[(i + n) % nbits];
+      failed += !Same(Stream().assign_rotate_left(sx, n), want, nbits);
+      for (i = 0; i < nbits; i++)
+         want[i] = x[(i + nbits - n % nbits) % nbits];
+      failed += !Same(Stream().assign_rotate_right(sx, n), want, nbits);
+   }
+
+   for (i = 0; i < nbits; i++) {
+      want[i] = x[i];
+      want[nbits + i] = y[i];
+   }
+   failed += !Same(concat(sx, vy), want, 2 * nbits);
+
+   /* in place on the operand itself, x ^ x is zero, x appended to itself
+    * is x twice */
+   Stream s = sx.clone();
+
+   s ^= s;
+   for (i = 0; i < nbits; i++)
+      want[i] = 0;
+   failed += !Same(s, want, nbits);
+
+   s = sx.clone();
+   s.append(s);
+   for (i = 0; i < nbits; i++)
+      want[i] = want[nbits + i] = x[i];
+   failed += !Same(s, want, 2 * nbits);
+
+   /* a view of the stream's own bytes makes the result a new stream */
+   s = sx.clone();
+   s.assign_concat(s, View(s.bytes(), nbits));
+   failed += !Same(s, want, 2 * nbits);
+
+   /* moved from is empty and usable again */
+   Stream t = std::move(s);
+
+   failed += !Same(t, want, 2 * nbits);
+   failed += s.get() != nullptr || !s.empty();
+   s = sx.clone();
+   failed += !Same(s, x, nbits);
+
+   if (failed)
+      fprintf(stderr, "%llu bits: %d mismatches\n", (unsigned long long)nbits,
+		      failed);
+   return failed;
+}
+
+/**
+ * @fn int TestErrors(void)
+ *
+ * @brief bad operands throw, and leave the left operand as it was
+ */
+static int TestErrors(void) {
+   static const uint8_t Bytes[] = { 0x12, 0x34, 0xAB, 0xCD };
+   Stream               s = Stream::from_hex("1234abCD");
+   int                  failed = 0;
+
+   if (s.size() != 32 || memcmp(s.bytes().data(), Bytes, 4) != 0)
+      failed++;
+   try {
+      s &= View(std::span<const uint8_t>(Bytes, 2));
+      failed++;
+   } catch (const std::invalid_argument &) {
+   }
+   try {
+      (void)Stream::from_hex("12x4");
+      failed++;
+   } catch (const std::invalid_argument &) {
+   }
+   try {
+      (void)View(std::span<const uint8_t>(Bytes, 1), 9);
+      failed++;
+   } catch (const std::invalid_argument &) {
+   }
+   if (s.size() != 32 || memcmp(s.bytes().data(), Bytes, 4) != 0)
+      failed++;
+
+   /* a view of a string is its characters */
+   if (Stream(std::string_view("abc")).bytes().size() != 3 ||
+       Stream(std::string_view("abc"))[1] != 1 ||
+       Stream(std::string_view("abc"))[0] != 0)
+      failed++;
+
+   if (failed)
+      fprintf(stderr, "errors: %d mismatches\n", failed);
+   return failed;
+}
+
+int main(void) {
+   unsigned l;
+   int      failed = 0;
+
+   for (l = 0; l < sizeof(Lengths) / sizeof(Lengths[0]); l++)
+      failed += TestLength(Lengths[l]);
+   failed += TestErrors();
+
+   printf("cpp: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
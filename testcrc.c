@@ -0,0 +1,90 @@
+#include "BitStream.h"
+#include "BitStreamCrc.h"
+
+/**
+ * Check values of CRC32 and CRC32C
+ *
+ * Every implementation this cpu has must give the catalogued check value
+ * of "123456789". The carry-less multiply path only folds buffers of 64
+ * bytes and more, so a longer buffer is also summed by each and compared
+ * against the tables.
+ */
+
+#define CHECK_CRC32	0xCBF43926u
+#define CHECK_CRC32C	0xE3069283u
+
+/**
+ * @def LONG_BYTES
+ * @brief length of the buffer folded by the SIMD paths, not a multiple of
+ * 	the fold block so the tail is handled too
+ */
+#define LONG_BYTES	4099
+
+static const uint8_t Check[] = "123456789";
+
+static uint8_t       Long[LONG_BYTES];
+
+/**
+ * @fn int Expect(const char *name, const char *what, uint32_t got,
+ * 	uint32_t want)
+ *
+ * @brief compares a checksum against the expected one
+ */
+static int Expect(const char *name, const char *what, uint32_t got,
+	uint32_t want) {
+   if (got == want)
+      return 0;
+
+   fprintf(stderr, "%s: %s is %08x, expected %08x\n", name, what, got, want);
+   return 1;
+}
+
+/**
+ * @fn int TestImpl(BitStreamCrcImpl impl, const char *name,
+ * 	uint32_t crc32, uint32_t crc32c)
+ *
+ * @brief runs the check values and the long buffer through one
+ * 	implementation, crc32 and crc32c are the sums of the long buffer
+ *
+ * @returns number of failures, 0 if the implementation is not available
+ */
+static int TestImpl(BitStreamCrcImpl impl, const char *name,
+	uint32_t crc32, uint32_t crc32c) {
+   int failed = 0;
+
+   if (BitStreamCrcSelect(impl) != impl) {
+      printf("%s: not available, skipped\n", name);
+      return 0;
+   }
+   failed += Expect(name, "crc32 check", BitStreamCrc32Update(0, Check, 9),
+		   CHECK_CRC32);
+   failed += Expect(name, "crc32c check", BitStreamCrc32cUpdate(0, Check, 9),
+		   CHECK_CRC32C);
+   failed += Expect(name, "crc32 long",
+		   BitStreamCrc32Update(0, Long, LONG_BYTES), crc32);
+   failed += Expect(name, "crc32c long",
+		   BitStreamCrc32cUpdate(0, Long, LONG_BYTES), crc32c);
+
+   printf("%s: %s\n", name, failed ? "FAILED" : "ok");
+   return failed;
+}
+
+int main(void) {
+   uint32_t crc32, crc32c;
+   size_t   i;
+   int      failed = 0;
+
+   for (i = 0; i < LONG_BYTES; i++)
+      Long[i] = (uint8_t)(i * 131 + (i >> 7));
+
+   /* the tables are the reference for the long buffer */
+   BitStreamCrcSelect(BITSTREAM_CRC_TABLE);
+   crc32 = BitStreamCrc32Update(0, Long, LONG_BYTES);
+   crc32c = BitStreamCrc32cUpdate(0, Long, LONG_BYTES);
+
+   failed += TestImpl(BITSTREAM_CRC_TABLE, "table", crc32, crc32c);
+   failed += TestImpl(BITSTREAM_CRC_SSE42, "sse4.2", crc32, crc32c);
+   failed += TestImpl(BITSTREAM_CRC_PCLMUL, "pclmul", crc32, crc32c);
+
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BitStream.h"
+#include "BitStreamFile.h"
+
+/**
+ * Saving and mapping container files
+ *
+ * Streams of several lengths are saved, with and without a checksum, and
+ * mapped back with the bit order they were saved with. Saving over a file
+ * that is mapped must leave the mapped stream as it was, a save that
+ * cannot replace its target must fail without touching it, and no
+ * temporary file may be left behind either way.
+ */
+
+static uint64_t Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+/**
+ * @fn BitStream* RandomStream(uint64_t nbits)
+ *
+ * @brief stream of nbits random bits
+ */
+static BitStream* RandomStream(uint64_t nbits) {
+   BitStream *bs = BitStreamCreate(nbits);
+   uint64_t   i;
+
+   for (i = 0; bs && i < (nbits + 7) / BITS_PER_BYTE; i++)
+      bs->array[i] = (uint8_t)Random();
+   return bs;
+}
+
+/**
+ * @fn int Same(BitStream *x, BitStream *y)
+ *
+ * @brief 1 if both streams hold the same whole bytes and length
+ */
+static int Same(BitStream *x, BitStream *y) {
+   return x && y && x->nbits == y->nbits && (x->nbits < BITS_PER_BYTE ||
+	  memcmp(x->array, y->array, x->nbits / BITS_PER_BYTE) == 0);
+}
+
+/**
+ * @fn int Exists(const char *path)
+ *
+ * @brief 1 if path names a file or a directory
+ */
+static int Exists(const char *path) {
+   struct stat st;
+
+   return stat(path, &st) == 0;
+}
+
+int main(void) {
+   static const uint64_t Lengths[] = { 0, 1, 8, 13, 4096 * 8 + 3, 100000 };
+   char               path[] = "testfileXXXXXX";
+   char               tmp[sizeof(path) + 4];
+   BitStream         *bs, *old, *mapped, *remapped;
+   BitStreamBitOrder  order;
+   unsigned           l, flags;
+   int                fd, failed = 0;
+
+   fd = mkstemp(path);
+   if (fd < 0)
+      return 1;
+   close(fd);
+   sprintf(tmp, "%s.tmp", path);
+
+   for (l = 0; l < sizeof(Lengths) / sizeof(Lengths[0]); l++)
+      for (flags = 0; flags <= BITSTREAM_FILE_CRC; flags++) {
+         bs = RandomStream(Lengths[l]);
+         order = l % 2 ? BITSTREAM_LSB_FIRST : BITSTREAM_MSB_FIRST;
+         if (bs == NULL || BitStreamFileSave(bs, path, order, flags) != 0)
+            failed = 1;
+         order = l % 2 ? BITSTREAM_MSB_FIRST : BITSTREAM_LSB_FIRST;
+         mapped = BitStreamFileMap(path, &order, BITSTREAM_FILE_CRC);
+         if (!Same(mapped, bs) || order != (l % 2 ? BITSTREAM_LSB_FIRST :
+					    BITSTREAM_MSB_FIRST) ||
+             Exists(tmp)) {
+            fprintf(stderr, "%llu bits, flags %u: mismatch\n",
+			    (unsigned long long)Lengths[l], flags);
+            failed = 1;
+         }
+         BitStreamDelete(mapped);
+         BitStreamDelete(bs);
+      }
+
+   /* a new save replaces the file, not the pages already mapped */
+   old = RandomStream(100000);
+   bs = RandomStream(40);
+   if (old == NULL || bs == NULL ||
+       BitStreamFileSave(old, path, BITSTREAM_MSB_FIRST, 0) != 0)
+      return 1;
+   mapped = BitStreamFileMap(path, NULL, 0);
+   if (BitStreamFileSave(bs, path, BITSTREAM_MSB_FIRST, 0) != 0)
+      failed = 1;
+   remapped = BitStreamFileMap(path, NULL, 0);
+   if (!Same(mapped, old) || !Same(remapped, bs)) {
+      fprintf(stderr, "save over a mapped file: mismatch\n");
+      failed = 1;
+   }
+   BitStreamDelete(remapped);
+   BitStreamDelete(mapped);
+
+   /* a directory in the way of the rename */
+   unlink(path);
+   if (mkdir(path, 0700) == 0) {
+      if (BitStreamFileSave(bs, path, BITSTREAM_MSB_FIRST, 0) != -1 ||
+          Exists(tmp)) {
+         fprintf(stderr, "failed save: not reported or not cleaned up\n");
+         failed = 1;
+      }
+      rmdir(path);
+   }
+   BitStreamDelete(bs);
+   BitStreamDelete(old);
+
+   printf("file: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
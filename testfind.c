@@ -0,0 +1,159 @@
+#include "BitStream.h"
+#include "BitStreamFind.h"
+
+/**
+ * Bit pattern search against a naive bit by bit search
+ *
+ * Patterns of 1 to 200 bits are cut out of the data at offsets chosen to
+ * straddle the 32 byte blocks of the SIMD scan and the end of the stream
+ * (whose length is not a whole number of bytes), then searched from every
+ * start offset 0..7 and from around the place they were cut from. Random
+ * data gives mostly single matches, data over a 2 byte alphabet gives many
+ * overlapping ones.
+ */
+
+#define DATA_BYTES	300
+#define MAX_MATCHES	(DATA_BYTES * BITS_PER_BYTE)
+
+static const uint32_t Lengths[] = {
+   1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 63, 64, 65, 100, 129, 200
+};
+
+static uint8_t        Data[DATA_BYTES];
+
+static uint64_t       Seed = 88172645463325252ull;
+
+static uint32_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return (uint32_t)(Seed >> 32);
+}
+
+static inline int Bit(const uint8_t *buf, uint64_t i) {
+   return buf[i / BITS_PER_BYTE] >> (BITS_PER_BYTE - 1 - i % BITS_PER_BYTE) & 1;
+}
+
+/**
+ * @fn uint64_t Naive(BitStream *bs, const uint8_t *pattern, uint32_t len,
+ * 	uint64_t start, uint64_t *offsets)
+ *
+ * @brief every offset from start on where the pattern matches bit by bit
+ */
+static uint64_t Naive(BitStream *bs, const uint8_t *pattern, uint32_t len,
+	uint64_t start, uint64_t *offsets) {
+   uint64_t o, n = 0;
+   uint32_t b;
+
+   for (o = start; o + len <= bs->nbits; o++) {
+      for (b = 0; b < len && Bit(bs->array, o + b) == Bit(pattern, b); b++)
+         ;
+      if (b == len)
+         offsets[n++] = o;
+   }
+   return n;
+}
+
+/**
+ * @fn int Search(BitStream *bs, const uint8_t *pattern, uint32_t len,
+ * 	uint64_t start)
+ *
+ * @brief compares the find routines with the naive search from start
+ *
+ * @returns 0 if they agree, 1 otherwise
+ */
+static int Search(BitStream *bs, const uint8_t *pattern, uint32_t len,
+	uint64_t start) {
+   static uint64_t want[MAX_MATCHES], got[MAX_MATCHES];
+   uint64_t        n, m, limit;
+   int64_t         first;
+
+   n = Naive(bs, pattern, len, start, want);
+   first = BitStreamFindBits(bs, pattern, len, start);
+   m = BitStreamFindAllBits(bs, pattern, len, start, got, MAX_MATCHES);
+
+   if (first != (n ? (int64_t)want[0] : -1) || m != n ||
+       memcmp(got, want, n * sizeof(uint64_t)) != 0 ||
+       BitStreamFindAllBits(bs, pattern, len, start, NULL, MAX_MATCHES) != n)
+      goto mismatch;
+
+   /* a full offsets array stops the search at the first matches */
+   limit = n / 2;
+   if (limit && (BitStreamFindAllBits(bs, pattern, len, start, got,
+				   limit) != limit ||
+	         memcmp(got, want, limit * sizeof(uint64_t)) != 0))
+      goto mismatch;
+   return 0;
+
+mismatch:
+   fprintf(stderr, "%u bit pattern from %llu in %llu bits: mismatch\n", len,
+		   (unsigned long long)start, (unsigned long long)bs->nbits);
+   return 1;
+}
+
+/**
+ * @fn int TestData(BitStream *bs)
+ *
+ * @brief cuts patterns out of the stream and searches for them
+ */
+static int TestData(BitStream *bs) {
+   uint8_t  pattern[(200 + 7) / BITS_PER_BYTE + 1];
+   uint64_t from[8], start;
+   uint32_t l, f, b, len, nfrom;
+   int      failed = 0;
+
+   for (l = 0; l < sizeof(Lengths) / sizeof(Lengths[0]); l++) {
+      len = Lengths[l];
+      nfrom = 0;
+      from[nfrom++] = Random() % (bs->nbits - len + 1);
+      from[nfrom++] = bs->nbits - len;                   /* end of stream */
+      from[nfrom++] = 32 * BITS_PER_BYTE - len / 2 - 3;  /* SIMD blocks */
+      from[nfrom++] = 64 * BITS_PER_BYTE - 1;
+      from[nfrom++] = 96 * BITS_PER_BYTE + 5 - len;
+      from[nfrom++] = 0;
+
+      for (f = 0; f < nfrom; f++) {
+         if (from[f] + len > bs->nbits)
+            continue;
+
+         memset(pattern, '\0', sizeof(pattern));
+         for (b = 0; b < len; b++)
+            pattern[b / BITS_PER_BYTE] |= Bit(bs->array, from[f] + b) <<
+		    (BITS_PER_BYTE - 1 - b % BITS_PER_BYTE);
+
+         for (start = 0; start < BITS_PER_BYTE; start++)
+            failed += Search(bs, pattern, len, start);
+         failed += Search(bs, pattern, len, from[f]);
+         failed += Search(bs, pattern, len, from[f] + 1);
+      }
+   }
+   return failed;
+}
+
+int main(void) {
+   BitStream *bs;
+   uint32_t   i, tail;
+   int        failed = 0;
+
+   bs = BitStreamCreate(DATA_BYTES * BITS_PER_BYTE);
+   if (bs == NULL)
+      return 1;
+
+   for (tail = 0; tail < BITS_PER_BYTE; tail++) {
+      bs->nbits = DATA_BYTES * BITS_PER_BYTE - tail;
+
+      for (i = 0; i < DATA_BYTES; i++)
+         Data[i] = (uint8_t)Random();
+      memcpy(bs->array, Data, DATA_BYTES);
+      failed += TestData(bs);
+
+      for (i = 0; i < DATA_BYTES; i++)
+         Data[i] = Random() & 1 ? 0xA5 : 0x5A;
+      memcpy(bs->array, Data, DATA_BYTES);
+      failed += TestData(bs);
+   }
+   BitStreamDelete(bs);
+
+   printf("find: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
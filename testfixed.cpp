@@ -0,0 +1,188 @@
+#include <utility>
+
+#include "BitStreamFixed.hpp"
+
+/**
+ * Fixed size streams at compile time and at run time
+ *
+ * The static_asserts decode hex and Base64, read and write fields and
+ * encode the result back in constant expressions, so they go through the
+ * byte at a time paths. The run time part reads and writes fields of every
+ * shape at start offsets 0..7 into a stream of random bytes, fields within
+ * one byte, within eight and straddling a ninth, and compares each with the
+ * bits taken one at a time, which goes through the word load and store.
+ */
+
+using namespace bitstream;
+
+typedef FixedBitStream<203> Fixed;
+
+static constexpr bool Equal(const char *s, std::string_view t) {
+   return std::string_view(s) == t;
+}
+
+/* 128 bit key, hex in and out, fields aligned, in a word and over 9 bytes */
+static constexpr auto Key =
+	FixedBitStream<128>::from_hex("000102030405060708090A0B0C0D0E0F");
+
+static_assert(Equal(Key.hex().data(), "000102030405060708090a0b0c0d0e0f"));
+static_assert(Equal(Key.base64().data(), "AAECAwQFBgcICQoLDA0ODw=="));
+static_assert(FixedBitStream<128>::from_base64("AAECAwQFBgcICQoLDA0ODw==") ==
+	      Key);
+static_assert(Key.get<8, 64>() == 0x0102030405060708ull);
+static_assert(Key.get<4, 64>() == 0x0010203040506070ull);
+static_assert(Key.get<60, 8>() == 0x70);
+static_assert(Key.get<127, 1>() == 1 && Key[124] && !Key[123]);
+
+/* 40 bits, Base64 with one padding character */
+static_assert(Equal(FixedBitStream<40>::from_hex("abcdef0123").base64().data(),
+		    "q83vASM="));
+static_assert(FixedBitStream<40>::from_base64("q83vASM=").get<0, 40>() ==
+	      0xabcdef0123ull);
+
+/* the bits past NBits are cleared */
+static_assert(Equal(FixedBitStream<12>::from_hex("abcd").hex().data(),
+		    "abc0"));
+
+/* a 64 bit field over 9 bytes written, everything around it left zero */
+static constexpr FixedBitStream<72> Put(void) {
+   FixedBitStream<72> s;
+
+   s.put<3, 64>(0x8123456789abcdefull);
+   return s;
+}
+
+static_assert(Put().get<3, 64>() == 0x8123456789abcdefull);
+static_assert(Equal(Put().hex().data(), "102468acf13579bde0"));
+static_assert(Put().get<0, 3>() == 0 && Put().get<67, 5>() == 0);
+
+static uint64_t Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+/**
+ * @fn uint64_t Field(const Fixed &s, uint64_t offset, unsigned width)
+ *
+ * @brief the field read a bit at a time
+ */
+static uint64_t Field(const Fixed &s, uint64_t offset, unsigned width) {
+   uint64_t v = 0;
+   unsigned b;
+
+   for (b = 0; b < width; b++)
+      v = v << 1 | s[offset + b];
+   return v;
+}
+
+/**
+ * @fn int TestField(const Fixed &s)
+ *
+ * @brief get and put of the Width bits at Offset against Field()
+ *
+ * @returns 0 on success, 1 on mismatch
+ */
+template <uint64_t Offset, unsigned Width>
+static int TestField(const Fixed &s) {
+   Fixed    t = s;
+   uint64_t v = Random(), mask = fixed::Mask(Width), i;
+   int      failed = 0;
+
+   if (s.get<Offset, Width>() != Field(s, Offset, Width))
+      failed = 1;
+
+   t.put<Offset, Width>(v);
+   if (t.get<Offset, Width>() != (v & mask) ||
+       Field(t, Offset, Width) != (v & mask))
+      failed = 1;
+   for (i = 0; i < Fixed::nbits; i++)
+      if ((i < Offset || i >= Offset + Width) && t[i] != s[i])
+         failed = 1;
+
+   if (failed)
+      fprintf(stderr, "%u bit field at %llu: mismatch\n", Width,
+		      (unsigned long long)Offset);
+   return failed;
+}
+
+/**
+ * @fn int TestShifts(const Fixed &s)
+ *
+ * @brief Width bit fields starting Base plus 0..7 bits in
+ */
+template <uint64_t Base, unsigned Width>
+static int TestShifts(const Fixed &s) {
+   return [&]<size_t... R>(std::index_sequence<R...>) {
+      return (TestField<Base + R, Width>(s) + ...);
+   }(std::make_index_sequence<BITS_PER_BYTE>());
+}
+
+template <uint64_t Base, unsigned... Widths>
+static int TestWidths(const Fixed &s) {
+   return (TestShifts<Base, Widths>(s) + ...);
+}
+
+/**
+ * @fn int TestCodecs(const Fixed &s)
+ *
+ * @brief hex and Base64 round trips at run time, bad text throws
+ */
+static int TestCodecs(const Fixed &s) {
+   int failed = 0;
+
+   if (Fixed::from_hex(s.hex().data()) != s ||
+       Fixed::from_base64(s.base64().data()) != s)
+      failed++;
+   try {
+      (void)FixedBitStream<16>::from_hex("12g4");
+      failed++;
+   } catch (const std::invalid_argument &) {
+   }
+   try {
+      (void)FixedBitStream<16>::from_hex("123");
+      failed++;
+   } catch (const std::invalid_argument &) {
+   }
+   try {
+      (void)FixedBitStream<16>::from_base64("EjQ");
+      failed++;
+   } catch (const std::invalid_argument &) {
+   }
+
+   /* the view covers NBits bits, and works with the owning stream */
+   Stream c(s.view());
+
+   if (c.size() != Fixed::nbits || (c ^ s).bytes().size() != Fixed::nbytes ||
+       memcmp(c.bytes().data(), s.data(), Fixed::nbytes) != 0)
+      failed++;
+
+   if (failed)
+      fprintf(stderr, "codecs: %d mismatches\n", failed);
+   return failed;
+}
+
+int main(void) {
+   std::array<uint8_t, Fixed::nbytes> bytes;
+   unsigned                           round;
+   int                                failed = 0;
+
+   for (round = 0; round < 16; round++) {
+      for (auto &b : bytes)
+         b = (uint8_t)Random();
+      Fixed s(bytes);
+
+      failed += TestWidths<0, 1, 5, 8, 13, 32, 57, 63, 64>(s);
+      failed += TestWidths<61, 1, 7, 9, 31, 56, 60, 64>(s);
+      failed += TestWidths<131, 2, 16, 33, 58, 64>(s);
+      failed += TestField<139, 64>(s);
+      failed += TestField<202, 1>(s);
+      failed += TestCodecs(s);
+   }
+
+   printf("fixed: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+#include "BitStream.h"
+#include "BitStreamHistogram.h"
+
+/**
+ * Histograms against naive counts
+ *
+ * Buffers below and above HISTOGRAM_BANKED_MIN and the bigram bank
+ * threshold, of random bytes, of a few letters and of a single value, with
+ * a trailing partial byte and from misaligned pointers, are counted by
+ * byte, by column (1 to 40 columns and a few more) and by bigram, into
+ * results filled with junk beforehand. A batch of records of all lengths,
+ * with missing ones, is counted on one thread and on several. Every count
+ * must equal a byte at a time count.
+ */
+
+#define MAX_SIZE	((1 << 18) + 4099)
+#define MAX_COLUMNS	97
+
+static const size_t   Sizes[] = {
+   0, 1, 2, 9, 1000, 1023, 1024, 1025, 4099, (1 << 18) - 1, 1 << 18,
+   MAX_SIZE
+};
+
+static uint8_t        Data[MAX_SIZE + 8];
+
+static uint64_t       Want[HISTOGRAM_BIGRAMS], Got[HISTOGRAM_BIGRAMS];
+
+static BitStreamHistogram WantCol[MAX_COLUMNS], GotCol[MAX_COLUMNS];
+
+static uint64_t       Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+/**
+ * @fn BitStream* Wrap(const uint8_t *buf, size_t size)
+ *
+ * @brief stream of the size bytes at buf and 5 more bits
+ */
+static BitStream* Wrap(const uint8_t *buf, size_t size) {
+   BitStream *bs = BitStreamCreate(size * BITS_PER_BYTE + 5);
+
+   if (bs)
+      memcpy(bs->array, buf, size + 1);
+   return bs;
+}
+
+/**
+ * @fn int TestBuffer(const uint8_t *buf, size_t size)
+ *
+ * @brief byte, column and bigram counts of the size bytes at buf
+ *
+ * @returns 0 on success, 1 on mismatch
+ */
+static int TestBuffer(const uint8_t *buf, size_t size) {
+   BitStream *bs;
+   uint32_t   columns;
+   size_t     i;
+   int        failed = 0;
+
+   bs = Wrap(buf, size);
+   if (bs == NULL)
+      return 1;
+
+   memset(Want, '\0', 256 * sizeof(uint64_t));
+   for (i = 0; i < size; i++)
+      Want[buf[i]]++;
+   memset(Got, 0xA5, 256 * sizeof(uint64_t));
+   BitStreamHistogramBytes(buf, size, Got);
+   if (memcmp(Got, Want, 256 * sizeof(uint64_t)) != 0)
+      failed = 1;
+   memset(Got, 0xA5, 256 * sizeof(uint64_t));
+   if (BitStreamByteHistogram(bs, Got) != size ||
+       memcmp(Got, Want, 256 * sizeof(uint64_t)) != 0)
+      failed = 1;
+
+   for (columns = 1; columns <= MAX_COLUMNS && !failed;
+        columns += columns < 40 ? 1 : 57 - columns % 57) {
+      memset(WantCol, '\0', columns * sizeof(BitStreamHistogram));
+      for (i = 0; i < size; i++)
+         WantCol[i % columns][buf[i]]++;
+      memset(GotCol, 0xA5, columns * sizeof(BitStreamHistogram));
+      if (BitStreamColumnHistogram(bs, columns, GotCol) != size ||
+          memcmp(GotCol, WantCol, columns * sizeof(BitStreamHistogram)) != 0)
+         failed = 1;
+   }
+   if (BitStreamColumnHistogram(bs, 0, GotCol) != 0)
+      failed = 1;
+
+   memset(Want, '\0', sizeof(Want));
+   for (i = 0; i + 1 < size; i++)
+      Want[buf[i] << 8 | buf[i + 1]]++;
+   memset(Got, 0xA5, sizeof(Got));
+   if (BitStreamBigramHistogram(bs, Got) != (size ? size - 1 : 0) ||
+       memcmp(Got, Want, sizeof(Want)) != 0)
+      failed = 1;
+
+   if (failed)
+      fprintf(stderr, "%zu bytes: mismatch\n", size);
+   BitStreamDelete(bs);
+   return failed;
+}
+
+/**
+ * @fn int TestBatch(size_t n, unsigned nthreads)
+ *
+ * @brief byte histograms of n records of random lengths
+ */
+static int TestBatch(size_t n, unsigned nthreads) {
+   BitStream          **records;
+   BitStreamHistogram  *hist;
+   BitStreamHistogram   want;
+   size_t               r, i, len;
+   int                  failed = 0;
+
+   records = (BitStream **)calloc(n + 1, sizeof(BitStream *));
+   hist = (BitStreamHistogram *)malloc((n + 1) * sizeof(BitStreamHistogram));
+   if (records == NULL || hist == NULL)
+      return 1;
+
+   for (r = 0; r < n; r++)
+      if (r % 11 != 5)
+         records[r] = Wrap(Data + r % 7, Random() % 3000);
+   memset(hist, 0xA5, (n + 1) * sizeof(BitStreamHistogram));
+
+   BitStreamHistogramBatch(records, n, hist, nthreads);
+
+   for (r = 0; r < n; r++) {
+      len = records[r] ? records[r]->nbits / BITS_PER_BYTE : 0;
+      memset(want, '\0', sizeof(want));
+      for (i = 0; i < len; i++)
+         want[records[r]->array[i]]++;
+      if (memcmp(hist[r], want, sizeof(want)) != 0)
+         failed = 1;
+      BitStreamDelete(records[r]);
+   }
+   /* nothing written past the last record */
+   for (i = 0; i < 256; i++)
+      if (hist[n][i] != 0xA5A5A5A5A5A5A5A5ull)
+         failed = 1;
+
+   if (failed)
+      fprintf(stderr, "batch of %zu on %u threads: mismatch\n", n, nthreads);
+   free(hist);
+   free(records);
+   return failed;
+}
+
+int main(void) {
+   static const size_t Batches[] = { 0, 1, 63, 64, 65, 300 };
+   unsigned kind, s, b;
+   size_t   i;
+   int      failed = 0;
+
+   /* random bytes, a few letters, a single value */
+   for (kind = 0; kind < 3; kind++) {
+      for (i = 0; i < sizeof(Data); i++)
+         Data[i] = kind == 0 ? (uint8_t)Random() :
+		   kind == 1 ? (uint8_t)("etaoin "[Random() % 7]) : 'e';
+
+      for (s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); s++) {
+         failed += TestBuffer(Data, Sizes[s]);
+         if (Sizes[s] < 5000)
+            failed += TestBuffer(Data + 3, Sizes[s]);
+      }
+   }
+
+   for (b = 0; b < sizeof(Batches) / sizeof(Batches[0]); b++) {
+      failed += TestBatch(Batches[b], 1);
+      failed += TestBatch(Batches[b], 3);
+   }
+
+   printf("histogram: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,305 @@
+#include "BitStream.h"
+#include "BitStreamLogic.h"
+
+/**
+ * Whole stream logic against a bit by bit reference
+ *
+ * With the word kernels and with the AVX2 ones (skipped when the cpu lacks
+ * them), for lengths around the byte, word and 32 byte vector sizes:
+ * AND, OR, ANDNOT, XOR and NOT into a new stream, in place in either
+ * operand and into an unrelated stream; shifts and rotates by amounts from
+ * 0 to past the length, new and in place; concatenation of every pair of
+ * lengths, appending in place, prepending in place and of a stream with
+ * itself; and bit copies between any two offsets. Every result must hold
+ * the reference bits and clear bits past its end.
+ */
+
+#define MAX_BITS	4200
+
+static const uint64_t Lengths[] = {
+   0, 1, 7, 8, 9, 63, 64, 65, 255, 256, 257, 263, 1000, 4099
+};
+
+static uint8_t        X[MAX_BITS * 2], Y[MAX_BITS * 2], Want[MAX_BITS * 2];
+
+static uint64_t       Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+static inline int Bit(const uint8_t *buf, uint64_t i) {
+   return buf[i / BITS_PER_BYTE] >> (BITS_PER_BYTE - 1 - i % BITS_PER_BYTE) & 1;
+}
+
+/**
+ * @fn BitStream* Make(const uint8_t *bits, uint64_t nbits)
+ *
+ * @brief stream holding the reference bits, padded with ones
+ */
+static BitStream* Make(const uint8_t *bits, uint64_t nbits) {
+   BitStream *bs = BitStreamCreate(nbits);
+   uint64_t   i;
+
+   if (bs == NULL || nbits == 0)
+      return bs;
+   memset(bs->array, 0xFF, (nbits + 7) / BITS_PER_BYTE);
+   for (i = 0; i < nbits; i++)
+      if (!bits[i])
+         bs->array[i / BITS_PER_BYTE] &= (uint8_t)~(0x80 >> i % BITS_PER_BYTE);
+   return bs;
+}
+
+/**
+ * @fn int Check(BitStream *bs, const uint8_t *bits, uint64_t nbits,
+ * 	const char *what)
+ *
+ * @returns 0 if bs holds the nbits reference bits and zeros after them
+ */
+static int Check(BitStream *bs, const uint8_t *bits, uint64_t nbits,
+	const char *what) {
+   uint64_t i;
+
+   if (bs == NULL || bs->nbits != nbits)
+      goto mismatch;
+   for (i = 0; i < (nbits + 7) / BITS_PER_BYTE * BITS_PER_BYTE; i++)
+      if (Bit(bs->array, i) != (i < nbits ? bits[i] : 0))
+         goto mismatch;
+   return 0;
+
+mismatch:
+   fprintf(stderr, "%s of %llu bits: mismatch\n", what,
+		   (unsigned long long)nbits);
+   return 1;
+}
+
+/**
+ * @fn int TestLogic(uint64_t nbits)
+ *
+ * @brief binary operations with bx of nbits and a longer by, and NOT
+ */
+static int TestLogic(uint64_t nbits) {
+   static const char *Names[] = { "and", "or", "andnot", "xor", "not" };
+   BitStream *(*binary[4])(BitStream *, BitStream *, BitStream *) = {
+      BitStreamAnd, BitStreamOr, BitStreamAndNot, BitStreamXor
+   };
+   BitStream *bx, *by, *other, *r;
+   uint64_t   i;
+   unsigned   op, d;
+   int        failed = 0;
+
+   for (op = 0; op < 5; op++) {
+      for (i = 0; i < nbits; i++) {
+         switch (op) {
+         case 0: Want[i] = X[i] & Y[i]; break;
+         case 1: Want[i] = X[i] | Y[i]; break;
+         case 2: Want[i] = X[i] & !Y[i]; break;
+         case 3: Want[i] = X[i] ^ Y[i]; break;
+         default: Want[i] = !X[i]; break;
+         }
+      }
+
+      /* new, in bx, in by, into a stream of another length */
+      for (d = 0; d < 4; d++) {
+         if (op == 4 && d == 2)
+            continue;
+         bx = Make(X, nbits);
+         by = Make(Y, nbits + 11);
+         other = Make(Y, 3 * nbits / 2 + 5);
+         r = d == 0 ? NULL : d == 1 ? bx : d == 2 ? by : other;
+         r = op == 4 ? BitStreamNot(r, bx) : binary[op](r, bx, by);
+
+         failed += Check(r, Want, nbits, Names[op]);
+         if (d == 0)
+            BitStreamDelete(r);
+         BitStreamDelete(other);
+         BitStreamDelete(by);
+         BitStreamDelete(bx);
+      }
+   }
+
+   /* by shorter than bx is refused */
+   if (nbits) {
+      bx = Make(X, nbits);
+      by = Make(Y, nbits - 1);
+      if (BitStreamAnd(NULL, bx, by) != NULL)
+         failed += Check(NULL, Want, nbits, "short operand");
+      BitStreamDelete(by);
+      BitStreamDelete(bx);
+   }
+   return failed;
+}
+
+/**
+ * @fn int TestShift(uint64_t nbits, uint64_t n)
+ *
+ * @brief shifts and rotates nbits bits by n, into a new stream and in place
+ */
+static int TestShift(uint64_t nbits, uint64_t n) {
+   static const char *Names[] = { "shift left", "shift right", "rotate left",
+				  "rotate right" };
+   BitStream *(*shift[4])(BitStream *, BitStream *, uint64_t) = {
+      BitStreamShiftLeft, BitStreamShiftRight, BitStreamRotateLeft,
+      BitStreamRotateRight
+   };
+   BitStream *bs, *r;
+   uint64_t   i, k = nbits ? n % nbits : 0;
+   unsigned   op, inplace;
+   int        failed = 0;
+
+   for (op = 0; op < 4; op++) {
+      for (i = 0; i < nbits; i++) {
+         switch (op) {
+         case 0: Want[i] = i + n < nbits ? X[i + n] : 0; break;
+         case 1: Want[i] = i >= n ? X[i - n] : 0; break;
+         case 2: Want[i] = X[(i + k) % nbits]; break;
+         default: Want[(i + k) % nbits] = X[i]; break;
+         }
+      }
+      for (inplace = 0; inplace < 2; inplace++) {
+         bs = Make(X, nbits);
+         r = shift[op](inplace ? bs : NULL, bs, n);
+         failed += Check(r, Want, nbits, Names[op]);
+         if (r != bs)
+            BitStreamDelete(r);
+         BitStreamDelete(bs);
+      }
+   }
+   return failed;
+}
+
+/**
+ * @fn int TestConcat(uint64_t a, uint64_t b)
+ *
+ * @brief concatenates a bits and b bits every way the destination allows
+ */
+static int TestConcat(uint64_t a, uint64_t b) {
+   BitStream *bx, *by, *other, *r;
+   unsigned   d;
+   int        failed = 0;
+
+   memcpy(Want, X, a);
+   memcpy(Want + a, Y, b);
+
+   /* new, appending to bx, prepending to by, into a stream of its own */
+   for (d = 0; d < 4; d++) {
+      bx = Make(X, a);
+      by = Make(Y, b);
+      other = Make(Y, 13);
+      r = BitStreamConcat(d == 0 ? NULL : d == 1 ? bx : d == 2 ? by : other,
+		      bx, by);
+      failed += Check(r, Want, a + b, "concat");
+      if (d == 0)
+         BitStreamDelete(r);
+      BitStreamDelete(other);
+      BitStreamDelete(by);
+      BitStreamDelete(bx);
+   }
+
+   /* a stream with itself, in place and not */
+   memcpy(Want + a, X, a);
+   for (d = 0; d < 2; d++) {
+      bx = Make(X, a);
+      r = BitStreamConcat(d ? bx : NULL, bx, bx);
+      failed += Check(r, Want, 2 * a, "self concat");
+      if (r != bx)
+         BitStreamDelete(r);
+      BitStreamDelete(bx);
+   }
+   return failed;
+}
+
+/**
+ * @fn int TestCopy(uint64_t nbits)
+ *
+ * @brief copies nbits bits between random offsets
+ */
+static int TestCopy(uint64_t nbits) {
+   BitStream *src, *dst;
+   uint64_t   i, from, to;
+   unsigned   t;
+   int        failed = 0;
+
+   for (t = 0; t < 8; t++) {
+      from = Random() % 70;
+      to = Random() % 70;
+      src = Make(X, from + nbits);
+      dst = Make(Y, to + nbits + 9);
+      if (src == NULL || dst == NULL)
+         return 1;
+
+      memcpy(Want, Y, to + nbits + 9);
+      for (i = 0; i < nbits; i++)
+         Want[to + i] = X[from + i];
+      if (nbits)
+         BitStreamCopyBits(dst->array, to, src->array, from, nbits);
+      for (i = 0; i < to + nbits + 9; i++)
+         if (Bit(dst->array, i) != Want[i])
+            break;
+      if (i != to + nbits + 9) {
+         fprintf(stderr, "copy of %llu bits from %llu to %llu: mismatch\n",
+			 (unsigned long long)nbits, (unsigned long long)from,
+			 (unsigned long long)to);
+         failed = 1;
+      }
+      BitStreamDelete(dst);
+      BitStreamDelete(src);
+   }
+   return failed;
+}
+
+/**
+ * @fn int TestAll(void)
+ *
+ * @brief every operation over every length, with the kernels selected
+ */
+static int TestAll(void) {
+   uint64_t  Shifts[8];
+   unsigned  l, m, s;
+   int       failed = 0;
+
+   for (l = 0; l < sizeof(Lengths) / sizeof(Lengths[0]); l++) {
+      uint64_t nbits = Lengths[l];
+
+      for (m = 0; m < sizeof(X); m++)
+         X[m] = Random() & 1;
+      for (m = 0; m < sizeof(Y); m++)
+         Y[m] = Random() & 1;
+
+      failed += TestLogic(nbits);
+      failed += TestCopy(nbits);
+
+      Shifts[0] = 0;
+      Shifts[1] = 1;
+      Shifts[2] = 7;
+      Shifts[3] = 8;
+      Shifts[4] = 9 + Random() % 300;
+      Shifts[5] = nbits ? nbits - 1 : 3;
+      Shifts[6] = nbits;
+      Shifts[7] = nbits + 5;
+      for (s = 0; s < 8; s++)
+         failed += TestShift(nbits, Shifts[s]);
+
+      for (m = 0; m < sizeof(Lengths) / sizeof(Lengths[0]); m++)
+         failed += TestConcat(nbits, Lengths[m]);
+   }
+   return failed;
+}
+
+int main(void) {
+   int failed = 0;
+
+   BitStreamLogicSelect(BITSTREAM_LOGIC_WORD);
+   failed += TestAll();
+   if (BitStreamLogicSelect(BITSTREAM_LOGIC_AVX2) == BITSTREAM_LOGIC_AVX2)
+      failed += TestAll();
+   else
+      printf("logic: avx2 not available, skipped\n");
+   BitStreamLogicSelect(BITSTREAM_LOGIC_AUTO);
+
+   printf("logic: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+#include "BitStream.h"
+#include "BitStreamPack.h"
+
+/**
+ * Bulk pack and unpack against a bit by bit reference
+ *
+ * For the four element sizes, every width from 1 bit to the element width
+ * and a few start offsets, the packed stream must equal fields written one
+ * bit at a time (bits outside the fields left alone), unpacking must give
+ * the low width bits of each value back, and a stream too short for all
+ * the values must take as many as fit.
+ */
+
+#define COUNT		259
+#define STREAM_BITS	(COUNT * 64 + 64)
+
+static const uint64_t Offsets[] = { 0, 1, 7, 8, 13, 64 };
+
+static uint64_t       Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+static inline int Bit(const uint8_t *buf, uint64_t i) {
+   return buf[i / BITS_PER_BYTE] >> (BITS_PER_BYTE - 1 - i % BITS_PER_BYTE) & 1;
+}
+
+static inline void SetBit(uint8_t *buf, uint64_t i, int v) {
+   uint8_t m = (uint8_t)(0x80 >> i % BITS_PER_BYTE);
+
+   buf[i / BITS_PER_BYTE] = v ? buf[i / BITS_PER_BYTE] | m :
+	   buf[i / BITS_PER_BYTE] & ~m;
+}
+
+/**
+ * @fn uint64_t Pack(BitStream *bs, uint64_t offset, const uint64_t *v,
+ * 	unsigned size, uint64_t count, uint32_t width)
+ *
+ * @brief calls the pack routine of the element size on v narrowed to it
+ */
+static uint64_t Pack(BitStream *bs, uint64_t offset, const uint64_t *v,
+	unsigned size, uint64_t count, uint32_t width) {
+   uint8_t  v8[COUNT];
+   uint16_t v16[COUNT];
+   uint32_t v32[COUNT];
+   uint64_t i;
+
+   for (i = 0; i < count; i++) {
+      v8[i] = (uint8_t)v[i];
+      v16[i] = (uint16_t)v[i];
+      v32[i] = (uint32_t)v[i];
+   }
+   switch (size) {
+   case 1: return BitStreamPack8(bs, offset, v8, count, width);
+   case 2: return BitStreamPack16(bs, offset, v16, count, width);
+   case 4: return BitStreamPack32(bs, offset, v32, count, width);
+   default: return BitStreamPack64(bs, offset, v, count, width);
+   }
+}
+
+/**
+ * @fn uint64_t Unpack(BitStream *bs, uint64_t offset, uint64_t *v,
+ * 	unsigned size, uint64_t count, uint32_t width)
+ *
+ * @brief calls the unpack routine of the element size, widened into v
+ */
+static uint64_t Unpack(BitStream *bs, uint64_t offset, uint64_t *v,
+	unsigned size, uint64_t count, uint32_t width) {
+   uint8_t  v8[COUNT];
+   uint16_t v16[COUNT];
+   uint32_t v32[COUNT];
+   uint64_t i, n;
+
+   switch (size) {
+   case 1: n = BitStreamUnpack8(bs, offset, v8, count, width); break;
+   case 2: n = BitStreamUnpack16(bs, offset, v16, count, width); break;
+   case 4: n = BitStreamUnpack32(bs, offset, v32, count, width); break;
+   default: return BitStreamUnpack64(bs, offset, v, count, width);
+   }
+   for (i = 0; i < n; i++)
+      v[i] = size == 1 ? v8[i] : size == 2 ? v16[i] : v32[i];
+   return n;
+}
+
+/**
+ * @fn int TestWidth(unsigned size, uint32_t width, uint64_t offset)
+ *
+ * @returns 0 on success, 1 on mismatch
+ */
+static int TestWidth(unsigned size, uint32_t width, uint64_t offset) {
+   uint64_t   values[COUNT], got[COUNT], mask, i, n, fit;
+   uint8_t    want[STREAM_BITS / BITS_PER_BYTE];
+   BitStream *bs;
+   uint32_t   b;
+   int        failed = 0;
+
+   mask = width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+   bs = BitStreamCreate(STREAM_BITS);
+   if (bs == NULL)
+      return 1;
+
+   for (i = 0; i < COUNT; i++)
+      values[i] = Random();
+   for (i = 0; i < STREAM_BITS / BITS_PER_BYTE; i++)
+      bs->array[i] = want[i] = (uint8_t)Random();
+
+   for (i = 0; i < COUNT; i++)
+      for (b = 0; b < width; b++)
+         SetBit(want, offset + i * width + b,
+		(int)(values[i] >> (width - 1 - b) & 1));
+
+   if (Pack(bs, offset, values, size, COUNT, width) != COUNT ||
+       memcmp(bs->array, want, sizeof(want)) != 0)
+      failed = 1;
+
+   memset(got, '\0', sizeof(got));
+   if (Unpack(bs, offset, got, size, COUNT, width) != COUNT)
+      failed = 1;
+   for (i = 0; i < COUNT; i++)
+      if (got[i] != (values[i] & mask))
+         failed = 1;
+
+   /* a stream ending within field fit takes the fields before it */
+   fit = COUNT / 3;
+   bs->nbits = offset + fit * width + width / 2;
+   if (Pack(bs, offset, values, size, COUNT, width) != fit ||
+       Unpack(bs, offset, got, size, COUNT, width) != fit)
+      failed = 1;
+   for (n = 0; n < offset + fit * width; n++)
+      if (Bit(bs->array, n) != Bit(want, n))
+         failed = 1;
+
+   if (failed)
+      fprintf(stderr, "%u byte elements, width %u, offset %llu: mismatch\n",
+		      size, width, (unsigned long long)offset);
+   BitStreamDelete(bs);
+   return failed;
+}
+
+int main(void) {
+   static const unsigned Sizes[] = { 1, 2, 4, 8 };
+   unsigned s, o;
+   uint32_t width;
+   int      failed = 0;
+
+   for (s = 0; s < 4; s++)
+      for (width = 1; width <= Sizes[s] * BITS_PER_BYTE; width++)
+         for (o = 0; o < sizeof(Offsets) / sizeof(Offsets[0]); o++)
+            failed += TestWidth(Sizes[s], width, Offsets[o]);
+
+   printf("pack: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
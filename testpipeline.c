@@ -0,0 +1,203 @@
+#include <unistd.h>
+
+#include "BitStream.h"
+#include "BitStreamBlocks.h"
+#include "BitStreamCorpus.h"
+#include "BitStreamPipeline.h"
+#include "BitStreamScore.h"
+
+/**
+ * Staged pipeline against the in-memory corpus searches
+ *
+ * A file of hex records spanning many pipeline batches is written, with
+ * the same plaintexts under the same and under different keys on lines
+ * spread over several batches (so that candidates tie on score across
+ * them), blocks repeated the same number of times in many records, empty
+ * and non hex lines, and a last line without a newline. The single byte
+ * XOR search and the ECB detection are run over it by
+ * BitStreamCorpusSingleByteXor() and BitStreamCorpusDetectEcb() and by a
+ * BitStreamPipeline, on one thread and on several; every run must keep the
+ * same candidates in the same order, and the pipeline the records they
+ * came from.
+ */
+
+#define LINES		2000
+#define CAPACITY	12
+#define AES_BLOCKSIZE	16
+
+static const char    *Texts[] = {
+   "Now that the party is jumping",
+   "Cooking MC's like a pound of bacon",
+   "the quick brown fox jumps over the lazy dog",
+   "It was the best of times, it was the worst of times"
+};
+
+static uint64_t       Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+/**
+ * @fn void WriteHex(FILE *fp, const uint8_t *buf, size_t size)
+ *
+ * @brief writes size bytes as hex digits
+ */
+static void WriteHex(FILE *fp, const uint8_t *buf, size_t size) {
+   size_t i;
+
+   for (i = 0; i < size; i++)
+      fprintf(fp, "%02x", buf[i]);
+}
+
+/**
+ * @fn int WriteFile(const char *path)
+ *
+ * @brief writes the records, XOR ones first and ECB like ones after
+ */
+static int WriteFile(const char *path) {
+   uint8_t  buf[8 * AES_BLOCKSIZE];
+   FILE    *fp;
+   size_t   len, i;
+   unsigned line, t, key, repeats;
+
+   fp = fopen(path, "w");
+   if (fp == NULL)
+      return (-1);
+
+   for (line = 0; line < LINES; line++) {
+      if (line % 97 == 13) {
+         fputs(line % 2 ? "\n" : "not hex at all\n", fp);
+         continue;
+      }
+      if (line < LINES / 2) {
+         /* now and then a text under one of two keys, else random bytes */
+         t = (unsigned)(Random() % 40);
+         if (t < 4) {
+            len = strlen(Texts[t]);
+            key = line % 3 ? 0x58 : 0x21;
+            for (i = 0; i < len; i++)
+               buf[i] = (uint8_t)Texts[t][i] ^ (uint8_t)key;
+         } else {
+            len = 30;
+            for (i = 0; i < len; i++)
+               buf[i] = (uint8_t)Random();
+         }
+      } else {
+         /* 8 blocks, the first repeated up to twice, now and then 3 times */
+         len = sizeof(buf);
+         for (i = 0; i < len; i++)
+            buf[i] = (uint8_t)Random();
+         repeats = (unsigned)(Random() % 32);
+         repeats = repeats ? repeats % 3 : 3;
+         for (t = 1; t <= repeats; t++)
+            memcpy(buf + t * AES_BLOCKSIZE, buf, AES_BLOCKSIZE);
+      }
+      WriteHex(fp, buf, len);
+      if (line + 1 < LINES)
+         fputc('\n', fp);
+   }
+   return fclose(fp) == 0 ? 0 : -1;
+}
+
+static uint32_t XorSearch(BitStream *record, uint64_t line,
+	BitStreamTopK *topk, void *ctx) {
+   (void)ctx;
+   return BitStreamSingleByteXorSearch(record, line, topk);
+}
+
+static uint32_t EcbSearch(BitStream *record, uint64_t line,
+	BitStreamTopK *topk, void *ctx) {
+   uint64_t dups = BitStreamCountDuplicateBlocks(record, AES_BLOCKSIZE);
+
+   (void)ctx;
+   return dups ? BitStreamTopKOffer(topk, (float)dups, AES_BLOCKSIZE, line) : 0;
+}
+
+/**
+ * @fn int Compare(const char *path, BitStreamCorpus *corpus, int ecb,
+ * 	unsigned nthreads)
+ *
+ * @brief runs one search both ways and compares the results
+ *
+ * @returns 0 if they agree, 1 otherwise
+ */
+static int Compare(const char *path, BitStreamCorpus *corpus, int ecb,
+	unsigned nthreads) {
+   BitStreamCandidate want[CAPACITY], got[CAPACITY];
+   BitStream          *records[CAPACITY], *r;
+   BitStreamPipeline  *pipeline;
+   BitStreamTopK      *topk;
+   float              floor = ecb ? 1.0f : -5.0f;
+   uint32_t           n, m = 0, i;
+   int                failed = 0;
+
+   topk = BitStreamTopKCreate(CAPACITY, floor);
+   if (topk == NULL)
+      return 1;
+   if ((ecb ? BitStreamCorpusDetectEcb(corpus, AES_BLOCKSIZE, topk, nthreads) :
+	BitStreamCorpusSingleByteXor(corpus, topk, nthreads)) != 0)
+      failed = 1;
+   n = BitStreamTopKResults(topk, want);
+   BitStreamTopKDelete(topk);
+
+   pipeline = BitStreamPipelineCreate(ecb ? EcbSearch : XorSearch, NULL,
+		   CAPACITY, floor, nthreads);
+   if (pipeline == NULL ||
+       BitStreamPipelineRunHex(pipeline, path, NULL, NULL) != 0)
+      failed = 1;
+   else
+      m = BitStreamPipelineResults(pipeline, got, records);
+
+   /* the file has enough ties to fill the collector */
+   if (n != CAPACITY || m != n)
+      failed = 1;
+   for (i = 0; i < n && i < m && !failed; i++) {
+      r = corpus->records[want[i].line];
+      if (got[i].score != want[i].score || got[i].line != want[i].line ||
+          got[i].key != want[i].key || records[i] == NULL ||
+          records[i]->nbits != r->nbits ||
+          memcmp(records[i]->array, r->array, r->nbits / BITS_PER_BYTE) != 0)
+         failed = 1;
+   }
+
+   if (failed)
+      fprintf(stderr, "%s search on %u threads: the pipeline differs\n",
+		      ecb ? "ecb" : "xor", nthreads);
+   BitStreamPipelineDelete(pipeline);
+   return failed;
+}
+
+int main(void) {
+   static const unsigned Threads[] = { 1, 2, 4 };
+   BitStreamCorpus *corpus;
+   char             path[] = "testpipelineXXXXXX";
+   unsigned         t;
+   int              fd, failed = 0;
+
+   fd = mkstemp(path);
+   if (fd < 0)
+      return 1;
+   close(fd);
+
+   corpus = WriteFile(path) == 0 ? BitStreamCorpusLoadHex(path) : NULL;
+   if (corpus == NULL) {
+      unlink(path);
+      return 1;
+   }
+   if (corpus->count != LINES)
+      failed = 1;
+
+   for (t = 0; t < sizeof(Threads) / sizeof(Threads[0]); t++) {
+      failed += Compare(path, corpus, 0, Threads[t]);
+      failed += Compare(path, corpus, 1, Threads[t]);
+   }
+   BitStreamCorpusDelete(corpus);
+   unlink(path);
+
+   printf("pipeline: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
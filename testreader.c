@@ -0,0 +1,351 @@
+#include "BitStream.h"
+#include "BitStreamReader.h"
+
+/**
+ * Bit reader against the bit writer and a bit by bit reference
+ *
+ * A random mix of fixed width fields (1 to 64 bits), unary, Exp-Golomb and
+ * signed Exp-Golomb codes is written from several start offsets, into a
+ * stream the writer has to grow and into one large enough to hold it. The
+ * bits written must equal the codes laid out one bit at a time, with the
+ * bits around them left alone, and the reader must decode every code back
+ * (skipping some, peeking at others) and end exactly where the writer did.
+ * The same is done with fixed width fields in LSB first order. Values the
+ * writer cannot code and reads past the end must be reported.
+ */
+
+#define NCODES		3000
+
+typedef enum CodeKind { FIELD, UNARY, UE, SE } CodeKind;
+
+typedef struct Code {
+   CodeKind kind;
+   uint64_t v;
+   uint32_t width;     /**< bits of a field */
+   uint64_t len;       /**< bits of the code */
+} Code;
+
+static const uint64_t Offsets[] = { 0, 1, 7, 8, 61, 64, 100 };
+
+static Code           Codes[NCODES];
+
+static uint64_t       Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+static inline int Bit(const uint8_t *buf, uint64_t i, int lsb) {
+   return buf[i / BITS_PER_BYTE] >> (lsb ? i % BITS_PER_BYTE :
+		   BITS_PER_BYTE - 1 - i % BITS_PER_BYTE) & 1;
+}
+
+static inline void SetBit(uint8_t *buf, uint64_t i, int v, int lsb) {
+   uint8_t m = (uint8_t)(lsb ? 1 << i % BITS_PER_BYTE :
+		   0x80 >> i % BITS_PER_BYTE);
+
+   buf[i / BITS_PER_BYTE] = v ? buf[i / BITS_PER_BYTE] | m :
+	   buf[i / BITS_PER_BYTE] & ~m;
+}
+
+/**
+ * @fn uint64_t PutBits(uint8_t *buf, uint64_t pos, uint64_t v,
+ * 	uint32_t nbits, int lsb)
+ *
+ * @brief lays out the low nbits bits of v, most significant first (least
+ * 	significant first if lsb)
+ *
+ * @returns bit offset following them
+ */
+static uint64_t PutBits(uint8_t *buf, uint64_t pos, uint64_t v,
+	uint32_t nbits, int lsb) {
+   uint32_t b;
+
+   for (b = 0; b < nbits; b++)
+      SetBit(buf, pos + b, (int)(v >> (lsb ? b : nbits - 1 - b) & 1), lsb);
+   return pos + nbits;
+}
+
+/**
+ * @fn uint64_t Reference(uint8_t *buf, uint64_t pos, Code *c)
+ *
+ * @brief lays out one code bit by bit and records its length
+ */
+static uint64_t Reference(uint8_t *buf, uint64_t pos, Code *c) {
+   uint64_t start = pos, k, i;
+   uint32_t z;
+
+   switch (c->kind) {
+   case FIELD:
+      pos = PutBits(buf, pos, c->v, c->width, 0);
+      break;
+   case UNARY:
+      for (i = 0; i < c->v; i++)
+         SetBit(buf, pos++, 0, 0);
+      SetBit(buf, pos++, 1, 0);
+      break;
+   case UE:
+   case SE:
+      k = c->kind == UE ? c->v : (int64_t)c->v > 0 ? 2 * c->v - 1 :
+	  2 * -c->v;
+      /* z zeros, then k + 1 in z + 1 bits */
+      for (z = 0; (k + 1) >> z > 1; z++)
+         SetBit(buf, pos++, 0, 0);
+      pos = PutBits(buf, pos, k + 1, z + 1, 0);
+      break;
+   }
+   c->len = pos - start;
+   return pos;
+}
+
+/**
+ * @fn void MakeCodes(int fieldsOnly)
+ *
+ * @brief random codes of every kind, values spread over all lengths
+ */
+static void MakeCodes(int fieldsOnly) {
+   uint32_t i;
+
+   for (i = 0; i < NCODES; i++) {
+      Code *c = &Codes[i];
+
+      c->kind = fieldsOnly ? FIELD : (CodeKind)(Random() % 4);
+      c->width = (uint32_t)(Random() % 64 + 1);
+      c->v = Random() >> (Random() % 64);
+      if (c->kind == FIELD && c->width < 64)
+         c->v &= (1ULL << c->width) - 1;
+      if (c->kind == UNARY)
+         c->v %= Random() % 8 ? 40 : 300;
+      if (c->kind == UE && i % 97 == 0)
+         c->v = UINT64_MAX - 1 - i % 2;
+      if (c->kind == SE) {
+         c->v = Random() & 1 ? -c->v : c->v;
+         if (i % 89 == 0)
+            c->v = i % 2 ? (uint64_t)INT64_MAX : (uint64_t)(INT64_MIN + 1);
+      }
+   }
+}
+
+/**
+ * @fn int TestMsb(uint64_t offset, int grow)
+ *
+ * @brief writes and reads the codes in MSB first order from offset
+ *
+ * @returns 0 on success, 1 on mismatch
+ */
+static int TestMsb(uint64_t offset, int grow) {
+   static uint8_t  want[NCODES * 600 / BITS_PER_BYTE];
+   BitStreamWriter w;
+   BitStreamReader r;
+   BitStream       *bs;
+   uint64_t        end, size, v, i;
+   int             failed = 0;
+
+   for (i = 0; i < sizeof(want); i++)
+      want[i] = (uint8_t)Random();
+   for (end = offset, i = 0; i < NCODES; i++)
+      end = Reference(want, end, &Codes[i]);
+
+   /* a stream holding the start offset only, or with 13 bits to spare */
+   size = grow ? offset : end + 13;
+   bs = BitStreamCreate(size);
+   if (bs == NULL)
+      return 1;
+   if (size)
+      memcpy(bs->array, want, (size + 7) / BITS_PER_BYTE);
+   if (grow && offset % BITS_PER_BYTE)
+      bs->array[offset / BITS_PER_BYTE] = want[offset / BITS_PER_BYTE];
+
+   if (BitStreamWriterInit(&w, bs, offset) != 0)
+      return 1;
+   for (i = 0; i < NCODES; i++) {
+      switch (Codes[i].kind) {
+      case FIELD: BitStreamWriterPut(&w, Codes[i].v, Codes[i].width); break;
+      case UNARY: BitStreamWriterUnary(&w, (uint32_t)Codes[i].v); break;
+      case UE: BitStreamWriterExpGolomb(&w, Codes[i].v); break;
+      case SE: BitStreamWriterSignedExpGolomb(&w, (int64_t)Codes[i].v); break;
+      }
+   }
+   if (BitStreamWriterFinish(&w) != (int64_t)end || bs->nbits != (grow ?
+				   end : size))
+      failed = 1;
+   for (i = 0; i < (grow ? end : size) && !failed; i++)
+      if (Bit(bs->array, i, 0) != Bit(want, i, 0))
+         failed = 1;
+
+   if (!failed && BitStreamReaderInit(&r, bs, offset) == 0) {
+      for (i = 0; i < NCODES && !failed; i++) {
+         Code *c = &Codes[i];
+
+         if (i % 7 == 0) {
+            BitStreamReaderSkip(&r, c->len);
+            continue;
+         }
+         switch (c->kind) {
+         case FIELD:
+            if (c->width <= BITSTREAM_READER_MAX_PEEK && i % 2) {
+               v = BitStreamReaderPeek(&r, c->width);
+               BitStreamReaderConsume(&r, c->width);
+            } else {
+               v = BitStreamReaderGet(&r, c->width);
+            }
+            break;
+         case UNARY: v = BitStreamReaderUnary(&r); break;
+         case UE: v = BitStreamReaderExpGolomb(&r); break;
+         case SE: v = (uint64_t)BitStreamReaderSignedExpGolomb(&r); break;
+         }
+         if (v != c->v)
+            failed = 1;
+      }
+      if (BitStreamReaderTell(&r) != end || BitStreamReaderOverrun(&r))
+         failed = 1;
+   } else {
+      failed = 1;
+   }
+
+   if (failed)
+      fprintf(stderr, "msb codes from %llu%s: mismatch\n",
+		      (unsigned long long)offset, grow ? ", growing" : "");
+   BitStreamDelete(bs);
+   return failed;
+}
+
+/**
+ * @fn int TestLsb(uint64_t offset, int grow)
+ *
+ * @brief writes and reads the fields in LSB first order from offset
+ *
+ * @returns 0 on success, 1 on mismatch
+ */
+static int TestLsb(uint64_t offset, int grow) {
+   static uint8_t  want[NCODES * 64 / BITS_PER_BYTE + 64];
+   BitStreamWriter w;
+   BitStreamReader r;
+   BitStream       *bs;
+   uint64_t        end, size, v, i;
+   int             failed = 0;
+
+   for (i = 0; i < sizeof(want); i++)
+      want[i] = (uint8_t)Random();
+   for (end = offset, i = 0; i < NCODES; i++)
+      end = PutBits(want, end, Codes[i].v, Codes[i].width, 1);
+
+   size = grow ? offset : end + 13;
+   bs = BitStreamCreate(size);
+   if (bs == NULL)
+      return 1;
+   if (size)
+      memcpy(bs->array, want, (size + 7) / BITS_PER_BYTE);
+   if (grow && offset % BITS_PER_BYTE)
+      bs->array[offset / BITS_PER_BYTE] = want[offset / BITS_PER_BYTE];
+
+   if (BitStreamWriterInitLsb(&w, bs, offset) != 0)
+      return 1;
+   for (i = 0; i < NCODES; i++)
+      BitStreamWriterPutLsb(&w, Codes[i].v, Codes[i].width);
+   if (BitStreamWriterFinishLsb(&w) != (int64_t)end || bs->nbits != (grow ?
+				   end : size))
+      failed = 1;
+   for (i = 0; i < (grow ? end : size) && !failed; i++)
+      if (Bit(bs->array, i, 1) != Bit(want, i, 1))
+         failed = 1;
+
+   if (!failed && BitStreamReaderInit(&r, bs, offset) == 0) {
+      for (i = 0; i < NCODES && !failed; i++) {
+         uint32_t width = Codes[i].width;
+
+         if (i % 7 == 0) {
+            BitStreamReaderSkipLsb(&r, width);
+            continue;
+         }
+         if (width <= BITSTREAM_READER_MAX_PEEK && i % 2) {
+            v = BitStreamReaderPeekLsb(&r, width);
+            BitStreamReaderConsumeLsb(&r, width);
+         } else {
+            v = BitStreamReaderGetLsb(&r, width);
+         }
+         if (v != Codes[i].v)
+            failed = 1;
+      }
+      if (BitStreamReaderTell(&r) != end || BitStreamReaderOverrun(&r))
+         failed = 1;
+   } else {
+      failed = 1;
+   }
+
+   if (failed)
+      fprintf(stderr, "lsb fields from %llu%s: mismatch\n",
+		      (unsigned long long)offset, grow ? ", growing" : "");
+   BitStreamDelete(bs);
+   return failed;
+}
+
+/**
+ * @fn int TestErrors(void)
+ *
+ * @brief values without a code put the writer in error, reads past the end
+ * 	put the reader in overrun
+ */
+static int TestErrors(void) {
+   BitStreamWriter w;
+   BitStreamReader r;
+   BitStream       *bs;
+   int             failed = 0;
+
+   bs = BitStreamCreate(20);
+   if (bs == NULL)
+      return 1;
+
+   BitStreamWriterInit(&w, bs, 0);
+   BitStreamWriterExpGolomb(&w, UINT64_MAX);
+   if (BitStreamWriterFinish(&w) != -1)
+      failed = 1;
+   BitStreamWriterInit(&w, bs, 0);
+   BitStreamWriterSignedExpGolomb(&w, INT64_MIN);
+   if (BitStreamWriterFinish(&w) != -1)
+      failed = 1;
+   if (BitStreamWriterInit(&w, bs, 21) != -1 ||
+       BitStreamReaderInit(&r, bs, 21) != -1)
+      failed = 1;
+
+   /* 20 zeros: no unary code ends within them */
+   memset(bs->array, '\0', 3);
+   BitStreamReaderInit(&r, bs, 0);
+   if (BitStreamReaderUnary(&r) != 20)
+      failed = 1;
+   if (!BitStreamReaderOverrun(&r))
+      failed = 1;
+   BitStreamReaderInit(&r, bs, 3);
+   if (BitStreamReaderGet(&r, 17) != 0)
+      failed = 1;
+   if (BitStreamReaderOverrun(&r))
+      failed = 1;
+   BitStreamReaderGet(&r, 1);
+   if (!BitStreamReaderOverrun(&r))
+      failed = 1;
+
+   if (failed)
+      fprintf(stderr, "errors not reported\n");
+   BitStreamDelete(bs);
+   return failed;
+}
+
+int main(void) {
+   unsigned o;
+   int      grow, failed = 0;
+
+   for (o = 0; o < sizeof(Offsets) / sizeof(Offsets[0]); o++)
+      for (grow = 0; grow < 2; grow++) {
+         MakeCodes(0);
+         failed += TestMsb(Offsets[o], grow);
+         MakeCodes(1);
+         failed += TestLsb(Offsets[o], grow);
+      }
+   failed += TestErrors();
+
+   printf("reader: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
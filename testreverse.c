@@ -0,0 +1,139 @@
+#include "BitStream.h"
+#include "BitStreamReverse.h"
+
+/**
+ * Byte reversal through each implementation against a bit by bit reference
+ *
+ * Every implementation the cpu has (the SSSE3 and AVX2 ones are skipped
+ * when BitStreamReverseSelect() falls back) reverses buffers of 0 to 200
+ * bytes, so that the 16 and 32 byte vectors are followed by every tail,
+ * from misaligned pointers, into another buffer and in place. Converting
+ * a stream with a partial last byte to LSB first and back must give it
+ * back, with bit k of the LSB first stream bit k % 8 of its byte.
+ */
+
+#define MAX_SIZE	200
+
+static uint64_t Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+/**
+ * @fn uint8_t Reversed(uint8_t x)
+ *
+ * @brief x with its bits reversed, one at a time
+ */
+static uint8_t Reversed(uint8_t x) {
+   uint8_t r = 0;
+   int     b;
+
+   for (b = 0; b < BITS_PER_BYTE; b++)
+      if (x & 1 << b)
+         r |= (uint8_t)(0x80 >> b);
+   return r;
+}
+
+/**
+ * @fn int TestBytes(void)
+ *
+ * @brief reverses every size from every misalignment of a 32 byte vector
+ */
+static int TestBytes(void) {
+   uint8_t  in[MAX_SIZE + 32], out[MAX_SIZE + 32], want[MAX_SIZE + 32];
+   size_t   size, align, i;
+   int      failed = 0;
+
+   for (size = 0; size <= MAX_SIZE; size++)
+      for (align = 0; align < 32; align += size % 3 ? 7 : 1) {
+         for (i = 0; i < sizeof(in); i++) {
+            in[i] = (uint8_t)Random();
+            want[i] = Reversed(in[i]);
+         }
+         memset(out, 0xA5, sizeof(out));
+
+         /* into another buffer, nothing past size touched */
+         BitStreamReverseBitsBytes(in + align, out + (align ^ 5) % 32, size);
+         if (memcmp(out + (align ^ 5) % 32, want + align, size) != 0 ||
+             ((align ^ 5) % 32 + size < sizeof(out) &&
+              out[(align ^ 5) % 32 + size] != 0xA5))
+            failed = 1;
+
+         /* in place */
+         BitStreamReverseBitsBytes(in + align, in + align, size);
+         if (memcmp(in + align, want + align, size) != 0)
+            failed = 1;
+
+         if (failed) {
+            fprintf(stderr, "%zu bytes at %zu: mismatch\n", size, align);
+            return 1;
+         }
+      }
+   return 0;
+}
+
+/**
+ * @fn int TestStream(void)
+ *
+ * @brief converts streams to LSB first and back
+ */
+static int TestStream(void) {
+   BitStream *bs, *lsb, *back;
+   uint64_t   nbits, k;
+   int        failed = 0;
+
+   for (nbits = 1; nbits < 300 && !failed; nbits += 7) {
+      bs = BitStreamCreate(nbits);
+      if (bs == NULL)
+         return 1;
+      for (k = 0; k < (nbits + 7) / BITS_PER_BYTE; k++)
+         bs->array[k] = (uint8_t)Random();
+
+      lsb = BitStreamReverseBitOrder(bs);
+      back = lsb ? BitStreamReverseBitOrder(lsb) : NULL;
+      if (back == NULL || lsb->nbits != nbits || back->nbits != nbits ||
+          memcmp(back->array, bs->array, (nbits + 7) / BITS_PER_BYTE) != 0)
+         failed = 1;
+
+      for (k = 0; k < nbits && !failed; k++)
+         if ((bs->array[k / 8] >> (7 - k % 8) & 1) !=
+             (lsb->array[k / 8] >> (k % 8) & 1))
+            failed = 1;
+
+      if (failed)
+         fprintf(stderr, "%llu bit stream: mismatch\n",
+			 (unsigned long long)nbits);
+      BitStreamDelete(back);
+      BitStreamDelete(lsb);
+      BitStreamDelete(bs);
+   }
+   return failed;
+}
+
+int main(void) {
+   static const BitStreamReverseImpl Impls[] = {
+      BITSTREAM_REVERSE_SCALAR, BITSTREAM_REVERSE_SSSE3, BITSTREAM_REVERSE_AVX2
+   };
+   static const char *Names[] = { "scalar", "ssse3", "avx2" };
+   unsigned i;
+   int      failed = 0;
+
+   for (i = 0; i < sizeof(Impls) / sizeof(Impls[0]); i++) {
+      if (BitStreamReverseSelect(Impls[i]) != Impls[i]) {
+         printf("reverse: %s not available, skipped\n", Names[i]);
+         continue;
+      }
+      if (TestBytes() || TestStream()) {
+         fprintf(stderr, "reverse: %s implementation\n", Names[i]);
+         failed = 1;
+      }
+   }
+   BitStreamReverseSelect(BITSTREAM_REVERSE_AUTO);
+
+   printf("reverse: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
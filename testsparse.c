@@ -0,0 +1,216 @@
+#include "BitStream.h"
+#include "BitStreamSparse.h"
+
+/**
+ * Sparse streams against the dense streams they stand for
+ *
+ * Dense streams mostly of zeros or of ones, with literal bytes scattered
+ * over them at gaps around BITSTREAM_SPARSE_GAP, all random or all fill,
+ * some ending in a partial byte whose pad bits are set, are converted to
+ * sparse streams. Converting back must give the dense stream (pad bits
+ * cleared), and BitStreamSparseGetByte() at every offset and width,
+ * BitStreamSparsePopcount() and BitStreamSparseExclusiveOr() into every
+ * kind of destination must agree with the dense stream. Streams built with
+ * BitStreamSparseAppend() must hold what was appended.
+ */
+
+#define MAX_BYTES	3000
+
+static uint64_t Seed = 88172645463325252ull;
+
+static uint64_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return Seed;
+}
+
+/**
+ * @fn void ClearPad(BitStream *bs)
+ *
+ * @brief clears the bits of the last byte past the end
+ */
+static void ClearPad(BitStream *bs) {
+   if (bs->nbits % BITS_PER_BYTE)
+      bs->array[bs->nbits / BITS_PER_BYTE] &= (uint8_t)(0xFF <<
+		      (BITS_PER_BYTE - bs->nbits % BITS_PER_BYTE));
+}
+
+/**
+ * @fn BitStream* Dense(uint64_t nbits, uint8_t fill, unsigned gapMax)
+ *
+ * @brief fill bytes with bursts of random bytes at random gaps below
+ * 	gapMax, all random if gapMax is 0, the pad bits set
+ */
+static BitStream* Dense(uint64_t nbits, uint8_t fill, unsigned gapMax) {
+   BitStream *bs = BitStreamCreate(nbits);
+   uint64_t   bytes = (nbits + 7) / BITS_PER_BYTE, i, n;
+
+   if (bs == NULL || bytes == 0)
+      return bs;
+   memset(bs->array, fill, bytes);
+   for (i = gapMax ? Random() % gapMax : 0; i < bytes;
+        i += gapMax ? Random() % gapMax + 1 : 1)
+      for (n = gapMax ? Random() % 5 + 1 : 1; n && i < bytes; n--, i++)
+         bs->array[i] = (uint8_t)Random();
+   if (nbits % BITS_PER_BYTE)
+      bs->array[bytes - 1] |= (uint8_t)(0xFF >> nbits % BITS_PER_BYTE);
+   return bs;
+}
+
+/**
+ * @fn int TestStream(BitStream *bs)
+ *
+ * @brief converts bs and checks every query against it
+ *
+ * @returns 0 on success, 1 on mismatch
+ */
+static int TestStream(BitStream *bs) {
+   BitStreamSparse *sp;
+   BitStream       *back, *bx, *other, *want, *r;
+   uint64_t         count = 0, i, bytes = (bs->nbits + 7) / BITS_PER_BYTE;
+   uint16_t         w, n, m;
+   uint8_t          a, b;
+   unsigned         d;
+   int              failed = 0;
+
+   sp = BitStreamSparseFromDense(bs);
+   if (sp == NULL)
+      return 1;
+   ClearPad(bs);
+
+   back = BitStreamSparseToDense(sp);
+   if (back == NULL || back->nbits != bs->nbits ||
+       (bytes && memcmp(back->array, bs->array, bytes) != 0))
+      failed = 1;
+   BitStreamDelete(back);
+
+   for (i = 0; i < bytes; i++)
+      count += __builtin_popcount(bs->array[i]);
+   if (BitStreamSparsePopcount(sp) != count)
+      failed = 1;
+
+   for (i = 0; i <= bs->nbits && !failed; i += i < 200 ? 1 : 13)
+      for (w = 1; w <= BITS_PER_BYTE; w++) {
+         a = b = 0;
+         n = BitStreamGetByte(bs, &a, i, w);
+         m = BitStreamSparseGetByte(sp, &b, i, w);
+         if (n != m || a != b)
+            failed = 1;
+      }
+
+   /* XOR into a new stream, in place and into a stream of its own */
+   for (d = 0; d < 3 && !failed; d++) {
+      bx = Dense(bs->nbits - bs->nbits / 7, 0x00, 0);
+      other = Dense(17, 0xFF, 0);
+      want = bx ? BitStreamCreate(bx->nbits) : NULL;
+      if (want == NULL || other == NULL)
+         return 1;
+      ClearPad(bx);
+      for (i = 0; i < (bx->nbits + 7) / BITS_PER_BYTE; i++)
+         want->array[i] = bx->array[i] ^ bs->array[i];
+      ClearPad(want);
+
+      r = BitStreamSparseExclusiveOr(d == 0 ? NULL : d == 1 ? bx : other, bx,
+		      sp);
+      if (r == NULL || r->nbits != want->nbits || (want->nbits &&
+          memcmp(r->array, want->array, (want->nbits + 7) / 8) != 0))
+         failed = 1;
+      if (d == 0)
+         BitStreamDelete(r);
+      BitStreamDelete(want);
+      BitStreamDelete(other);
+      BitStreamDelete(bx);
+   }
+
+   /* a longer dense operand is refused */
+   bx = BitStreamCreate(bs->nbits + 1);
+   if (BitStreamSparseExclusiveOr(NULL, bx, sp) != NULL)
+      failed = 1;
+   BitStreamDelete(bx);
+
+   if (failed)
+      fprintf(stderr, "%llu bits, fill %#x, %llu runs: mismatch\n",
+		      (unsigned long long)bs->nbits, sp->fill,
+		      (unsigned long long)sp->nruns);
+   BitStreamSparseDelete(sp);
+   return failed;
+}
+
+/**
+ * @fn int TestAppend(uint64_t nbits, uint8_t fill)
+ *
+ * @brief builds a sparse stream from runs at random gaps
+ */
+static int TestAppend(uint64_t nbits, uint8_t fill) {
+   BitStreamSparse *sp;
+   BitStream       *got;
+   uint8_t          want[MAX_BYTES + 1], data[40];
+   uint64_t         bytes = (nbits + 7) / BITS_PER_BYTE;
+   uint64_t         offset, end = 0, n, i;
+   int              failed = 0;
+
+   sp = BitStreamSparseCreate(nbits, fill);
+   if (sp == NULL)
+      return 1;
+   memset(want, fill, sizeof(want));
+
+   for (;;) {
+      offset = end + Random() % (2 * BITSTREAM_SPARSE_GAP);
+      n = Random() % sizeof(data) + 1;
+      if (offset + n > bytes)
+         break;
+      for (i = 0; i < n; i++)
+         data[i] = want[offset + i] = (uint8_t)Random();
+      if (BitStreamSparseAppend(sp, offset, data, n) != 0)
+         failed = 1;
+      end = offset + n;
+   }
+
+   /* out of order, and past the end */
+   if (end && BitStreamSparseAppend(sp, end - 1, data, 1) != -1)
+      failed = 1;
+   if (BitStreamSparseAppend(sp, bytes, data, 1) != -1)
+      failed = 1;
+
+   got = BitStreamSparseToDense(sp);
+   if (bytes && nbits % BITS_PER_BYTE)
+      want[bytes - 1] &= (uint8_t)(0xFF << (BITS_PER_BYTE -
+			      nbits % BITS_PER_BYTE));
+   if (got == NULL || got->nbits != nbits ||
+       (bytes && memcmp(got->array, want, bytes) != 0))
+      failed = 1;
+
+   if (failed)
+      fprintf(stderr, "append to %llu bits, fill %#x: mismatch\n",
+		      (unsigned long long)nbits, fill);
+   BitStreamDelete(got);
+   BitStreamSparseDelete(sp);
+   return failed;
+}
+
+int main(void) {
+   static const uint64_t Lengths[] = {
+      0, 1, 7, 8, 9, 64, 127, 1000, 8 * MAX_BYTES - 3, 8 * MAX_BYTES
+   };
+   static const unsigned Gaps[] = {
+      0, 1, BITSTREAM_SPARSE_GAP - 1, BITSTREAM_SPARSE_GAP,
+      BITSTREAM_SPARSE_GAP + 1, 3 * BITSTREAM_SPARSE_GAP, 1000, 100000
+   };
+   BitStream *bs;
+   unsigned   l, g, f;
+   int        failed = 0;
+
+   for (l = 0; l < sizeof(Lengths) / sizeof(Lengths[0]); l++)
+      for (f = 0; f < 2; f++) {
+         for (g = 0; g < sizeof(Gaps) / sizeof(Gaps[0]); g++) {
+            bs = Dense(Lengths[l], f ? 0xFF : 0x00, Gaps[g]);
+            failed += bs ? TestStream(bs) : 1;
+            BitStreamDelete(bs);
+         }
+         failed += TestAppend(Lengths[l], f ? 0xFF : 0x00);
+      }
+
+   printf("sparse: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
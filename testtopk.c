@@ -0,0 +1,131 @@
+#include "BitStream.h"
+#include "BitStreamTopK.h"
+
+/**
+ * Order independence of the top-K collector
+ *
+ * Candidates with many tied scores are offered in shuffled orders, straight
+ * into one collector and spread over several collectors that are merged
+ * afterwards. The candidates kept must always be the first K of the whole
+ * set under score descending, line and key ascending.
+ */
+
+#define CANDIDATES	500
+#define CAPACITY	7
+#define SHUFFLES	200
+#define COLLECTORS	4
+
+static BitStreamCandidate All[CANDIDATES];
+
+static uint64_t           Seed = 88172645463325252ull;
+
+/**
+ * @fn uint32_t Random(void)
+ *
+ * @brief xorshift64, reproducible from run to run
+ */
+static uint32_t Random(void) {
+   Seed ^= Seed << 13;
+   Seed ^= Seed >> 7;
+   Seed ^= Seed << 17;
+   return (uint32_t)(Seed >> 32);
+}
+
+/**
+ * @fn int Better(const void *a, const void *b)
+ *
+ * @brief reference order, best first
+ */
+static int Better(const void *a, const void *b) {
+   const BitStreamCandidate *x = (const BitStreamCandidate *)a;
+   const BitStreamCandidate *y = (const BitStreamCandidate *)b;
+
+   if (x->score != y->score)
+      return x->score > y->score ? -1 : 1;
+   if (x->line != y->line)
+      return x->line < y->line ? -1 : 1;
+   return x->key < y->key ? -1 : (x->key > y->key);
+}
+
+/**
+ * @fn int Same(const BitStreamCandidate *got, uint32_t n,
+ * 	const BitStreamCandidate *want)
+ *
+ * @brief compares results against the first CAPACITY of the reference
+ */
+static int Same(const BitStreamCandidate *got, uint32_t n,
+	const BitStreamCandidate *want) {
+   uint32_t i;
+
+   if (n != CAPACITY)
+      return 0;
+   for (i = 0; i < n; i++) {
+      if (got[i].score != want[i].score || got[i].line != want[i].line ||
+	  got[i].key != want[i].key)
+         return 0;
+   }
+   return 1;
+}
+
+int main(void) {
+   BitStreamCandidate want[CANDIDATES], got[CAPACITY], order[CANDIDATES];
+   BitStreamTopK      *topk, *local[COLLECTORS];
+   uint32_t           i, j, s, n;
+   int                failed = 0;
+
+   /* 4 distinct scores over 500 candidates, each line with 2 keys */
+   for (i = 0; i < CANDIDATES; i++) {
+      All[i].score = (float)(Random() % 4);
+      All[i].line = i / 2;
+      All[i].key = Random() % 128 * 2 + i % 2;
+   }
+   memcpy(want, All, sizeof(All));
+   qsort(want, CANDIDATES, sizeof(BitStreamCandidate), Better);
+
+   topk = BitStreamTopKCreate(CAPACITY, 0.0f);
+   for (i = 0; i < COLLECTORS; i++)
+      local[i] = BitStreamTopKCreate(CAPACITY, 0.0f);
+
+   for (s = 0; s < SHUFFLES; s++) {
+      memcpy(order, All, sizeof(All));
+      for (i = CANDIDATES - 1; i > 0; i--) {
+         BitStreamCandidate c = order[i];
+
+         j = Random() % (i + 1);
+         order[i] = order[j];
+         order[j] = c;
+      }
+
+      /* a single collector */
+      BitStreamTopKReset(topk);
+      for (i = 0; i < CANDIDATES; i++)
+         BitStreamTopKOffer(topk, order[i].score, order[i].key, order[i].line);
+      n = BitStreamTopKResults(topk, got);
+      if (!Same(got, n, want)) {
+         fprintf(stderr, "shuffle %u: single collector differs\n", s);
+         failed++;
+      }
+
+      /* per thread collectors merged in a shuffle dependent order */
+      BitStreamTopKReset(topk);
+      for (i = 0; i < COLLECTORS; i++)
+         BitStreamTopKReset(local[i]);
+      for (i = 0; i < CANDIDATES; i++)
+         BitStreamTopKOffer(local[Random() % COLLECTORS], order[i].score,
+			 order[i].key, order[i].line);
+      for (i = 0, j = s % COLLECTORS; i < COLLECTORS; i++)
+         BitStreamTopKMerge(topk, local[(i + j) % COLLECTORS]);
+      n = BitStreamTopKResults(topk, got);
+      if (!Same(got, n, want)) {
+         fprintf(stderr, "shuffle %u: merged collectors differ\n", s);
+         failed++;
+      }
+   }
+
+   for (i = 0; i < COLLECTORS; i++)
+      BitStreamTopKDelete(local[i]);
+   BitStreamTopKDelete(topk);
+
+   printf("topk: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
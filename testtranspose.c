@@ -0,0 +1,86 @@
+#include "BitStream.h"
+#include "BitStreamTranspose.h"
+
+/**
+ * Transposition against a bitwise reference
+ *
+ * For every k from 1 to 40 (the specialized kernels) and a few above, and
+ * lengths that are not multiples of k nor of the 16 row groups, column j of
+ * BitStreamTranspose() must hold bytes j, j + k, ... as BitStreamGetByte()
+ * reads them, BitStreamUntranspose() must put them back and the round trip
+ * must give the input. The streams carry a trailing partial byte, which is
+ * ignored.
+ */
+
+#define MAX_SIZE	70001
+
+static const uint64_t Sizes[] = {
+   1, 2, 15, 16, 17, 39, 40, 41, 255, 1000, 4099, 65536 + 37, MAX_SIZE
+};
+
+static const uint32_t ExtraK[] = { 41, 64, 97 };
+
+static uint8_t        Want[MAX_SIZE];
+
+/**
+ * @fn int TestOne(BitStream *bs, uint64_t size, uint32_t k)
+ *
+ * @brief checks one stream of size whole bytes with k columns
+ *
+ * @returns 0 on success, 1 on mismatch
+ */
+static int TestOne(BitStream *bs, uint64_t size, uint32_t k) {
+   BitStream *t, *u;
+   uint64_t   o = 0, r;
+   uint32_t   c;
+   int        failed = 0;
+
+   /* reference gather, one byte at a time at its bit offset */
+   for (c = 0; c < k; c++) {
+      if (BitStreamColumnOffset(size, k, c) != o)
+         failed = 1;
+      for (r = c; r < size; r += k)
+         BitStreamGetByte(bs, &Want[o++], r * BITS_PER_BYTE, BITS_PER_BYTE);
+   }
+
+   t = BitStreamTranspose(bs, k);
+   u = t ? BitStreamUntranspose(t, k) : NULL;
+
+   if (failed || t == NULL || u == NULL || t->nbits != size * BITS_PER_BYTE ||
+       memcmp(t->array, Want, size) != 0 ||
+       memcmp(u->array, bs->array, size) != 0) {
+      fprintf(stderr, "size %llu k %u: mismatch\n", (unsigned long long)size,
+		      k);
+      failed = 1;
+   }
+   BitStreamDelete(u);
+   BitStreamDelete(t);
+
+   return failed;
+}
+
+int main(void) {
+   BitStream *bs;
+   uint64_t   i;
+   uint32_t   s, k;
+   int        failed = 0;
+
+   bs = BitStreamCreate(MAX_SIZE * BITS_PER_BYTE + 3);
+   if (bs == NULL)
+      return 1;
+   for (i = 0; i < MAX_SIZE + 1; i++)
+      bs->array[i] = (uint8_t)(i * 7 + (i >> 8));
+
+   for (s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); s++) {
+      bs->nbits = Sizes[s] * BITS_PER_BYTE + 3;
+
+      for (k = 1; k <= 40; k++)
+         failed += TestOne(bs, Sizes[s], k);
+      for (k = 0; k < sizeof(ExtraK) / sizeof(ExtraK[0]); k++)
+         failed += TestOne(bs, Sizes[s], ExtraK[k]);
+   }
+   BitStreamDelete(bs);
+
+   printf("transpose: %s\n", failed ? "FAILED" : "ok");
+   return failed ? 1 : 0;
+}
@@ -20,7 +20,7 @@
  *   746865206b696420646f6e277420706c6179
  */   
 int main() {
-   BitStream  *bx, *by, *bz;
+   BitStream  *bx, *by, *bz = NULL;
 
    bx = BitStreamCreateHex("1c0111001f010100061a024b53535009181c");
 